@@ -0,0 +1,470 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "rapidjson/writer.h"
+#include "rdf-tdaa/dictionary/dictionary.hpp"
+#include "rdf-tdaa/index/characteristic_set.hpp"
+#include "rdf-tdaa/index/cs_daa_map.hpp"
+#include "rdf-tdaa/index/daas.hpp"
+#include "rdf-tdaa/index/index_builder.hpp"
+#include "rdf-tdaa/index/predicate_index.hpp"
+#include "rdf-tdaa/query/query_executor.hpp"
+#include "rdf-tdaa/utils/bit_operations.hpp"
+
+namespace fs = std::filesystem;
+
+// Microbenchmarks of the primitives on the hot paths of the queries: the DAAs and their bit sequences, the
+// maps of the entities, the sets of the predicate index and of the characteristic sets, the dictionary and
+// the leapfrog join. The inputs are sampled with a fixed seed from a database, by default one generated
+// from a synthetic dataset, so two runs with the same arguments measure the same operations.
+
+struct Options {
+    std::string db_path;
+    // whether the database is generated from a synthetic dataset of that many triples
+    bool generated = false;
+    ulong triples = 200000;
+    uint seed = 42;
+    uint repetitions = 5;
+    ulong samples = 100000;
+    // runs the benchmarks whose name contains it
+    std::string filter;
+    std::string output;
+};
+
+struct Result {
+    std::string name;
+    std::string params;
+    ulong operations;
+    // nanoseconds per operation of the repetitions, the median is reported with the extremes
+    std::vector<double> ns_per_op;
+    // the sum of the results of the operations, it keeps them from being optimized away and differs
+    // between two runs only when the index does
+    ulong checksum;
+};
+
+class Bench {
+    Options options_;
+    std::vector<Result> results_;
+
+   public:
+    Bench(const Options& options) : options_(options) {}
+
+    bool Enabled(const std::string& name) {
+        return options_.filter.empty() || name.find(options_.filter) != std::string::npos;
+    }
+
+    /**
+     * @brief Runs an operation once to warm up, then once per repetition, and records its time.
+     * @param run Performs the operations of one repetition and returns the sum of their results.
+     * @param setup Called before every run, outside of the time, may be null.
+     */
+    void Measure(const std::string& name,
+                 const std::string& params,
+                 ulong operations,
+                 const std::function<ulong()>& run,
+                 const std::function<void()>& setup = nullptr) {
+        if (!Enabled(name) || operations == 0)
+            return;
+        Result result = {name, params, operations, {}, 0};
+        for (uint repetition = 0; repetition <= options_.repetitions; repetition++) {
+            if (setup)
+                setup();
+            auto start = std::chrono::steady_clock::now();
+            ulong checksum = run();
+            std::chrono::duration<double, std::nano> time = std::chrono::steady_clock::now() - start;
+            // the first run warms the caches and the lazily decoded sets up
+            if (repetition == 0)
+                continue;
+            result.ns_per_op.push_back(time.count() / operations);
+            result.checksum = checksum;
+        }
+        std::cerr << name << " " << params << ": " << Median(result.ns_per_op) << " ns/op" << std::endl;
+        results_.push_back(std::move(result));
+    }
+
+    static double Median(std::vector<double> values) {
+        std::sort(values.begin(), values.end());
+        return values[values.size() / 2];
+    }
+
+    std::string Report() {
+        rapidjson::StringBuffer buffer;
+        rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+        writer.StartObject();
+        writer.Key("database");
+        writer.String(options_.db_path.c_str());
+        if (options_.generated) {
+            writer.Key("triples");
+            writer.Uint64(options_.triples);
+        }
+        writer.Key("seed");
+        writer.Uint(options_.seed);
+        writer.Key("repetitions");
+        writer.Uint(options_.repetitions);
+        writer.Key("benchmarks");
+        writer.StartArray();
+        for (const auto& result : results_) {
+            writer.StartObject();
+            writer.Key("name");
+            writer.String(result.name.c_str());
+            writer.Key("params");
+            writer.String(result.params.c_str());
+            writer.Key("operations");
+            writer.Uint64(result.operations);
+            writer.Key("ns_per_op");
+            writer.Double(Median(result.ns_per_op));
+            writer.Key("min_ns_per_op");
+            writer.Double(*std::min_element(result.ns_per_op.begin(), result.ns_per_op.end()));
+            writer.Key("max_ns_per_op");
+            writer.Double(*std::max_element(result.ns_per_op.begin(), result.ns_per_op.end()));
+            writer.Key("checksum");
+            writer.Uint64(result.checksum);
+            writer.EndObject();
+        }
+        writer.EndArray();
+        writer.EndObject();
+        return buffer.GetString();
+    }
+};
+
+// writes a dataset of skewed triples: a few predicates are on most subjects, a few objects are shared by
+// many subjects, and some objects are literals or subjects themselves
+void GenerateDataset(const std::string& file_path, ulong triples, uint seed) {
+    std::mt19937 random(seed);
+    ulong subjects = std::max(triples / 8, 1ul);
+    uint predicates = 32;
+    ulong objects = std::max(triples / 4, 1ul);
+    // the ranks of the predicates and objects drawn with a power law
+    auto skewed = [&](ulong n) {
+        double u = std::uniform_real_distribution<double>(0, 1)(random);
+        return ulong(std::pow(u, 3) * n);
+    };
+
+    std::ofstream out(file_path, std::ofstream::out);
+    for (ulong i = 0; i < triples; i++) {
+        ulong s = random() % subjects;
+        ulong p = skewed(predicates);
+        out << "<http://bench.org/s" << s << "> <http://bench.org/p" << p << "> ";
+        switch (random() % 8) {
+            case 0:
+                out << "\"" << skewed(objects) << "\"^^<http://www.w3.org/2001/XMLSchema#integer>";
+                break;
+            case 1:
+                out << "<http://bench.org/s" << random() % subjects << ">";
+                break;
+            default:
+                out << "<http://bench.org/o" << skewed(objects) << ">";
+        }
+        out << " .\n";
+    }
+}
+
+// sorted distinct values drawn from [0, range)
+std::vector<uint> SortedList(std::mt19937& random, ulong size, ulong range) {
+    std::vector<uint> list(size);
+    for (auto& value : list)
+        value = random() % range;
+    std::sort(list.begin(), list.end());
+    list.erase(std::unique(list.begin(), list.end()), list.end());
+    return list;
+}
+
+void IndexBenchmarks(Bench& bench, const Options& options) {
+    std::string dictionary_path = options.db_path + "/dictionary/";
+    std::string index_path = options.db_path + "/index/";
+    std::string spo_path = index_path + "spo/";
+
+    Dictionary dict(dictionary_path);
+    ulong max_subject_id = dict.shared_cnt() + dict.subject_cnt();
+    ulong max_id = dict.max_id();
+
+    MMap<uint> metadata = MMap<uint>(index_path + "metadata");
+    CsDaaMap cs_daa_map(index_path + "cs_daa_map", {metadata[1], metadata[2]}, {metadata[3], metadata[4]},
+                        metadata[5], metadata[6], dict.shared_cnt(), dict.subject_cnt(), dict.object_cnt(),
+                        metadata[0]);
+    DAAs spo(spo_path, metadata[7]);
+    spo.Load();
+    metadata.CloseMap();
+    PredicateIndex predicate_index(index_path, dict.predicate_cnt());
+    CharacteristicSet subject_sets(index_path + "s_c_sets");
+    subject_sets.Load();
+    MMap<char> level_end(spo_path + "daa_level_end");
+    MMap<char> array_end(spo_path + "daa_array_end");
+
+    std::mt19937 random(options.seed);
+    std::vector<uint> subjects(options.samples);
+    for (auto& subject : subjects)
+        subject = random() % max_subject_id + 1;
+    // the objects with an OPS entry, shared entities and objects that are not subjects
+    std::vector<uint> objects;
+    for (ulong i = 0; i < options.samples; i++) {
+        uint object = random() % (dict.shared_cnt() + dict.object_cnt()) + 1;
+        objects.push_back(object <= dict.shared_cnt() ? object : object - dict.shared_cnt() + max_subject_id);
+    }
+
+    bench.Measure("CsDaaMap::ChararisticSetIdOf", "spo", subjects.size(), [&]() {
+        ulong sum = 0;
+        for (uint subject : subjects)
+            sum += cs_daa_map.ChararisticSetIdOf(subject, CsDaaMap::kSPO);
+        return sum;
+    });
+    bench.Measure("CsDaaMap::ChararisticSetIdOf", "ops", objects.size(), [&]() {
+        ulong sum = 0;
+        for (uint object : objects)
+            sum += cs_daa_map.ChararisticSetIdOf(object, CsDaaMap::kOPS);
+        return sum;
+    });
+    bench.Measure("CsDaaMap::DAAOffsetSizeOf", "spo", subjects.size(), [&]() {
+        ulong sum = 0;
+        for (uint subject : subjects) {
+            auto [offset, size] = cs_daa_map.DAAOffsetSizeOf(subject, CsDaaMap::kSPO);
+            sum += offset + size;
+        }
+        return sum;
+    });
+
+    // the DAA of each sampled subject, with one of its predicates
+    struct Access {
+        uint offset;
+        uint size;
+        std::span<uint>* offset2id;
+        uint index;
+        std::vector<std::span<uint>> all_offset2id;
+    };
+    std::vector<Access> accesses;
+    for (uint subject : subjects) {
+        auto& char_set = subject_sets[cs_daa_map.ChararisticSetIdOf(subject, CsDaaMap::kSPO)];
+        if (char_set.empty())
+            continue;
+        auto [offset, size] = cs_daa_map.DAAOffsetSizeOf(subject, CsDaaMap::kSPO);
+        uint index = random() % char_set.size();
+        Access access = {offset, size, &predicate_index.GetOSet(char_set[index]), index, {}};
+        for (uint pid : char_set)
+            access.all_offset2id.push_back(predicate_index.GetOSet(pid));
+        accesses.push_back(std::move(access));
+    }
+
+    // the results of the accesses are allocated as in the queries, they are not freed here either
+    bench.Measure("DAAs::AccessDAA", "spo", accesses.size(), [&]() {
+        ulong sum = 0;
+        for (auto& access : accesses)
+            sum += spo.AccessDAA(access.offset, access.size, *access.offset2id, access.index).size();
+        return sum;
+    });
+    bench.Measure("DAAs::AccessDAAAllArrays", "spo", accesses.size(), [&]() {
+        ulong sum = 0;
+        for (auto& access : accesses)
+            sum += spo.AccessDAAAllArrays(access.offset, access.size, access.all_offset2id).size();
+        return sum;
+    });
+    bench.Measure("bitop::range_rank", "daa_array_end", accesses.size(), [&]() {
+        ulong sum = 0;
+        for (auto& access : accesses) {
+            if (access.size != 0)
+                sum += bitop::range_rank(array_end, access.offset, access.offset + access.size - 1);
+        }
+        return sum;
+    });
+    ulong ones = 0;
+    for (auto& access : accesses) {
+        bitop::One one(level_end, access.offset, access.offset + access.size);
+        while (one.Next() != access.offset + access.size)
+            ones++;
+    }
+    bench.Measure("bitop::One::Next", "daa_level_end", ones, [&]() {
+        ulong sum = 0;
+        for (auto& access : accesses) {
+            bitop::One one(level_end, access.offset, access.offset + access.size);
+            for (uint next = one.Next(); next != access.offset + access.size; next = one.Next())
+                sum += next;
+        }
+        return sum;
+    });
+
+    // a fresh index decodes every set on its first access
+    std::shared_ptr<PredicateIndex> cold_predicate_index;
+    bench.Measure(
+        "PredicateIndex::GetSSet", "decode", dict.predicate_cnt(),
+        [&]() {
+            ulong sum = 0;
+            for (uint pid = 1; pid <= dict.predicate_cnt(); pid++)
+                sum += cold_predicate_index->GetSSet(pid).size();
+            return sum;
+        },
+        [&]() { cold_predicate_index = std::make_shared<PredicateIndex>(index_path, dict.predicate_cnt()); });
+    std::vector<uint> pids(options.samples);
+    for (auto& pid : pids)
+        pid = random() % dict.predicate_cnt() + 1;
+    bench.Measure("PredicateIndex::GetSSet", "decoded", pids.size(), [&]() {
+        ulong sum = 0;
+        for (uint pid : pids)
+            sum += predicate_index.GetSSet(pid).size();
+        return sum;
+    });
+
+    uint set_cnt = MMap<uint>(index_path + "s_c_sets")[0];
+    std::shared_ptr<CharacteristicSet> cold_sets;
+    bench.Measure(
+        "CharacteristicSet::operator[]", "decode", set_cnt,
+        [&]() {
+            ulong sum = 0;
+            for (uint set_id = 1; set_id <= set_cnt; set_id++)
+                sum += (*cold_sets)[set_id].size();
+            return sum;
+        },
+        [&]() {
+            cold_sets = std::make_shared<CharacteristicSet>(index_path + "s_c_sets");
+            cold_sets->Load();
+        });
+    std::vector<uint> set_ids(options.samples);
+    for (auto& set_id : set_ids)
+        set_id = random() % set_cnt + 1;
+    bench.Measure("CharacteristicSet::operator[]", "decoded", set_ids.size(), [&]() {
+        ulong sum = 0;
+        for (uint set_id : set_ids)
+            sum += subject_sets[set_id].size();
+        return sum;
+    });
+
+    // the terms of the sampled entities, by the position of their dictionary
+    std::vector<uint> ids(options.samples);
+    for (auto& id : ids)
+        id = random() % max_id + 1;
+    auto position = [&](uint id) {
+        return id <= max_subject_id ? SPARQLParser::Term::Positon::kSubject : SPARQLParser::Term::Positon::kObject;
+    };
+    bench.Measure("Dictionary::ID2String", "entity", ids.size(), [&]() {
+        ulong sum = 0;
+        for (uint id : ids) {
+            const char* term = dict.ID2String(id, position(id));
+            sum += term[0];
+            delete[] term;
+        }
+        return sum;
+    });
+    std::vector<std::string> terms;
+    for (uint id : ids) {
+        const char* term = dict.ID2String(id, position(id));
+        terms.push_back(term);
+        delete[] term;
+    }
+    bench.Measure("Dictionary::String2ID", "entity", terms.size(), [&]() {
+        ulong sum = 0;
+        for (uint i = 0; i < terms.size(); i++)
+            sum += dict.String2ID(terms[i], position(ids[i]));
+        return sum;
+    });
+}
+
+void JoinBenchmarks(Bench& bench, const Options& options) {
+    std::mt19937 random(options.seed);
+    const ulong small = 1000;
+    const ulong joins = 200;
+    // the larger lists hold the smaller one in a few places, so the join seeks far more than it scans
+    for (ulong ratio : {1, 10, 100, 1000}) {
+        for (uint list_cnt : {2, 3}) {
+            ulong range = small * ratio * 4;
+            std::vector<std::vector<uint>> lists = {SortedList(random, small, range)};
+            for (uint i = 1; i < list_cnt; i++)
+                lists.push_back(SortedList(random, small * ratio, range));
+            std::vector<std::span<uint>> spans(lists.begin(), lists.end());
+
+            std::string params = "lists=" + std::to_string(list_cnt) + " sizes=" + std::to_string(small) + ":" +
+                                 std::to_string(small * ratio);
+            bench.Measure("QueryExecutor::LeapfrogJoin", params, joins, [&]() {
+                ulong sum = 0;
+                for (ulong i = 0; i < joins; i++)
+                    sum += QueryExecutor::LeapfrogJoin(spans).size();
+                return sum;
+            });
+        }
+    }
+}
+
+void Usage() {
+    std::cout << "Usage: rdftdaa_bench [OPTIONS]\n\n"
+              << "Options:\n"
+              << "  -d, --database <PATH>      Benchmark a database instead of a generated one.\n"
+              << "  --triples <N>              The triples of the generated database, default 200000.\n"
+              << "  --seed <N>                 The seed of the dataset and of the samples, default 42.\n"
+              << "  --repetitions <N>          The timed runs of each benchmark, default 5.\n"
+              << "  --samples <N>              The inputs sampled for each benchmark, default 100000.\n"
+              << "  --filter <TEXT>            Runs the benchmarks whose name contains the text.\n"
+              << "  -o, --output <FILE>        Writes the JSON report to a file instead of stdout.\n";
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help") {
+            Usage();
+            return 0;
+        }
+        if (i + 1 >= argc) {
+            std::cerr << "Missing the value of " << arg << std::endl;
+            return 1;
+        }
+        std::string value = argv[++i];
+        if (arg == "-d" || arg == "--database")
+            options.db_path = value.find("/") == std::string::npos ? "./DB_DATA_ARCHIVE/" + value : value;
+        else if (arg == "--triples")
+            options.triples = std::stoul(value);
+        else if (arg == "--seed")
+            options.seed = std::stoul(value);
+        else if (arg == "--repetitions")
+            options.repetitions = std::max(std::stoul(value), 1ul);
+        else if (arg == "--samples")
+            options.samples = std::stoul(value);
+        else if (arg == "--filter")
+            options.filter = value;
+        else if (arg == "-o" || arg == "--output")
+            options.output = value;
+        else {
+            std::cerr << "Unknown option " << arg << std::endl;
+            Usage();
+            return 1;
+        }
+    }
+
+    // the index prints its progress, the report alone goes to stdout
+    std::streambuf* stdout_buffer = std::cout.rdbuf(std::cerr.rdbuf());
+    fs::path generated;
+    if (options.db_path.empty()) {
+        generated = fs::temp_directory_path() /
+                    ("rdftdaa_bench_" + std::to_string(options.triples) + "_" + std::to_string(options.seed));
+        fs::remove_all(generated);
+        fs::create_directories(generated);
+        std::string data_file = (generated / "data.nt").string();
+        GenerateDataset(data_file, options.triples, options.seed);
+        options.db_path = (generated / "db").string();
+        options.generated = true;
+        IndexBuilder builder(options.db_path, data_file);
+        if (!builder.Build()) {
+            std::cerr << "Building the benchmark database failed." << std::endl;
+            return 1;
+        }
+    }
+
+    Bench bench(options);
+    IndexBenchmarks(bench, options);
+    JoinBenchmarks(bench, options);
+    std::cout.rdbuf(stdout_buffer);
+
+    if (options.output.empty()) {
+        std::cout << bench.Report() << std::endl;
+    } else {
+        std::ofstream out(options.output, std::ofstream::out);
+        out << bench.Report() << std::endl;
+    }
+    if (!generated.empty())
+        fs::remove_all(generated);
+    return 0;
+}
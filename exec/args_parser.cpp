@@ -15,6 +15,53 @@ void ArgsParser::Build(const std::unordered_map<std::string, std::string>& args)
     arguments_[arg_file_] = args.count("-f") ? args.at("-f") : args.at("--file");
 }
 
+void ArgsParser::Merge(const std::unordered_map<std::string, std::string>& args) {
+    if (args.empty() || args.count("-h") || args.count("--help")) {
+        std::cout << help_info_ << std::endl;
+        exit(1);
+    }
+    if ((!args.count("-d") && !args.count("--database")) || !args.count("--from")) {
+        std::cerr << "usage: epei merge [-d DATABASE] [--from DATABASE]..." << std::endl;
+        std::cerr << "epei: error: the following arguments are required: [-d DATABASE] [--from DATABASE]"
+                  << std::endl;
+        exit(1);
+    }
+    arguments_[arg_db_path_] = args.count("-d") ? args.at("-d") : args.at("--database");
+    arguments_[arg_sources_] = args.at("--from");
+}
+
+void ArgsParser::Pack(const std::unordered_map<std::string, std::string>& args) {
+    if (args.empty() || args.count("-h") || args.count("--help")) {
+        std::cout << help_info_ << std::endl;
+        exit(1);
+    }
+    if (!args.count("-d") && !args.count("--database")) {
+        std::cerr << "usage: epei pack [-d DATABASE] [-f FILE]" << std::endl;
+        std::cerr << "epei: error: the following arguments are required: [-d DATABASE]" << std::endl;
+        exit(1);
+    }
+    arguments_[arg_db_path_] = args.count("-d") ? args.at("-d") : args.at("--database");
+    if (args.count("-f") || args.count("--file"))
+        arguments_[arg_file_] = args.count("-f") ? args.at("-f") : args.at("--file");
+}
+
+void ArgsParser::Verify(const std::unordered_map<std::string, std::string>& args) {
+    if (args.empty() || args.count("-h") || args.count("--help")) {
+        std::cout << help_info_ << std::endl;
+        exit(1);
+    }
+    if (!args.count("-d") && !args.count("--database") && !args.count("-f") && !args.count("--file")) {
+        std::cerr << "usage: epei verify [-d DATABASE] [-f FILE]" << std::endl;
+        std::cerr << "epei: error: one of the following arguments is required: [-d DATABASE] [-f FILE]"
+                  << std::endl;
+        exit(1);
+    }
+    if (args.count("-d") || args.count("--database"))
+        arguments_[arg_db_path_] = args.count("-d") ? args.at("-d") : args.at("--database");
+    if (args.count("-f") || args.count("--file"))
+        arguments_[arg_file_] = args.count("-f") ? args.at("-f") : args.at("--file");
+}
+
 void ArgsParser::Query(const std::unordered_map<std::string, std::string>& args) {
     if (args.count("-h") || args.count("--help")) {
         std::cout << help_info_ << std::endl;
@@ -31,12 +78,55 @@ void ArgsParser::Query(const std::unordered_map<std::string, std::string>& args)
         arguments_[arg_file_] = "";
 
     size_t default_thread_num = std::thread::hardware_concurrency();
-    if (args.count("-t") && default_thread_num >= std::stoull(args.at("-t")))
-        arguments_[arg_thread_num_] = args.at("-t");
+    std::string thread_num = args.count("-t") ? args.at("-t") : "";
+    if (args.count("--threads"))
+        thread_num = args.at("--threads");
+    if (thread_num != "" && IsNumber(thread_num) && default_thread_num >= std::stoull(thread_num))
+        arguments_[arg_thread_num_] = thread_num;
     else
         arguments_[arg_thread_num_] = std::to_string(default_thread_num);
 }
 
+void ArgsParser::Bench(const std::unordered_map<std::string, std::string>& args) {
+    if (args.empty() || args.count("-h") || args.count("--help")) {
+        std::cout << help_info_ << std::endl;
+        exit(1);
+    }
+    if ((!args.count("-d") && !args.count("--database")) || (!args.count("-f") && !args.count("--file"))) {
+        std::cerr << "usage: epei bench [-d DATABASE] [-f FILE]" << std::endl;
+        std::cerr << "epei: error: the following arguments are required: [-d DATABASE] [-f FILE]"
+                  << std::endl;
+        exit(1);
+    }
+    arguments_[arg_db_path_] = args.count("-d") ? args.at("-d") : args.at("--database");
+    arguments_[arg_file_] = args.count("-f") ? args.at("-f") : args.at("--file");
+    if (args.count("-o") || args.count("--output"))
+        arguments_[arg_output_] = args.count("-o") ? args.at("-o") : args.at("--output");
+
+    // the queries are measured one thread each, running side by side on the workers
+    std::string cores = std::to_string(std::max(std::thread::hardware_concurrency(), 1u));
+    const std::pair<std::string, std::pair<std::string, std::string>> number_args[] = {
+        {"--threads", {arg_thread_num_, args.count("-t") ? args.at("-t") : "1"}},
+        {"--workers", {arg_workers_, args.count("-w") ? args.at("-w") : cores}},
+        {"--warmup", {arg_warmup_, "1"}},
+        {"--repetitions", {arg_repetitions_, "5"}},
+    };
+    for (const auto& [flag, arg] : number_args) {
+        arguments_[arg.first] = args.count(flag) ? args.at(flag) : arg.second;
+        if (arguments_[arg.first].empty() || !IsNumber(arguments_[arg.first])) {
+            std::cerr << "epei: error: the argument [" << flag << " N] requires a number, but got "
+                      << arguments_[arg.first] << std::endl;
+            exit(1);
+        }
+    }
+    for (const auto& arg : {arg_thread_num_, arg_workers_, arg_repetitions_}) {
+        if (std::stoull(arguments_[arg]) == 0) {
+            std::cerr << "epei: error: the argument " << arg << " requires a positive number" << std::endl;
+            exit(1);
+        }
+    }
+}
+
 void ArgsParser::Server(const std::unordered_map<std::string, std::string>& args) {
     if (args.empty() || args.count("-h") || args.count("--help")) {
         std::cout << help_info_ << std::endl;
@@ -57,6 +147,48 @@ void ArgsParser::Server(const std::unordered_map<std::string, std::string>& args
                   << arguments_[arg_port_] << std::endl;
         exit(1);
     }
+
+    // queries of the endpoint run concurrently, so each of them uses one thread unless asked otherwise
+    std::string thread_num = args.count("-t") ? args.at("-t") : "";
+    if (args.count("--threads"))
+        thread_num = args.at("--threads");
+    if (thread_num != "" && IsNumber(thread_num) && std::thread::hardware_concurrency() >= std::stoull(thread_num))
+        arguments_[arg_thread_num_] = thread_num;
+    else
+        arguments_[arg_thread_num_] = "1";
+
+    arguments_[arg_timeout_] = args.count("--timeout") ? args.at("--timeout") : "0";
+    if (!IsNumber(arguments_[arg_timeout_])) {
+        std::cerr << "epei: error: the argument [--timeout MS] requires a number, but got "
+                  << arguments_[arg_timeout_] << std::endl;
+        exit(1);
+    }
+    arguments_[arg_on_timeout_] = args.count("--on-timeout") ? args.at("--on-timeout") : "error";
+    if (arguments_[arg_on_timeout_] != "error" && arguments_[arg_on_timeout_] != "partial") {
+        std::cerr << "epei: error: the argument [--on-timeout MODE] requires 'error' or 'partial', but got "
+                  << arguments_[arg_on_timeout_] << std::endl;
+        exit(1);
+    }
+
+    // the limits of the light and heavy lanes of the queries and the result cache
+    std::string cores = std::to_string(std::max(std::thread::hardware_concurrency(), 1u));
+    const std::pair<std::string, std::pair<std::string, std::string>> number_args[] = {
+        {"--light-queries", {arg_light_queries_, cores}},
+        {"--light-queue", {arg_light_queue_, "64"}},
+        {"--heavy-queries", {arg_heavy_queries_, "2"}},
+        {"--heavy-queue", {arg_heavy_queue_, "16"}},
+        {"--heavy-cost", {arg_heavy_cost_, "1000000"}},
+        {"--result-cache", {arg_result_cache_, "0"}},
+        {"--result-cache-ttl", {arg_result_cache_ttl_, "60"}},
+    };
+    for (const auto& [flag, arg] : number_args) {
+        arguments_[arg.first] = args.count(flag) ? args.at(flag) : arg.second;
+        if (arguments_[arg.first].empty() || !IsNumber(arguments_[arg.first])) {
+            std::cerr << "epei: error: the argument [" << flag << " N] requires a number, but got "
+                      << arguments_[arg.first] << std::endl;
+            exit(1);
+        }
+    }
 }
 
 ArgsParser::CommandT ArgsParser::Parse(int argc, char** argv) {
@@ -96,7 +228,9 @@ ArgsParser::CommandT ArgsParser::Parse(int argc, char** argv) {
             std::cerr << "hinDB: error: argument " << argv[i] << ": expected one argument" << std::endl;
             exit(1);
         }
-        args.emplace(argv[i], argv[i + 1]);
+        auto [it, inserted] = args.emplace(argv[i], argv[i + 1]);
+        if (!inserted && repeatable_.count(argv[i]))
+            it->second += std::string(",") + argv[i + 1];
     }
 
     // 执行对应的命令的解析器
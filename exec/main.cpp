@@ -1,4 +1,6 @@
 #include <rdf-tdaa/rdf-tdaa.hpp>
+#include <sstream>
+#include <vector>
 #include "exec/args_parser.hpp"
 
 void Build(const std::unordered_map<std::string, std::string>& arguments) {
@@ -7,6 +9,53 @@ void Build(const std::unordered_map<std::string, std::string>& arguments) {
     rdftdaa::RDFTDAA::Create(db_name, data_file);
 }
 
+void Merge(const std::unordered_map<std::string, std::string>& arguments) {
+    std::string db_name = arguments.at("path");
+
+    std::vector<std::string> source_paths;
+    std::stringstream sources(arguments.at("sources"));
+    std::string source_path;
+    while (std::getline(sources, source_path, ',')) {
+        if (source_path.empty())
+            continue;
+        if (source_path.find("/") == std::string::npos)
+            source_path = "./DB_DATA_ARCHIVE/" + source_path;
+        source_paths.push_back(source_path);
+    }
+
+    rdftdaa::RDFTDAA::Merge(db_name, source_paths);
+}
+
+void Pack(const std::unordered_map<std::string, std::string>& arguments) {
+    std::string db_path = arguments.at("path");
+    if (db_path.find("/") == std::string::npos)
+        db_path = "./DB_DATA_ARCHIVE/" + db_path;
+    while (db_path.size() > 1 && db_path.back() == '/')
+        db_path.pop_back();
+
+    std::string image_path = db_path + ".rdftdaa";
+    if (arguments.count("file"))
+        image_path = arguments.at("file");
+
+    rdftdaa::RDFTDAA::Pack(db_path, image_path);
+}
+
+void Verify(const std::unordered_map<std::string, std::string>& arguments) {
+    std::string image_path;
+    if (arguments.count("file")) {
+        image_path = arguments.at("file");
+    } else {
+        std::string db_path = arguments.at("path");
+        if (db_path.find("/") == std::string::npos)
+            db_path = "./DB_DATA_ARCHIVE/" + db_path;
+        while (db_path.size() > 1 && db_path.back() == '/')
+            db_path.pop_back();
+        image_path = db_path + ".rdftdaa";
+    }
+
+    rdftdaa::RDFTDAA::Verify(image_path);
+}
+
 void Query(const std::unordered_map<std::string, std::string>& arguments) {
     std::string db_path;
     std::string sparql_file;
@@ -19,7 +68,24 @@ void Query(const std::unordered_map<std::string, std::string>& arguments) {
     if (arguments.count("file"))
         sparql_file = arguments.at("file");
 
-    rdftdaa::RDFTDAA::Query(db_path, sparql_file);
+    uint thread_num = std::stoul(arguments.at("thread_num"));
+    rdftdaa::RDFTDAA::Query(db_path, sparql_file, thread_num);
+}
+
+void Bench(const std::unordered_map<std::string, std::string>& arguments) {
+    std::string db_path = arguments.at("path");
+    if (db_path.find("/") == std::string::npos)
+        db_path = "./DB_DATA_ARCHIVE/" + db_path;
+
+    std::string output;
+    if (arguments.count("output"))
+        output = arguments.at("output");
+
+    uint thread_num = std::stoul(arguments.at("thread_num"));
+    uint worker_num = std::stoul(arguments.at("workers"));
+    uint warmup = std::stoul(arguments.at("warmup"));
+    uint repetitions = std::stoul(arguments.at("repetitions"));
+    rdftdaa::RDFTDAA::Bench(db_path, arguments.at("file"), thread_num, worker_num, warmup, repetitions, output);
 }
 
 void Server(const std::unordered_map<std::string, std::string>& arguments) {
@@ -35,7 +101,18 @@ void Server(const std::unordered_map<std::string, std::string>& arguments) {
     }
 
     std::string port = arguments.at("port");
-    rdftdaa::RDFTDAA::Server(ip, port, db_path);
+    uint thread_num = std::stoul(arguments.at("thread_num"));
+    uint timeout = std::stoul(arguments.at("timeout"));
+    bool partial = arguments.at("on_timeout") == "partial";
+    AdmissionController::Limits light_lane = {uint(std::stoul(arguments.at("light_queries"))),
+                                              uint(std::stoul(arguments.at("light_queue")))};
+    AdmissionController::Limits heavy_lane = {uint(std::stoul(arguments.at("heavy_queries"))),
+                                              uint(std::stoul(arguments.at("heavy_queue")))};
+    ulong heavy_cost = std::stoul(arguments.at("heavy_cost"));
+    ulong result_cache_bytes = std::stoul(arguments.at("result_cache")) << 20;
+    uint result_cache_ttl = std::stoul(arguments.at("result_cache_ttl"));
+    rdftdaa::RDFTDAA::Server(ip, port, db_path, thread_num, timeout, partial, light_lane, heavy_lane, heavy_cost,
+                             result_cache_bytes, result_cache_ttl);
 }
 
 struct EnumClassHash {
@@ -52,7 +129,11 @@ std::unordered_map<ArgsParser::CommandT,
 
 int main(int argc, char** argv) {
     selector = {{ArgsParser::CommandT::kBuild, &Build},
+                {ArgsParser::CommandT::kMerge, &Merge},
+                {ArgsParser::CommandT::kPack, &Pack},
+                {ArgsParser::CommandT::kVerify, &Verify},
                 {ArgsParser::CommandT::kQuery, &Query},
+                {ArgsParser::CommandT::kBench, &Bench},
                 {ArgsParser::CommandT::kServer, &Server}};
 
     auto parser = ArgsParser();
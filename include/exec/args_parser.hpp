@@ -14,27 +14,53 @@ class ArgsParser {
     enum CommandT {
         kNone,
         kBuild,
+        kMerge,
+        kPack,
+        kVerify,
         kQuery,
+        kBench,
         kServer,
     };
 
     const std::string arg_db_path_ = "path";
     const std::string arg_file_ = "file";
+    const std::string arg_sources_ = "sources";
     const std::string arg_ip_ = "ip";
     const std::string arg_port_ = "port";
     const std::string arg_thread_num_ = "thread_num";
     const std::string arg_chunk_size_ = "chunk_size";
+    const std::string arg_timeout_ = "timeout";
+    const std::string arg_on_timeout_ = "on_timeout";
+    const std::string arg_light_queries_ = "light_queries";
+    const std::string arg_light_queue_ = "light_queue";
+    const std::string arg_heavy_queries_ = "heavy_queries";
+    const std::string arg_heavy_queue_ = "heavy_queue";
+    const std::string arg_heavy_cost_ = "heavy_cost";
+    const std::string arg_result_cache_ = "result_cache";
+    const std::string arg_result_cache_ttl_ = "result_cache_ttl";
+    const std::string arg_workers_ = "workers";
+    const std::string arg_warmup_ = "warmup";
+    const std::string arg_repetitions_ = "repetitions";
+    const std::string arg_output_ = "output";
 
    private:
     std::unordered_map<std::string, CommandT> position_ = {
         {"-h", CommandT::kNone},     {"--help", CommandT::kNone},   {"build", CommandT::kBuild},
-        {"query", CommandT::kQuery}, {"server", CommandT::kServer},
+        {"merge", CommandT::kMerge}, {"pack", CommandT::kPack},     {"verify", CommandT::kVerify},
+        {"query", CommandT::kQuery}, {"bench", CommandT::kBench},   {"server", CommandT::kServer},
     };
 
+    // flags that may be repeated, their arguments are joined with ','
+    std::unordered_set<std::string> repeatable_ = {"--from"};
+
     std::unordered_map<std::string, void (ArgsParser::*)(const std::unordered_map<std::string, std::string>&)>
         selector_ = {
             {"build", &ArgsParser::Build},
+            {"merge", &ArgsParser::Merge},
+            {"pack", &ArgsParser::Pack},
+            {"verify", &ArgsParser::Verify},
             {"query", &ArgsParser::Query},
+            {"bench", &ArgsParser::Bench},
             {"server", &ArgsParser::Server},
     };
 
@@ -43,7 +69,11 @@ class ArgsParser {
         "\n"
         "Commands:\n"
         "  build      Build an RDF database.\n"
+        "  merge      Merge RDF databases into a new one.\n"
+        "  pack       Pack an RDF database into a single image file.\n"
+        "  verify     Check the checksums of a database image file.\n"
         "  query      Query an RDF database.\n"
+        "  bench      Measure the latencies of queries on an RDF database.\n"
         "  server     Start an RDF database.\n"
         "\n"
         "Options:\n"
@@ -60,6 +90,36 @@ class ArgsParser {
         "      -d, --database <PATH>   Specify the path of the database.\n"
         "      -f, --file <FILE>       Specify the input file to build the database.\n"
         "\n"
+        "  merge\n"
+        "    Merge RDF databases, including their pending updates, into a new database. The\n"
+        "    new database is built from the indexes of the sources, without RDF files.\n"
+        "\n"
+        "    Usage: rdftdaa merge [OPTIONS]\n"
+        "\n"
+        "    Options:\n"
+        "      -d, --database <PATH>   Specify the path of the new database.\n"
+        "      --from <PATH>           Specify a database to merge, repeat it for every source.\n"
+        "\n"
+        "  pack\n"
+        "    Pack an RDF database into a single image file, which can be used in place of the\n"
+        "    database directory by the query and server commands.\n"
+        "\n"
+        "    Usage: rdftdaa pack [OPTIONS]\n"
+        "\n"
+        "    Options:\n"
+        "      -d, --database <PATH>   Specify the path of the database.\n"
+        "      -f, --file <FILE>       Specify the image file, default is <PATH>.rdftdaa.\n"
+        "\n"
+        "  verify\n"
+        "    Check the checksums of all sections of a database image file, which are not read\n"
+        "    when the image is opened.\n"
+        "\n"
+        "    Usage: rdftdaa verify [OPTIONS]\n"
+        "\n"
+        "    Options:\n"
+        "      -d, --database <PATH>   Specify the path of the database, its image is <PATH>.rdftdaa.\n"
+        "      -f, --file <FILE>       Specify the image file.\n"
+        "\n"
         "  query\n"
         "    Query an RDF database.\n"
         "\n"
@@ -68,6 +128,22 @@ class ArgsParser {
         "    Options:\n"
         "      -d, --database <PATH>   Specify the path of the database.\n"
         "      -f, --file <FILE>       Specify the file containing the query.\n"
+        "      -t, --threads <N>       Specify the threads of a query, default is the number of cores.\n"
+        "\n"
+        "  bench\n"
+        "    Run the queries of a file repeatedly and report their latencies and the queries per\n"
+        "    second as JSON. The results are projected but not printed.\n"
+        "\n"
+        "    Usage: rdftdaa bench [OPTIONS]\n"
+        "\n"
+        "    Options:\n"
+        "      -d, --database <PATH>   Specify the path of the database.\n"
+        "      -f, --file <FILE>       Specify the file containing the queries, one per line.\n"
+        "      -t, --threads <N>       Specify the threads of a query, default is 1.\n"
+        "      -w, --workers <N>       Specify the queries running at a time, default is the number of cores.\n"
+        "      --warmup <N>            Specify the rounds of the queries run before measuring, default is 1.\n"
+        "      --repetitions <N>       Specify the measured rounds of the queries, default is 5.\n"
+        "      -o, --output <FILE>     Specify the file of the report, default is the standard output.\n"
         "\n"
         "  server\n"
         "    Start an RDF endpoint.\n"
@@ -77,15 +153,37 @@ class ArgsParser {
         "    Options:\n"
         "      -d, --database <NAME>   Specify the name of the database.\n"
         "      --ip <IP ADDRESS>       Specify the IP address for the endpoint.\n"
-        "      --port <PORT>           Specify the port for the endpoint.\n";
+        "      --port <PORT>           Specify the port for the endpoint.\n"
+        "      -t, --threads <N>       Specify the threads of a query, default is 1.\n"
+        "      --timeout <MS>          Specify the time limit of a query in milliseconds, default is none.\n"
+        "      --on-timeout <MODE>     Specify what a query that times out returns, 'error' (default) or\n"
+        "                              'partial' for the results found before.\n"
+        "      --light-queries <N>     Specify the light queries running at a time, default is the number\n"
+        "                              of cores.\n"
+        "      --light-queue <N>       Specify the light queries waiting to run, default is 64.\n"
+        "      --heavy-queries <N>     Specify the heavy queries running at a time, default is 2.\n"
+        "      --heavy-queue <N>       Specify the heavy queries waiting to run, default is 16.\n"
+        "      --heavy-cost <N>        Specify the estimated cost of the plan from which a query is heavy,\n"
+        "                              default is 1000000. A query arriving at a full queue gets a 503.\n"
+        "      --result-cache <MB>     Specify the megabytes of responses kept for repeated queries, default\n"
+        "                              is 0 for no cache.\n"
+        "      --result-cache-ttl <S>  Specify the seconds a response is kept, default is 60, 0 for no limit.\n";
 
     std::unordered_map<std::string, std::string> arguments_;
 
    private:
     void Build(const std::unordered_map<std::string, std::string>& args);
 
+    void Merge(const std::unordered_map<std::string, std::string>& args);
+
+    void Pack(const std::unordered_map<std::string, std::string>& args);
+
+    void Verify(const std::unordered_map<std::string, std::string>& args);
+
     void Query(const std::unordered_map<std::string, std::string>& args);
 
+    void Bench(const std::unordered_map<std::string, std::string>& args);
+
     void Server(const std::unordered_map<std::string, std::string>& args);
 
     inline bool IsNumber(const std::string& s) {
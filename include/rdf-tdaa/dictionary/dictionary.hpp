@@ -7,6 +7,7 @@
 #include <fstream>
 #include <future>
 #include <iostream>
+#include <string_view>
 #include <variant>
 #include <vector>
 #include "rdf-tdaa/parser/sparql_parser.hpp"
@@ -20,6 +21,12 @@ enum Order { kSPO, kOPS };
 enum Map { kSubjectMap, kPredicateMap, kObjectMap, kSharedMap };
 
 class Dictionary {
+   public:
+    // The datatypes whose literals are given ids in the order of their values, the ids of each datatype
+    // are a range of the object ids. The numeric XSD types share one range.
+    enum LiteralType { kNumeric, kDate, kDateTime, kUnordered };
+
+   private:
     template <typename T>
     class Node {
         T* offsets_;
@@ -81,6 +88,9 @@ class Dictionary {
     MMap<uint> object_ids_;
     MMap<uint> shared_ids_;
     hash_map<std::string, uint> predicate2id_;
+    // the first id and the id after the last one of the literals of each ordered datatype
+    std::pair<uint, uint> literal_ranges_[kUnordered];
+    bool ordered_literals_;
 
     std::vector<std::string> id2predicate_;
     std::variant<Node<uint>, Node<ulong>> id2subject_;
@@ -106,6 +116,36 @@ class Dictionary {
 
     uint String2ID(const std::string& str, SPARQLParser::Term::Positon pos);
 
+    /**
+     * @brief Finds the ordered datatype of a term.
+     * @param term The term, e.g. "5"^^<http://www.w3.org/2001/XMLSchema#integer>.
+     * @param lexical Set to the lexical form of the literal, e.g. 5, it points into the term.
+     * @return The datatype, kUnordered for the other terms and for values that cannot be ordered.
+     */
+    static LiteralType TypeOf(std::string_view term, std::string_view& lexical);
+
+    /**
+     * @brief Compares the lexical forms of two literals of an ordered datatype by their values.
+     * @return A negative value, zero or a positive value.
+     */
+    static int CompareLiterals(LiteralType type, std::string_view a, std::string_view b);
+
+    /**
+     * @brief Finds the ids of the literals of an ordered datatype that compare to a value as a FILTER
+     * requires, the bounds are found by a binary search on the range of the datatype.
+     * @param type The datatype.
+     * @param op The comparison, Equal, Less, LessOrEq, Greater or GreaterOrEq.
+     * @param lexical The lexical form of the value.
+     * @return The first id and the id after the last one.
+     */
+    std::pair<uint, uint> LiteralRange(LiteralType type, SPARQLParser::Filter::Type op, std::string_view lexical);
+
+    // Whether the database was built with the literals of the ordered datatypes in the order of their values.
+    bool ordered_literals();
+
+    // The ordered datatype whose range holds an object id, kUnordered if there is none.
+    LiteralType OrderedType(uint id);
+
     uint subject_cnt();
 
     uint predicate_cnt();
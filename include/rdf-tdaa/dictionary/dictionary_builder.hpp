@@ -6,6 +6,7 @@
 #include <iostream>
 #include <thread>
 
+#include "rdf-tdaa/dictionary/dictionary.hpp"
 #include "rdf-tdaa/utils/mmap.hpp"
 
 template <typename Key, typename Value>
@@ -58,15 +59,20 @@ class DictionaryBuilder {
     /**
      * @brief Reassigns IDs and saves the hash map to a file.
      *
+     * With order_literals, the numeric, date and dateTime literals get the last IDs, grouped by datatype
+     * and sorted by value, and the range of each datatype is saved in the management file.
+     *
      * @param map The hash map to be processed.
      * @param dict_out The output file stream for saving the dictionary.
      * @param hashmap_path The path where the hash map will be saved.
      * @param management_file_offset The offset in the management file for this hash map.
+     * @param order_literals Whether the literals of the ordered datatypes get IDs in the order of their values.
      */
     void ReassignIDAndSave(hash_map<std::string, uint>& map,
                            std::ofstream& dict_out,
                            std::string hashmap_path,
-                           uint management_file_offset);
+                           uint management_file_offset,
+                           bool order_literals = false);
 
     /**
      * @brief Saves the dictionary using multiple threads.
@@ -92,6 +98,59 @@ class DictionaryBuilder {
      */
     void Build();
 
+    /**
+     * @brief Adds an entity in the subject position, it becomes shared if it is also an object.
+     *
+     * @param s The subject.
+     */
+    void AddSubject(const std::string& s);
+
+    /**
+     * @brief Adds an entity in the object position, it becomes shared if it is also a subject.
+     *
+     * @param o The object.
+     */
+    void AddObject(const std::string& o);
+
+    /**
+     * @brief Adds a predicate, predicates get ids in the order they are added.
+     *
+     * @param p The predicate.
+     */
+    void AddPredicate(const std::string& p);
+
+    /**
+     * @brief Assigns the final IDs to the added terms and saves the dictionary.
+     *
+     * Build calls it after reading the RDF file; when the terms are added one by one,
+     * e.g. when merging databases, it has to be called before looking up IDs.
+     */
+    void Save();
+
+    /**
+     * @brief Retrieves the ID of a subject, valid after Save.
+     *
+     * @param s The subject.
+     * @return The ID of the subject.
+     */
+    uint SubjectID(const std::string& s);
+
+    /**
+     * @brief Retrieves the ID of an object, valid after Save.
+     *
+     * @param o The object.
+     * @return The ID of the object.
+     */
+    uint ObjectID(const std::string& o);
+
+    /**
+     * @brief Retrieves the ID of a predicate.
+     *
+     * @param p The predicate.
+     * @return The ID of the predicate.
+     */
+    uint PredicateID(const std::string& p);
+
     /**
      * @brief Encodes RDF triples into a hash map.
      *
@@ -3,6 +3,7 @@
 
 #include <parallel_hashmap/btree.h>
 #include <parallel_hashmap/phmap.h>
+#include <mutex>
 #include <span>
 #include <vector>
 #include "rdf-tdaa/utils/mmap.hpp"
@@ -32,6 +33,7 @@ class CharacteristicSet {
     MMap<uint8_t> mmap_;
     std::vector<std::pair<uint, uint>> offset_size_;
     std::vector<std::span<uint>> sets_;
+    std::vector<std::once_flag> loaded_;
 
    public:
     CharacteristicSet();
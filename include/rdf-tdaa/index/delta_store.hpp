@@ -0,0 +1,225 @@
+#ifndef DELTA_STORE_HPP
+#define DELTA_STORE_HPP
+
+#include <parallel_hashmap/btree.h>
+#include <parallel_hashmap/phmap.h>
+#include <atomic>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <span>
+#include <string>
+#include <vector>
+
+/**
+ * @class DeltaStore
+ * @brief A writable layer of inserted and deleted triples on top of an immutable index.
+ *
+ * Updates are kept as sorted runs per (s, p) and per (o, p). IndexRetriever merges the runs with the
+ * spans of the base index, the merged spans of single predicates are cached within a budget of bytes,
+ * least recently used first out. A span invalidated by an update or evicted is freed once no Reader
+ * that started before it is left. Terms that are not in the
+ * base dictionary get ids after the base ids. Every update is appended to a log, which is replayed
+ * when the database is opened again.
+ */
+class DeltaStore {
+   public:
+    // Sorted ids added to and removed from one span of the base index.
+    struct Run {
+        std::vector<uint> inserted;
+        std::vector<uint> deleted;
+    };
+
+    // Kinds of merged spans kept by Cached.
+    enum Merged { kBySP, kByOP, kSSet, kOSet, kSPreSet, kOPreSet, kMergedCnt };
+
+    // Bytes of the merged spans kept by Cached.
+    static constexpr ulong kCacheBytes = 256ul << 20;
+
+    // Keeps the merged spans a query reads valid while it runs, a query holds one from planning to its end.
+    class Reader {
+        std::shared_ptr<DeltaStore> store_;
+        ulong epoch_;
+
+       public:
+        explicit Reader(std::shared_ptr<DeltaStore> store);
+
+        ~Reader();
+
+        Reader(const Reader&) = delete;
+
+        Reader& operator=(const Reader&) = delete;
+    };
+
+   private:
+    std::string log_path_;
+    std::ofstream log_;
+    // The size of the log, the offset the next update is appended at.
+    ulong log_offset_;
+
+    uint max_entity_id_;
+    uint max_predicate_id_;
+
+    phmap::flat_hash_map<std::string, uint> entity2id_;
+    phmap::flat_hash_map<std::string, uint> predicate2id_;
+    // deque keeps the addresses of the strings stable when new terms are added
+    std::deque<std::string> id2entity_;
+    std::deque<std::string> id2predicate_;
+
+    // (s, p) -> objects
+    phmap::btree_map<std::pair<uint, uint>, Run> sp_runs_;
+    // (o, p) -> subjects
+    phmap::btree_map<std::pair<uint, uint>, Run> op_runs_;
+    // (p, s) and (p, o) of the runs
+    phmap::btree_set<std::pair<uint, uint>> ps_touched_;
+    phmap::btree_set<std::pair<uint, uint>> po_touched_;
+
+    std::atomic<bool> empty_;
+    std::shared_mutex mutex_;
+
+    struct Entry {
+        std::vector<uint>* merged;
+        // the place of the key in the recency list
+        std::list<std::pair<Merged, ulong>>::iterator recency;
+    };
+
+    std::mutex cache_mutex_;
+    phmap::flat_hash_map<ulong, Entry> merged_[kMergedCnt];
+    // the keys of the merged spans, the most recently used first
+    std::list<std::pair<Merged, ulong>> recency_;
+    ulong cached_bytes_;
+    // incremented by every invalidation, a reader records the epoch it started at
+    ulong epoch_;
+    phmap::btree_multiset<ulong> readers_;
+    // merged spans invalidated by updates or evicted, with the epoch they were dropped at, in the order of
+    // the epochs; the readers that started at or before it may still hold them
+    std::deque<std::pair<ulong, std::vector<uint>*>> retired_;
+
+    bool Add(std::vector<uint>& ids, uint id);
+
+    bool Remove(std::vector<uint>& ids, uint id);
+
+    // Moves a merged span to retired_, the caller holds cache_mutex_ and increments epoch_ after.
+    void Retire(Merged kind, phmap::flat_hash_map<ulong, Entry>::iterator it);
+
+    void Invalidate(Merged kind, uint first, uint second);
+
+    // Frees the retired spans no reader can hold, the caller holds cache_mutex_.
+    void Reclaim();
+
+   public:
+    /**
+     * @brief Constructs a DeltaStore for a database.
+     * @param log_path The path of the update log, it is created at the first update. An existing log is
+     *                 replayed by the caller.
+     * @param max_entity_id The largest entity id of the base dictionary.
+     * @param max_predicate_id The largest predicate id of the base dictionary.
+     */
+    DeltaStore(std::string log_path, uint max_entity_id, uint max_predicate_id);
+
+    ~DeltaStore();
+
+    /**
+     * @brief Parses an N-Triples line in the same way as the dictionary builder.
+     * @return False if the line does not contain a triple.
+     */
+    static bool ParseTriple(const std::string& line, std::string& s, std::string& p, std::string& o);
+
+    /**
+     * @brief Merges a run into a sorted span of the base index.
+     */
+    static void Merge(std::span<uint> base, const Run& run, std::vector<uint>& merged);
+
+    std::shared_mutex& mutex();
+
+    // True if no update has been applied, then nothing has to be merged.
+    bool empty() const;
+
+    const std::string& log_path() const;
+
+    /**
+     * @brief Appends the next updates to another log, the caller holds the unique lock.
+     * @param log_path The new path of the update log, it is opened at the next update.
+     */
+    void Relocate(std::string log_path);
+
+    uint EntityID(const std::string& entity) const;
+
+    uint PredicateID(const std::string& predicate) const;
+
+    uint AddEntity(const std::string& entity);
+
+    uint AddPredicate(const std::string& predicate);
+
+    const std::string& Entity(uint id) const;
+
+    const std::string& Predicate(uint id) const;
+
+    uint max_predicate_id() const;
+
+    /**
+     * @brief Records a triple as inserted, the caller holds the unique lock.
+     * @param in_base Whether the base index contains the triple.
+     * @return True if the triple was not visible before.
+     */
+    bool Insert(uint sid, uint pid, uint oid, bool in_base);
+
+    /**
+     * @brief Records a triple as deleted, the caller holds the unique lock.
+     * @param in_base Whether the base index contains the triple.
+     * @return True if the triple was visible before.
+     */
+    bool Delete(uint sid, uint pid, uint oid, bool in_base);
+
+    /**
+     * @brief Appends an update to the log.
+     * @param line The update, '+' or '-' followed by an N-Triples line.
+     */
+    void Log(const std::string& line);
+
+    // The offset in the log after the last update.
+    ulong log_offset() const;
+
+    /**
+     * @brief Reads the updates appended to the log after an offset, the caller holds the shared lock.
+     * @param offset An offset returned by log_offset.
+     */
+    std::vector<std::string> UpdatesSince(ulong offset) const;
+
+    const Run* FindSP(uint sid, uint pid) const;
+
+    const Run* FindOP(uint oid, uint pid) const;
+
+    bool PredicateTouched(uint pid) const;
+
+    bool SubjectTouched(uint sid) const;
+
+    bool ObjectTouched(uint oid) const;
+
+    void TouchedSubjects(uint pid, std::vector<uint>& subjects) const;
+
+    void TouchedObjects(uint pid, std::vector<uint>& objects) const;
+
+    void TouchedPredicatesOfS(uint sid, std::vector<uint>& predicates) const;
+
+    void TouchedPredicatesOfO(uint oid, std::vector<uint>& predicates) const;
+
+    /**
+     * @brief Returns the merged span of a key, computing it if it is not cached. It stays valid while the
+     * Reader of the caller is alive.
+     * @param kind The kind of the merged span.
+     * @param first The first id of the key.
+     * @param second The second id of the key, 0 for keys of a single id.
+     * @param compute Fills the merged ids, it may call Cached for other keys.
+     */
+    std::span<uint> Cached(Merged kind,
+                           uint first,
+                           uint second,
+                           const std::function<void(std::vector<uint>&)>& compute);
+};
+
+#endif
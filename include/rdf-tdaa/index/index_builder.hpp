@@ -3,7 +3,9 @@
 
 #include <parallel_hashmap/btree.h>
 #include <parallel_hashmap/phmap.h>
+#include <atomic>
 #include <filesystem>
+#include <functional>
 #include <future>
 #include <iostream>
 #include <mutex>
@@ -13,6 +15,7 @@
 
 #include "rdf-tdaa/dictionary/dictionary.hpp"
 #include "rdf-tdaa/index/daas.hpp"
+#include "rdf-tdaa/index/index_retriever.hpp"
 #include "rdf-tdaa/index/predicate_index.hpp"
 
 namespace fs = std::filesystem;
@@ -56,6 +59,19 @@ class IndexBuilder {
     // p_id -> (s_id, o_id).
     std::shared_ptr<hash_map<uint, std::vector<std::pair<uint, uint>>>> pso_;
 
+    // Databases to merge, empty when building from an RDF data file.
+    std::vector<std::shared_ptr<IndexRetriever>> sources_;
+    // The offset in the delta log of every source at the time it was scanned.
+    std::vector<ulong> delta_offsets_;
+
+    /**
+     * @brief Builds the dictionary and pso_ from the indexes of the source databases.
+     *
+     * The sources are scanned in parallel for the terms of their triples, which are decoded and added to a
+     * new dictionary. A second scan adds the triples to pso_ in the new IDs, so only pso_ holds them.
+     */
+    void MergeSources();
+
     /**
      * @brief Builds the characteristic set index for the given permutation.
      * @param c_set_id A vector to store characteristic set IDs.
@@ -81,16 +97,29 @@ class IndexBuilder {
    public:
     /**
      * @brief Constructs an IndexBuilder object.
-     * @param db_name The name of the database.
+     * @param db_name The name of the database, or its path if it contains "/".
      * @param data_file The path to the RDF data file.
      */
     IndexBuilder(std::string db_name, std::string data_file);
 
+    /**
+     * @brief Constructs an IndexBuilder that merges existing databases.
+     * @param db_name The name of the database, or its path if it contains "/".
+     * @param sources The databases to merge, including their deltas.
+     */
+    IndexBuilder(std::string db_name, std::vector<std::shared_ptr<IndexRetriever>> sources);
+
     /**
      * @brief Builds the RDF indexes and dictionaries.
      * @return True if the build process is successful, false otherwise.
      */
     bool Build();
+
+    /**
+     * @brief Retrieves the offsets in the delta logs the merged sources were scanned at.
+     * @return One offset per source, see IndexRetriever::DeltaUpdatesSince.
+     */
+    const std::vector<ulong>& delta_offsets() const;
 };
 
 #endif
\ No newline at end of file
@@ -3,7 +3,9 @@
 
 #include <limits.h>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <shared_mutex>
 #include <span>
 #include <thread>
 #include <vector>
@@ -11,6 +13,7 @@
 #include "rdf-tdaa/index/characteristic_set.hpp"
 #include "rdf-tdaa/index/cs_daa_map.hpp"
 #include "rdf-tdaa/index/daas.hpp"
+#include "rdf-tdaa/index/delta_store.hpp"
 #include "rdf-tdaa/index/predicate_index.hpp"
 
 /**
@@ -36,6 +39,10 @@ class IndexRetriever {
     PredicateIndex predicate_index_;
 
     ulong max_subject_id_;
+    ulong max_id_;
+
+    // Inserted and deleted triples that are not in the DAA index yet.
+    std::shared_ptr<DeltaStore> delta_;
 
     /**
      * @brief Retrieves the size of a file.
@@ -44,6 +51,53 @@ class IndexRetriever {
      */
     ulong FileSize(std::string file_name);
 
+    // The path of the update log of a database, next to its directory.
+    static std::string DeltaLogPath(std::string db_path);
+
+    // Restores a database moved aside by a compaction that stopped before the rebuilt one replaced it.
+    static void RecoverCompaction(std::string db_path);
+
+    /**
+     * @brief Finds the id of an entity in any position, adding it to the delta if it is new.
+     */
+    uint EntityID(const std::string& entity, bool add);
+
+    /**
+     * @brief Converts an entity ID to its string, the caller holds the shared lock of the delta.
+     */
+    const char* EntityString(uint id);
+
+    /**
+     * @brief Applies an update to the delta, the caller holds the unique lock of the delta.
+     * @param op '+' for insertion and '-' for deletion.
+     * @param persist Whether to append the update to the delta log.
+     * @return True if the update changed the data.
+     */
+    bool ApplyUpdate(char op, const std::string& s, const std::string& p, const std::string& o, bool persist);
+
+    // The spans of the base index, without the delta.
+    std::span<uint> BaseSSet(uint pid);
+    std::span<uint> BaseOSet(uint pid);
+    std::span<uint> BaseSPreSet(uint sid);
+    std::span<uint> BaseOPreSet(uint oid);
+    std::span<uint> BaseBySP(uint sid, uint pid);
+    std::span<uint> BaseByOP(uint oid, uint pid);
+    std::span<uint> BaseBySO(uint sid, uint oid);
+    std::span<uint> BaseByS(uint sid);
+    std::span<uint> BaseByO(uint oid);
+
+    // The spans of the base index merged with the delta, the caller holds the shared lock of the delta.
+    std::span<uint> MergedSSet(uint pid);
+    std::span<uint> MergedOSet(uint pid);
+    std::span<uint> MergedSPreSet(uint sid);
+    std::span<uint> MergedOPreSet(uint oid);
+    std::span<uint> MergedBySP(uint sid, uint pid);
+    std::span<uint> MergedByOP(uint oid, uint pid);
+    // not cached, the merged ids are held by owner
+    std::span<uint> MergedBySO(uint sid, uint oid, std::shared_ptr<std::vector<uint>>& owner);
+    std::span<uint> MergedByS(uint sid, std::shared_ptr<std::vector<uint>>& owner);
+    std::span<uint> MergedByO(uint oid, std::shared_ptr<std::vector<uint>>& owner);
+
    public:
     /**
      * @brief Default constructor for IndexRetriever.
@@ -61,14 +115,28 @@ class IndexRetriever {
      */
     void Close();
 
+    /**
+     * @brief Follows the database after its directory is renamed, the next updates are logged next to it.
+     * @param db_name The new name of the database.
+     */
+    void Relocate(std::string db_name);
+
     /**
      * @brief Converts an ID to its corresponding string representation.
      * @param id The ID to convert.
      * @param pos The position of the term in the SPARQL triple pattern.
-     * @return The string representation of the ID.
+     * @return The string representation of the ID. The string of a predicate belongs to the index, the
+     *         string of another term is a copy the caller deletes with delete[].
      */
     const char* ID2String(uint id, SPARQLParser::Term::Positon pos);
 
+    /**
+     * @brief Converts an ID to its term, without the caller having to release it.
+     * @param id The ID to convert, 0 for an unbound variable, which is decoded to an empty string.
+     * @param pos The position of the term in the SPARQL triple pattern.
+     */
+    std::string Decode(uint id, SPARQLParser::Term::Positon pos);
+
     /**
      * @brief Converts a term in a SPARQL triple pattern to its corresponding ID.
      * @param term The SPARQL term.
@@ -76,6 +144,86 @@ class IndexRetriever {
      */
     uint Term2ID(const SPARQLParser::Term& term);
 
+    /**
+     * @brief Finds the ids of the literals of an ordered datatype that compare to a value as a FILTER requires.
+     * @param type The datatype, numeric, date or dateTime.
+     * @param op The comparison.
+     * @param lexical The lexical form of the value.
+     * @return The first id and the id after the last one, the literals inserted later are not in it.
+     */
+    std::pair<uint, uint> LiteralRange(Dictionary::LiteralType type,
+                                       SPARQLParser::Filter::Type op,
+                                       std::string_view lexical);
+
+    /**
+     * @brief Whether the literals of the ordered datatypes have ids in the order of their values, it is false
+     * for databases built before the order was kept.
+     */
+    bool ordered_literals();
+
+    /**
+     * @brief The ordered datatype of the literal of an id, found from the id alone. Two ids of one datatype
+     * compare like the values of their literals.
+     * @return kUnordered for the other terms, for the terms inserted after the build and for predicates.
+     */
+    Dictionary::LiteralType OrderedType(uint id, SPARQLParser::Term::Positon pos);
+
+    /**
+     * @brief The largest id of the entities of the database, the entities inserted later have larger ids.
+     */
+    uint max_id();
+
+    /**
+     * @brief The largest id of the subjects of the database, the objects that are not subjects have larger ids.
+     */
+    uint max_subject_id();
+
+    /**
+     * @brief Inserts a triple into the delta of the index.
+     * @param s The subject.
+     * @param p The predicate.
+     * @param o The object.
+     * @return True if the triple was not in the database.
+     */
+    bool Insert(const std::string& s, const std::string& p, const std::string& o);
+
+    /**
+     * @brief Deletes a triple through the delta of the index.
+     * @param s The subject.
+     * @param p The predicate.
+     * @param o The object.
+     * @return True if the triple was in the database.
+     */
+    bool Delete(const std::string& s, const std::string& p, const std::string& o);
+
+    /**
+     * @brief Applies an update in the format of the delta log.
+     * @param update '+' or '-' followed by an N-Triples line.
+     * @return True if the update changed the data.
+     */
+    bool Apply(const std::string& update);
+
+    /**
+     * @brief Visits all triples of the database, including the delta, grouped by predicate and subject.
+     * @param visit Called with a predicate ID, a subject ID and the sorted object IDs of the pair. It runs
+     *              while the delta is locked, so it must not call other methods of the retriever.
+     * @return The offset in the delta log the scan corresponds to, see DeltaUpdatesSince.
+     */
+    ulong ScanTriples(const std::function<void(uint, uint, std::span<uint>)>& visit);
+
+    /**
+     * @brief Keeps the merged spans valid while a query reads them, updates meanwhile do not free them.
+     * @return The reader of the query, the spans are released when the last copy of it is destroyed.
+     */
+    std::shared_ptr<DeltaStore::Reader> ReadDelta();
+
+    /**
+     * @brief Reads the updates appended to the delta log after an offset.
+     * @param offset An offset returned by ScanTriples.
+     * @return The updates in the format of the delta log.
+     */
+    std::vector<std::string> DeltaUpdatesSince(ulong offset);
+
     /**
      * @brief Retrieves the set of subjects for a given predicate ID.
      * @param pid The predicate ID.
@@ -107,16 +255,18 @@ class IndexRetriever {
     /**
      * @brief Retrieves the set of objects by subject ID.
      * @param sid The subject ID.
+     * @param owner Set to the ids merged with the delta, the span points into it then.
      * @return A span of triples.
      */
-    std::span<uint> GetByS(uint sid);
+    std::span<uint> GetByS(uint sid, std::shared_ptr<std::vector<uint>>& owner);
 
     /**
      * @brief Retrieves the set of subjects by object ID.
      * @param oid The object ID.
+     * @param owner Set to the ids merged with the delta, the span points into it then.
      * @return A span of triples.
      */
-    std::span<uint> GetByO(uint oid);
+    std::span<uint> GetByO(uint oid, std::shared_ptr<std::vector<uint>>& owner);
 
     /**
      * @brief Retrieves the set of objects by subject and predicate IDs.
@@ -138,9 +288,10 @@ class IndexRetriever {
      * @brief Retrieves the set of predicates by subject and object IDs.
      * @param sid The subject ID.
      * @param oid The object ID.
+     * @param owner Set to the ids merged with the delta, the span points into it then.
      * @return A span of triples.
      */
-    std::span<uint> GetBySO(uint sid, uint oid);
+    std::span<uint> GetBySO(uint sid, uint oid, std::shared_ptr<std::vector<uint>>& owner);
 
     /**
      * @brief Retrieves the count of subjects for a given predicate ID.
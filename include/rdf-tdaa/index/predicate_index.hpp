@@ -44,6 +44,8 @@ class PredicateIndex {
     MMap<uint8_t> predicate_index_arrays_;
     std::vector<std::span<uint>> ps_sets_;
     std::vector<std::span<uint>> po_sets_;
+    std::vector<std::once_flag> ps_loaded_;
+    std::vector<std::once_flag> po_loaded_;
 
     void BuildPredicateIndex();
 
@@ -10,6 +10,7 @@ class SPARQLLexer {
         kError,
         kEof,
         kVariable,
+        kParameter,
         kIRI,
         kIdentifier,
         kColon,
@@ -33,7 +34,8 @@ class SPARQLLexer {
         kLess,
         kLessOrEq,
         kGreater,
-        kGreaterOrEq
+        kGreaterOrEq,
+        kNot
     };
 
    private:
@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include <exception>
+#include <memory>
 #include <set>
 #include <sstream>
 #include <string>
@@ -27,7 +28,7 @@ class SPARQLParser {
     };
 
     struct Term {
-        enum Type { kVariable, kIRI, kLiteral, kBlank };
+        enum Type { kVariable, kIRI, kLiteral, kBlank, kParameter };
         enum ValueType { kInteger, kDouble, kString, kFunction, kNone };
         enum Positon { kSubject, kPredicate, kObject, kShared };
 
@@ -41,14 +42,20 @@ class SPARQLParser {
         Term(Type type, ValueType value_type, std::string value);
 
         bool IsVariable() const;
+
+        bool IsParameter() const;
     };
 
     struct TriplePattern {
+        // The repetition of the predicate of a property path, <p>+ or <p>*.
+        enum Path { kNone, kOneOrMore, kZeroOrMore };
+
         Term subject;
         Term predicate;
         Term object;
         bool is_option;
         uint variable_cnt;
+        Path path;
 
         TriplePattern(Term subject, Term predicate, Term object, bool is_option, uint variale_cnt);
 
@@ -57,10 +64,11 @@ class SPARQLParser {
 
     // TODO: Filter need to be imporoved
     struct Filter {
-        enum Type { Equal, NotEqual, Less, LessOrEq, Greater, GreaterOrEq, Function };
+        enum Type { Equal, NotEqual, Less, LessOrEq, Greater, GreaterOrEq, Bound, NotBound, SameTerm, Function };
         Type filter_type;
         std::string variable_str;
         // if Type == Function then filter_args[0] is functions_register_name
+        // the other term of a comparison or of sameTerm, a variable or a constant, none for BOUND
         std::vector<Term> filter_args;
     };
 
@@ -74,13 +82,31 @@ class SPARQLParser {
         [[nodiscard]] std::string toString() const;
     };
 
+    // A key of ORDER BY, the results are sorted by the first key, then by the second, and so on.
+    struct OrderCondition {
+        std::string variable;
+        bool descending;
+    };
+
+    // The triple patterns and FILTERs of one alternative of the UNIONs of a query.
+    struct UnionBranch {
+        std::vector<TriplePattern> triple_patterns;
+        std::vector<Filter> filters;
+    };
+
    private:
     size_t limit_;  // limit number
     SPARQLLexer sparql_lexer_;
     ProjectModifier project_modifier_;            // modifier
     std::vector<std::string> project_variables_;  // all variables to be outputted
+    std::string count_variable_;                  // the output variable of a COUNT query
+    bool count_distinct_;                         // COUNT(DISTINCT ...)
+    bool count_all_;                              // COUNT(*)
     std::vector<TriplePattern> triple_patterns_;  // all triple patterns
-    std::unordered_map<std::string, Filter> filters_;
+    std::vector<Filter> filters_;
+    std::vector<OrderCondition> order_conditions_;
+    std::vector<std::vector<UnionBranch>> unions_;  // the UNIONs of the group being parsed
+    std::vector<UnionBranch> union_branches_;       // the alternatives of a query with UNION
     std::unordered_map<std::string, std::string> prefixes_;  // the registered prefixes
 
     void parse();
@@ -89,14 +115,30 @@ class SPARQLParser {
 
     void ParseProjection();
 
+    void ParseCount();
+
     void ParseWhere();
 
     void ParseFilter();
 
+    // the term a variable is compared with in a FILTER
+    Term ParseFilterArgument(SPARQLLexer::TokenT token);
+
     void ParseGroupGraphPattern();
 
+    // a group in braces and the groups joined to it by UNION
+    void ParseUnion();
+
+    // the alternatives of the group being parsed, one per combination of the alternatives of its UNIONs
+    std::vector<UnionBranch> ExpandUnions() const;
+
     void ParseBasicGraphPattern(bool is_option);
 
+    // the IRI of a prefixed name, e.g. rdfs:subClassOf, the prefix is the current token
+    Term ParsePrefixedName(const std::string& prefix);
+
+    void ParseOrderBy();
+
     void ParseLimit();
 
     Term MakeVariable(std::string variable);
@@ -113,6 +155,8 @@ class SPARQLParser {
 
     Term MakeFunctionLiteral(std::string literal);
 
+    Term MakeParameter(std::string parameter);
+
    public:
     explicit SPARQLParser(const SPARQLLexer& sparql_lexer);
 
@@ -124,15 +168,48 @@ class SPARQLParser {
 
     const std::vector<std::string>& ProjectVariables() const;
 
+    // The variable a COUNT query binds its count to, "?count" unless the query names it with AS.
+    const std::string& CountVariable() const;
+
+    // Whether a COUNT query counts the distinct values of its project variables instead of the matches.
+    bool CountDistinct() const;
+
+    // Whether a COUNT query counts all the matches, COUNT(*), instead of the matches binding its variable.
+    bool CountAll() const;
+
     const std::vector<TriplePattern>& TriplePatterns() const;
 
     std::vector<std::vector<std::string>> TripleList() const;
 
-    const std::unordered_map<std::string, Filter>& Filters() const;
+    const std::vector<Filter>& Filters() const;
+
+    // Whether the query has a UNION, its patterns are then those of Branches().
+    bool HasUnion() const;
+
+    /**
+     * @brief Splits a query with UNION into a query per alternative. The patterns and FILTERs outside
+     * the UNIONs are copied into every alternative, and a query with several UNIONs has an alternative
+     * per combination of theirs.
+     * @return The queries of the alternatives, with the projection, modifier, order and limit of the query.
+     */
+    std::vector<std::shared_ptr<SPARQLParser>> Branches() const;
 
     const std::unordered_map<std::string, std::string>& Prefixes() const;
 
+    const std::vector<OrderCondition>& OrderConditions() const;
+
     size_t Limit() const;
+
+    // The placeholders of a prepared statement, e.g. "$name", in the order they first appear.
+    std::vector<std::string> Parameters() const;
+
+    /**
+     * @brief Replaces the placeholders with constants.
+     * @param bindings placeholder -> IRI or literal in N-Triples syntax, e.g. "$name" -> "<http://ex.org/a>".
+     * @return A copy of the query with the placeholders bound, the parser itself is not changed.
+     * @throws ParserException if a placeholder has no binding.
+     */
+    std::shared_ptr<SPARQLParser> Bind(const std::unordered_map<std::string, std::string>& bindings) const;
 };
 
 #endif  // SPARQL_PARSER_HPP
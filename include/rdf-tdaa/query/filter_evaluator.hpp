@@ -0,0 +1,49 @@
+#ifndef FILTER_EVALUATOR_HPP
+#define FILTER_EVALUATOR_HPP
+
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+#include "rdf-tdaa/index/index_retriever.hpp"
+#include "rdf-tdaa/query/plan_generator.hpp"
+
+/**
+ * @class FilterEvaluator
+ * @brief Checks the FILTERs of a level on the ids of a tuple.
+ *
+ * BOUND and sameTerm only look at the ids. An equality compares the ids first, and decodes the terms
+ * only when both can be literals, whose different ids may still hold equal values, e.g. "5" and "5.0".
+ * The orders decode the terms and compare numeric, date and dateTime literals by their values and the
+ * plain strings by their characters; the other terms have no order and fail the comparison.
+ */
+class FilterEvaluator {
+    using Positon = SPARQLParser::Term::Positon;
+
+    std::shared_ptr<IndexRetriever> index_;
+    // the entities up to it are subjects, which are never literals
+    uint max_subject_id_;
+
+    // whether the term of an id can be a literal
+    bool MaybeLiteral(uint id, Positon position);
+
+    bool Equal(const PlanGenerator::FilterItem& filter, uint value, uint other);
+
+    bool Compare(const PlanGenerator::FilterItem& filter, uint value, uint other);
+
+   public:
+    FilterEvaluator(std::shared_ptr<IndexRetriever> index);
+
+    /**
+     * @brief Evaluates a FILTER, a comparison with an unbound variable fails.
+     * @param filter The FILTER.
+     * @param tuple The values of the levels, those up to the level of the FILTER are bound.
+     * @return Whether the tuple passes the FILTER.
+     */
+    bool Evaluate(const PlanGenerator::FilterItem& filter, std::span<const uint> tuple);
+
+    // Whether the tuple passes all the FILTERs.
+    bool Evaluate(const std::vector<PlanGenerator::FilterItem>& filters, std::span<const uint> tuple);
+};
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef PATH_SEARCH_HPP
+#define PATH_SEARCH_HPP
+
+#include <memory>
+#include <span>
+#include <vector>
+#include "rdf-tdaa/index/index_retriever.hpp"
+#include "rdf-tdaa/utils/bitset.hpp"
+#include "rdf-tdaa/utils/cancellation_token.hpp"
+
+/**
+ * @class PathSearch
+ * @brief Follows a predicate transitively, for the property paths <p>+ and <p>*.
+ *
+ * The search is a breadth first search over the entity ids, a level of the search is the frontier of the
+ * entities reached last, and their neighbours are looked up with GetBySP, or with GetByOP against the
+ * direction of the predicate. The entities reached are marked in a Bitset over the entity ids. The
+ * neighbours of a large frontier are looked up by several threads, the entities are marked by one.
+ *
+ * The searches keep no state in the object and may run at the same time. A search stops early, with the
+ * entities reached so far, when the token of its query is cancelled.
+ */
+class PathSearch {
+    // a frontier with fewer entities is expanded by the calling thread
+    static constexpr ulong kParallelFrontier = 1024;
+
+    std::shared_ptr<IndexRetriever> index_;
+    uint max_id_;
+    uint thread_num_;
+    // polled by the searches, may be null
+    std::shared_ptr<CancellationToken> token_;
+
+    bool Cancelled();
+
+    // the neighbours of the entities of a frontier, with duplicates
+    std::vector<uint> Expand(const std::vector<uint>& frontier, uint pid, bool forward);
+
+   public:
+    /**
+     * @param index The index of the database.
+     * @param thread_num The threads expanding a large frontier.
+     */
+    PathSearch(std::shared_ptr<IndexRetriever> index, uint thread_num = 1);
+
+    // Makes the searches stop when the token is cancelled.
+    void CancelBy(std::shared_ptr<CancellationToken> token);
+
+    /**
+     * @brief The entities reachable from an entity by the predicate.
+     * @param start The entity the paths start at.
+     * @param pid The predicate of the path.
+     * @param forward Whether the path goes from subject to object, otherwise from object to subject.
+     * @param zero_length Whether the path may have no edge, then start is reachable from itself.
+     * @return The sorted entities, the start is only in them through a cycle unless zero_length is set.
+     */
+    std::vector<uint> Reach(uint start, uint pid, bool forward, bool zero_length);
+
+    /**
+     * @brief Whether there is a path from an entity to another by the predicate. The search goes
+     * forward from the first and backward from the second, expanding the smaller frontier, until the
+     * searches meet or one of them has no entity left.
+     * @param from The subject of the path.
+     * @param to The object of the path.
+     * @param pid The predicate of the path.
+     * @param zero_length Whether the path may have no edge.
+     */
+    bool Reachable(uint from, uint to, uint pid, bool zero_length);
+};
+
+#endif  // PATH_SEARCH_HPP
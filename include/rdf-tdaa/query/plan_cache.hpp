@@ -0,0 +1,75 @@
+#ifndef PLAN_CACHE_HPP
+#define PLAN_CACHE_HPP
+
+#include <atomic>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+#include "rdf-tdaa/query/plan_generator.hpp"
+
+/**
+ * @class PlanCache
+ * @brief A concurrent cache of query plans keyed by the shape of the query.
+ *
+ * The shape of a query is its text with the constants of the triple patterns abstracted away, so
+ * queries made from the same template share one entry. An entry keeps the variable order found by
+ * the query graph, the path search and the variable ranking; a query hitting the entry only binds
+ * its own constants to ids and fills the plan table, see PlanGenerator.
+ */
+class PlanCache {
+   public:
+    struct Plan {
+        // The values of the variables in the order of the plan.
+        std::vector<std::string> variable_order;
+        bool distinct_predicate;
+    };
+
+   private:
+    ulong capacity_;
+    std::shared_mutex mutex_;
+    hash_map<std::string, std::shared_ptr<const Plan>> plans_;
+
+    std::atomic<ulong> hits_;
+    std::atomic<ulong> misses_;
+    std::atomic<ulong> invalidations_;
+
+   public:
+    /**
+     * @brief Constructs a PlanCache.
+     * @param capacity The maximum number of cached plans.
+     */
+    PlanCache(ulong capacity = 1024);
+
+    /**
+     * @brief Builds the shape of a query, the triple patterns with their constants replaced by "$".
+     * @param parser The parsed query.
+     * @return The key of the query in the cache.
+     */
+    static std::string Key(const SPARQLParser& parser);
+
+    /**
+     * @brief Generates the plan of a query, reusing the cached variable order of its shape.
+     * @param index The index the query runs on.
+     * @param parser The parsed query.
+     * @return The plan, bound to the constants of the query.
+     */
+    std::shared_ptr<PlanGenerator> Generate(std::shared_ptr<IndexRetriever>& index,
+                                            std::shared_ptr<SPARQLParser>& parser);
+
+    /**
+     * @brief Drops all plans, called when the index is replaced.
+     */
+    void Clear();
+
+    ulong hits() const;
+
+    ulong misses() const;
+
+    ulong invalidations() const;
+
+    ulong size();
+};
+
+#endif
@@ -4,6 +4,7 @@
 #include <deque>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include "rdf-tdaa/index/index_retriever.hpp"
@@ -62,6 +63,9 @@ class PlanGenerator {
         // Storing retrieval results associated with the item.
         std::span<uint> index_result;
 
+        // The ids of index_result when they are merged with the delta and not a span of the index.
+        std::shared_ptr<std::vector<uint>> owned_result;
+
         // The ID of the triple pattern associated with the item.
         uint triple_pattern_id;
 
@@ -117,12 +121,128 @@ class PlanGenerator {
         Variable& operator=(const Variable& other);
     };
 
+    /**
+     * @struct OptionalItem
+     * @brief A lookup giving the values of a variable of an OPTIONAL triple pattern.
+     *
+     * The variables of an OPTIONAL pattern that are not bound before it are placed after the required
+     * variables. Their values are looked up from the constants of the pattern and the values of the
+     * levels before; a level whose lookups have no common value, or that depends on an unbound level,
+     * is bound to the id 0, which stands for an unbound variable.
+     */
+    struct OptionalItem {
+        // The lookup, kNone when the values do not depend on any level.
+        Item::RType retrieval_type;
+
+        // The arguments of the lookup in the order of the retrieval operation, the id of a constant
+        // argument and -1 as level, or the level of a variable argument.
+        uint first_id;
+        int first_level;
+        uint second_id;
+        int second_level;
+
+        // The values of a lookup that does not depend on any level.
+        std::span<uint> index_result;
+    };
+
+    /**
+     * @struct FilterRange
+     * @brief The ids the range FILTERs on a variable leave to it.
+     *
+     * The literals of the numeric, date and dateTime datatypes have ids in the order of their values, so
+     * the comparison of a variable with a constant of one of them keeps a range of ids, and the candidate
+     * values of the variable are cut by two binary searches. The literals inserted after the database was
+     * built have larger ids and are checked against the conditions.
+     */
+    struct FilterRange {
+        struct Condition {
+            Dictionary::LiteralType type;
+            SPARQLParser::Filter::Type op;
+            std::string lexical;
+        };
+
+        // The first id and the id after the last one.
+        uint first;
+        uint last;
+
+        // The comparisons, no range is kept when it is empty.
+        std::vector<Condition> conditions;
+    };
+
+    /**
+     * @struct FilterItem
+     * @brief A FILTER checked on the tuples, at the level where the last of its variables is bound.
+     *
+     * The ids are compared first, the terms are decoded only when different ids can still be equal
+     * values or when the comparison is an order, see FilterEvaluator.
+     */
+    struct FilterItem {
+        SPARQLParser::Filter::Type type;
+        // The level of the variable of the FILTER.
+        int first_level;
+        SPARQLParser::Term::Positon first_position;
+        // The level of the variable it is compared with, -1 when it is compared with a constant.
+        int second_level;
+        SPARQLParser::Term::Positon second_position;
+        // The id of the constant, 0 when it is not in the database.
+        uint constant_id;
+        std::string constant;
+    };
+
+    /**
+     * @struct ConstantPath
+     * @brief A property path <p>+ or <p>* from a constant, searched by the executor before the levels are enumerated.
+     *
+     * A search from a constant may reach a large part of the graph, so it is not run while planning: the
+     * executor runs it under the deadline and with the threads of the query. The entities reached become a
+     * list the level is joined from; a path between two constants that does not hold means no results.
+     */
+    struct ConstantPath {
+        // The level of the variable of the path, -1 when both of its terms are constants.
+        int level;
+        // The constant the path is followed from, the subject when forward.
+        uint start;
+        // The object of a path between two constants.
+        uint end;
+        // The predicate of the path.
+        uint predicate_id;
+        // Whether the path is followed from subject to object.
+        bool forward;
+        // Whether the path may have no edge, <p>*.
+        bool zero_length;
+    };
+
+    /**
+     * @struct PathItem
+     * @brief A property path <p>+ or <p>* between the variable of a level and a variable of a level before.
+     *
+     * The variables only bound by property paths come after the others in the plan. The values of such a
+     * level are searched from the value of the other level, see PathSearch; when both variables are bound
+     * by other patterns, the path between their values is checked instead.
+     */
+    struct PathItem {
+        // The predicate of the path.
+        uint predicate_id;
+
+        // The level of the other variable of the path, the level itself for ?x <p>+ ?x.
+        uint other_level;
+
+        // Whether the other variable is the subject of the path, the path is then followed forwards from it.
+        bool forward;
+
+        // Whether the path may have no edge, <p>*.
+        bool zero_length;
+    };
+
    private:
     bool debug_ = false;
 
     // A shared pointer to the IndexRetriever instance used for query plan generation.
     std::shared_ptr<IndexRetriever>& index_;
 
+    // Keeps the spans of the delta read by the plan and by its executors valid until the plan is released.
+    std::shared_ptr<DeltaStore::Reader> delta_reader_;
+
     // A vector storing the order of variables used in the query plan.
     std::vector<Variable> variable_order_;
 
@@ -142,6 +262,33 @@ class PlanGenerator {
     // A 2D vector storing pre-retrieved results variable items in query plan.
     std::vector<std::vector<std::span<uint>>> pre_results_;
 
+    // The entities of the property paths in pre_results_ that are not spans of the index, owned by the plan.
+    std::deque<std::vector<uint>> path_results_;
+
+    // The ids of the spans read by the plan that are merged with the delta and not cached by it.
+    std::vector<std::shared_ptr<std::vector<uint>>> merged_results_;
+
+    // The property paths from constants, searched by the executor.
+    std::vector<ConstantPath> constant_paths_;
+
+    // A 2D vector storing the lookups of the levels of the variables only bound by OPTIONAL patterns.
+    std::vector<std::vector<OptionalItem>> optional_items_;
+
+    // All the predicate ids, the values of a predicate variable of an OPTIONAL pattern with no other term known.
+    std::vector<uint> all_predicates_;
+
+    // A 2D vector storing the property paths the values of each level are searched from.
+    std::vector<std::vector<PathItem>> path_items_;
+
+    // A 2D vector storing the property paths checked on the values of each level.
+    std::vector<std::vector<PathItem>> path_checks_;
+
+    // A vector storing the range FILTERs of each level.
+    std::vector<FilterRange> filter_ranges_;
+
+    // A vector storing the other FILTERs of each level.
+    std::vector<std::vector<FilterItem>> filter_items_;
+
     // A flag indicating whether the a predicate has a distinct modifier in the query.
     bool distinct_predicate_ = false;
 
@@ -247,6 +394,54 @@ class PlanGenerator {
                       TripplePattern& two_variable_tp,
                       TripplePattern& three_variable_tp);
 
+    /**
+     * @brief Appends the variables only bound by property paths to the variable order, first those with a
+     * constant at the other end of a path, then those with a path to a variable already in the order.
+     *
+     * @param path_tp The triple patterns with a property path.
+     */
+    void OrderPathVariables(const std::vector<SPARQLParser::TriplePattern>& path_tp);
+
+    /**
+     * @brief Generates the candidate values and the searches of the levels of the variables of the property
+     * paths, a path between two constants is checked once here.
+     *
+     * @param path_tp The triple patterns with a property path.
+     */
+    void GenPathTable(const std::vector<SPARQLParser::TriplePattern>& path_tp);
+
+    /**
+     * @brief Appends the variables first bound by the OPTIONAL triple patterns to the variable order,
+     * pattern by pattern, the predicate before the subject and the object.
+     *
+     * @param optional_tp The OPTIONAL triple patterns.
+     * @param required_variables The variables of the required triple patterns.
+     */
+    void OrderOptionalVariables(TripplePattern& optional_tp,
+                                const std::unordered_set<std::string>& required_variables);
+
+    /**
+     * @brief Generates the lookups of the levels of the variables first bound by the OPTIONAL triple patterns.
+     *
+     * @param optional_tp The OPTIONAL triple patterns.
+     * @param required_variables The variables of the required triple patterns.
+     */
+    void GenOptionalTable(TripplePattern& optional_tp, const std::unordered_set<std::string>& required_variables);
+
+    /**
+     * @brief Generates the FILTERs of each level, a FILTER is kept as a range of ids when it can be,
+     * otherwise as an item checked on the tuples. The FILTERs calling functions are left out.
+     *
+     * @param sparql_parser A shared pointer to the SPARQL parser instance.
+     */
+    void GenFilters(std::shared_ptr<SPARQLParser>& sparql_parser);
+
+    // Turns a comparison of a variable with a numeric, date or dateTime constant into a range of ids.
+    bool GenFilterRange(const SPARQLParser::Filter& filter);
+
+    // Attaches a FILTER to the level where all of its variables are bound.
+    void GenFilterItem(const SPARQLParser::Filter& filter);
+
    public:
     /**
      * @brief Constructs a PlanGenerator instance with the given index retriever and SPARQL parser.
@@ -256,6 +451,22 @@ class PlanGenerator {
      */
     PlanGenerator(std::shared_ptr<IndexRetriever>& index, std::shared_ptr<SPARQLParser>& sparql_parser);
 
+    /**
+     * @brief Constructs a PlanGenerator with the variable order of a query of the same shape.
+     *
+     * The query graph, path search and variable ranking are skipped, only the constants of the query
+     * are bound to ids and the plan table is filled, see PlanCache.
+     *
+     * @param index A shared pointer to the IndexRetriever instance.
+     * @param sparql_parser A shared pointer to the SPARQL parser instance.
+     * @param variable_order The variable order of the plan of the same shape.
+     * @param distinct_predicate Whether that plan only projects distinct predicates.
+     */
+    PlanGenerator(std::shared_ptr<IndexRetriever>& index,
+                  std::shared_ptr<SPARQLParser>& sparql_parser,
+                  const std::vector<std::string>& variable_order,
+                  bool distinct_predicate);
+
     /**
      * @brief Maps a list of variable names to their corresponding Variable objects.
      *
@@ -266,6 +477,9 @@ class PlanGenerator {
 
     std::vector<std::vector<Item>>& query_plan();
 
+    // The values of the variables in the order of the plan.
+    std::vector<std::string> variable_order();
+
     hash_map<std::string, Variable*>& value2variable();
 
     std::vector<std::vector<uint>>& filled_item_indices();
@@ -274,9 +488,29 @@ class PlanGenerator {
 
     std::vector<std::vector<std::span<uint>>>& pre_results();
 
+    std::vector<std::vector<OptionalItem>>& optional_items();
+
+    std::vector<std::vector<PathItem>>& path_items();
+
+    std::vector<std::vector<PathItem>>& path_checks();
+
+    std::vector<ConstantPath>& constant_paths();
+
+    std::vector<FilterRange>& filter_ranges();
+
+    std::vector<std::vector<FilterItem>>& filter_items();
+
     bool zero_result();
 
     bool distinct_predicate();
+
+    /**
+     * @brief A rough number of the steps of the search of the plan: the number of variables times the
+     * values of every level not looked up from an earlier one, the smallest list the level is joined from.
+     * A path from a constant counts the objects, or the subjects, of its predicate. A first level without
+     * lists is bound by a property path or a pattern of three variables and counts every entity.
+     */
+    ulong estimated_cost();
 };
 
 #endif
@@ -1,13 +1,54 @@
 #ifndef QUERY_EXECUTOR_HPP
 #define QUERY_EXECUTOR_HPP
 
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
 #include <string>
+#include <thread>
 #include <vector>
 #include "rdf-tdaa/index/index_retriever.hpp"
+#include "rdf-tdaa/query/filter_evaluator.hpp"
+#include "rdf-tdaa/query/path_search.hpp"
 #include "rdf-tdaa/query/plan_generator.hpp"
+#include "rdf-tdaa/query/result_table.hpp"
+#include "rdf-tdaa/utils/cancellation_token.hpp"
 
 class QueryExecutor {
+   public:
+    // Receives a tuple of the results, its values are in the order of the plan. Returning false stops the query.
+    using Sink = std::function<bool(std::span<const uint> tuple)>;
+
+    // A key of the order of the results, the value of a level compared as the term it is decoded to.
+    struct OrderKey {
+        uint level;
+        SPARQLParser::Term::Positon position;
+        bool descending;
+    };
+
+    // What a level of a profiled query did, see Profile.
+    struct LevelProfile {
+        // the times the candidate values of the level were generated, and the values generated
+        ulong generations = 0;
+        ulong candidates = 0;
+        // the candidate values bound that matched the patterns, filters and paths of the level
+        ulong matches = 0;
+        // the intersections of the level, the lists they intersected, the values of those lists and of the results
+        ulong joins = 0;
+        ulong join_lists = 0;
+        ulong join_input = 0;
+        ulong join_output = 0;
+        // the lookups of the index and the searches of property paths made at the level
+        ulong index_calls = 0;
+        std::chrono::nanoseconds time{0};
+    };
+
+   private:
     using PType = PlanGenerator::Item::PType;
     using RType = PlanGenerator::Item::RType;
 
@@ -18,7 +59,10 @@ class QueryExecutor {
         std::vector<uint> current_tuple;
         std::vector<std::span<uint>> candidate_value;
         std::vector<uint> candidate_indices;
-        std::shared_ptr<std::vector<std::vector<uint>>> result;
+        // the candidate values of each level that are not in the index or the plan, shared with the morsels
+        // split from the stat
+        std::vector<std::shared_ptr<std::vector<uint>>> owned_value;
+        std::shared_ptr<ResultTable> result;
         std::vector<std::vector<PlanGenerator::Item>> plan;
 
         Stat(const std::vector<std::vector<PlanGenerator::Item>>& p);
@@ -28,19 +72,115 @@ class QueryExecutor {
         Stat& operator=(const Stat& other);
     };
 
+    // The candidate values of one level left to enumerate, the levels above are bound in the stat.
+    struct Morsel {
+        int base_level;
+        Stat stat;
+    };
+
+    // The value of an ORDER BY key of a result, its term is decoded by the first comparison that needs it.
+    struct KeyValue {
+        uint id;
+        Dictionary::LiteralType type;
+        std::string term;
+        bool decoded;
+    };
+
+    // tuples a worker buffers before handing them to the sink
+    static constexpr ulong kFlushSize = 1024;
+
     Stat stat_;
     std::shared_ptr<IndexRetriever> index_;
     std::vector<std::vector<uint>>& filled_item_indices_;
     std::vector<std::vector<uint>>& empty_item_indices_;
-    std::vector<std::vector<std::span<uint>>>& pre_results_;
+    // the lists of the plan, and the entities reached by its paths from constants
+    std::vector<std::vector<std::span<uint>>> pre_results_;
+    std::vector<PlanGenerator::ConstantPath>& constant_paths_;
+    std::deque<std::vector<uint>> constant_path_results_;
+    bool constant_paths_searched_;
+    std::vector<std::vector<PlanGenerator::OptionalItem>>& optional_items_;
+    std::vector<PlanGenerator::FilterRange>& filter_ranges_;
+    // the ids above it were inserted after the build and are not in the ranges of the filters
+    uint max_id_;
+    // the filters of each level that are not ranges, checked when the value of the level is bound
+    std::vector<std::vector<PlanGenerator::FilterItem>>& filter_items_;
+    FilterEvaluator filter_evaluator_;
+    // the property paths the values of each level are searched from, and those checked on them
+    std::vector<std::vector<PlanGenerator::PathItem>>& path_items_;
+    std::vector<std::vector<PlanGenerator::PathItem>>& path_checks_;
+    PathSearch path_search_;
     std::vector<std::span<uint>> pre_join_;
+    // the lists of pre_join_ restricted by the filters of their levels
+    std::vector<std::shared_ptr<std::vector<uint>>> pre_join_owned_;
     uint limit_;
     uint shared_cnt_;
     bool skip_pre_result_;
 
+    uint thread_num_;
+    // deques of the workers, a worker takes from the back of its own and steals from the front of others
+    std::vector<std::deque<std::unique_ptr<Morsel>>> morsels_;
+    std::vector<std::mutex> morsel_mutexes_;
+    // morsels queued or running, and those queued
+    std::atomic<ulong> pending_cnt_;
+    std::atomic<ulong> queued_cnt_;
+    std::atomic<uint> idle_cnt_;
+    // idle workers wait here until a morsel is pushed or the last one is done
+    std::mutex idle_mutex_;
+    std::condition_variable idle_cv_;
+    std::atomic<ulong> result_cnt_;
+    // set when the limit is reached, the sink refuses a tuple or the query is cancelled
+    std::atomic<bool> stop_;
+    // polled by the loops of the query, may be null
+    std::shared_ptr<CancellationToken> token_;
+
+    const Sink* sink_;
+    // serializes the tuples the workers hand to the sink
+    std::mutex sink_mutex_;
+    ulong delivered_cnt_;
+    bool sink_closed_;
+
+    // levels of the projected variables of a DISTINCT query
+    std::vector<uint> distinct_levels_;
+    // the levels from here on bind no projected variable, so one match of them is enough
+    int existential_level_;
+    // whether a projected prefix of the plan can repeat, then the projected values seen are kept
+    bool distinct_hash_;
+    phmap::flat_hash_set<ulong> seen_ids_;
+    phmap::flat_hash_set<std::string> seen_rows_;
+
+    // whether the query counts its matches instead of enumerating them
+    bool counting_;
+    // the levels from here on are fed only by the levels before, their counts are multiplied
+    int count_level_;
+    // levels from count_level_ on whose candidate values depend on the levels before
+    std::vector<int> count_levels_;
+    // product of the counts of the other levels from count_level_ on, they are the same for every prefix
+    ulong suffix_cnt_;
+    std::atomic<ulong> count_;
+
+    // levels of OPTIONAL variables whose unbound tuples are dropped
+    std::vector<bool> bound_levels_;
+
+    // keys of ORDER BY, the results reach the sink only when all of them are found
+    std::vector<OrderKey> order_keys_;
+    // bytes of the results Sort keeps in memory, beyond it the sorted results are spilled to files
+    ulong sort_budget_;
+
     std::chrono::duration<double, std::milli> query_duration_;
 
-    std::span<uint> static LeapfrogJoin(JoinList& lists);
+    bool profiling_;
+    std::vector<LevelProfile> profile_;
+
+    // stops early, with a part of the intersection, when the token is cancelled
+    std::span<uint> static LeapfrogJoin(JoinList& lists, CancellationToken* token = nullptr);
+
+    bool Cancelled();
+
+    // the intersection of the lists of a level, recorded in the profile of the level
+    std::span<uint> Join(int level, JoinList& lists);
+
+    // adds the time since start to the profile of a level
+    void Spent(int level, std::chrono::steady_clock::time_point start);
 
     bool PreJoin();
 
@@ -52,23 +192,178 @@ class QueryExecutor {
 
     void GenCandidateValue(Stat& stat);
 
+    // the candidate values of a level bound by OPTIONAL patterns, the unbound value 0 when they have none
+    void GenOptionalValue(Stat& stat);
+
+    // the candidate values of a level only bound by property paths, reached from the values of the levels before
+    void GenPathValue(Stat& stat);
+
+    // checks the property paths between the value of the current level and the values of the levels before
+    bool CheckPaths(Stat& stat);
+
+    // searches the paths from constants with the threads of the query, false when one of them has no match
+    bool SearchConstantPaths();
+
+    // keeps the sorted values of a level that are in the range of its filters, a list of the kept values that
+    // is not a part of values is held by owner
+    std::span<uint> Restrict(uint level, std::span<uint> values, std::shared_ptr<std::vector<uint>>& owner);
+
+    // checks a value inserted after the build against the filters of a level
+    bool InFilterRange(const PlanGenerator::FilterRange& range, uint value);
+
     bool UpdateCurrentTuple(Stat& stat);
 
     bool FillEmptyItem(Stat& stat, uint entity);
 
+    // leaves the existential levels after a tuple, the next tuple differs in a projected level
+    void SkipExistential(Stat& stat);
+
+    // true if the projected values of the tuple have been delivered before
+    bool Seen(std::span<const uint> tuple);
+
+    // the first level from which the candidate values of every level depend only on the levels before it
+    int IndependentLevel();
+
+    // number of matches of the levels from count_level_ on, given the values bound before them in the stat
+    ulong CountSuffix(Stat& stat);
+
+    // enumerates the results of the plan in the order they are found
+    void Execute(const Sink& sink);
+
+    KeyValue MakeKey(uint key, uint id);
+
+    // compares two values of a key like CompareTerms, the literals of one ordered datatype by their ids
+    int CompareKey(uint key, KeyValue& a, KeyValue& b);
+
+    // keeps the first k results in a heap, the keys of a result are decoded only as far as needed to compare it
+    void TopK(const Sink& sink, ulong k);
+
+    // sorts all results, the values of each key are decoded once, or not at all when they are literals of
+    // one ordered datatype, and replaced by their rank; the results beyond the budget are sorted in runs
+    // spilled to temporary files, which are merged at the end
+    void Sort(const Sink& sink);
+
+    // the order of the rows by the keys, rows with equal keys stay in the order they are found
+    void SortRows(const ResultTable& rows, std::vector<ulong>& order);
+
+    // writes the rows in their order to a temporary file, false if it can not be written
+    bool Spill(const ResultTable& rows, std::vector<std::string>& runs);
+
+    // merges the sorted runs of the files into the sink
+    void MergeRuns(const std::vector<std::string>& runs, const Sink& sink);
+
+    // splits [0, n) into one range per thread and runs them in parallel
+    void ParallelFor(ulong n, const std::function<void(ulong begin, ulong end)>& f);
+
+    void ParallelQuery();
+
+    void Worker(uint worker_id);
+
+    // hands the tuples buffered by a worker to the sink
+    void Flush(ResultTable& tuples);
+
+    bool PopMorsel(uint worker_id, std::unique_ptr<Morsel>& morsel);
+
+    void PushMorsel(uint worker_id, std::unique_ptr<Morsel> morsel);
+
+    // enumerates the values of a morsel, its tuples are appended to stat.result, or counted
+    void Enumerate(uint worker_id, Stat& stat, int base_level);
+
+    // gives half of the values left on the shallowest level of the stat to an idle worker
+    void Split(uint worker_id, Stat& stat, int base_level);
+
    public:
     std::span<uint> static LeapfrogJoin(const std::vector<std::span<uint>>& lists);
 
+    // Compares two terms: unbound values, then blank nodes, IRIs and literals, the literals of an ordered
+    // datatype by their value.
+    static int CompareTerms(const std::string& a, const std::string& b);
+
     QueryExecutor(std::shared_ptr<IndexRetriever> index,
                   std::shared_ptr<PlanGenerator>& plan,
                   uint limit,
-                  uint shared_cnt);
+                  uint shared_cnt,
+                  uint thread_num = 1);
+
+    /**
+     * @brief Makes the query deliver every combination of the projected values once. The levels after
+     * the last projected one are only checked for one match instead of being enumerated, the other
+     * duplicates are dropped by a hash set of the projected values.
+     * @param levels The levels of the projected variables in the plan.
+     */
+    void Distinct(const std::vector<uint>& levels);
+
+    /**
+     * @brief Makes the query drop the tuples in which a variable of an OPTIONAL pattern is unbound, as
+     * COUNT(?v) only counts the matches that bind ?v.
+     * @param levels The levels of the variables.
+     */
+    void RequireBound(const std::vector<uint>& levels);
+
+    /**
+     * @brief Makes the query deliver its results sorted by the keys. With a limit, the first results are
+     * kept in a bounded heap, otherwise all results are sorted in parallel. The limit then applies to the
+     * sorted results.
+     * @param keys The keys, the first one is compared first.
+     */
+    void OrderBy(const std::vector<OrderKey>& keys);
+
+    // Default bytes of the results sorted in memory.
+    static constexpr ulong kSortBudget = 1ul << 30;
 
+    /**
+     * @brief Limits the memory of the sort of the results without a limit.
+     * @param bytes The budget, the results beyond it are sorted in runs spilled to temporary files.
+     */
+    void SortBudget(ulong bytes);
+
+    /**
+     * @brief Makes the query stop when the token is cancelled. The tuples delivered before stay
+     * delivered, a query with ORDER BY delivers none, and a count stops with the matches counted so far.
+     * @param token The token polled by the enumeration, the joins and the searches of property paths.
+     */
+    void CancelBy(std::shared_ptr<CancellationToken> token);
+
+    /**
+     * @brief Makes the query record what each level does: the candidate values generated and matched,
+     * the intersections, the lookups of the index and the time spent. The query then runs on one thread,
+     * and reads the clock on every value, so its time is not that of the query alone.
+     */
+    void Profile();
+
+    /**
+     * @brief Enumerates the results of the plan. With more than one thread, the candidate values of the
+     * first level are split into morsels, and levels that fan out are split again whenever a worker is
+     * idle. The order of the results is then not the order of a single thread.
+     */
     void Query();
 
+    /**
+     * @brief Enumerates the results of the plan and hands every tuple to a sink as soon as it is found,
+     * without keeping the results. The workers of a parallel query buffer a few tuples before calling
+     * the sink, the calls never overlap.
+     * @param sink Receives the tuples, returning false stops the query.
+     */
+    void Query(const Sink& sink);
+
+    /**
+     * @brief Counts the results of the plan without building them. The levels at the end of the plan
+     * whose candidate values only depend on the levels bound before them are not enumerated, the sizes
+     * of their candidate values are multiplied for each prefix. After Distinct, the distinct
+     * combinations of the projected values are counted. The limit of the query does not apply.
+     * @return The number of results.
+     */
+    ulong Count();
+
     double query_duration();
 
-    std::vector<std::vector<uint>>& result();
+    // the profile of each level, empty unless Profile was called
+    const std::vector<LevelProfile>& profile() const;
+
+    // the values of the levels intersected before the enumeration, empty for the levels that are not
+    const std::vector<std::span<uint>>& pre_join() const;
+
+    ResultTable& result();
 };
 
 #endif  // QUERY_EXECUTOR_HPP
@@ -0,0 +1,73 @@
+#ifndef QUERY_EXPLAINER_HPP
+#define QUERY_EXPLAINER_HPP
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "rdf-tdaa/index/index_retriever.hpp"
+#include "rdf-tdaa/parser/sparql_parser.hpp"
+#include "rdf-tdaa/query/plan_generator.hpp"
+#include "rdf-tdaa/query/query_executor.hpp"
+#include "rdf-tdaa/utils/cancellation_token.hpp"
+
+/**
+ * @class QueryExplainer
+ * @brief Describes the plan of a query as JSON: the order of its variables, the estimated candidates of
+ * each level and the lookups the level is joined from. With ANALYZE, the query is also executed on one
+ * thread and what each level did is added: the candidate values generated and matched, the intersections,
+ * the lookups of the index and the time spent.
+ *
+ * The alternatives of a query with UNION are described one by one, each with the matches of its own plan.
+ */
+class QueryExplainer {
+   public:
+    // Plans a parsed query, or an alternative of a query with UNION.
+    using Planner = std::function<std::shared_ptr<PlanGenerator>(std::shared_ptr<SPARQLParser>& parser)>;
+
+   private:
+    struct Branch {
+        std::shared_ptr<SPARQLParser> parser;
+        std::shared_ptr<PlanGenerator> plan;
+    };
+
+    std::shared_ptr<IndexRetriever> index_;
+    std::shared_ptr<SPARQLParser> parser_;
+    std::vector<Branch> branches_;
+    std::chrono::duration<double, std::milli> plan_time_;
+    // polled by the executors of an analyzed query, may be null
+    std::shared_ptr<CancellationToken> token_;
+
+    // executes the plan of a branch, the profile of its levels is empty when it has no results
+    std::shared_ptr<QueryExecutor> Analyze(Branch& branch, ulong& rows, double& execute_time);
+
+   public:
+    /**
+     * @brief Strips the keywords EXPLAIN or EXPLAIN ANALYZE, in any case, from the start of a query.
+     * @param query The text of the query, left without the keywords.
+     * @param analyze Set to whether the query is to be executed.
+     * @return Whether the query asked for its plan.
+     */
+    static bool Strip(std::string& query, bool& analyze);
+
+    // plans the query, or every alternative of a query with UNION
+    QueryExplainer(std::shared_ptr<IndexRetriever> index,
+                   std::shared_ptr<SPARQLParser> parser,
+                   const Planner& planner);
+
+    void CancelBy(std::shared_ptr<CancellationToken> token);
+
+    // the estimated cost of the plans, summed over the alternatives of a query with UNION
+    ulong estimated_cost();
+
+    /**
+     * @brief Describes the plans of the query.
+     * @param analyze Whether the query is executed to describe what its levels did. The rows are then
+     * counted without being decoded, ORDER BY is left out and a COUNT query counts its matches.
+     * @return The JSON of the plans.
+     */
+    std::string Explain(bool analyze);
+};
+
+#endif  // QUERY_EXPLAINER_HPP
@@ -0,0 +1,100 @@
+#ifndef RESULT_PROJECTOR_HPP
+#define RESULT_PROJECTOR_HPP
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+#include "rdf-tdaa/index/index_retriever.hpp"
+#include "rdf-tdaa/parser/sparql_parser.hpp"
+#include "rdf-tdaa/query/result_table.hpp"
+
+/**
+ * @class ResultProjector
+ * @brief Decodes the projected ids of the rows of a query to their terms, each distinct id once.
+ *
+ * The rows are buffered in batches. Before a batch is emitted, the ids of its columns that have not been
+ * decoded yet are collected, sorted, which is the order of their offsets in the dictionary, and decoded
+ * together, by several threads when there are many of them. The terms are kept for the rest of the query,
+ * so an id repeated in many rows is decoded once, until the kept terms exceed a bound and are dropped.
+ */
+class ResultProjector {
+   public:
+    // The ids of a row with the positions they are decoded by and their terms, nullptr for an unbound
+    // variable. Returns false to stop the query.
+    using Sink = std::function<bool(std::span<const uint> ids,
+                                    std::span<const SPARQLParser::Term::Positon> positions,
+                                    std::span<const std::string* const> terms)>;
+
+   private:
+    // rows buffered before their terms are decoded
+    static constexpr ulong kBatchRows = 4096;
+    // fewer new ids in a batch are decoded by the calling thread
+    static constexpr ulong kParallelTerms = 4096;
+    // the kept terms are dropped before a batch when there are more of them
+    static constexpr ulong kMaxTerms = 1 << 20;
+
+    std::shared_ptr<IndexRetriever> index_;
+    uint thread_num_;
+    Sink sink_;
+
+    ResultTable rows_;
+    // the positions of the values of the buffered rows
+    std::vector<SPARQLParser::Term::Positon> positions_;
+    // predicates have their own ids, the string of an entity id does not depend on its position
+    hash_map<uint, std::string> entities_;
+    hash_map<uint, std::string> predicates_;
+    // the bytes of the kept terms, of this projector and of all of them
+    ulong bytes_;
+    static std::atomic<ulong> all_bytes_;
+
+    std::chrono::nanoseconds decode_time_;
+    std::chrono::nanoseconds emit_time_;
+
+    void DropTerms();
+
+    // decodes the sorted ids that are not in terms
+    void Decode(std::vector<uint>& ids, bool predicate, hash_map<uint, std::string>& terms);
+
+   public:
+    /**
+     * @param index The index of the database.
+     * @param columns The number of values of a row.
+     * @param thread_num The threads decoding the ids of a large batch.
+     * @param sink Receives the terms of the rows in the order they were added.
+     */
+    ResultProjector(std::shared_ptr<IndexRetriever> index,
+                    uint columns,
+                    uint thread_num,
+                    Sink sink);
+
+    ~ResultProjector();
+
+    /**
+     * @brief Adds a row, emitting the buffered rows when the batch is full.
+     * @param row The ids of the columns, 0 for an unbound variable.
+     * @param positions The positions of the variables of the columns, predicates are decoded by their own ids.
+     * @return False if the sink stopped the query.
+     */
+    bool Add(std::span<const uint> row, std::span<const SPARQLParser::Term::Positon> positions);
+
+    /**
+     * @brief Decodes and emits the buffered rows.
+     * @return False if the sink stopped the query.
+     */
+    bool Flush();
+
+    // the time spent decoding ids
+    std::chrono::nanoseconds decode_time() const;
+
+    // the time spent in the sink
+    std::chrono::nanoseconds emit_time() const;
+
+    // the bytes of the terms kept by the projectors of the running queries
+    static ulong decoded_bytes();
+};
+
+#endif  // RESULT_PROJECTOR_HPP
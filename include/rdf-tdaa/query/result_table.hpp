@@ -0,0 +1,46 @@
+#ifndef RESULT_TABLE_HPP
+#define RESULT_TABLE_HPP
+
+#include <span>
+#include <vector>
+#include "sys/types.h"
+
+/**
+ * @class ResultTable
+ * @brief The bindings of a query, stored row by row in one contiguous array.
+ *
+ * Every row has the same width, one value per variable in the order of the plan, so appending a row
+ * never allocates on its own and the rows are read linearly.
+ */
+class ResultTable {
+    uint width_;
+    std::vector<uint> values_;
+
+   public:
+    ResultTable(uint width = 0);
+
+    uint width() const;
+
+    // Number of rows.
+    ulong size() const;
+
+    bool empty() const;
+
+    void Reserve(ulong rows);
+
+    void Append(std::span<const uint> row);
+
+    std::span<uint> operator[](ulong row);
+
+    std::span<const uint> operator[](ulong row) const;
+
+    void Clear();
+
+    /**
+     * @brief Keeps the first rows of the table.
+     * @param rows The number of rows to keep.
+     */
+    void Truncate(ulong rows);
+};
+
+#endif
@@ -0,0 +1,114 @@
+#ifndef UNION_EXECUTOR_HPP
+#define UNION_EXECUTOR_HPP
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <vector>
+#include "rdf-tdaa/index/index_retriever.hpp"
+#include "rdf-tdaa/parser/sparql_parser.hpp"
+#include "rdf-tdaa/query/plan_generator.hpp"
+#include "rdf-tdaa/query/query_executor.hpp"
+
+/**
+ * @class UnionExecutor
+ * @brief Executes a query with UNION as one query per alternative, each with its own plan and executor.
+ *
+ * The branches run at the same time on threads of their own and share the threads of the query. Their
+ * tuples are turned into rows of the projected variables, a variable a branch does not bind is unbound,
+ * and handed to a single sink. The limit of the query applies to the rows of all branches.
+ */
+class UnionExecutor {
+   public:
+    using Positon = SPARQLParser::Term::Positon;
+
+    // Receives a row, the values of the projected variables, 0 for an unbound one, and their positions.
+    // Returning false stops the query.
+    using Sink = std::function<bool(std::span<const uint> row, std::span<const Positon> positions)>;
+
+   private:
+    struct Branch {
+        std::shared_ptr<PlanGenerator> plan;
+        std::shared_ptr<QueryExecutor> executor;
+        // levels of the projected variables in the plan, -1 for a variable the branch does not bind
+        std::vector<int> levels;
+        std::vector<Positon> positions;
+        // levels and positions of the variables of ORDER BY
+        std::vector<int> key_levels;
+        std::vector<Positon> key_positions;
+    };
+
+    std::shared_ptr<IndexRetriever> index_;
+    std::shared_ptr<SPARQLParser> parser_;
+    // the branches whose plans may have results
+    std::vector<Branch> branches_;
+    uint limit_;
+    // whether the rows found by more than one branch are delivered once
+    bool distinct_;
+
+    // serializes the rows the branches hand to the sink
+    std::mutex sink_mutex_;
+    ulong delivered_cnt_;
+    bool sink_closed_;
+    // the rows delivered by a DISTINCT query, their values and whether they are predicates
+    phmap::flat_hash_set<std::string> seen_rows_;
+
+    // polled by the executors of the branches, may be null
+    std::shared_ptr<CancellationToken> token_;
+    std::chrono::duration<double, std::milli> query_duration_;
+
+    // runs a function for every branch, on a thread per branch
+    void ForEachBranch(const std::function<void(Branch& branch)>& f);
+
+    // the levels of the projected variables bound by a branch
+    std::vector<uint> BoundLevels(const Branch& branch);
+
+    // the values of the projected variables in a tuple of a branch
+    void Project(const Branch& branch, std::span<const uint> tuple, std::vector<uint>& row);
+
+    // hands a row to the sink, false once no more rows are wanted; the caller holds sink_mutex_
+    bool Deliver(const Sink& sink, std::span<const uint> row, std::span<const Positon> positions);
+
+    // merges the sorted rows of the branches
+    void Sort(const Sink& sink);
+
+   public:
+    /**
+     * @brief Prepares the executors of the branches of a query.
+     * @param index The index of the database.
+     * @param parser The query with UNION.
+     * @param plans The plans of the queries of parser->Branches(), in their order.
+     * @param thread_num The threads of the query, shared by the branches.
+     */
+    UnionExecutor(std::shared_ptr<IndexRetriever> index,
+                  std::shared_ptr<SPARQLParser> parser,
+                  const std::vector<std::shared_ptr<PlanGenerator>>& plans,
+                  uint thread_num = 1);
+
+    /**
+     * @brief Makes the executors of all branches stop when the token is cancelled, as QueryExecutor::CancelBy.
+     */
+    void CancelBy(std::shared_ptr<CancellationToken> token);
+
+    /**
+     * @brief Runs the branches and hands their rows to a sink as they are found, in no particular order.
+     * With DISTINCT the rows found by several branches are delivered once, and with ORDER BY the sorted
+     * rows of the branches are merged before they are delivered.
+     * @param sink Receives the rows, the calls never overlap.
+     */
+    void Query(const Sink& sink);
+
+    /**
+     * @brief Counts the results of a COUNT query, the sum of the counts of the branches. COUNT(DISTINCT)
+     * of more than one branch enumerates the distinct rows of the branches to count the rows they share once.
+     * @return The number of results.
+     */
+    ulong Count();
+
+    double query_duration();
+};
+
+#endif  // UNION_EXECUTOR_HPP
@@ -2,6 +2,8 @@
 #define RDF_TDAA_HPP
 
 #include <string>
+#include <vector>
+#include "rdf-tdaa/server/admission_controller.hpp"
 
 namespace rdftdaa {
 
@@ -13,9 +15,33 @@ class RDFTDAA {
 
     static void Create(const std::string& db_name, const std::string& data_file);
 
-    static void Query(const std::string& db_path, const std::string& data_file);
-
-    static void Server(const std::string& ip, const std::string& port, const std::string& db);
+    static void Merge(const std::string& db_name, const std::vector<std::string>& source_paths);
+
+    static void Pack(const std::string& db_path, const std::string& image_path);
+
+    static void Verify(const std::string& image_path);
+
+    static void Query(const std::string& db_path, const std::string& data_file, uint thread_num);
+
+    static void Bench(const std::string& db_path,
+                      const std::string& data_file,
+                      uint thread_num,
+                      uint worker_num,
+                      uint warmup,
+                      uint repetitions,
+                      const std::string& output);
+
+    static void Server(const std::string& ip,
+                       const std::string& port,
+                       const std::string& db,
+                       uint thread_num,
+                       uint timeout,
+                       bool partial,
+                       AdmissionController::Limits light_lane,
+                       AdmissionController::Limits heavy_lane,
+                       ulong heavy_cost,
+                       ulong result_cache_bytes,
+                       uint result_cache_ttl);
 };
 
 }  // namespace rdftdaa
@@ -0,0 +1,91 @@
+#ifndef ADMISSION_CONTROLLER_HPP
+#define ADMISSION_CONTROLLER_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include "rdf-tdaa/utils/cancellation_token.hpp"
+
+/**
+ * @class AdmissionController
+ * @brief Admits the queries of the endpoint into two lanes, one for the light queries and one for the heavy
+ * ones, so that a few analytical queries can not hold all the threads of the server.
+ *
+ * A query goes to the heavy lane when the estimated cost of its plan reaches a threshold. Each lane runs
+ * at most a number of queries at a time and keeps at most a number of queries waiting for them, a query
+ * arriving at a lane whose queue is full is shed.
+ */
+class AdmissionController {
+   public:
+    enum Lane { kLight, kHeavy };
+
+    struct Limits {
+        // queries running at the same time
+        uint queries;
+        // queries waiting for one of them to end
+        uint queue;
+    };
+
+    /**
+     * @class Slot
+     * @brief The place of a running query in its lane, given back when it is destroyed.
+     */
+    class Slot {
+        friend class AdmissionController;
+
+        AdmissionController* controller_;
+        Lane lane_;
+
+        Slot(AdmissionController* controller, Lane lane);
+
+       public:
+        Slot(const Slot&) = delete;
+
+        Slot& operator=(const Slot&) = delete;
+
+        ~Slot();
+
+        Lane lane() const;
+    };
+
+   private:
+    // how often a waiting query checks whether it has been cancelled
+    static constexpr std::chrono::milliseconds kWaitInterval{100};
+
+    struct LaneState {
+        Limits limits;
+        uint running = 0;
+        uint waiting = 0;
+        std::condition_variable released;
+    };
+
+    std::mutex mutex_;
+    LaneState lanes_[2];
+    ulong heavy_cost_;
+
+    void Release(Lane lane);
+
+   public:
+    /**
+     * @param light The limits of the light lane.
+     * @param heavy The limits of the heavy lane.
+     * @param heavy_cost The estimated cost from which a query is heavy, see PlanGenerator::estimated_cost.
+     */
+    AdmissionController(Limits light, Limits heavy, ulong heavy_cost);
+
+    Lane Route(ulong cost) const;
+
+    /**
+     * @brief Waits until the lane has room for the query.
+     * @param lane The lane of the query.
+     * @param token The token of the query, a query cancelled or timed out while waiting is not admitted.
+     * @return The slot of the query, nullptr if the queue of the lane is full or the query was cancelled.
+     */
+    std::shared_ptr<Slot> Admit(Lane lane, CancellationToken& token);
+
+    // the threads serving requests needed by the queries of both lanes, running or waiting
+    uint threads() const;
+};
+
+#endif  // ADMISSION_CONTROLLER_HPP
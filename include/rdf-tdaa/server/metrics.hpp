@@ -0,0 +1,108 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include "sys/types.h"
+
+/**
+ * @class Metrics
+ * @brief The counters of the queries of the endpoint and the histograms of the time of their phases,
+ * written in the text format of Prometheus.
+ *
+ * The values are atomics updated with relaxed operations, a query never waits for another one to record
+ * its times.
+ */
+class Metrics {
+   public:
+    enum Phase { kParse, kPlan, kExecute, kProjection, kSerialize };
+
+    /**
+     * @class Histogram
+     * @brief Counts of durations by the upper bounds of their buckets, with their sum.
+     */
+    class Histogram {
+       public:
+        // the upper bounds of the buckets in seconds, the last bucket is +Inf
+        static constexpr double kBounds[] = {0.0001, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05,
+                                             0.1,    0.25,   0.5,   1,      2.5,   5,    10,   30};
+        static constexpr uint kBuckets = sizeof(kBounds) / sizeof(kBounds[0]) + 1;
+
+       private:
+        std::atomic<ulong> counts_[kBuckets];
+        std::atomic<ulong> sum_;
+
+       public:
+        Histogram();
+
+        void Observe(std::chrono::nanoseconds duration);
+
+        /**
+         * @brief Appends the buckets, the sum and the count of the histogram.
+         * @param name The name of the metric.
+         * @param labels The labels of the histogram, such as phase="parse".
+         */
+        void Write(std::string& out, const std::string& name, const std::string& labels) const;
+    };
+
+    /**
+     * @class InFlight
+     * @brief A query being answered, counted until it is destroyed with the response.
+     */
+    class InFlight {
+        Metrics& metrics_;
+
+       public:
+        InFlight(Metrics& metrics);
+
+        InFlight(const InFlight&) = delete;
+
+        InFlight& operator=(const InFlight&) = delete;
+
+        ~InFlight();
+    };
+
+   private:
+    static constexpr uint kPhases = kSerialize + 1;
+    static constexpr const char* kPhaseNames[] = {"parse", "plan", "execute", "projection", "serialize"};
+
+    Histogram phases_[kPhases];
+    std::atomic<ulong> queries_;
+    std::atomic<ulong> results_;
+    std::atomic<ulong> errors_;
+    std::atomic<ulong> timeouts_;
+    std::atomic<ulong> in_flight_;
+
+   public:
+    Metrics();
+
+    void Observe(Phase phase, std::chrono::nanoseconds duration);
+
+    void AddQuery();
+
+    void AddResults(ulong results);
+
+    // a query answered with an error status
+    void AddError();
+
+    void AddTimeout();
+
+    /**
+     * @brief Writes the metrics of the queries in the text format of Prometheus.
+     * @param out The text the metrics are appended to.
+     */
+    void Write(std::string& out) const;
+
+    /**
+     * @brief Appends a metric with one value.
+     * @param type "counter" or "gauge".
+     */
+    static void WriteValue(std::string& out,
+                           const std::string& name,
+                           const std::string& type,
+                           const std::string& help,
+                           double value);
+};
+
+#endif  // METRICS_HPP
@@ -0,0 +1,101 @@
+#ifndef RESULT_CACHE_HPP
+#define RESULT_CACHE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "rdf-tdaa/dictionary/dictionary.hpp"
+
+/**
+ * @class ResultCache
+ * @brief A cache of the serialized responses of the queries of the endpoint, a repeated query is answered
+ * with a copy of its response.
+ *
+ * The responses are keyed by the normalized text of the query and the format of the response, for one
+ * version of the database: an entry of an older version is dropped when a newer one is seen. The entries
+ * are evicted least recently used first to keep them within a budget of bytes, and expire after a time.
+ */
+class ResultCache {
+   public:
+    struct Response {
+        std::string content_type;
+        std::string body;
+    };
+
+   private:
+    struct Entry {
+        std::shared_ptr<const Response> response;
+        std::chrono::steady_clock::time_point expiry;
+        // the place of the key in the recency list
+        std::list<std::string>::iterator recency;
+    };
+
+    ulong capacity_;
+    std::chrono::seconds ttl_;
+    std::mutex mutex_;
+    hash_map<std::string, Entry> entries_;
+    // the keys, the most recently used first
+    std::list<std::string> recency_;
+    ulong bytes_;
+    // the version of the database of the entries
+    ulong version_;
+
+    std::atomic<ulong> hits_;
+    std::atomic<ulong> misses_;
+    std::atomic<ulong> evictions_;
+    std::atomic<ulong> invalidations_;
+
+    void Erase(hash_map<std::string, Entry>::iterator it);
+
+    // drops the entries of an older version, called with the mutex held
+    void Update(ulong version);
+
+   public:
+    /**
+     * @param capacity The budget of bytes of the responses, 0 disables the cache.
+     * @param ttl The time an entry is kept, 0 for no limit.
+     */
+    ResultCache(ulong capacity = 0, std::chrono::seconds ttl = std::chrono::seconds(0));
+
+    /**
+     * @brief The text of a query with its white space outside of literals and IRIs collapsed, so queries
+     * written differently share an entry.
+     */
+    static std::string Normalize(const std::string& query);
+
+    bool enabled() const;
+
+    // the largest response kept, a response is not collected beyond it
+    ulong max_response() const;
+
+    /**
+     * @brief Finds the response of a query.
+     * @param key The key of the query and its format.
+     * @param version The version of the database the query runs on.
+     * @return The response, nullptr when it is not cached.
+     */
+    std::shared_ptr<const Response> Lookup(const std::string& key, ulong version);
+
+    /**
+     * @brief Keeps the complete response of a query, evicting the least recently used ones to make room.
+     * @param version The version of the database the query ran on, read before it started.
+     */
+    void Insert(const std::string& key, ulong version, std::string content_type, std::string body);
+
+    ulong hits() const;
+
+    ulong misses() const;
+
+    ulong evictions() const;
+
+    ulong invalidations() const;
+
+    ulong bytes();
+
+    ulong size();
+};
+
+#endif  // RESULT_CACHE_HPP
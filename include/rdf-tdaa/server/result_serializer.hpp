@@ -0,0 +1,99 @@
+#ifndef RESULT_SERIALIZER_HPP
+#define RESULT_SERIALIZER_HPP
+
+#include <functional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "rapidjson/stringbuffer.h"
+#include "rapidjson/writer.h"
+#include "rdf-tdaa/dictionary/dictionary.hpp"
+#include "rdf-tdaa/parser/sparql_parser.hpp"
+
+/**
+ * @class ResultSerializer
+ * @brief Writes the rows of a query in the format asked for by the client, in chunks while they are found.
+ *
+ * The formats are the SPARQL 1.1 JSON, TSV and CSV results and a binary format of rows of ids. The binary
+ * format starts with "RTB1", the number of variables and the variables, every row has a value per
+ * variable: 0 for an unbound variable, 1 followed by a term that is not kept, or the key of the term plus
+ * 2, followed by the term the first time the key is sent. The key of a term is its id shifted left by one,
+ * plus one for a predicate. Numbers are varints, 7 bits per byte with the high bit set on all but the last,
+ * and a term is its length followed by its bytes.
+ */
+class ResultSerializer {
+   public:
+    enum Format { kJSON, kTSV, kCSV, kBinary };
+
+    // Sends a chunk of the response, returns false when the client has gone away.
+    using Write = std::function<bool(const char* data, size_t size)>;
+
+   private:
+    // bytes buffered before a chunk is sent
+    static constexpr size_t kChunkSize = 64 * 1024;
+
+    Format format_;
+    Write write_;
+    rapidjson::StringBuffer buffer_;
+    rapidjson::Writer<rapidjson::StringBuffer> writer_;
+    // the variables without '?', the keys of the JSON bindings
+    std::vector<std::string> variables_;
+    // the keys of the terms sent in the binary format
+    phmap::flat_hash_set<ulong> sent_;
+
+    void Append(std::string_view data);
+
+    void Varint(ulong value);
+
+    // a term in the binary format, its length and bytes
+    void BinaryTerm(std::string_view term);
+
+    // a binding of a SPARQL JSON result, with the type of the term and its value without the N-Triples syntax
+    void JSONTerm(std::string_view term);
+
+    // a field of a CSV result, the lexical form of a literal and an IRI without brackets
+    void CSVTerm(std::string_view term);
+
+    // sends the buffered bytes once they are a chunk
+    bool Send();
+
+   public:
+    /**
+     * @brief The format of the first media type in an Accept header the serializer writes, the one with
+     * the highest quality if they have one. SPARQL JSON when there is none.
+     */
+    static Format Negotiate(const std::string& accept);
+
+    static const char* ContentType(Format format);
+
+    /**
+     * @param format The format of the response.
+     * @param variables The projected variables.
+     * @param write Sends the chunks of the response.
+     */
+    ResultSerializer(Format format, const std::vector<std::string>& variables, Write write);
+
+    /**
+     * @brief Writes a row, sending the buffered bytes when they are a chunk.
+     * @param ids The ids of the terms, used by the binary format.
+     * @param positions The positions the ids are decoded by.
+     * @param terms The terms, nullptr for an unbound variable.
+     * @return False if the client has gone away.
+     */
+    bool Row(std::span<const uint> ids,
+             std::span<const SPARQLParser::Term::Positon> positions,
+             std::span<const std::string* const> terms);
+
+    /**
+     * @brief Writes the row of a COUNT query, an xsd:integer.
+     */
+    bool Count(ulong count);
+
+    /**
+     * @brief Ends the result and sends the rest of it.
+     */
+    bool Finish();
+};
+
+#endif  // RESULT_SERIALIZER_HPP
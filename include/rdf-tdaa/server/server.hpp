@@ -2,25 +2,170 @@
 #define SERVER_HPP
 
 #include <httplib.h>
+#include <atomic>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <list>
+#include <mutex>
 #include <set>
 #include <string>
+#include <thread>
 #include <unordered_set>
 #include <utility>
 
 #include "rdf-tdaa/index/index_retriever.hpp"
+#include "rdf-tdaa/query/plan_cache.hpp"
+#include "rdf-tdaa/server/admission_controller.hpp"
+#include "rdf-tdaa/server/metrics.hpp"
+#include "rdf-tdaa/server/result_cache.hpp"
+#include "rdf-tdaa/server/result_serializer.hpp"
+#include "rdf-tdaa/utils/cancellation_token.hpp"
 
 class Endpoint {
+    // threads of the server for the requests other than queries
+    static constexpr uint kServiceThreads = 4;
+    // prepared statements kept, the least recently used is closed when another one is prepared
+    static constexpr ulong kStatementCapacity = 4096;
+
+    // how a query is answered, taken from the headers and parameters of its request
+    struct QueryOptions {
+        ResultSerializer::Format format;
+        // cancels the query at its deadline or when the client has gone away
+        std::shared_ptr<CancellationToken> token;
+        // whether a query that times out returns the results found before, otherwise its response is cut off
+        bool partial;
+        // the key of the response in the result cache, empty when it is not cached
+        std::string cache_key;
+        // the version of the database when the query arrived
+        ulong version;
+        // counts the query in flight until its response is sent
+        std::shared_ptr<Metrics::InFlight> in_flight;
+    };
+
+    std::shared_ptr<IndexRetriever> db_index_;
+    std::mutex db_index_mutex_;
+    // serializes the updates with the replacement of the index at the end of a compaction
+    std::mutex update_mutex_;
+    std::thread compaction_;
+    std::atomic<bool> compacting_;
+    // plans of the queries by their shape, dropped when a compaction replaces the index
+    PlanCache plan_cache_;
+
+    struct Statement {
+        // the text of the query, the key of the statement in statement_handles_
+        std::string query;
+        // the query with placeholders
+        std::shared_ptr<SPARQLParser> parser;
+        // the place of the handle in the recency list
+        std::list<std::string>::iterator recency;
+    };
+
+    // prepared statements by their handles
+    std::mutex statements_mutex_;
+    hash_map<std::string, Statement> statements_;
+    // query -> handle, preparing a query again returns its handle
+    hash_map<std::string, std::string> statement_handles_;
+    // the handles, the most recently used first
+    std::list<std::string> statement_recency_;
+    // the number of the next handle, handles are not reused after their statements are closed
+    ulong next_statement_;
+    // the light and heavy lanes of the queries, made by start_server
+    std::unique_ptr<AdmissionController> admission_;
+    // responses of the queries by their text, made by start_server
+    std::unique_ptr<ResultCache> result_cache_;
+    // counters and phase latencies of the queries, see metrics()
+    Metrics metrics_;
+
+    QueryOptions query_options(const httplib::Request& req);
+
+    // answers a query with its cached response, if there is one
+    bool cached(httplib::Response& res, const QueryOptions& options);
+
+    // admits a query by the estimated cost of its plan, the response is a 503 when it is not admitted
+    std::shared_ptr<AdmissionController::Slot> admit(httplib::Response& res,
+                                                     ulong cost,
+                                                     const std::shared_ptr<CancellationToken>& token);
+
+    // plans and executes a parsed query and writes the results to the response
+    void execute_query(httplib::Response& res,
+                       std::shared_ptr<IndexRetriever>& db_index,
+                       std::shared_ptr<SPARQLParser>& parser,
+                       const QueryOptions& options);
+
+    // plans every alternative of a query with UNION and writes the rows of all of them to the response
+    void execute_union_query(httplib::Response& res,
+                             std::shared_ptr<IndexRetriever>& db_index,
+                             std::shared_ptr<SPARQLParser>& parser,
+                             const QueryOptions& options);
+
+    // writes the plan of a query as JSON, with analyze the query is admitted and executed to profile it
+    void explain_query(httplib::Response& res,
+                       std::shared_ptr<IndexRetriever>& db_index,
+                       std::shared_ptr<SPARQLParser>& parser,
+                       bool analyze,
+                       const QueryOptions& options);
+
    public:
     std::string db_name;
-    std::shared_ptr<IndexRetriever> db_index;
+    // incremented by every change of the data
+    std::atomic<ulong> db_version;
+    // threads of a query
+    uint thread_num;
+    // milliseconds a query may run, 0 for no limit; a request may ask for less with the parameter timeout
+    uint timeout;
+    // whether a query that times out returns the results found before, unless its request sets on_timeout
+    bool partial_results;
+    // the queries with a plan cheaper than heavy_cost are light, they run on one thread
+    AdmissionController::Limits light_lane;
+    AdmissionController::Limits heavy_lane;
+    ulong heavy_cost;
+    // bytes of the responses kept by the result cache, 0 for no cache, and the seconds they are kept
+    ulong result_cache_bytes;
+    uint result_cache_ttl;
 
-    Endpoint() {}
+    Endpoint()
+        : compacting_(false),
+          next_statement_(1),
+          db_version(0),
+          thread_num(1),
+          timeout(0),
+          partial_results(false),
+          light_lane({8, 64}),
+          heavy_lane({2, 16}),
+          heavy_cost(1000000),
+          result_cache_bytes(0),
+          result_cache_ttl(0) {}
+
+    ~Endpoint();
+
+    std::shared_ptr<IndexRetriever> index();
 
     void query(const httplib::Request& req, httplib::Response& res);
 
+    // parses a query with $placeholders once and returns a handle to execute it
+    void prepare(const httplib::Request& req, httplib::Response& res);
+
+    // executes a prepared statement, the parameters of the request named "$..." bind the placeholders
+    void execute(const httplib::Request& req, httplib::Response& res);
+
+    // hit and miss counts of the plan cache
+    void plan_cache(const httplib::Request& req, httplib::Response& res);
+
+    // hit and miss counts and bytes of the result cache
+    void result_cache(const httplib::Request& req, httplib::Response& res);
+
+    // counters, gauges and phase latency histograms of the queries in the text format of Prometheus
+    void metrics(const httplib::Request& req, httplib::Response& res);
+
+    // inserts (op '+') or deletes (op '-') the N-Triples in the body of the request
+    void update(const httplib::Request& req, httplib::Response& res, char op);
+
+    // folds the delta into a new DAA index in the background
+    void compact(const httplib::Request& req, httplib::Response& res);
+
+    bool compact_database();
+
     bool start_server(const std::string& ip, const std::string& port, const std::string& db);
 };
 
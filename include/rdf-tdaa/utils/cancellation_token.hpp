@@ -0,0 +1,71 @@
+#ifndef CANCELLATION_TOKEN_HPP
+#define CANCELLATION_TOKEN_HPP
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include "sys/types.h"
+
+/**
+ * @class CancellationToken
+ * @brief Tells the loops of a query to stop, when it is cancelled, its deadline has passed or its client
+ * has gone away.
+ *
+ * The loops poll Cancelled(), which reads a flag. Every kPollInterval polls of a thread it also reads the
+ * clock, and the client is probed at most once per kProbeInterval, by one thread at a time.
+ */
+class CancellationToken {
+   public:
+    enum Reason { kNone, kCancelled, kTimeout, kDisconnected };
+
+   private:
+    static constexpr uint kPollInterval = 1024;
+    static constexpr std::chrono::milliseconds kProbeInterval{100};
+
+    std::atomic<bool> cancelled_;
+    std::atomic<Reason> reason_;
+    std::chrono::steady_clock::time_point deadline_;
+    // whether the client has gone away
+    std::function<bool()> probe_;
+    std::mutex probe_mutex_;
+    std::chrono::steady_clock::time_point last_probe_;
+
+    void Stop(Reason reason);
+
+   public:
+    CancellationToken();
+
+    /**
+     * @brief Cancels the query once the time has passed.
+     * @param timeout The time from now, 0 for no deadline.
+     */
+    void SetTimeout(std::chrono::milliseconds timeout);
+
+    /**
+     * @brief Cancels the query once the probe returns true.
+     * @param probe Whether the client has gone away, it is not called by two threads at the same time.
+     */
+    void SetProbe(std::function<bool()> probe);
+
+    void Cancel();
+
+    bool Cancelled() {
+        if (cancelled_.load(std::memory_order_relaxed))
+            return true;
+        static thread_local uint polls = 0;
+        if (++polls % kPollInterval != 0)
+            return false;
+        return Check();
+    }
+
+    /**
+     * @brief Reads the clock and probes the client now, for a query waiting to run.
+     * @return Whether the query is cancelled.
+     */
+    bool Check();
+
+    Reason reason() const;
+};
+
+#endif  // CANCELLATION_TOKEN_HPP
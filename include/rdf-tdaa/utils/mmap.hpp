@@ -6,6 +6,7 @@
 #include <unistd.h>
 #include <fstream>
 #include <string>
+#include "rdf-tdaa/utils/packed_image.hpp"
 
 template <typename T>
 class MMap {
@@ -38,10 +39,19 @@ class MMap {
     std::string path_;
     ulong size_;  // bytes
     ulong offset_;
+    // true if map_ points into a mounted PackedImage, the view is read only and is not unmapped
+    bool view_ = false;
 
     MMap() {}
 
     MMap(std::string path) : path_(path), offset_(0) {
+        char* data;
+        if (PackedImage::Resolve(path, data, size_)) {
+            map_ = reinterpret_cast<T*>(data);
+            view_ = true;
+            return;
+        }
+
         std::ifstream file(path, std::ios::binary | std::ios::ate);
         if (file.fail()) {
             perror("File not exist");
@@ -76,7 +86,7 @@ class MMap {
     }
 
     void CloseMap() {
-        if (size_) {
+        if (size_ && !view_) {
             if (msync(map_, size_, MS_SYNC) == -1) {
                 perror("Error syncing memory to disk");
             }
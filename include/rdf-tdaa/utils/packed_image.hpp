@@ -0,0 +1,103 @@
+#ifndef PACKED_IMAGE_HPP
+#define PACKED_IMAGE_HPP
+
+#include <sys/types.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * @class PackedImage
+ * @brief A single file image that holds every file of a database directory.
+ *
+ * An image starts with a Header and a table of Sections, one per database file, followed by the
+ * file contents, each aligned to a page boundary. Mounting an image maps it with a single mmap;
+ * afterwards MMap resolves paths inside the mounted database to views of the image, so the
+ * dictionary and index loaders work unchanged on packed databases.
+ */
+class PackedImage {
+   public:
+    static constexpr char kMagic[8] = {'R', 'D', 'F', 'T', 'D', 'A', 'A', '\0'};
+    static constexpr uint kVersion = 1;
+    static constexpr ulong kAlignment = 4096;
+
+    struct Header {
+        char magic[8];
+        uint version;
+        uint section_cnt;
+        ulong alignment;
+        // Size of the whole image in bytes.
+        ulong file_size;
+        // Checksum of the section table.
+        ulong table_checksum;
+    };
+
+    struct Section {
+        // Path of the file relative to the database directory, e.g. "index/spo/daa_levels".
+        char name[104];
+        ulong offset;
+        ulong size;
+        ulong checksum;
+    };
+
+   private:
+    // Normalized path of the image, paths under it are resolved to sections.
+    std::string root_;
+    char* map_;
+    ulong size_;
+    Header* header_;
+    Section* sections_;
+
+    static std::mutex mounted_mutex_;
+    static std::vector<std::shared_ptr<PackedImage>> mounted_;
+
+    PackedImage(std::string root, char* map, ulong size);
+
+    Section* FindSection(const std::string& name) const;
+
+   public:
+    ~PackedImage();
+
+    /**
+     * @brief Packs all files of a database directory into a single image.
+     * @param db_path The path of the database directory.
+     * @param image_path The path of the image to write.
+     * @return True if the image is written and verified, false otherwise.
+     */
+    static bool Pack(const std::string& db_path, const std::string& image_path);
+
+    /**
+     * @brief Maps an image and registers it, so that MMap resolves the paths under it. Only the header
+     * and the section table are checked, the sections are checked by Verify.
+     * @param image_path The path of the image.
+     * @return True if the image is mounted (or was already mounted), false if it is invalid.
+     */
+    static bool Mount(const std::string& image_path);
+
+    /**
+     * @brief Resolves a path inside a mounted image to the memory of its section.
+     * @param path The path of the file, e.g. "<image_path>/index/metadata".
+     * @param data Set to the start of the section.
+     * @param size Set to the size of the section in bytes.
+     * @return True if the path belongs to a mounted image.
+     */
+    static bool Resolve(const std::string& path, char*& data, ulong& size);
+
+    /**
+     * @brief Checks the checksums of all sections, this touches every page of the image.
+     * @return True if all sections are intact.
+     */
+    bool Verify() const;
+
+    /**
+     * @brief Mounts an image and checks the checksums of all its sections.
+     * @param image_path The path of the image.
+     * @return True if the image is valid and all sections are intact.
+     */
+    static bool Verify(const std::string& image_path);
+
+    static ulong Checksum(const char* data, ulong size, ulong seed = 14695981039346656037ul);
+};
+
+#endif
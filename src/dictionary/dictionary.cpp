@@ -1,23 +1,32 @@
 #include "rdf-tdaa/dictionary/dictionary.hpp"
+#include <cctype>
+#include <cmath>
 #include "rdf-tdaa/utils/vbyte.hpp"
 
 bool Dictionary::LoadPredicate(std::vector<std::string>& id2predicate,
                                hash_map<std::string, uint>& predicate2id) {
-    std::ifstream predicate_in(dict_path_ + "/predicates", std::ofstream::out | std::ofstream::binary);
-    std::string predicate;
+    if (predicate_cnt_ == 0)
+        return true;
+
+    MMap<char> predicate_in = MMap<char>(dict_path_ + "/predicates");
     uint id = 1;
-    while (std::getline(predicate_in, predicate)) {
+    ulong begin = 0;
+    for (ulong end = 0; end < predicate_in.size_; end++) {
+        if (predicate_in.map_[end] != '\n')
+            continue;
+        std::string predicate(predicate_in.map_ + begin, end - begin);
         predicate2id[predicate] = id;
         id2predicate[id] = predicate;
         id++;
+        begin = end + 1;
     }
-    predicate_in.close();
+    predicate_in.CloseMap();
     return true;
 }
 
-Dictionary::Dictionary() {}
+Dictionary::Dictionary() : ordered_literals_(false) {}
 
-Dictionary::Dictionary(std::string& dict_path) : dict_path_(dict_path) {
+Dictionary::Dictionary(std::string& dict_path) : dict_path_(dict_path), ordered_literals_(false) {
     std::string file_path = dict_path_ + "/subjects/hash2id";
     subject_hashes_ = MMap<std::size_t>(file_path);
     subject_ids_ = MMap<uint>(file_path);
@@ -35,6 +44,15 @@ Dictionary::Dictionary(std::string& dict_path) : dict_path_(dict_path) {
     object_cnt_ = menagement_data[2];
     shared_cnt_ = menagement_data[3];
 
+    // databases built before the literals were ordered have no ranges
+    if (menagement_data.size_ >= (7 + 2 * kUnordered) * sizeof(ulong)) {
+        ordered_literals_ = true;
+        for (uint type = 0; type < kUnordered; type++) {
+            literal_ranges_[type] = {shared_cnt_ + subject_cnt_ + menagement_data[7 + 2 * type],
+                                     shared_cnt_ + subject_cnt_ + menagement_data[8 + 2 * type]};
+        }
+    }
+
     id2predicate_ = std::vector<std::string>(predicate_cnt_ + 1);
     LoadPredicate(id2predicate_, predicate2id_);
 
@@ -191,6 +209,115 @@ uint Dictionary::String2ID(const std::string& str, SPARQLParser::Term::Positon p
     return 0;
 }
 
+Dictionary::LiteralType Dictionary::TypeOf(std::string_view term, std::string_view& lexical) {
+    static constexpr std::string_view kXSD = "\"^^<http://www.w3.org/2001/XMLSchema#";
+    static const hash_map<std::string_view, LiteralType> types = {
+        {"integer", kNumeric},
+        {"decimal", kNumeric},
+        {"double", kNumeric},
+        {"float", kNumeric},
+        {"int", kNumeric},
+        {"long", kNumeric},
+        {"short", kNumeric},
+        {"byte", kNumeric},
+        {"nonNegativeInteger", kNumeric},
+        {"nonPositiveInteger", kNumeric},
+        {"negativeInteger", kNumeric},
+        {"positiveInteger", kNumeric},
+        {"unsignedLong", kNumeric},
+        {"unsignedInt", kNumeric},
+        {"unsignedShort", kNumeric},
+        {"unsignedByte", kNumeric},
+        {"date", kDate},
+        {"dateTime", kDateTime}};
+
+    size_t type_pos = term.rfind(kXSD);
+    if (term.empty() || term[0] != '"' || type_pos == std::string_view::npos || term.back() != '>')
+        return kUnordered;
+    auto it = types.find(term.substr(type_pos + kXSD.size(), term.size() - type_pos - kXSD.size() - 1));
+    if (it == types.end())
+        return kUnordered;
+    lexical = term.substr(1, type_pos - 1);
+
+    if (it->second == kNumeric) {
+        // the lexical form ends at the quote, so strtod stops there
+        char* end;
+        double value = std::strtod(lexical.data(), &end);
+        if (lexical.empty() || end != lexical.data() + lexical.size() || std::isnan(value))
+            return kUnordered;
+        return kNumeric;
+    }
+    // YYYY-MM-DD, the lexical forms of dates and dateTimes of positive years sort as strings
+    if (lexical.size() < 10 || lexical[4] != '-' || lexical[7] != '-' || !std::isdigit(lexical[0]))
+        return kUnordered;
+    if (it->second == kDateTime && (lexical.size() < 19 || lexical[10] != 'T'))
+        return kUnordered;
+    return it->second;
+}
+
+int Dictionary::CompareLiterals(LiteralType type, std::string_view a, std::string_view b) {
+    if (type == kNumeric) {
+        double value_a = std::strtod(a.data(), nullptr);
+        double value_b = std::strtod(b.data(), nullptr);
+        return (value_a > value_b) - (value_a < value_b);
+    }
+    int cmp = a.compare(b);
+    return (cmp > 0) - (cmp < 0);
+}
+
+std::pair<uint, uint> Dictionary::LiteralRange(LiteralType type,
+                                               SPARQLParser::Filter::Type op,
+                                               std::string_view lexical) {
+    auto [first, last] = literal_ranges_[type];
+    // the first id whose value is not less than the value, or greater than it when upper is set
+    auto bound = [&](bool upper) {
+        uint low = first, high = last;
+        while (low < high) {
+            uint mid = low + (high - low) / 2;
+            const char* term = ID2String(mid, SPARQLParser::Term::Positon::kObject);
+            std::string_view mid_lexical;
+            TypeOf(term, mid_lexical);
+            int cmp = CompareLiterals(type, mid_lexical, lexical);
+            delete[] term;
+            if (cmp < 0 || (upper && cmp == 0))
+                low = mid + 1;
+            else
+                high = mid;
+        }
+        return low;
+    };
+
+    switch (op) {
+        case SPARQLParser::Filter::Type::Equal:
+            return {bound(false), bound(true)};
+        case SPARQLParser::Filter::Type::Less:
+            return {first, bound(false)};
+        case SPARQLParser::Filter::Type::LessOrEq:
+            return {first, bound(true)};
+        case SPARQLParser::Filter::Type::Greater:
+            return {bound(true), last};
+        case SPARQLParser::Filter::Type::GreaterOrEq:
+            return {bound(false), last};
+        default:
+            break;
+    }
+    return {first, last};
+}
+
+bool Dictionary::ordered_literals() {
+    return ordered_literals_;
+}
+
+Dictionary::LiteralType Dictionary::OrderedType(uint id) {
+    if (!ordered_literals_)
+        return kUnordered;
+    for (uint type = 0; type < kUnordered; type++) {
+        if (literal_ranges_[type].first <= id && id < literal_ranges_[type].second)
+            return LiteralType(type);
+    }
+    return kUnordered;
+}
+
 uint Dictionary::subject_cnt() {
     return subject_cnt_;
 }
@@ -18,7 +18,6 @@ void DictionaryBuilder::Init() {
 }
 
 void DictionaryBuilder::BuildDict() {
-    hash_map<std::string, uint>::iterator s_it, o_it, shared_it;
     std::string s, p, o;
     std::ifstream fin(file_path_, std::ios::in);
 
@@ -29,29 +28,9 @@ void DictionaryBuilder::BuildDict() {
         for (o.pop_back(); o.back() == ' ' || o.back() == '.'; o.pop_back()) {
         }
 
-        shared_it = shared_.find(s);
-        if (shared_it == shared_.end()) {
-            o_it = objects_.find(s);
-            if (o_it != objects_.end()) {
-                shared_.insert({s, 0});
-                objects_.erase(s);
-            } else {
-                subjects_.insert({s, 0});
-            }
-        }
-
-        shared_it = shared_.find(o);
-        if (shared_it == shared_.end()) {
-            s_it = subjects_.find(o);
-            if (s_it != subjects_.end()) {
-                shared_.insert({o, 0});
-                subjects_.erase(o);
-            } else {
-                objects_.insert({o, 0});
-            }
-        }
-
-        predicates_.insert({p, predicates_.size() + 1});
+        AddSubject(s);
+        AddObject(o);
+        AddPredicate(p);
 
         ++triplet_loaded_;
 
@@ -68,29 +47,66 @@ void DictionaryBuilder::BuildDict() {
 void DictionaryBuilder::ReassignIDAndSave(hash_map<std::string, uint>& map,
                                           std::ofstream& dict_out,
                                           std::string nodes_path,
-                                          uint management_file_offset) {
+                                          uint management_file_offset,
+                                          bool order_literals) {
+    // the entries in the order of their ids
+    std::vector<std::pair<const std::string, uint>*> entries;
+    entries.reserve(map.size());
+
+    // (value, lexical form, entry) of the literals of each ordered datatype
+    using Literal = std::tuple<double, std::string_view, std::pair<const std::string, uint>*>;
+    std::vector<Literal> literals[Dictionary::kUnordered];
+    for (auto& entry : map) {
+        std::string_view lexical;
+        Dictionary::LiteralType type =
+            order_literals ? Dictionary::TypeOf(entry.first, lexical) : Dictionary::LiteralType::kUnordered;
+        if (type == Dictionary::LiteralType::kUnordered) {
+            entries.push_back(&entry);
+            continue;
+        }
+        double value = (type == Dictionary::LiteralType::kNumeric) ? std::strtod(lexical.data(), nullptr) : 0;
+        literals[type].push_back({value, lexical, &entry});
+    }
+    if (order_literals) {
+        for (uint type = 0; type < Dictionary::kUnordered; type++) {
+            // equal values, e.g. "5" and "5.0", are next to each other, the lexical forms break the ties
+            std::sort(literals[type].begin(), literals[type].end(), [](const Literal& a, const Literal& b) {
+                if (std::get<0>(a) != std::get<0>(b))
+                    return std::get<0>(a) < std::get<0>(b);
+                if (std::get<1>(a) != std::get<1>(b))
+                    return std::get<1>(a) < std::get<1>(b);
+                return std::get<2>(a)->first < std::get<2>(b)->first;
+            });
+            menagement_data_[7 + 2 * type] = entries.size() + 1;
+            for (const auto& literal : literals[type])
+                entries.push_back(std::get<2>(literal));
+            menagement_data_[8 + 2 * type] = entries.size() + 1;
+            std::vector<Literal>().swap(literals[type]);
+        }
+    }
+
     // hash -> (id, p_str)
     phmap::btree_map<std::size_t, std::pair<uint, const std::string*>> hash2id;
     phmap::flat_hash_map<uint, std::vector<std::string>> conflicts;
     ulong size = 0;
     ulong str_len = 0;
     ulong id = 1;
-    for (auto it = map.begin(); it != map.end(); it++) {
-        it->second = id;
-        str_len = it->first.size() + 1;
-        dict_out.write((it->first + "\n").c_str(), str_len);
+    for (auto entry : entries) {
+        entry->second = id;
+        str_len = entry->first.size() + 1;
+        dict_out.write((entry->first + "\n").c_str(), str_len);
         id++;
         size += str_len;
 
-        std::size_t hash = std::hash<std::string>{}(it->first);
-        auto ret = hash2id.insert({hash, {it->second, &it->first}});
+        std::size_t hash = std::hash<std::string>{}(entry->first);
+        auto ret = hash2id.insert({hash, {entry->second, &entry->first}});
         if (!ret.second) {
             if (ret.first->second.first != 0) {
-                std::vector<std::string> c = {*ret.first->second.second, it->first};
+                std::vector<std::string> c = {*ret.first->second.second, entry->first};
                 conflicts.insert({hash, c}).second;
                 ret.first->second.first = 0;
             } else
-                conflicts[hash].push_back(it->first);
+                conflicts[hash].push_back(entry->first);
         }
     }
 
@@ -108,8 +124,8 @@ void DictionaryBuilder::ReassignIDAndSave(hash_map<std::string, uint>& map,
 
     ulong end_offset = 0;
     ulong i = 0;
-    for (auto it = map.begin(); it != map.end(); it++) {
-        end_offset += it->first.size() + 1;
+    for (auto entry : entries) {
+        end_offset += entry->first.size() + 1;
         if (size < UINT_MAX) {
             // std::cout << i << " " << end_offset << std::endl;
             id2offset[i++] = end_offset;
@@ -158,7 +174,7 @@ void DictionaryBuilder::SaveDict(uint max_threads) {
     shared_out.tie(nullptr);
 
     std::thread t1([&]() { ReassignIDAndSave(subjects_, subject_out, dict_path_ + "/subjects/", 4); });
-    std::thread t2([&]() { ReassignIDAndSave(objects_, object_out, dict_path_ + "/objects/", 5); });
+    std::thread t2([&]() { ReassignIDAndSave(objects_, object_out, dict_path_ + "/objects/", 5, true); });
     std::thread t3([&]() { ReassignIDAndSave(shared_, shared_out, dict_path_ + "/shared/", 6); });
     t1.join();
     t2.join();
@@ -177,15 +193,35 @@ void DictionaryBuilder::SaveDict(uint max_threads) {
     predicate_out.close();
 }
 
-void DictionaryBuilder::Build() {
-    if (file_path_.empty())
+void DictionaryBuilder::AddSubject(const std::string& s) {
+    if (shared_.find(s) != shared_.end())
         return;
+    if (objects_.find(s) != objects_.end()) {
+        shared_.insert({s, 0});
+        objects_.erase(s);
+    } else {
+        subjects_.insert({s, 0});
+    }
+}
 
-    uint max_threads = 6;
+void DictionaryBuilder::AddObject(const std::string& o) {
+    if (shared_.find(o) != shared_.end())
+        return;
+    if (subjects_.find(o) != subjects_.end()) {
+        shared_.insert({o, 0});
+        subjects_.erase(o);
+    } else {
+        objects_.insert({o, 0});
+    }
+}
 
-    menagement_data_ = MMap<ulong>(dict_path_ + "/menagement_data", 7 * 8);
+void DictionaryBuilder::AddPredicate(const std::string& p) {
+    predicates_.insert({p, predicates_.size() + 1});
+}
 
-    Init();
+void DictionaryBuilder::Build() {
+    if (file_path_.empty())
+        return;
 
     auto beg = std::chrono::high_resolution_clock::now();
     BuildDict();
@@ -193,20 +229,45 @@ void DictionaryBuilder::Build() {
     std::cout << "assign id takes " << std::chrono::duration<double, std::milli>(end - beg).count() << " ms."
               << std::endl;
 
+    Save();
+}
+
+void DictionaryBuilder::Save() {
+    uint max_threads = 6;
+
+    // the counts, the widths of the offsets, and the ranges of the ordered literals
+    menagement_data_ = MMap<ulong>(dict_path_ + "/menagement_data", (7 + 2 * Dictionary::kUnordered) * 8);
+
+    Init();
+
     menagement_data_[0] = subjects_.size();
     menagement_data_[1] = predicates_.size();
     menagement_data_[2] = objects_.size();
     menagement_data_[3] = shared_.size();
 
-    beg = std::chrono::high_resolution_clock::now();
+    auto beg = std::chrono::high_resolution_clock::now();
     SaveDict(max_threads);
-    end = std::chrono::high_resolution_clock::now();
+    auto end = std::chrono::high_resolution_clock::now();
     std::cout << "save dictionary takes " << std::chrono::duration<double, std::milli>(end - beg).count()
               << " ms." << std::endl;
 
     menagement_data_.CloseMap();
 }
 
+uint DictionaryBuilder::SubjectID(const std::string& s) {
+    auto it = subjects_.find(s);
+    return (it != subjects_.end()) ? shared_.size() + it->second : shared_.find(s)->second;
+}
+
+uint DictionaryBuilder::ObjectID(const std::string& o) {
+    auto it = objects_.find(o);
+    return (it != objects_.end()) ? shared_.size() + subjects_.size() + it->second : shared_.find(o)->second;
+}
+
+uint DictionaryBuilder::PredicateID(const std::string& p) {
+    return predicates_.find(p)->second;
+}
+
 void DictionaryBuilder::EncodeRDF(hash_map<uint, std::vector<std::pair<uint, uint>>>& pso) {
     std::cout << "encoding rdf." << std::endl;
 
@@ -221,13 +282,9 @@ void DictionaryBuilder::EncodeRDF(hash_map<uint, std::vector<std::pair<uint, uin
         for (o.pop_back(); o.back() == ' ' || o.back() == '.'; o.pop_back()) {
         }
 
-        auto it = subjects_.find(s);
-        sid = (it != subjects_.end()) ? shared_.size() + it->second : shared_.find(s)->second;
-        it = objects_.find(o);
-        oid =
-            (it != objects_.end()) ? shared_.size() + subjects_.size() + it->second : shared_.find(o)->second;
-
-        pid = predicates_.find(p)->second;
+        sid = SubjectID(s);
+        oid = ObjectID(o);
+        pid = PredicateID(p);
 
         pso[pid].push_back({sid, oid});
 
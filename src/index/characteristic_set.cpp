@@ -73,6 +73,7 @@ CharacteristicSet::CharacteristicSet() {}
 CharacteristicSet::CharacteristicSet(uint cnt) {
     offset_size_ = std::vector<std::pair<uint, uint>>(cnt);
     sets_ = std::vector<std::span<uint>>(cnt);
+    loaded_ = std::vector<std::once_flag>(cnt);
     base_ = (cnt * 2 + 1) * 4;
 }
 
@@ -84,6 +85,7 @@ void CharacteristicSet::Load() {
     base_ = (count * 2 + 1) * 4;
     offset_size_ = std::vector<std::pair<uint, uint>>(count);
     sets_ = std::vector<std::span<uint>>(count);
+    loaded_ = std::vector<std::once_flag>(count);
     mmap_ = MMap<uint8_t>(file_path_);
     for (uint set_id = 1; set_id <= count; set_id++)
         offset_size_[set_id - 1] = {c_sets[2 * set_id - 1], c_sets[2 * set_id]};
@@ -120,7 +122,7 @@ void CharacteristicSet::Build(std::vector<std::pair<uint8_t*, uint>>& compressed
 
 std::span<uint>& CharacteristicSet::operator[](uint c_id) {
     c_id -= 1;
-    if (sets_[c_id].size() == 0) {
+    std::call_once(loaded_[c_id], [&]() {
         uint offset = (c_id == 0) ? 0 : offset_size_[c_id - 1].first;
         uint buffer_size = offset_size_[c_id].first - offset;
         uint original_size = offset_size_[c_id].second;
@@ -133,6 +135,6 @@ std::span<uint>& CharacteristicSet::operator[](uint c_id) {
         for (uint i = 1; i < original_size; i++)
             original_data[i] += original_data[i - 1];
         sets_[c_id] = std::span<uint>(original_data, original_size);
-    }
+    });
     return sets_[c_id];
 }
@@ -181,22 +181,17 @@ std::pair<uint, uint> CsDaaMap::DAAOffsetSizeOf(uint id, Permutation permutation
         return {end, 0};
     }
 
-    // offset in the offset array is the start of the next DAA
+    // offset in the offset array is the start of the next DAA,
+    // entities with a single value have no DAA and are skipped
     uint daa_offset = 0;
-    uint daa_size = end;  // where next daa start
-    if (id != 1) {
-        uint i = 1;
-        daa_offset = DAAOffsetOf(id - i, permutation);
-        while ((daa_offset & (1u << (daa_offset_width - 1))) != 0) {
-            i++;
-            if (id - i > 0)
-                daa_offset = DAAOffsetOf(id - i, permutation);
-            else
-                break;
+    for (uint prev_id = id - 1; prev_id > 0; prev_id--) {
+        uint prev_end = DAAOffsetOf(prev_id, permutation);
+        if ((prev_end & (1u << (daa_offset_width - 1))) == 0) {
+            daa_offset = prev_end;
+            break;
         }
-        daa_size = daa_size - daa_offset;
     }
-    return {daa_offset, daa_size};
+    return {daa_offset, end - daa_offset};
 }
 
 uint CsDaaMap::shared_id_size() {
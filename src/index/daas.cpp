@@ -36,7 +36,7 @@ void DAAs::Structure::create(std::vector<std::vector<uint>>& arrays) {
     level_end = (char*)malloc((data_cnt + 7) / 8);
     levels = (uint*)malloc(sizeof(uint) * data_cnt);
     array_end = (char*)malloc((data_cnt + 7) / 8);
-    uint* contB = (uint*)malloc(sizeof(uint) * level_cnt + 1);
+    uint* contB = (uint*)malloc(sizeof(uint) * (level_cnt + 1));
 
     for (uint i = 0; i < (data_cnt + 7) / 8; i++) {
         level_end[i] = 0;
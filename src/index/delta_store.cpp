@@ -0,0 +1,320 @@
+#include "rdf-tdaa/index/delta_store.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <sstream>
+
+DeltaStore::DeltaStore(std::string log_path, uint max_entity_id, uint max_predicate_id)
+    : log_path_(log_path),
+      log_offset_(std::filesystem::exists(log_path) ? std::filesystem::file_size(log_path) : 0),
+      max_entity_id_(max_entity_id),
+      max_predicate_id_(max_predicate_id),
+      empty_(true),
+      cached_bytes_(0),
+      epoch_(0) {}
+
+DeltaStore::~DeltaStore() {
+    for (uint kind = 0; kind < kMergedCnt; kind++) {
+        for (auto& [key, entry] : merged_[kind])
+            delete entry.merged;
+    }
+    for (auto& [epoch, merged] : retired_)
+        delete merged;
+    if (log_.is_open())
+        log_.close();
+}
+
+DeltaStore::Reader::Reader(std::shared_ptr<DeltaStore> store) : store_(store) {
+    std::lock_guard<std::mutex> lock(store_->cache_mutex_);
+    epoch_ = store_->epoch_;
+    store_->readers_.insert(epoch_);
+}
+
+DeltaStore::Reader::~Reader() {
+    std::lock_guard<std::mutex> lock(store_->cache_mutex_);
+    store_->readers_.erase(store_->readers_.find(epoch_));
+    store_->Reclaim();
+}
+
+bool DeltaStore::ParseTriple(const std::string& line, std::string& s, std::string& p, std::string& o) {
+    std::istringstream in(line);
+    if (!(in >> s >> p))
+        return false;
+    in.ignore();
+    std::getline(in, o);
+    while (!o.empty() && (o.back() == ' ' || o.back() == '.' || o.back() == '\r'))
+        o.pop_back();
+    return !o.empty();
+}
+
+void DeltaStore::Merge(std::span<uint> base, const Run& run, std::vector<uint>& merged) {
+    std::vector<uint> kept;
+    kept.reserve(base.size());
+    std::set_difference(base.begin(), base.end(), run.deleted.begin(), run.deleted.end(),
+                        std::back_inserter(kept));
+    merged.reserve(kept.size() + run.inserted.size());
+    std::set_union(kept.begin(), kept.end(), run.inserted.begin(), run.inserted.end(),
+                   std::back_inserter(merged));
+}
+
+std::shared_mutex& DeltaStore::mutex() {
+    return mutex_;
+}
+
+bool DeltaStore::empty() const {
+    return empty_.load(std::memory_order_acquire);
+}
+
+const std::string& DeltaStore::log_path() const {
+    return log_path_;
+}
+
+void DeltaStore::Relocate(std::string log_path) {
+    if (log_.is_open())
+        log_.close();
+    log_path_ = log_path;
+}
+
+uint DeltaStore::EntityID(const std::string& entity) const {
+    auto it = entity2id_.find(entity);
+    return (it != entity2id_.end()) ? it->second : 0;
+}
+
+uint DeltaStore::PredicateID(const std::string& predicate) const {
+    auto it = predicate2id_.find(predicate);
+    return (it != predicate2id_.end()) ? it->second : 0;
+}
+
+uint DeltaStore::AddEntity(const std::string& entity) {
+    uint id = max_entity_id_ + id2entity_.size() + 1;
+    id2entity_.push_back(entity);
+    entity2id_[entity] = id;
+    return id;
+}
+
+uint DeltaStore::AddPredicate(const std::string& predicate) {
+    uint id = max_predicate_id_ + id2predicate_.size() + 1;
+    id2predicate_.push_back(predicate);
+    predicate2id_[predicate] = id;
+    return id;
+}
+
+const std::string& DeltaStore::Entity(uint id) const {
+    return id2entity_[id - max_entity_id_ - 1];
+}
+
+const std::string& DeltaStore::Predicate(uint id) const {
+    return id2predicate_[id - max_predicate_id_ - 1];
+}
+
+uint DeltaStore::max_predicate_id() const {
+    return max_predicate_id_ + id2predicate_.size();
+}
+
+bool DeltaStore::Add(std::vector<uint>& ids, uint id) {
+    auto it = std::lower_bound(ids.begin(), ids.end(), id);
+    if (it != ids.end() && *it == id)
+        return false;
+    ids.insert(it, id);
+    return true;
+}
+
+bool DeltaStore::Remove(std::vector<uint>& ids, uint id) {
+    auto it = std::lower_bound(ids.begin(), ids.end(), id);
+    if (it == ids.end() || *it != id)
+        return false;
+    ids.erase(it);
+    return true;
+}
+
+void DeltaStore::Retire(Merged kind, phmap::flat_hash_map<ulong, Entry>::iterator it) {
+    retired_.push_back({epoch_, it->second.merged});
+    cached_bytes_ -= it->second.merged->capacity() * sizeof(uint);
+    recency_.erase(it->second.recency);
+    merged_[kind].erase(it);
+}
+
+void DeltaStore::Invalidate(Merged kind, uint first, uint second) {
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    auto it = merged_[kind].find((ulong(first) << 32) | second);
+    if (it != merged_[kind].end()) {
+        Retire(kind, it);
+        // the readers that start from now on can not find the span
+        epoch_++;
+        Reclaim();
+    }
+}
+
+void DeltaStore::Reclaim() {
+    ulong oldest = readers_.empty() ? epoch_ : *readers_.begin();
+    while (!retired_.empty() && retired_.front().first < oldest) {
+        delete retired_.front().second;
+        retired_.pop_front();
+    }
+}
+
+bool DeltaStore::Insert(uint sid, uint pid, uint oid, bool in_base) {
+    Run& sp_run = sp_runs_[{sid, pid}];
+    Run& op_run = op_runs_[{oid, pid}];
+    bool changed;
+    if (in_base) {
+        changed = Remove(sp_run.deleted, oid);
+        Remove(op_run.deleted, sid);
+    } else {
+        changed = Add(sp_run.inserted, oid);
+        Add(op_run.inserted, sid);
+    }
+    ps_touched_.insert({pid, sid});
+    po_touched_.insert({pid, oid});
+
+    if (changed) {
+        Invalidate(kBySP, sid, pid);
+        Invalidate(kByOP, oid, pid);
+        Invalidate(kSSet, pid, 0);
+        Invalidate(kOSet, pid, 0);
+        Invalidate(kSPreSet, sid, 0);
+        Invalidate(kOPreSet, oid, 0);
+    }
+    empty_.store(false, std::memory_order_release);
+    return changed;
+}
+
+bool DeltaStore::Delete(uint sid, uint pid, uint oid, bool in_base) {
+    Run& sp_run = sp_runs_[{sid, pid}];
+    Run& op_run = op_runs_[{oid, pid}];
+    bool changed;
+    if (in_base) {
+        changed = Add(sp_run.deleted, oid);
+        Add(op_run.deleted, sid);
+    } else {
+        changed = Remove(sp_run.inserted, oid);
+        Remove(op_run.inserted, sid);
+    }
+    ps_touched_.insert({pid, sid});
+    po_touched_.insert({pid, oid});
+
+    if (changed) {
+        Invalidate(kBySP, sid, pid);
+        Invalidate(kByOP, oid, pid);
+        Invalidate(kSSet, pid, 0);
+        Invalidate(kOSet, pid, 0);
+        Invalidate(kSPreSet, sid, 0);
+        Invalidate(kOPreSet, oid, 0);
+    }
+    empty_.store(false, std::memory_order_release);
+    return changed;
+}
+
+void DeltaStore::Log(const std::string& line) {
+    if (!log_.is_open()) {
+        log_.open(log_path_, std::ios::out | std::ios::app);
+        if (log_.fail()) {
+            perror("Error opening delta log");
+            return;
+        }
+    }
+    log_ << line << '\n';
+    log_.flush();
+    log_offset_ += line.size() + 1;
+}
+
+ulong DeltaStore::log_offset() const {
+    return log_offset_;
+}
+
+std::vector<std::string> DeltaStore::UpdatesSince(ulong offset) const {
+    std::vector<std::string> updates;
+    std::ifstream log(log_path_, std::ios::in);
+    if (!log.is_open())
+        return updates;
+    log.seekg(offset);
+    std::string line;
+    while (std::getline(log, line))
+        updates.push_back(line);
+    return updates;
+}
+
+const DeltaStore::Run* DeltaStore::FindSP(uint sid, uint pid) const {
+    auto it = sp_runs_.find({sid, pid});
+    return (it != sp_runs_.end()) ? &it->second : nullptr;
+}
+
+const DeltaStore::Run* DeltaStore::FindOP(uint oid, uint pid) const {
+    auto it = op_runs_.find({oid, pid});
+    return (it != op_runs_.end()) ? &it->second : nullptr;
+}
+
+bool DeltaStore::PredicateTouched(uint pid) const {
+    auto it = ps_touched_.lower_bound({pid, 0});
+    return it != ps_touched_.end() && it->first == pid;
+}
+
+bool DeltaStore::SubjectTouched(uint sid) const {
+    auto it = sp_runs_.lower_bound({sid, 0});
+    return it != sp_runs_.end() && it->first.first == sid;
+}
+
+bool DeltaStore::ObjectTouched(uint oid) const {
+    auto it = op_runs_.lower_bound({oid, 0});
+    return it != op_runs_.end() && it->first.first == oid;
+}
+
+void DeltaStore::TouchedSubjects(uint pid, std::vector<uint>& subjects) const {
+    for (auto it = ps_touched_.lower_bound({pid, 0}); it != ps_touched_.end() && it->first == pid; ++it)
+        subjects.push_back(it->second);
+}
+
+void DeltaStore::TouchedObjects(uint pid, std::vector<uint>& objects) const {
+    for (auto it = po_touched_.lower_bound({pid, 0}); it != po_touched_.end() && it->first == pid; ++it)
+        objects.push_back(it->second);
+}
+
+void DeltaStore::TouchedPredicatesOfS(uint sid, std::vector<uint>& predicates) const {
+    for (auto it = sp_runs_.lower_bound({sid, 0}); it != sp_runs_.end() && it->first.first == sid; ++it)
+        predicates.push_back(it->first.second);
+}
+
+void DeltaStore::TouchedPredicatesOfO(uint oid, std::vector<uint>& predicates) const {
+    for (auto it = op_runs_.lower_bound({oid, 0}); it != op_runs_.end() && it->first.first == oid; ++it)
+        predicates.push_back(it->first.second);
+}
+
+std::span<uint> DeltaStore::Cached(Merged kind,
+                                   uint first,
+                                   uint second,
+                                   const std::function<void(std::vector<uint>&)>& compute) {
+    ulong key = (ulong(first) << 32) | second;
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex_);
+        auto it = merged_[kind].find(key);
+        if (it != merged_[kind].end()) {
+            recency_.splice(recency_.begin(), recency_, it->second.recency);
+            return std::span<uint>(*it->second.merged);
+        }
+    }
+
+    // computed without holding cache_mutex_, because compute may merge other keys
+    std::vector<uint>* merged = new std::vector<uint>();
+    compute(*merged);
+
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    auto it = merged_[kind].find(key);
+    if (it != merged_[kind].end()) {
+        delete merged;
+        return std::span<uint>(*it->second.merged);
+    }
+    recency_.push_front({kind, key});
+    merged_[kind].emplace(key, Entry{merged, recency_.begin()});
+    cached_bytes_ += merged->capacity() * sizeof(uint);
+
+    // the evicted spans are retired like invalidated ones, the running readers may still hold them
+    if (cached_bytes_ > kCacheBytes && recency_.size() > 1) {
+        while (cached_bytes_ > kCacheBytes && recency_.size() > 1) {
+            auto [evicted_kind, evicted_key] = recency_.back();
+            Retire(evicted_kind, merged_[evicted_kind].find(evicted_key));
+        }
+        epoch_++;
+        Reclaim();
+    }
+    return std::span<uint>(*merged);
+}
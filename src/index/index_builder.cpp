@@ -11,10 +11,14 @@
 IndexBuilder::IndexBuilder(std::string db_name, std::string data_file) {
     db_name_ = db_name;
     data_file_ = data_file;
-    db_index_path_ = "./DB_DATA_ARCHIVE/" + db_name_ + "/index/";
+    // a name containing "/" is the path of the database, e.g. the temporary database of a compaction
+    std::string db_root = db_name_;
+    if (db_root.find("/") == std::string::npos)
+        db_root = "./DB_DATA_ARCHIVE/" + db_root;
+    db_index_path_ = db_root + "/index/";
     spo_index_path_ = db_index_path_ + "spo/";
     ops_index_path_ = db_index_path_ + "ops/";
-    db_dictionary_path_ = "./DB_DATA_ARCHIVE/" + db_name_ + "/dictionary/";
+    db_dictionary_path_ = db_root + "/dictionary/";
 
     fs::path db_path = db_index_path_;
     if (!fs::exists(db_path))
@@ -32,6 +36,163 @@ IndexBuilder::IndexBuilder(std::string db_name, std::string data_file) {
     pso_ = std::make_shared<hash_map<uint, std::vector<std::pair<uint, uint>>>>();
 }
 
+IndexBuilder::IndexBuilder(std::string db_name, std::vector<std::shared_ptr<IndexRetriever>> sources)
+    : IndexBuilder(db_name, std::string()) {
+    sources_ = sources;
+}
+
+const std::vector<ulong>& IndexBuilder::delta_offsets() const {
+    return delta_offsets_;
+}
+
+// Runs task(0), ..., task(task_cnt - 1) on all cores.
+static void ParallelFor(ulong task_cnt, const std::function<void(ulong)>& task) {
+    ulong thread_cnt = std::min<ulong>(std::max(std::thread::hardware_concurrency(), 1u), task_cnt);
+    std::atomic<ulong> next_task = 0;
+    std::vector<std::thread> threads;
+    for (ulong t = 0; t < thread_cnt; t++) {
+        threads.emplace_back([&]() {
+            for (ulong i = next_task++; i < task_cnt; i = next_task++)
+                task(i);
+        });
+    }
+    for (auto& t : threads)
+        t.join();
+}
+
+void IndexBuilder::MergeSources() {
+    uint source_cnt = sources_.size();
+    const ulong batch_size = 4096;
+
+    // source -> entity id -> 1 if it is a subject, 2 if it is an object, 3 if both
+    std::vector<std::vector<uint8_t>> roles(source_cnt);
+    // source -> source p_id -> whether the predicate has triples
+    std::vector<std::vector<bool>> used_predicates(source_cnt);
+    delta_offsets_ = std::vector<ulong>(source_cnt);
+
+    // the triples are not kept by the first scan, only the roles of the terms in them
+    std::cout << "scanning source indexes." << std::endl;
+    std::vector<std::thread> threads;
+    for (uint i = 0; i < source_cnt; i++) {
+        threads.emplace_back([&, i]() {
+            auto& used = used_predicates[i];
+            auto& role = roles[i];
+            delta_offsets_[i] = sources_[i]->ScanTriples([&](uint pid, uint sid, std::span<uint> objects) {
+                if (used.size() <= pid)
+                    used.resize(pid + 1);
+                used[pid] = true;
+                uint max_id = std::max(sid, objects.back());
+                if (role.size() <= max_id)
+                    role.resize(max_id + 1);
+                role[sid] |= 1;
+                for (uint oid : objects)
+                    role[oid] |= 2;
+            });
+        });
+    }
+    for (auto& t : threads)
+        t.join();
+
+    std::cout << "decoding terms." << std::endl;
+    // source -> ids of the entities in the triples
+    std::vector<std::vector<uint>> entities(source_cnt);
+    // source -> strings of the entities, aligned with entities
+    std::vector<std::vector<std::string>> names(source_cnt);
+    // source -> source p_id -> string, empty for predicates without triples
+    std::vector<std::vector<std::string>> predicates(source_cnt);
+    for (uint i = 0; i < source_cnt; i++) {
+        for (uint id = 1; id < roles[i].size(); id++) {
+            if (roles[i][id] != 0)
+                entities[i].push_back(id);
+        }
+        predicates[i].resize(used_predicates[i].size());
+        for (uint pid = 1; pid < used_predicates[i].size(); pid++) {
+            if (used_predicates[i][pid])
+                predicates[i][pid] = sources_[i]->Decode(pid, SPARQLParser::Term::Positon::kPredicate);
+        }
+
+        names[i].resize(entities[i].size());
+        ParallelFor((entities[i].size() + batch_size - 1) / batch_size, [&](ulong batch) {
+            ulong end = std::min((batch + 1) * batch_size, entities[i].size());
+            for (ulong j = batch * batch_size; j < end; j++)
+                names[i][j] = sources_[i]->Decode(entities[i][j], SPARQLParser::Term::Positon::kSubject);
+        });
+    }
+
+    DictionaryBuilder dict_builder = DictionaryBuilder(db_dictionary_path_, data_file_);
+    for (uint i = 0; i < source_cnt; i++) {
+        for (uint pid = 1; pid < predicates[i].size(); pid++) {
+            if (!predicates[i][pid].empty())
+                dict_builder.AddPredicate(predicates[i][pid]);
+        }
+        for (ulong j = 0; j < entities[i].size(); j++) {
+            uint8_t role = roles[i][entities[i][j]];
+            if (role & 1)
+                dict_builder.AddSubject(names[i][j]);
+            if (role & 2)
+                dict_builder.AddObject(names[i][j]);
+        }
+    }
+    dict_builder.Save();
+
+    std::cout << "remapping triples." << std::endl;
+    // source -> source id -> new id, 0 for the terms not in the first scan
+    std::vector<std::vector<uint>> id_map(source_cnt);
+    std::vector<std::vector<uint>> pid_map(source_cnt);
+    for (uint i = 0; i < source_cnt; i++) {
+        id_map[i].resize(roles[i].size());
+        ParallelFor((entities[i].size() + batch_size - 1) / batch_size, [&](ulong batch) {
+            ulong end = std::min((batch + 1) * batch_size, entities[i].size());
+            for (ulong j = batch * batch_size; j < end; j++) {
+                uint id = entities[i][j];
+                id_map[i][id] =
+                    (roles[i][id] & 1) ? dict_builder.SubjectID(names[i][j]) : dict_builder.ObjectID(names[i][j]);
+            }
+        });
+        std::vector<std::string>().swap(names[i]);
+        std::vector<uint>().swap(entities[i]);
+        std::vector<uint8_t>().swap(roles[i]);
+
+        pid_map[i].resize(predicates[i].size());
+        for (uint pid = 1; pid < predicates[i].size(); pid++) {
+            if (!predicates[i][pid].empty())
+                pid_map[i][pid] = dict_builder.PredicateID(predicates[i][pid]);
+            if (pid_map[i][pid] != 0)
+                (*pso_)[pid_map[i][pid]];
+        }
+    }
+
+    // the second scan writes the triples in the new ids straight into pso_, so they are held once. A
+    // triple changed by an update after the first scan may already be in it or not, the updates since the
+    // offset of the first scan are replayed by the caller and set every triple they touch, and the triples
+    // of terms the first scan has not seen are added by them.
+    for (uint i = 0; i < source_cnt; i++) {
+        sources_[i]->ScanTriples([&](uint pid, uint sid, std::span<uint> objects) {
+            uint new_pid = pid < pid_map[i].size() ? pid_map[i][pid] : 0;
+            uint new_sid = sid < id_map[i].size() ? id_map[i][sid] : 0;
+            if (new_pid == 0 || new_sid == 0)
+                return;
+            std::vector<std::pair<uint, uint>>& pairs = pso_->at(new_pid);
+            for (uint oid : objects) {
+                if (oid < id_map[i].size() && id_map[i][oid] != 0)
+                    pairs.push_back({new_sid, id_map[i][oid]});
+            }
+        });
+    }
+
+    // every predicate is sorted and deduplicated by one thread
+    std::vector<uint> pids;
+    for (auto& [pid, pairs] : *pso_)
+        pids.push_back(pid);
+    ParallelFor(pids.size(), [&](ulong task) {
+        std::vector<std::pair<uint, uint>>& pairs = pso_->at(pids[task]);
+        std::sort(pairs.begin(), pairs.end());
+        pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+    });
+
+    dict_builder.Close();
+}
+
 void IndexBuilder::BuildCharacteristicSet(std::vector<uint>& c_set_id,
                                           std::vector<uint>& c_set_size,
                                           Permutation permutation) {
@@ -141,10 +302,14 @@ bool IndexBuilder::Build() {
 
     auto beg = std::chrono::high_resolution_clock::now();
 
-    DictionaryBuilder dict_builder = DictionaryBuilder(db_dictionary_path_, data_file_);
-    dict_builder.Build();
-    dict_builder.EncodeRDF(*pso_);
-    dict_builder.Close();
+    if (sources_.empty()) {
+        DictionaryBuilder dict_builder = DictionaryBuilder(db_dictionary_path_, data_file_);
+        dict_builder.Build();
+        dict_builder.EncodeRDF(*pso_);
+        dict_builder.Close();
+    } else {
+        MergeSources();
+    }
     dict_ = Dictionary(db_dictionary_path_);
     dict_.Close();
     malloc_trim(0);
@@ -1,12 +1,19 @@
 #include "rdf-tdaa/index/index_retriever.hpp"
+#include <cstring>
 #include "rdf-tdaa/index/predicate_index.hpp"
 #include "rdf-tdaa/utils/join_list.hpp"
+#include "rdf-tdaa/utils/packed_image.hpp"
 #include "rdf-tdaa/utils/vbyte.hpp"
 #include "streamvbyte.h"
 
 IndexRetriever::IndexRetriever() {}
 
 IndexRetriever::IndexRetriever(std::string db_name) : db_path_(db_name) {
+    RecoverCompaction(db_path_);
+    // a packed database is a single file, mount it so that all files below are read from the image
+    if (std::filesystem::is_regular_file(db_path_) && !PackedImage::Mount(db_path_))
+        exit(1);
+
     db_dictionary_path_ = db_path_ + "/dictionary/";
     db_index_path_ = db_path_ + "/index/";
     spo_index_path_ = db_index_path_ + "spo/";
@@ -18,6 +25,7 @@ IndexRetriever::IndexRetriever(std::string db_name) : db_path_(db_name) {
     std::chrono::duration<double, std::milli> diff = end - beg;
 
     max_subject_id_ = dict_.shared_cnt() + dict_.subject_cnt();
+    max_id_ = dict_.max_id();
 
     predicate_index_ = PredicateIndex(db_index_path_, dict_.predicate_cnt());
 
@@ -50,9 +58,42 @@ IndexRetriever::IndexRetriever(std::string db_name) : db_path_(db_name) {
     object_characteristic_set_ = CharacteristicSet(db_index_path_ + "o_c_sets");
     object_characteristic_set_.Load();
 
+    delta_ = std::make_shared<DeltaStore>(DeltaLogPath(db_path_), max_id_, dict_.predicate_cnt());
+    std::ifstream delta_log(delta_->log_path(), std::ios::in);
+    if (delta_log.is_open()) {
+        std::string update, s, p, o;
+        ulong update_cnt = 0;
+        std::unique_lock<std::shared_mutex> lock(delta_->mutex());
+        while (std::getline(delta_log, update)) {
+            if (update.size() < 2 || !DeltaStore::ParseTriple(update.substr(2), s, p, o))
+                continue;
+            ApplyUpdate(update[0], s, p, o, false);
+            update_cnt++;
+        }
+        delta_log.close();
+        std::cout << "replay " << update_cnt << " updates from " << delta_->log_path() << std::endl;
+    }
+
     std::cout << "init string dictionary takes " << diff.count() << " ms." << std::endl;
 }
 
+std::string IndexRetriever::DeltaLogPath(std::string db_path) {
+    while (db_path.size() > 1 && db_path.back() == '/')
+        db_path.pop_back();
+    return db_path + ".delta";
+}
+
+void IndexRetriever::RecoverCompaction(std::string db_path) {
+    while (db_path.size() > 1 && db_path.back() == '/')
+        db_path.pop_back();
+    // the delta log is moved after the databases, so db.delta is still the log of db.old
+    std::string old_path = db_path + ".old";
+    if (!std::filesystem::exists(db_path) && std::filesystem::exists(old_path)) {
+        std::cout << "restore " << db_path << " from " << old_path << std::endl;
+        std::filesystem::rename(old_path, db_path);
+    }
+}
+
 ulong IndexRetriever::FileSize(std::string file_name) {
     std::ifstream file(file_name, std::ios::binary | std::ios::ate);
     ulong size = static_cast<ulong>(file.tellg());
@@ -67,26 +108,184 @@ void IndexRetriever::Close() {
     dict_.Close();
 }
 
+void IndexRetriever::Relocate(std::string db_name) {
+    std::unique_lock<std::shared_mutex> lock(delta_->mutex());
+    db_path_ = db_name;
+    db_dictionary_path_ = db_path_ + "/dictionary/";
+    db_index_path_ = db_path_ + "/index/";
+    spo_index_path_ = db_index_path_ + "spo/";
+    ops_index_path_ = db_index_path_ + "ops/";
+    delta_->Relocate(DeltaLogPath(db_path_));
+}
+
 const char* IndexRetriever::ID2String(uint id, SPARQLParser::Term::Positon pos) {
-    return dict_.ID2String(id, pos);
+    if (pos == SPARQLParser::Term::Positon::kPredicate) {
+        if (id > dict_.predicate_cnt()) {
+            std::shared_lock<std::shared_mutex> lock(delta_->mutex());
+            return delta_->Predicate(id).c_str();
+        }
+        return dict_.ID2String(id, pos);
+    }
+
+    if (id > max_id_) {
+        std::shared_lock<std::shared_mutex> lock(delta_->mutex());
+        return EntityString(id);
+    }
+    return EntityString(id);
+}
+
+std::string IndexRetriever::Decode(uint id, SPARQLParser::Term::Positon pos) {
+    if (id == 0)
+        return "";
+    const char* term = ID2String(id, pos);
+    std::string value(term);
+    // the predicates are kept by the dictionary and the delta, the other terms are decoded into a copy
+    if (pos != SPARQLParser::Term::Positon::kPredicate)
+        delete[] term;
+    return value;
+}
+
+const char* IndexRetriever::EntityString(uint id) {
+    if (id > max_id_) {
+        const std::string& entity = delta_->Entity(id);
+        char* str = new char[entity.size() + 1];
+        memcpy(str, entity.c_str(), entity.size() + 1);
+        return str;
+    }
+    // an entity may be bound in a position it does not have in the base dictionary when it came from the
+    // delta, so the dictionary is chosen by the id range
+    if (id <= max_subject_id_)
+        return dict_.ID2String(id, SPARQLParser::Term::Positon::kSubject);
+    return dict_.ID2String(id, SPARQLParser::Term::Positon::kObject);
+}
+
+std::pair<uint, uint> IndexRetriever::LiteralRange(Dictionary::LiteralType type,
+                                                   SPARQLParser::Filter::Type op,
+                                                   std::string_view lexical) {
+    return dict_.LiteralRange(type, op, lexical);
+}
+
+bool IndexRetriever::ordered_literals() {
+    return dict_.ordered_literals();
+}
+
+Dictionary::LiteralType IndexRetriever::OrderedType(uint id, SPARQLParser::Term::Positon pos) {
+    if (pos == SPARQLParser::Term::Positon::kPredicate || id > max_id_)
+        return Dictionary::LiteralType::kUnordered;
+    return dict_.OrderedType(id);
+}
+
+uint IndexRetriever::max_id() {
+    return max_id_;
+}
+
+uint IndexRetriever::max_subject_id() {
+    return max_subject_id_;
 }
 
 uint IndexRetriever::Term2ID(const SPARQLParser::Term& term) {
-    return dict_.String2ID(term.value, term.position);
+    uint id = dict_.String2ID(term.value, term.position);
+    if (id != 0 || delta_->empty())
+        return id;
+
+    std::shared_lock<std::shared_mutex> lock(delta_->mutex());
+    if (term.position == SPARQLParser::Term::Positon::kPredicate)
+        return delta_->PredicateID(term.value);
+    return EntityID(term.value, false);
+}
+
+uint IndexRetriever::EntityID(const std::string& entity, bool add) {
+    uint id = dict_.String2ID(entity, SPARQLParser::Term::Positon::kSubject);
+    if (id == 0)
+        id = dict_.String2ID(entity, SPARQLParser::Term::Positon::kObject);
+    if (id == 0)
+        id = delta_->EntityID(entity);
+    if (id == 0 && add)
+        id = delta_->AddEntity(entity);
+    return id;
+}
+
+bool IndexRetriever::ApplyUpdate(char op,
+                                 const std::string& s,
+                                 const std::string& p,
+                                 const std::string& o,
+                                 bool persist) {
+    bool insert = (op == '+');
+    uint sid = EntityID(s, insert);
+    uint oid = EntityID(o, insert);
+    uint pid = dict_.String2ID(p, SPARQLParser::Term::Positon::kPredicate);
+    if (pid == 0)
+        pid = delta_->PredicateID(p);
+    if (pid == 0 && insert)
+        pid = delta_->AddPredicate(p);
+    if (sid == 0 || pid == 0 || oid == 0)
+        return false;
+
+    std::span<uint> base = BaseBySP(sid, pid);
+    bool in_base = std::binary_search(base.begin(), base.end(), oid);
+    bool changed = insert ? delta_->Insert(sid, pid, oid, in_base) : delta_->Delete(sid, pid, oid, in_base);
+    if (changed && persist)
+        delta_->Log(op + std::string(" ") + s + " " + p + " " + o + " .");
+    return changed;
+}
+
+bool IndexRetriever::Insert(const std::string& s, const std::string& p, const std::string& o) {
+    std::unique_lock<std::shared_mutex> lock(delta_->mutex());
+    return ApplyUpdate('+', s, p, o, true);
+}
+
+bool IndexRetriever::Delete(const std::string& s, const std::string& p, const std::string& o) {
+    std::unique_lock<std::shared_mutex> lock(delta_->mutex());
+    return ApplyUpdate('-', s, p, o, true);
+}
+
+bool IndexRetriever::Apply(const std::string& update) {
+    std::string s, p, o;
+    if (update.size() < 2 || (update[0] != '+' && update[0] != '-') ||
+        !DeltaStore::ParseTriple(update.substr(2), s, p, o))
+        return false;
+    std::unique_lock<std::shared_mutex> lock(delta_->mutex());
+    return ApplyUpdate(update[0], s, p, o, true);
+}
+
+ulong IndexRetriever::ScanTriples(const std::function<void(uint, uint, std::span<uint>)>& visit) {
+    // updates wait until the scan is finished, so the scan matches the returned offset
+    std::shared_lock<std::shared_mutex> lock(delta_->mutex());
+    for (uint pid = 1; pid <= delta_->max_predicate_id(); pid++) {
+        for (uint sid : MergedSSet(pid)) {
+            std::span<uint> objects = MergedBySP(sid, pid);
+            if (!objects.empty())
+                visit(pid, sid, objects);
+        }
+    }
+    return delta_->log_offset();
+}
+
+std::shared_ptr<DeltaStore::Reader> IndexRetriever::ReadDelta() {
+    return std::make_shared<DeltaStore::Reader>(delta_);
+}
+
+std::vector<std::string> IndexRetriever::DeltaUpdatesSince(ulong offset) {
+    std::shared_lock<std::shared_mutex> lock(delta_->mutex());
+    return delta_->UpdatesSince(offset);
 }
 
 // ?s p ?o
-std::span<uint> IndexRetriever::GetSSet(uint pid) {
-    return predicate_index_.GetSSet(pid);
+std::span<uint> IndexRetriever::BaseSSet(uint pid) {
+    if (0 < pid && pid <= dict_.predicate_cnt())
+        return predicate_index_.GetSSet(pid);
+    return std::span<uint>();
 }
 
 // ?s p ?o
-std::span<uint> IndexRetriever::GetOSet(uint pid) {
-    return predicate_index_.GetOSet(pid);
+std::span<uint> IndexRetriever::BaseOSet(uint pid) {
+    if (0 < pid && pid <= dict_.predicate_cnt())
+        return predicate_index_.GetOSet(pid);
+    return std::span<uint>();
 }
 
 // ?s ?p o, s ?p ?o
-std::span<uint> IndexRetriever::GetSPreSet(uint sid) {
+std::span<uint> IndexRetriever::BaseSPreSet(uint sid) {
     if (0 < sid && sid <= max_subject_id_) {
         uint cs_id = cs_daa_map_.ChararisticSetIdOf(sid, CsDaaMap::Permutation::kSPO);
         return subject_characteristic_set_[cs_id];
@@ -95,8 +294,8 @@ std::span<uint> IndexRetriever::GetSPreSet(uint sid) {
 }
 
 // ?s ?p o, s ?p ?o
-std::span<uint> IndexRetriever::GetOPreSet(uint oid) {
-    if ((0 < oid && oid <= dict_.shared_cnt()) || max_subject_id_ < oid) {
+std::span<uint> IndexRetriever::BaseOPreSet(uint oid) {
+    if ((0 < oid && oid <= dict_.shared_cnt()) || (max_subject_id_ < oid && oid <= max_id_)) {
         uint cs_id = cs_daa_map_.ChararisticSetIdOf(oid, CsDaaMap::Permutation::kOPS);
         return object_characteristic_set_[cs_id];
     }
@@ -104,7 +303,7 @@ std::span<uint> IndexRetriever::GetOPreSet(uint oid) {
 }
 
 // s p ?o
-std::span<uint> IndexRetriever::GetBySP(uint sid, uint pid) {
+std::span<uint> IndexRetriever::BaseBySP(uint sid, uint pid) {
     if (0 < sid && sid <= max_subject_id_) {
         uint cs_id = cs_daa_map_.ChararisticSetIdOf(sid, CsDaaMap::Permutation::kSPO);
         const auto& char_set = subject_characteristic_set_[cs_id];
@@ -120,8 +319,8 @@ std::span<uint> IndexRetriever::GetBySP(uint sid, uint pid) {
 }
 
 // ?s p o
-std::span<uint> IndexRetriever::GetByOP(uint oid, uint pid) {
-    if ((0 < oid && oid <= dict_.shared_cnt()) || max_subject_id_ < oid) {
+std::span<uint> IndexRetriever::BaseByOP(uint oid, uint pid) {
+    if ((0 < oid && oid <= dict_.shared_cnt()) || (max_subject_id_ < oid && oid <= max_id_)) {
         uint cs_id = cs_daa_map_.ChararisticSetIdOf(oid, CsDaaMap::Permutation::kOPS);
         const auto& char_set = object_characteristic_set_[cs_id];
         auto it = std::lower_bound(char_set.begin(), char_set.end(), pid);
@@ -134,15 +333,13 @@ std::span<uint> IndexRetriever::GetByOP(uint oid, uint pid) {
     }
     return std::span<uint>();
 }
+
 // s ?p o
-std::span<uint> IndexRetriever::GetBySO(uint sid, uint oid) {
+std::span<uint> IndexRetriever::BaseBySO(uint sid, uint oid) {
     std::vector<uint>* result = new std::vector<uint>;
 
-    if ((0 < sid && sid <= max_subject_id_) && (oid <= dict_.shared_cnt() || max_subject_id_ < oid)) {
-        uint original_oid = oid;
-        if (oid > dict_.shared_cnt())
-            oid -= dict_.subject_cnt();
-
+    if ((0 < sid && sid <= max_subject_id_) &&
+        (oid <= dict_.shared_cnt() || (max_subject_id_ < oid && oid <= max_id_))) {
         uint cs_id = cs_daa_map_.ChararisticSetIdOf(sid, CsDaaMap::Permutation::kSPO);
         std::span<uint>& s_c_set = subject_characteristic_set_[cs_id];
         cs_id = cs_daa_map_.ChararisticSetIdOf(oid, CsDaaMap::Permutation::kOPS);
@@ -151,8 +348,8 @@ std::span<uint> IndexRetriever::GetBySO(uint sid, uint oid) {
         for (uint i = 0; i < s_c_set.size(); i++) {
             for (uint j = 0; j < o_c_set.size(); j++) {
                 if (s_c_set[i] == o_c_set[j]) {
-                    auto r = GetBySP(sid, s_c_set[i]);
-                    bool found = std::binary_search(r.begin(), r.end(), original_oid);
+                    auto r = BaseBySP(sid, s_c_set[i]);
+                    bool found = std::binary_search(r.begin(), r.end(), oid);
                     if (found)
                         result->push_back(s_c_set[i]);
                 }
@@ -163,7 +360,7 @@ std::span<uint> IndexRetriever::GetBySO(uint sid, uint oid) {
     return std::span<uint>(*result);
 }
 
-std::span<uint> IndexRetriever::GetByS(uint sid) {
+std::span<uint> IndexRetriever::BaseByS(uint sid) {
     if (0 < sid && sid <= max_subject_id_) {
         uint cs_id = cs_daa_map_.ChararisticSetIdOf(sid, CsDaaMap::Permutation::kSPO);
         const auto& char_set = subject_characteristic_set_[cs_id];
@@ -180,8 +377,8 @@ std::span<uint> IndexRetriever::GetByS(uint sid) {
     return std::span<uint>();
 }
 
-std::span<uint> IndexRetriever::GetByO(uint oid) {
-    if ((0 < oid && oid <= dict_.shared_cnt()) || max_subject_id_ < oid) {
+std::span<uint> IndexRetriever::BaseByO(uint oid) {
+    if ((0 < oid && oid <= dict_.shared_cnt()) || (max_subject_id_ < oid && oid <= max_id_)) {
         uint cs_id = cs_daa_map_.ChararisticSetIdOf(oid, CsDaaMap::Permutation::kOPS);
         const auto& char_set = object_characteristic_set_[cs_id];
         std::vector<std::span<uint>> offset2id;
@@ -197,22 +394,246 @@ std::span<uint> IndexRetriever::GetByO(uint oid) {
     return std::span<uint>();
 }
 
+std::span<uint> IndexRetriever::MergedSSet(uint pid) {
+    if (!delta_->PredicateTouched(pid))
+        return BaseSSet(pid);
+    return delta_->Cached(DeltaStore::kSSet, pid, 0, [&](std::vector<uint>& merged) {
+        // a touched subject stays in the set only if it still has objects for pid
+        std::vector<uint> touched;
+        delta_->TouchedSubjects(pid, touched);
+        std::span<uint> base = BaseSSet(pid);
+        std::set_difference(base.begin(), base.end(), touched.begin(), touched.end(),
+                            std::back_inserter(merged));
+        for (uint sid : touched) {
+            if (!MergedBySP(sid, pid).empty())
+                merged.insert(std::lower_bound(merged.begin(), merged.end(), sid), sid);
+        }
+    });
+}
+
+std::span<uint> IndexRetriever::MergedOSet(uint pid) {
+    if (!delta_->PredicateTouched(pid))
+        return BaseOSet(pid);
+    return delta_->Cached(DeltaStore::kOSet, pid, 0, [&](std::vector<uint>& merged) {
+        std::vector<uint> touched;
+        delta_->TouchedObjects(pid, touched);
+        std::span<uint> base = BaseOSet(pid);
+        std::set_difference(base.begin(), base.end(), touched.begin(), touched.end(),
+                            std::back_inserter(merged));
+        for (uint oid : touched) {
+            if (!MergedByOP(oid, pid).empty())
+                merged.insert(std::lower_bound(merged.begin(), merged.end(), oid), oid);
+        }
+    });
+}
+
+std::span<uint> IndexRetriever::MergedSPreSet(uint sid) {
+    if (!delta_->SubjectTouched(sid))
+        return BaseSPreSet(sid);
+    return delta_->Cached(DeltaStore::kSPreSet, sid, 0, [&](std::vector<uint>& merged) {
+        std::vector<uint> touched;
+        delta_->TouchedPredicatesOfS(sid, touched);
+        std::span<uint> base = BaseSPreSet(sid);
+        std::set_difference(base.begin(), base.end(), touched.begin(), touched.end(),
+                            std::back_inserter(merged));
+        for (uint pid : touched) {
+            if (!MergedBySP(sid, pid).empty())
+                merged.insert(std::lower_bound(merged.begin(), merged.end(), pid), pid);
+        }
+    });
+}
+
+std::span<uint> IndexRetriever::MergedOPreSet(uint oid) {
+    if (!delta_->ObjectTouched(oid))
+        return BaseOPreSet(oid);
+    return delta_->Cached(DeltaStore::kOPreSet, oid, 0, [&](std::vector<uint>& merged) {
+        std::vector<uint> touched;
+        delta_->TouchedPredicatesOfO(oid, touched);
+        std::span<uint> base = BaseOPreSet(oid);
+        std::set_difference(base.begin(), base.end(), touched.begin(), touched.end(),
+                            std::back_inserter(merged));
+        for (uint pid : touched) {
+            if (!MergedByOP(oid, pid).empty())
+                merged.insert(std::lower_bound(merged.begin(), merged.end(), pid), pid);
+        }
+    });
+}
+
+std::span<uint> IndexRetriever::MergedBySP(uint sid, uint pid) {
+    const DeltaStore::Run* run = delta_->FindSP(sid, pid);
+    if (run == nullptr)
+        return BaseBySP(sid, pid);
+    return delta_->Cached(DeltaStore::kBySP, sid, pid, [&](std::vector<uint>& merged) {
+        DeltaStore::Merge(BaseBySP(sid, pid), *run, merged);
+    });
+}
+
+std::span<uint> IndexRetriever::MergedByOP(uint oid, uint pid) {
+    const DeltaStore::Run* run = delta_->FindOP(oid, pid);
+    if (run == nullptr)
+        return BaseByOP(oid, pid);
+    return delta_->Cached(DeltaStore::kByOP, oid, pid, [&](std::vector<uint>& merged) {
+        DeltaStore::Merge(BaseByOP(oid, pid), *run, merged);
+    });
+}
+
+// the spans below are not cached, a key of them is rarely probed twice
+std::span<uint> IndexRetriever::MergedBySO(uint sid, uint oid, std::shared_ptr<std::vector<uint>>& owner) {
+    if (!delta_->SubjectTouched(sid) && !delta_->ObjectTouched(oid))
+        return BaseBySO(sid, oid);
+    owner = std::make_shared<std::vector<uint>>();
+    for (uint pid : MergedSPreSet(sid)) {
+        std::span<uint> objects = MergedBySP(sid, pid);
+        if (std::binary_search(objects.begin(), objects.end(), oid))
+            owner->push_back(pid);
+    }
+    return std::span<uint>(*owner);
+}
+
+std::span<uint> IndexRetriever::MergedByS(uint sid, std::shared_ptr<std::vector<uint>>& owner) {
+    if (!delta_->SubjectTouched(sid))
+        return BaseByS(sid);
+    owner = std::make_shared<std::vector<uint>>();
+    for (uint pid : MergedSPreSet(sid)) {
+        std::span<uint> objects = MergedBySP(sid, pid);
+        owner->insert(owner->end(), objects.begin(), objects.end());
+    }
+    std::sort(owner->begin(), owner->end());
+    owner->erase(std::unique(owner->begin(), owner->end()), owner->end());
+    return std::span<uint>(*owner);
+}
+
+std::span<uint> IndexRetriever::MergedByO(uint oid, std::shared_ptr<std::vector<uint>>& owner) {
+    if (!delta_->ObjectTouched(oid))
+        return BaseByO(oid);
+    owner = std::make_shared<std::vector<uint>>();
+    for (uint pid : MergedOPreSet(oid)) {
+        std::span<uint> subjects = MergedByOP(oid, pid);
+        owner->insert(owner->end(), subjects.begin(), subjects.end());
+    }
+    std::sort(owner->begin(), owner->end());
+    owner->erase(std::unique(owner->begin(), owner->end()), owner->end());
+    return std::span<uint>(*owner);
+}
+
+// ?s p ?o
+std::span<uint> IndexRetriever::GetSSet(uint pid) {
+    if (delta_->empty())
+        return BaseSSet(pid);
+    std::shared_lock<std::shared_mutex> lock(delta_->mutex());
+    return MergedSSet(pid);
+}
+
+// ?s p ?o
+std::span<uint> IndexRetriever::GetOSet(uint pid) {
+    if (delta_->empty())
+        return BaseOSet(pid);
+    std::shared_lock<std::shared_mutex> lock(delta_->mutex());
+    return MergedOSet(pid);
+}
+
+// ?s ?p o, s ?p ?o
+std::span<uint> IndexRetriever::GetSPreSet(uint sid) {
+    if (delta_->empty())
+        return BaseSPreSet(sid);
+    std::shared_lock<std::shared_mutex> lock(delta_->mutex());
+    return MergedSPreSet(sid);
+}
+
+// ?s ?p o, s ?p ?o
+std::span<uint> IndexRetriever::GetOPreSet(uint oid) {
+    if (delta_->empty())
+        return BaseOPreSet(oid);
+    std::shared_lock<std::shared_mutex> lock(delta_->mutex());
+    return MergedOPreSet(oid);
+}
+
+// s p ?o
+std::span<uint> IndexRetriever::GetBySP(uint sid, uint pid) {
+    if (delta_->empty())
+        return BaseBySP(sid, pid);
+    std::shared_lock<std::shared_mutex> lock(delta_->mutex());
+    return MergedBySP(sid, pid);
+}
+
+// ?s p o
+std::span<uint> IndexRetriever::GetByOP(uint oid, uint pid) {
+    if (delta_->empty())
+        return BaseByOP(oid, pid);
+    std::shared_lock<std::shared_mutex> lock(delta_->mutex());
+    return MergedByOP(oid, pid);
+}
+
+// s ?p o
+std::span<uint> IndexRetriever::GetBySO(uint sid, uint oid, std::shared_ptr<std::vector<uint>>& owner) {
+    if (delta_->empty())
+        return BaseBySO(sid, oid);
+    std::shared_lock<std::shared_mutex> lock(delta_->mutex());
+    return MergedBySO(sid, oid, owner);
+}
+
+std::span<uint> IndexRetriever::GetByS(uint sid, std::shared_ptr<std::vector<uint>>& owner) {
+    if (delta_->empty())
+        return BaseByS(sid);
+    std::shared_lock<std::shared_mutex> lock(delta_->mutex());
+    return MergedByS(sid, owner);
+}
+
+std::span<uint> IndexRetriever::GetByO(uint oid, std::shared_ptr<std::vector<uint>>& owner) {
+    if (delta_->empty())
+        return BaseByO(oid);
+    std::shared_lock<std::shared_mutex> lock(delta_->mutex());
+    return MergedByO(oid, owner);
+}
+
 uint IndexRetriever::GetSSetSize(uint pid) {
-    return predicate_index_.GetSSetSize(pid);
+    if (!delta_->empty()) {
+        std::shared_lock<std::shared_mutex> lock(delta_->mutex());
+        if (delta_->PredicateTouched(pid))
+            return MergedSSet(pid).size();
+    }
+    if (0 < pid && pid <= dict_.predicate_cnt())
+        return predicate_index_.GetSSetSize(pid);
+    return 0;
 }
 
 uint IndexRetriever::GetOSetSize(uint pid) {
-    return predicate_index_.GetOSetSize(pid);
+    if (!delta_->empty()) {
+        std::shared_lock<std::shared_mutex> lock(delta_->mutex());
+        if (delta_->PredicateTouched(pid))
+            return MergedOSet(pid).size();
+    }
+    if (0 < pid && pid <= dict_.predicate_cnt())
+        return predicate_index_.GetOSetSize(pid);
+    return 0;
 }
 
 uint IndexRetriever::GetBySSize(uint sid) {
-    if (sid <= max_subject_id_)
+    if (!delta_->empty()) {
+        std::shared_lock<std::shared_mutex> lock(delta_->mutex());
+        if (delta_->SubjectTouched(sid)) {
+            uint size = 0;
+            for (uint pid : MergedSPreSet(sid))
+                size += MergedBySP(sid, pid).size();
+            return size;
+        }
+    }
+    if (0 < sid && sid <= max_subject_id_)
         return cs_daa_map_.DAAOffsetSizeOf(sid, CsDaaMap::Permutation::kSPO).second;
     return 0;
 }
 
 uint IndexRetriever::GetByOSize(uint oid) {
-    if ((0 < oid && oid <= dict_.shared_cnt()) || max_subject_id_ < oid)
+    if (!delta_->empty()) {
+        std::shared_lock<std::shared_mutex> lock(delta_->mutex());
+        if (delta_->ObjectTouched(oid)) {
+            uint size = 0;
+            for (uint pid : MergedOPreSet(oid))
+                size += MergedByOP(oid, pid).size();
+            return size;
+        }
+    }
+    if ((0 < oid && oid <= dict_.shared_cnt()) || (max_subject_id_ < oid && oid <= max_id_))
         return cs_daa_map_.DAAOffsetSizeOf(oid, CsDaaMap::Permutation::kOPS).second;
     return 0;
 }
@@ -226,11 +647,15 @@ uint IndexRetriever::GetByOPSize(uint oid, uint pid) {
 }
 
 uint IndexRetriever::GetBySOSize(uint sid, uint oid) {
-    return GetBySO(sid, oid).size();
+    std::shared_ptr<std::vector<uint>> owner;
+    return GetBySO(sid, oid, owner).size();
 }
 
 uint IndexRetriever::predicate_cnt() {
-    return dict_.predicate_cnt();
+    if (delta_->empty())
+        return dict_.predicate_cnt();
+    std::shared_lock<std::shared_mutex> lock(delta_->mutex());
+    return delta_->max_predicate_id();
 }
 
 uint IndexRetriever::shared_cnt() {
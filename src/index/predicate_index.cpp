@@ -47,6 +47,8 @@ PredicateIndex::PredicateIndex(std::string file_path, uint max_predicate_id)
 
     ps_sets_ = std::vector<std::span<uint>>(max_predicate_id_);
     po_sets_ = std::vector<std::span<uint>>(max_predicate_id_);
+    ps_loaded_ = std::vector<std::once_flag>(max_predicate_id_);
+    po_loaded_ = std::vector<std::once_flag>(max_predicate_id_);
 
     phmap::btree_map<uint, uint> s_sizes, o_sizes;
     for (uint pid = 1; pid <= max_predicate_id_; pid++) {
@@ -249,7 +251,8 @@ void PredicateIndex::Store() {
 }
 
 std::span<uint>& PredicateIndex::GetSSet(uint pid) {
-    if (ps_sets_[pid - 1].size() == 0) {
+    // several query threads may ask for the same set, it is decoded by the first one
+    std::call_once(ps_loaded_[pid - 1], [&]() {
         if (compress_predicate_index_) {
             uint s_array_offset = predicate_index_mmap_[(pid - 1) * 4];
             uint s_compressed_size = predicate_index_mmap_[(pid - 1) * 4 + 2] - s_array_offset;
@@ -278,12 +281,12 @@ std::span<uint>& PredicateIndex::GetSSet(uint pid) {
 
             ps_sets_[pid - 1] = std::span<uint>(set, s_array_size);
         }
-    }
+    });
     return ps_sets_[pid - 1];
 };
 
 std::span<uint>& PredicateIndex::GetOSet(uint pid) {
-    if (po_sets_[pid - 1].size() == 0) {
+    std::call_once(po_loaded_[pid - 1], [&]() {
         if (compress_predicate_index_) {
             uint o_array_offset = predicate_index_mmap_[(pid - 1) * 4 + 2];
             uint o_compressed_size;
@@ -318,39 +321,33 @@ std::span<uint>& PredicateIndex::GetOSet(uint pid) {
 
             po_sets_[pid - 1] = std::span<uint>(set, set + o_array_size);
         }
-    }
+    });
     return po_sets_[pid - 1];
 }
 
 uint PredicateIndex::GetSSetSize(uint pid) {
-    if (ps_sets_[pid - 1].size() == 0) {
-        uint s_array_size;
-        if (compress_predicate_index_) {
-            s_array_size = predicate_index_mmap_[(pid - 1) * 4 + 1];
-        } else {
-            uint s_array_offset = predicate_index_mmap_[(pid - 1) * 2];
-            s_array_size = predicate_index_mmap_[(pid - 1) * 2 + 1] - s_array_offset;
-        }
-        return s_array_size;
+    uint s_array_size;
+    if (compress_predicate_index_) {
+        s_array_size = predicate_index_mmap_[(pid - 1) * 4 + 1];
+    } else {
+        uint s_array_offset = predicate_index_mmap_[(pid - 1) * 2];
+        s_array_size = predicate_index_mmap_[(pid - 1) * 2 + 1] - s_array_offset;
     }
-    return ps_sets_[pid - 1].size();
+    return s_array_size;
 }
 
 uint PredicateIndex::GetOSetSize(uint pid) {
-    if (po_sets_[pid - 1].size() == 0) {
-        uint o_array_size;
-        if (compress_predicate_index_) {
-            o_array_size = predicate_index_mmap_[(pid - 1) * 4 + 3];
-        } else {
-            uint o_array_offset = predicate_index_mmap_[(pid - 1) * 2 + 1];
-            if (pid != max_predicate_id_)
-                o_array_size = predicate_index_mmap_[pid * 2] - o_array_offset;
-            else
-                o_array_size = predicate_index_mmap_.size_ / 4 - o_array_offset;
-        }
-        return o_array_size;
+    uint o_array_size;
+    if (compress_predicate_index_) {
+        o_array_size = predicate_index_mmap_[(pid - 1) * 4 + 3];
+    } else {
+        uint o_array_offset = predicate_index_mmap_[(pid - 1) * 2 + 1];
+        if (pid != max_predicate_id_)
+            o_array_size = predicate_index_mmap_[pid * 2] - o_array_offset;
+        else
+            o_array_size = predicate_index_mmap_.size_ / 4 - o_array_offset;
     }
-    return po_sets_[pid - 1].size();
+    return o_array_size;
 }
 
 void PredicateIndex::Close() {
@@ -362,4 +359,6 @@ void PredicateIndex::Close() {
 
     std::vector<std::span<uint>>().swap(ps_sets_);
     std::vector<std::span<uint>>().swap(po_sets_);
+    std::vector<std::once_flag>().swap(ps_loaded_);
+    std::vector<std::once_flag>().swap(po_loaded_);
 }
\ No newline at end of file
@@ -58,9 +58,9 @@ SPARQLLexer::TokenT SPARQLLexer::GetNextTokenType() {
             // case '@':
             //     token_stop_pos_ = current_pos_;
             //     return TokenT::kAt;
-            //                case '+':
-            //                    token_stop_pos_ = current_pos_;
-            //                    return TokenT::kPlus;
+            case '+':
+                token_stop_pos_ = current_pos_;
+                return TokenT::kPlus;
             //                case '-':
             //                    token_stop_pos_ = current_pos_;
             //                    return TokenT::kMinus;
@@ -76,11 +76,12 @@ SPARQLLexer::TokenT SPARQLLexer::GetNextTokenType() {
                 return TokenT::kEqual;
             case '!':
                 if (*current_pos_ == '=') {
+                    ++current_pos_;
                     token_stop_pos_ = current_pos_;
                     return TokenT::kNotEqual;
                 }
-                is_token_finish_ = true;
-                return TokenT::kError;
+                token_stop_pos_ = current_pos_;
+                return TokenT::kNot;
             case '>':
                 if (*current_pos_ == '=') {
                     ++current_pos_;
@@ -110,12 +111,19 @@ SPARQLLexer::TokenT SPARQLLexer::GetNextTokenType() {
                 while (HasNext()) {
                     if (*(current_pos_++) == '"') {
                         if (*(current_pos_) == '@' || *(current_pos_) == '^') {
+                            bool is_typed = *(current_pos_) == '^';
                             while (HasNext()) {
-                                if (*(current_pos_++) == ' ') {
+                                char c = *(current_pos_++);
+                                if (c == ' ') {
                                     token_stop_pos_ = current_pos_;
                                     token_stop_pos_--;
                                     return TokenT::kString;
                                 }
+                                // the datatype ends at '>', e.g. the ')' of a FILTER may follow it
+                                if (is_typed && c == '>') {
+                                    token_stop_pos_ = current_pos_;
+                                    return TokenT::kString;
+                                }
                             }
                         }
                         token_stop_pos_ = current_pos_;
@@ -130,6 +138,13 @@ SPARQLLexer::TokenT SPARQLLexer::GetNextTokenType() {
                 }
                 token_stop_pos_ = current_pos_;
                 return TokenT::kVariable;
+            case '$':
+                // placeholder of a prepared statement
+                while (HasNext() && IsLegalVariableCharacter(*current_pos_)) {
+                    ++current_pos_;
+                }
+                token_stop_pos_ = current_pos_;
+                return TokenT::kParameter;
             case '0':
             case '1':
             case '2':
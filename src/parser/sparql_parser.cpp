@@ -1,4 +1,5 @@
 #include "rdf-tdaa/parser/sparql_parser.hpp"
+#include <algorithm>
 #include <codecvt>
 #include <iomanip>
 #include <iostream>
@@ -24,19 +25,25 @@ bool SPARQLParser::Term::IsVariable() const {
     return type == Type::kVariable;
 }
 
+bool SPARQLParser::Term::IsParameter() const {
+    return type == Type::kParameter;
+}
+
 SPARQLParser::TriplePattern::TriplePattern(Term subj, Term pred, Term obj, bool is_option, uint variale_cnt)
     : subject(std::move(subj)),
       predicate(std::move(pred)),
       object(std::move(obj)),
       is_option(is_option),
-      variable_cnt(variale_cnt) {}
+      variable_cnt(variale_cnt),
+      path(kNone) {}
 
 SPARQLParser::TriplePattern::TriplePattern(Term subj, Term pred, Term obj)
     : subject(std::move(subj)),
       predicate(std::move(pred)),
       object(std::move(obj)),
       is_option(false),
-      variable_cnt(0) {}
+      variable_cnt(0),
+      path(kNone) {}
 
 SPARQLParser::ProjectModifier::ProjectModifier(Type modifierType) : modifier_type(modifierType) {}
 
@@ -61,36 +68,73 @@ void SPARQLParser::parse() {
     ParseProjection();
     ParseWhere();
     ParseGroupGraphPattern();
+    ParseOrderBy();
     ParseLimit();
 
+    if (!unions_.empty()) {
+        union_branches_ = ExpandUnions();
+        unions_.clear();
+    }
+    // the patterns of each query that is answered, one per alternative of the UNIONs
+    std::vector<const std::vector<TriplePattern>*> groups;
+    if (union_branches_.empty())
+        groups.push_back(&triple_patterns_);
+    for (const auto& branch : union_branches_)
+        groups.push_back(&branch.triple_patterns);
+
     // 如果 select 后是 *，则查询结果的变量应该是三元组中出现的变量
     if (project_variables_[0] == "*") {
         project_variables_.clear();
         std::set<std::string> variables_set;
-        for (const auto& item : triple_patterns_) {
-            const auto& s = item.subject.value;
-            const auto& p = item.predicate.value;
-            const auto& o = item.object.value;
-            if (s[0] == '?')
-                variables_set.insert(s);
-            if (p[0] == '?')
-                variables_set.insert(p);
-            if (o[0] == '?')
-                variables_set.insert(o);
+        for (const auto* group : groups) {
+            for (const auto& item : *group) {
+                const auto& s = item.subject.value;
+                const auto& p = item.predicate.value;
+                const auto& o = item.object.value;
+                if (s[0] == '?')
+                    variables_set.insert(s);
+                if (p[0] == '?')
+                    variables_set.insert(p);
+                if (o[0] == '?')
+                    variables_set.insert(o);
+            }
         }
         project_variables_.assign(variables_set.begin(), variables_set.end());
     }
+
+    // the OPTIONAL patterns extend the results of the others
+    for (const auto* group : groups) {
+        if (!group->empty() && std::all_of(group->begin(), group->end(),
+                                           [](const TriplePattern& item) { return item.is_option; }))
+            throw ParserException("Expect : a triple pattern outside OPTIONAL");
+    }
+
+    for (const auto& condition : order_conditions_) {
+        bool found = std::any_of(groups.begin(), groups.end(), [&](const auto* group) {
+            return std::any_of(group->begin(), group->end(), [&](const TriplePattern& item) {
+                return item.subject.value == condition.variable || item.predicate.value == condition.variable ||
+                       item.object.value == condition.variable;
+            });
+        });
+        if (!found)
+            throw ParserException("Unknown variable '" + condition.variable + "' in order by");
+    }
 }
 
 void SPARQLParser::ParsePrefix() {
     for (;;) {
         auto token_t = sparql_lexer_.GetNextTokenType();
         if (token_t == SPARQLLexer::kIdentifier && sparql_lexer_.IsKeyword("prefix")) {
-            if (sparql_lexer_.GetNextTokenType() != SPARQLLexer::kIdentifier) {
+            std::string name;
+            token_t = sparql_lexer_.GetNextTokenType();
+            // PREFIX : <...> declares the empty prefix
+            if (token_t == SPARQLLexer::kIdentifier) {
+                name = sparql_lexer_.GetCurrentTokenValue();
+                token_t = sparql_lexer_.GetNextTokenType();
+            } else if (token_t != SPARQLLexer::kColon) {
                 throw ParserException("Expect : prefix name");
             }
-            std::string name = sparql_lexer_.GetCurrentTokenValue();
-            if (sparql_lexer_.GetNextTokenType() != SPARQLLexer::kColon) {
+            if (token_t != SPARQLLexer::kColon) {
                 throw ParserException("Expect : ':");
             }
             if (sparql_lexer_.GetNextTokenType() != SPARQLLexer::kIRI) {
@@ -127,6 +171,10 @@ void SPARQLParser::ParseProjection() {
             project_modifier_ = ProjectModifier::Type::Duplicates;
         else
             sparql_lexer_.PutBack(token_t);
+    } else if (token_t == SPARQLLexer::kLRound) {
+        project_variables_.clear();
+        ParseCount();
+        return;
     } else
         sparql_lexer_.PutBack(token_t);
 
@@ -145,6 +193,44 @@ void SPARQLParser::ParseProjection() {
     }
 }
 
+// (COUNT([DISTINCT] * | ?variable) [AS ?variable])
+void SPARQLParser::ParseCount() {
+    if (sparql_lexer_.GetNextTokenType() != SPARQLLexer::TokenT::kIdentifier || !sparql_lexer_.IsKeyword("count")) {
+        throw ParserException("Except : 'count'");
+    }
+    if (sparql_lexer_.GetNextTokenType() != SPARQLLexer::TokenT::kLRound) {
+        throw ParserException("Expect : (");
+    }
+
+    auto token_t = sparql_lexer_.GetNextTokenType();
+    if (token_t == SPARQLLexer::TokenT::kIdentifier && sparql_lexer_.IsKeyword("distinct")) {
+        count_distinct_ = true;
+        token_t = sparql_lexer_.GetNextTokenType();
+    }
+    // '*' is lexed as a variable, parse() expands it
+    if (token_t != SPARQLLexer::TokenT::kVariable) {
+        throw ParserException("Expect : Variable or *");
+    }
+    project_variables_.push_back(sparql_lexer_.GetCurrentTokenValue());
+    count_all_ = project_variables_.back() == "*";
+    if (sparql_lexer_.GetNextTokenType() != SPARQLLexer::TokenT::kRRound) {
+        throw ParserException("Expect : )");
+    }
+
+    token_t = sparql_lexer_.GetNextTokenType();
+    if (token_t == SPARQLLexer::TokenT::kIdentifier && sparql_lexer_.IsKeyword("as")) {
+        if (sparql_lexer_.GetNextTokenType() != SPARQLLexer::TokenT::kVariable) {
+            throw ParserException("Expect : Variable");
+        }
+        count_variable_ = sparql_lexer_.GetCurrentTokenValue();
+        token_t = sparql_lexer_.GetNextTokenType();
+    }
+    if (token_t != SPARQLLexer::TokenT::kRRound) {
+        throw ParserException("Expect : )");
+    }
+    project_modifier_ = ProjectModifier::Type::Count;
+}
+
 void SPARQLParser::ParseWhere() {
     if (sparql_lexer_.GetNextTokenType() != SPARQLLexer::TokenT::kIdentifier ||
         !sparql_lexer_.IsKeyword("where")) {
@@ -157,13 +243,48 @@ void SPARQLParser::ParseFilter() {
         throw ParserException("Expect : (");
     }
 
-    if (sparql_lexer_.GetNextTokenType() != SPARQLLexer::TokenT::kVariable) {
+    Filter filter;
+    auto token = sparql_lexer_.GetNextTokenType();
+    bool negated = token == SPARQLLexer::TokenT::kNot;
+    if (negated)
+        token = sparql_lexer_.GetNextTokenType();
+    // BOUND(?x), !BOUND(?x) and sameTerm(?x, term)
+    if (token == SPARQLLexer::TokenT::kIdentifier &&
+        (sparql_lexer_.IsKeyword("bound") || (!negated && sparql_lexer_.IsKeyword("sameterm")))) {
+        bool is_bound = sparql_lexer_.IsKeyword("bound");
+        if (sparql_lexer_.GetNextTokenType() != SPARQLLexer::TokenT::kLRound) {
+            throw ParserException("Expect : (");
+        }
+        if (sparql_lexer_.GetNextTokenType() != SPARQLLexer::TokenT::kVariable) {
+            throw ParserException("Expect : Variable");
+        }
+        filter.variable_str = sparql_lexer_.GetCurrentTokenValue();
+        if (is_bound) {
+            filter.filter_type = negated ? Filter::Type::NotBound : Filter::Type::Bound;
+        } else {
+            filter.filter_type = Filter::Type::SameTerm;
+            if (sparql_lexer_.GetNextTokenType() != SPARQLLexer::TokenT::kComma) {
+                throw ParserException("Expect : ,");
+            }
+            filter.filter_args.push_back(ParseFilterArgument(sparql_lexer_.GetNextTokenType()));
+        }
+        if (sparql_lexer_.GetNextTokenType() != SPARQLLexer::TokenT::kRRound ||
+            sparql_lexer_.GetNextTokenType() != SPARQLLexer::TokenT::kRRound) {
+            throw ParserException("Expect : )");
+        }
+        filters_.push_back(filter);
+        return;
+    }
+    if (negated) {
+        throw ParserException("Expect : BOUND");
+    }
+
+    if (token != SPARQLLexer::TokenT::kVariable) {
         throw ParserException("Expect : Variable");
     }
     std::string variable = sparql_lexer_.GetCurrentTokenValue();
-    Filter filter;
     filter.variable_str = variable;
-    auto token = sparql_lexer_.GetNextTokenType();
+    token = sparql_lexer_.GetNextTokenType();
     switch (token) {
         case SPARQLLexer::TokenT::kEqual:
             filter.filter_type = Filter::Type::Equal;
@@ -198,22 +319,27 @@ void SPARQLParser::ParseFilter() {
                 break;
             case SPARQLLexer::TokenT::kEof:
                 throw ParserException("Unexpect EOF in parse 'filter(...'");
-            case SPARQLLexer::TokenT::kString: {
-                std::string value = sparql_lexer_.GetCurrentTokenValue();
-                auto string_elem = MakeStringLiteral(value);
-                filter.filter_args.push_back(string_elem);
-            } break;
-            case SPARQLLexer::TokenT::kNumber: {
-                std::string value = sparql_lexer_.GetCurrentTokenValue();
-                auto double_elem = MakeDoubleLiteral(value);
-                filter.filter_args.push_back(double_elem);
-            } break;
             default:
-                throw ParserException("Parse filter failed when meet :" +
-                                      sparql_lexer_.GetCurrentTokenValue());
+                filter.filter_args.push_back(ParseFilterArgument(token));
         }
     }
-    filters_[filter.variable_str] = filter;
+    filters_.push_back(filter);
+}
+
+SPARQLParser::Term SPARQLParser::ParseFilterArgument(SPARQLLexer::TokenT token) {
+    std::string value = sparql_lexer_.GetCurrentTokenValue();
+    switch (token) {
+        case SPARQLLexer::TokenT::kVariable:
+            return MakeVariable(value);
+        case SPARQLLexer::TokenT::kIRI:
+            return MakeIRI(value);
+        case SPARQLLexer::TokenT::kString:
+            return MakeStringLiteral(value);
+        case SPARQLLexer::TokenT::kNumber:
+            return MakeDoubleLiteral(value);
+        default:
+            throw ParserException("Parse filter failed when meet :" + value);
+    }
 }
 
 void SPARQLParser::ParseGroupGraphPattern() {
@@ -225,9 +351,8 @@ void SPARQLParser::ParseGroupGraphPattern() {
         auto token_t = sparql_lexer_.GetNextTokenType();
         if (token_t == SPARQLLexer::TokenT::kLCurly) {
             sparql_lexer_.PutBack(token_t);
-            ParseGroupGraphPattern();
-        } else if (token_t == SPARQLLexer::TokenT::kIdentifier && sparql_lexer_.IsKeyword("optional") &&
-                   sparql_lexer_.IsKeyword("OPTIONAL")) {
+            ParseUnion();
+        } else if (token_t == SPARQLLexer::TokenT::kIdentifier && sparql_lexer_.IsKeyword("optional")) {
             if (sparql_lexer_.GetNextTokenType() != SPARQLLexer::TokenT::kLCurly) {
                 throw ParserException("Except : '{'");
             }
@@ -235,8 +360,7 @@ void SPARQLParser::ParseGroupGraphPattern() {
             if (sparql_lexer_.GetNextTokenType() != SPARQLLexer::TokenT::kRCurly) {
                 throw ParserException("Except : '}'");
             }
-        } else if (token_t == SPARQLLexer::TokenT::kIdentifier && sparql_lexer_.IsKeyword("filter") &&
-                   sparql_lexer_.IsKeyword("FILTER")) {
+        } else if (token_t == SPARQLLexer::TokenT::kIdentifier && sparql_lexer_.IsKeyword("filter")) {
             ParseFilter();
         } else if (token_t == SPARQLLexer::TokenT::kRCurly) {
             break;
@@ -249,9 +373,67 @@ void SPARQLParser::ParseGroupGraphPattern() {
     }
 }
 
+void SPARQLParser::ParseUnion() {
+    std::vector<UnionBranch> alternatives;
+    for (;;) {
+        // the group is parsed on its own, then its alternatives are added to those of the UNION
+        auto triple_patterns = std::move(triple_patterns_);
+        auto filters = std::move(filters_);
+        auto unions = std::move(unions_);
+        triple_patterns_.clear();
+        filters_.clear();
+        unions_.clear();
+
+        ParseGroupGraphPattern();
+        auto group = ExpandUnions();
+        alternatives.insert(alternatives.end(), group.begin(), group.end());
+
+        triple_patterns_ = std::move(triple_patterns);
+        filters_ = std::move(filters);
+        unions_ = std::move(unions);
+
+        auto token_t = sparql_lexer_.GetNextTokenType();
+        if (token_t != SPARQLLexer::TokenT::kIdentifier || !sparql_lexer_.IsKeyword("union")) {
+            sparql_lexer_.PutBack(token_t);
+            break;
+        }
+    }
+
+    // a group without UNION is a part of the enclosing group
+    if (alternatives.size() == 1) {
+        triple_patterns_.insert(triple_patterns_.end(), alternatives[0].triple_patterns.begin(),
+                                alternatives[0].triple_patterns.end());
+        filters_.insert(filters_.end(), alternatives[0].filters.begin(), alternatives[0].filters.end());
+    } else {
+        unions_.push_back(std::move(alternatives));
+    }
+}
+
+std::vector<SPARQLParser::UnionBranch> SPARQLParser::ExpandUnions() const {
+    std::vector<UnionBranch> branches = {{triple_patterns_, filters_}};
+    for (const auto& alternatives : unions_) {
+        std::vector<UnionBranch> expanded;
+        expanded.reserve(branches.size() * alternatives.size());
+        for (const auto& branch : branches) {
+            for (const auto& alternative : alternatives) {
+                UnionBranch combined = branch;
+                combined.triple_patterns.insert(combined.triple_patterns.end(),
+                                                alternative.triple_patterns.begin(),
+                                                alternative.triple_patterns.end());
+                combined.filters.insert(combined.filters.end(), alternative.filters.begin(),
+                                        alternative.filters.end());
+                expanded.push_back(std::move(combined));
+            }
+        }
+        branches = std::move(expanded);
+    }
+    return branches;
+}
+
 void SPARQLParser::ParseBasicGraphPattern(bool is_option) {
     Term pattern_term[3];
     uint variable_cnt = 0;
+    TriplePattern::Path path = TriplePattern::kNone;
     for (uint i = 0; i < 3; ++i) {
         auto token_t = sparql_lexer_.GetNextTokenType();
         std::string token_value = sparql_lexer_.GetCurrentTokenValue();
@@ -274,6 +456,9 @@ void SPARQLParser::ParseBasicGraphPattern(bool is_option) {
                 term = MakeVariable(token_value);
                 variable_cnt++;
                 break;
+            case SPARQLLexer::TokenT::kParameter:
+                term = MakeParameter(token_value);
+                break;
             case SPARQLLexer::TokenT::kIRI:
                 term = MakeIRI(token_value);
                 break;
@@ -283,23 +468,104 @@ void SPARQLParser::ParseBasicGraphPattern(bool is_option) {
             case SPARQLLexer::TokenT::kNumber:
                 term = MakeDoubleLiteral(token_value);
                 break;
-            case SPARQLLexer::TokenT::kIdentifier:
-                term = MakeNoTypeLiteral(token_value);
+            case SPARQLLexer::TokenT::kIdentifier: {
+                auto next_t = sparql_lexer_.GetNextTokenType();
+                if (next_t == SPARQLLexer::TokenT::kColon) {
+                    term = ParsePrefixedName(token_value);
+                } else {
+                    sparql_lexer_.PutBack(next_t);
+                    term = MakeNoTypeLiteral(token_value);
+                }
+                break;
+            }
+            case SPARQLLexer::TokenT::kColon:
+                term = ParsePrefixedName("");
                 break;
             default:
                 throw ParserException("Except variable or IRI or Literal or Blank");
         }
         term.position = SPARQLParser::Term::Positon(i);
         pattern_term[i] = term;
+
+        if (i == 1) {
+            // <p>+ and <p>*, the '*' is read as the variable of SELECT *
+            auto path_t = sparql_lexer_.GetNextTokenType();
+            if (path_t == SPARQLLexer::TokenT::kPlus ||
+                (path_t == SPARQLLexer::TokenT::kVariable && sparql_lexer_.GetCurrentTokenValue() == "*")) {
+                if (term.type != Term::Type::kIRI)
+                    throw ParserException("Expect : IRI before '+' or '*'");
+                if (is_option)
+                    throw ParserException("Expect : a triple pattern without property path in OPTIONAL");
+                path = (path_t == SPARQLLexer::TokenT::kPlus) ? TriplePattern::kOneOrMore
+                                                              : TriplePattern::kZeroOrMore;
+            } else {
+                sparql_lexer_.PutBack(path_t);
+            }
+        }
     }
     auto token_t = sparql_lexer_.GetNextTokenType();
     if (token_t != SPARQLLexer::TokenT::kDot) {
         sparql_lexer_.PutBack(token_t);
     }
     TriplePattern pattern(pattern_term[0], pattern_term[1], pattern_term[2], is_option, variable_cnt);
+    pattern.path = path;
     triple_patterns_.push_back(std::move(pattern));
 }
 
+SPARQLParser::Term SPARQLParser::ParsePrefixedName(const std::string& prefix) {
+    auto it = prefixes_.find(prefix);
+    if (it == prefixes_.end())
+        throw ParserException("Unknown prefix '" + prefix + "'");
+    std::string local;
+    auto token_t = sparql_lexer_.GetNextTokenType();
+    if (token_t == SPARQLLexer::TokenT::kIdentifier)
+        local = sparql_lexer_.GetCurrentTokenValue();
+    else
+        sparql_lexer_.PutBack(token_t);
+    // the IRI of the prefix is kept with its angle brackets
+    const std::string& iri = it->second;
+    return MakeIRI(iri.substr(0, iri.size() - 1) + local + ">");
+}
+
+// ORDER BY (?variable | ASC(?variable) | DESC(?variable))+
+void SPARQLParser::ParseOrderBy() {
+    auto token_t = sparql_lexer_.GetNextTokenType();
+    if (token_t != SPARQLLexer::kIdentifier || !sparql_lexer_.IsKeyword("order")) {
+        sparql_lexer_.PutBack(token_t);
+        return;
+    }
+    if (sparql_lexer_.GetNextTokenType() != SPARQLLexer::kIdentifier || !sparql_lexer_.IsKeyword("by")) {
+        throw ParserException("Except : 'by'");
+    }
+
+    for (;;) {
+        token_t = sparql_lexer_.GetNextTokenType();
+        if (token_t == SPARQLLexer::kVariable) {
+            order_conditions_.push_back({sparql_lexer_.GetCurrentTokenValue(), false});
+        } else if (token_t == SPARQLLexer::kIdentifier &&
+                   (sparql_lexer_.IsKeyword("asc") || sparql_lexer_.IsKeyword("desc"))) {
+            bool descending = sparql_lexer_.IsKeyword("desc");
+            if (sparql_lexer_.GetNextTokenType() != SPARQLLexer::kLRound) {
+                throw ParserException("Expect : (");
+            }
+            if (sparql_lexer_.GetNextTokenType() != SPARQLLexer::kVariable) {
+                throw ParserException("Expect : Variable");
+            }
+            order_conditions_.push_back({sparql_lexer_.GetCurrentTokenValue(), descending});
+            if (sparql_lexer_.GetNextTokenType() != SPARQLLexer::kRRound) {
+                throw ParserException("Expect : )");
+            }
+        } else {
+            sparql_lexer_.PutBack(token_t);
+            break;
+        }
+    }
+
+    if (order_conditions_.empty()) {
+        throw ParserException("Except : order by variable");
+    }
+}
+
 void SPARQLParser::ParseLimit() {
     auto token_t = sparql_lexer_.GetNextTokenType();
     if (token_t == SPARQLLexer::kIdentifier && sparql_lexer_.IsKeyword("limit")) {
@@ -348,15 +614,27 @@ SPARQLParser::Term SPARQLParser::MakeFunctionLiteral(std::string literal) {
     return {Term::Type::kLiteral, Term::ValueType::kFunction, std::move(literal)};
 }
 
+SPARQLParser::Term SPARQLParser::MakeParameter(std::string parameter) {
+    return {Term::Type::kParameter, Term::ValueType::kNone, std::move(parameter)};
+}
+
 SPARQLParser::SPARQLParser(const SPARQLLexer& sparql_lexer)
-    : limit_(UINTMAX_MAX), sparql_lexer_(sparql_lexer), project_modifier_(ProjectModifier::Type::None) {
+    : limit_(UINTMAX_MAX),
+      sparql_lexer_(sparql_lexer),
+      project_modifier_(ProjectModifier::Type::None),
+      count_variable_("?count"),
+      count_distinct_(false),
+      count_all_(false) {
     parse();
 }
 
 SPARQLParser::SPARQLParser(std::string input_string)
     : limit_(UINTMAX_MAX),
       sparql_lexer_(SPARQLLexer(std::move(input_string))),
-      project_modifier_(ProjectModifier::Type::None) {
+      project_modifier_(ProjectModifier::Type::None),
+      count_variable_("?count"),
+      count_distinct_(false),
+      count_all_(false) {
     parse();
 }
 
@@ -368,6 +646,18 @@ const std::vector<std::string>& SPARQLParser::ProjectVariables() const {
     return project_variables_;
 }
 
+const std::string& SPARQLParser::CountVariable() const {
+    return count_variable_;
+}
+
+bool SPARQLParser::CountDistinct() const {
+    return count_distinct_;
+}
+
+bool SPARQLParser::CountAll() const {
+    return count_all_;
+}
+
 const std::vector<SPARQLParser::TriplePattern>& SPARQLParser::TriplePatterns() const {
     return triple_patterns_;
 }
@@ -380,14 +670,73 @@ std::vector<std::vector<std::string>> SPARQLParser::TripleList() const {
     return list;
 }
 
-const std::unordered_map<std::string, SPARQLParser::Filter>& SPARQLParser::Filters() const {
+const std::vector<SPARQLParser::Filter>& SPARQLParser::Filters() const {
     return filters_;
 }
 
+bool SPARQLParser::HasUnion() const {
+    return !union_branches_.empty();
+}
+
+std::vector<std::shared_ptr<SPARQLParser>> SPARQLParser::Branches() const {
+    std::vector<std::shared_ptr<SPARQLParser>> branches;
+    for (const auto& branch : union_branches_) {
+        auto query = std::make_shared<SPARQLParser>(*this);
+        query->triple_patterns_ = branch.triple_patterns;
+        query->filters_ = branch.filters;
+        query->union_branches_.clear();
+        branches.push_back(query);
+    }
+    return branches;
+}
+
 const std::unordered_map<std::string, std::string>& SPARQLParser::Prefixes() const {
     return prefixes_;
 }
 
+const std::vector<SPARQLParser::OrderCondition>& SPARQLParser::OrderConditions() const {
+    return order_conditions_;
+}
+
 size_t SPARQLParser::Limit() const {
     return limit_;
-}
\ No newline at end of file
+}
+std::vector<std::string> SPARQLParser::Parameters() const {
+    std::vector<std::string> parameters;
+    auto collect = [&](const std::vector<TriplePattern>& triple_patterns) {
+        for (const auto& item : triple_patterns) {
+            for (const Term* term : {&item.subject, &item.predicate, &item.object}) {
+                if (term->IsParameter() &&
+                    std::find(parameters.begin(), parameters.end(), term->value) == parameters.end())
+                    parameters.push_back(term->value);
+            }
+        }
+    };
+    collect(triple_patterns_);
+    for (const auto& branch : union_branches_)
+        collect(branch.triple_patterns);
+    return parameters;
+}
+
+std::shared_ptr<SPARQLParser> SPARQLParser::Bind(const std::unordered_map<std::string, std::string>& bindings) const {
+    // the copied lexer is not used again, parsing is finished
+    auto bound = std::make_shared<SPARQLParser>(*this);
+    auto bind = [&](std::vector<TriplePattern>& triple_patterns) {
+        for (auto& item : triple_patterns) {
+            for (Term* term : {&item.subject, &item.predicate, &item.object}) {
+                if (!term->IsParameter())
+                    continue;
+                auto it = bindings.find(term->value);
+                if (it == bindings.end())
+                    throw ParserException("No binding for '" + term->value + "'");
+                term->value = it->second;
+                term->type =
+                    (!it->second.empty() && it->second[0] == '<') ? Term::Type::kIRI : Term::Type::kLiteral;
+            }
+        }
+    };
+    bind(bound->triple_patterns_);
+    for (auto& branch : bound->union_branches_)
+        bind(branch.triple_patterns);
+    return bound;
+}
@@ -0,0 +1,112 @@
+#include "rdf-tdaa/query/filter_evaluator.hpp"
+
+// the characters of a plain string or of an xsd:string literal
+static bool StringValue(std::string_view term, std::string_view& value) {
+    static constexpr std::string_view kString = "\"^^<http://www.w3.org/2001/XMLSchema#string>";
+    if (term.size() < 2 || term[0] != '"')
+        return false;
+    if (term.back() == '"') {
+        value = term.substr(1, term.size() - 2);
+        return true;
+    }
+    if (term.size() > kString.size() && term.ends_with(kString)) {
+        value = term.substr(1, term.size() - kString.size() - 1);
+        return true;
+    }
+    return false;
+}
+
+FilterEvaluator::FilterEvaluator(std::shared_ptr<IndexRetriever> index)
+    : index_(index), max_subject_id_(index->max_subject_id()) {}
+
+bool FilterEvaluator::MaybeLiteral(uint id, Positon position) {
+    return position != Positon::kPredicate && id > max_subject_id_;
+}
+
+bool FilterEvaluator::Equal(const PlanGenerator::FilterItem& filter, uint value, uint other) {
+    bool is_constant = filter.second_level == -1;
+    // a constant has an id of the position of the variable
+    bool same_ids = is_constant || (filter.first_position == Positon::kPredicate) ==
+                                       (filter.second_position == Positon::kPredicate);
+    if (same_ids && other != 0 && value == other)
+        return true;
+
+    bool other_literal = is_constant ? filter.constant.starts_with('"') : MaybeLiteral(other, filter.second_position);
+    if (same_ids && !(MaybeLiteral(value, filter.first_position) && other_literal))
+        return false;
+
+    std::string a = index_->Decode(value, filter.first_position);
+    std::string b = is_constant ? filter.constant : index_->Decode(other, filter.second_position);
+    std::string_view lexical_a, lexical_b;
+    Dictionary::LiteralType type = Dictionary::TypeOf(a, lexical_a);
+    if (type != Dictionary::LiteralType::kUnordered && type == Dictionary::TypeOf(b, lexical_b))
+        return Dictionary::CompareLiterals(type, lexical_a, lexical_b) == 0;
+    return a == b;
+}
+
+bool FilterEvaluator::Compare(const PlanGenerator::FilterItem& filter, uint value, uint other) {
+    std::string a = index_->Decode(value, filter.first_position);
+    std::string b = filter.second_level == -1 ? filter.constant : index_->Decode(other, filter.second_position);
+
+    int cmp;
+    std::string_view lexical_a, lexical_b;
+    Dictionary::LiteralType type = Dictionary::TypeOf(a, lexical_a);
+    if (type != Dictionary::LiteralType::kUnordered) {
+        if (type != Dictionary::TypeOf(b, lexical_b))
+            return false;
+        cmp = Dictionary::CompareLiterals(type, lexical_a, lexical_b);
+    } else if (StringValue(a, lexical_a) && StringValue(b, lexical_b)) {
+        cmp = lexical_a.compare(lexical_b);
+    } else {
+        return false;
+    }
+
+    switch (filter.type) {
+        case SPARQLParser::Filter::Type::Less:
+            return cmp < 0;
+        case SPARQLParser::Filter::Type::LessOrEq:
+            return cmp <= 0;
+        case SPARQLParser::Filter::Type::Greater:
+            return cmp > 0;
+        case SPARQLParser::Filter::Type::GreaterOrEq:
+            return cmp >= 0;
+        default:
+            return false;
+    }
+}
+
+bool FilterEvaluator::Evaluate(const PlanGenerator::FilterItem& filter, std::span<const uint> tuple) {
+    // 0 is the value of a variable left unbound by an OPTIONAL pattern
+    uint value = tuple[filter.first_level];
+    if (filter.type == SPARQLParser::Filter::Type::Bound)
+        return value != 0;
+    if (filter.type == SPARQLParser::Filter::Type::NotBound)
+        return value == 0;
+
+    uint other = filter.second_level == -1 ? filter.constant_id : tuple[filter.second_level];
+    if (value == 0 || (filter.second_level != -1 && other == 0))
+        return false;
+
+    switch (filter.type) {
+        case SPARQLParser::Filter::Type::SameTerm:
+            if (filter.second_level == -1 || (filter.first_position == Positon::kPredicate) ==
+                                                 (filter.second_position == Positon::kPredicate))
+                return value == other;
+            return index_->Decode(value, filter.first_position) == index_->Decode(other, filter.second_position);
+        case SPARQLParser::Filter::Type::Equal:
+            return Equal(filter, value, other);
+        case SPARQLParser::Filter::Type::NotEqual:
+            return !Equal(filter, value, other);
+        default:
+            return Compare(filter, value, other);
+    }
+}
+
+bool FilterEvaluator::Evaluate(const std::vector<PlanGenerator::FilterItem>& filters,
+                               std::span<const uint> tuple) {
+    for (const auto& filter : filters) {
+        if (!Evaluate(filter, tuple))
+            return false;
+    }
+    return true;
+}
@@ -0,0 +1,122 @@
+#include "rdf-tdaa/query/path_search.hpp"
+#include <algorithm>
+#include <thread>
+
+PathSearch::PathSearch(std::shared_ptr<IndexRetriever> index, uint thread_num)
+    : index_(index), max_id_(index->max_id()), thread_num_(std::max(thread_num, 1u)) {}
+
+void PathSearch::CancelBy(std::shared_ptr<CancellationToken> token) {
+    token_ = token;
+}
+
+bool PathSearch::Cancelled() {
+    return token_ != nullptr && token_->Cancelled();
+}
+
+std::vector<uint> PathSearch::Expand(const std::vector<uint>& frontier, uint pid, bool forward) {
+    auto neighbours = [&](ulong begin, ulong end, std::vector<uint>& result) {
+        for (ulong i = begin; i < end && !Cancelled(); i++) {
+            std::span<uint> r = forward ? index_->GetBySP(frontier[i], pid) : index_->GetByOP(frontier[i], pid);
+            result.insert(result.end(), r.begin(), r.end());
+        }
+    };
+
+    std::vector<uint> result;
+    if (thread_num_ == 1 || frontier.size() < kParallelFrontier) {
+        neighbours(0, frontier.size(), result);
+        return result;
+    }
+
+    std::vector<std::vector<uint>> results(thread_num_);
+    std::vector<std::thread> threads;
+    ulong chunk = (frontier.size() + thread_num_ - 1) / thread_num_;
+    for (uint t = 0; t < thread_num_; t++) {
+        ulong begin = std::min(t * chunk, frontier.size());
+        ulong end = std::min(begin + chunk, frontier.size());
+        threads.emplace_back(neighbours, begin, end, std::ref(results[t]));
+    }
+    for (auto& thread : threads)
+        thread.join();
+    for (const auto& r : results)
+        result.insert(result.end(), r.begin(), r.end());
+    return result;
+}
+
+// the marks of the searches of a thread, only the bits set by a search are cleared after it
+static thread_local Bitset forward_visited(0);
+static thread_local Bitset backward_visited(0);
+
+std::vector<uint> PathSearch::Reach(uint start, uint pid, bool forward, bool zero_length) {
+    Bitset& visited = forward_visited;
+    if (visited.Size() <= max_id_)
+        visited.Resize(max_id_ + 1);
+
+    std::vector<uint> reached;
+    if (zero_length) {
+        visited.Set(start);
+        reached.push_back(start);
+    }
+    // the start is not marked by p+, it is reached again only through a cycle
+    std::vector<uint> frontier = {start};
+    while (!frontier.empty() && !Cancelled()) {
+        std::vector<uint> next;
+        for (uint entity : Expand(frontier, pid, forward)) {
+            if (!visited.Get(entity)) {
+                visited.Set(entity);
+                next.push_back(entity);
+            }
+        }
+        reached.insert(reached.end(), next.begin(), next.end());
+        frontier = std::move(next);
+    }
+
+    for (uint entity : reached)
+        visited.Unset(entity);
+    std::sort(reached.begin(), reached.end());
+    return reached;
+}
+
+bool PathSearch::Reachable(uint from, uint to, uint pid, bool zero_length) {
+    if (zero_length && from == to)
+        return true;
+    for (Bitset* visited : {&forward_visited, &backward_visited}) {
+        if (visited->Size() <= max_id_)
+            visited->Resize(max_id_ + 1);
+    }
+
+    // the entities reached from `from` and those reaching `to`, by at least one edge
+    std::vector<uint> forward_frontier = {from};
+    std::vector<uint> backward_frontier = {to};
+    std::vector<uint> forward_reached;
+    std::vector<uint> backward_reached;
+    bool found = false;
+    // a search whose frontier is empty has reached all it can, then the other one can not meet it either
+    while (!found && !forward_frontier.empty() && !backward_frontier.empty() && !Cancelled()) {
+        bool forward = forward_frontier.size() <= backward_frontier.size();
+        auto& frontier = forward ? forward_frontier : backward_frontier;
+        auto& reached = forward ? forward_reached : backward_reached;
+        Bitset& visited = forward ? forward_visited : backward_visited;
+        Bitset& other = forward ? backward_visited : forward_visited;
+        uint target = forward ? to : from;
+
+        std::vector<uint> next;
+        for (uint entity : Expand(frontier, pid, forward)) {
+            if (entity == target || other.Get(entity)) {
+                found = true;
+                break;
+            }
+            if (!visited.Get(entity)) {
+                visited.Set(entity);
+                next.push_back(entity);
+            }
+        }
+        reached.insert(reached.end(), next.begin(), next.end());
+        frontier = std::move(next);
+    }
+
+    for (uint entity : forward_reached)
+        forward_visited.Unset(entity);
+    for (uint entity : backward_reached)
+        backward_visited.Unset(entity);
+    return found;
+}
@@ -0,0 +1,78 @@
+#include "rdf-tdaa/query/plan_cache.hpp"
+#include <mutex>
+
+PlanCache::PlanCache(ulong capacity) : capacity_(capacity), hits_(0), misses_(0), invalidations_(0) {}
+
+std::string PlanCache::Key(const SPARQLParser& parser) {
+    std::string key = parser.project_modifier().toString();
+    for (const auto& variable : parser.ProjectVariables())
+        key += " " + variable;
+    key += " {";
+    for (const auto& triple_pattern : parser.TriplePatterns()) {
+        for (const auto* term : {&triple_pattern.subject, &triple_pattern.predicate, &triple_pattern.object}) {
+            key += term->IsVariable() ? " " + term->value : " $";
+            if (term == &triple_pattern.predicate && triple_pattern.path != SPARQLParser::TriplePattern::kNone)
+                key += (triple_pattern.path == SPARQLParser::TriplePattern::kOneOrMore) ? "+" : "*";
+        }
+        key += triple_pattern.is_option ? " ?." : " .";
+    }
+    key += " }";
+    return key;
+}
+
+std::shared_ptr<PlanGenerator> PlanCache::Generate(std::shared_ptr<IndexRetriever>& index,
+                                                   std::shared_ptr<SPARQLParser>& parser) {
+    std::string key = Key(*parser);
+
+    std::shared_ptr<const Plan> plan;
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        auto it = plans_.find(key);
+        if (it != plans_.end())
+            plan = it->second;
+    }
+    if (plan) {
+        hits_++;
+        return std::make_shared<PlanGenerator>(index, parser, plan->variable_order, plan->distinct_predicate);
+    }
+
+    misses_++;
+    auto query_plan = std::make_shared<PlanGenerator>(index, parser);
+    // a query stopped by a constant that is not in the database has no variable order to keep
+    if (query_plan->zero_result())
+        return query_plan;
+
+    auto new_plan = std::make_shared<Plan>();
+    new_plan->variable_order = query_plan->variable_order();
+    new_plan->distinct_predicate = query_plan->distinct_predicate();
+
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    // the templates of a workload are few, evicting any entry is enough to bound the memory
+    if (plans_.size() >= capacity_ && !plans_.contains(key))
+        plans_.erase(plans_.begin());
+    plans_[key] = new_plan;
+    return query_plan;
+}
+
+void PlanCache::Clear() {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    plans_.clear();
+    invalidations_++;
+}
+
+ulong PlanCache::hits() const {
+    return hits_;
+}
+
+ulong PlanCache::misses() const {
+    return misses_;
+}
+
+ulong PlanCache::invalidations() const {
+    return invalidations_;
+}
+
+ulong PlanCache::size() {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return plans_.size();
+}
@@ -1,5 +1,7 @@
 #include "rdf-tdaa/query/plan_generator.hpp"
 #include <algorithm>
+#include <limits>
+#include <numeric>
 #include <unordered_set>
 #include "rdf-tdaa/query/query_executor.hpp"
 
@@ -12,6 +14,7 @@ PlanGenerator::Item::Item()
     : retrieval_type(RType::kNone),
       prestore_type(PType::kEmpty),
       index_result(),
+      owned_result(),
       triple_pattern_id(0),
       search_id(0),
       father_item_id(0),
@@ -21,6 +24,7 @@ PlanGenerator::Item::Item(const Item& other)
     : retrieval_type(other.retrieval_type),
       prestore_type(other.prestore_type),
       index_result(other.index_result),
+      owned_result(other.owned_result),
       triple_pattern_id(other.triple_pattern_id),
       search_id(other.search_id),
       father_item_id(other.father_item_id),
@@ -31,6 +35,7 @@ PlanGenerator::Item& PlanGenerator::Item::operator=(const Item& other) {
         retrieval_type = other.retrieval_type;
         prestore_type = other.prestore_type;
         index_result = other.index_result;
+        owned_result = other.owned_result;
         triple_pattern_id = other.triple_pattern_id;
         search_id = other.search_id;
         father_item_id = other.father_item_id;
@@ -57,13 +62,16 @@ PlanGenerator::Variable& PlanGenerator::Variable::operator=(const Variable& othe
 }
 
 PlanGenerator::PlanGenerator(std::shared_ptr<IndexRetriever>& index, std::shared_ptr<SPARQLParser>& sparql_parser)
-    : index_(index) {
+    : index_(index), delta_reader_(index->ReadDelta()) {
     const std::vector<SPARQLParser::TriplePattern>& triple_partterns = sparql_parser->TriplePatterns();
 
     std::vector<std::string> unsorted_variables;
     TripplePattern one_variable_tp;
     TripplePattern two_variable_tp;
     TripplePattern three_variable_tp;
+    TripplePattern optional_tp;
+    std::vector<SPARQLParser::TriplePattern> path_tp;
+    std::unordered_set<std::string> required_variables;
     phmap::flat_hash_map<std::string, uint> variable_frequency;
     uint tp_id = 0;
     for (const auto& triple_parttern : triple_partterns) {
@@ -71,6 +79,26 @@ PlanGenerator::PlanGenerator(std::shared_ptr<IndexRetriever>& index, std::shared
         auto& p = triple_parttern.predicate;
         auto& o = triple_parttern.object;
 
+        // OPTIONAL patterns neither restrict the results nor take part in the variable order
+        if (triple_parttern.is_option) {
+            optional_tp.push_back({{s, p, o}, tp_id++});
+            continue;
+        }
+        // property paths are followed from the values of the other patterns, their variables come after them
+        if (triple_parttern.path != SPARQLParser::TriplePattern::kNone) {
+            for (const auto* term : {&s, &o}) {
+                if (term->IsVariable())
+                    required_variables.insert(term->value);
+            }
+            path_tp.push_back(triple_parttern);
+            tp_id++;
+            continue;
+        }
+        for (const auto* term : {&s, &p, &o}) {
+            if (term->IsVariable())
+                required_variables.insert(term->value);
+        }
+
         if (s.IsVariable())
             variable_frequency[s.value]++;
         if (o.IsVariable())
@@ -133,6 +161,8 @@ PlanGenerator::PlanGenerator(std::shared_ptr<IndexRetriever>& index, std::shared
 
     HandleUnsortedVariables(unsorted_variables, variable_priority);
     HandleThreeVariableTriplePattern(three_variable_tp, sparql_parser);
+    OrderPathVariables(path_tp);
+    OrderOptionalVariables(optional_tp, required_variables);
 
     for (size_t i = 0; i < variable_order_.size(); ++i) {
         variable_order_[i].priority = i;
@@ -148,6 +178,9 @@ PlanGenerator::PlanGenerator(std::shared_ptr<IndexRetriever>& index, std::shared
     }
 
     GenPlanTable(one_variable_tp, two_variable_tp, three_variable_tp);
+    GenPathTable(path_tp);
+    GenOptionalTable(optional_tp, required_variables);
+    GenFilters(sparql_parser);
 
     if (debug_) {
         std::cout << "query plan: " << std::endl;
@@ -161,6 +194,83 @@ PlanGenerator::PlanGenerator(std::shared_ptr<IndexRetriever>& index, std::shared
     }
 }
 
+PlanGenerator::PlanGenerator(std::shared_ptr<IndexRetriever>& index,
+                             std::shared_ptr<SPARQLParser>& sparql_parser,
+                             const std::vector<std::string>& variable_order,
+                             bool distinct_predicate)
+    : index_(index), delta_reader_(index->ReadDelta()), distinct_predicate_(distinct_predicate) {
+    TripplePattern one_variable_tp;
+    TripplePattern two_variable_tp;
+    TripplePattern three_variable_tp;
+    TripplePattern optional_tp;
+    std::vector<SPARQLParser::TriplePattern> path_tp;
+    std::unordered_set<std::string> required_variables;
+    uint tp_id = 0;
+    for (const auto& triple_parttern : sparql_parser->TriplePatterns()) {
+        auto& s = triple_parttern.subject;
+        auto& p = triple_parttern.predicate;
+        auto& o = triple_parttern.object;
+
+        if (triple_parttern.is_option) {
+            optional_tp.push_back({{s, p, o}, tp_id++});
+            continue;
+        }
+        if (triple_parttern.path != SPARQLParser::TriplePattern::kNone) {
+            for (const auto* term : {&s, &o}) {
+                if (term->IsVariable())
+                    required_variables.insert(term->value);
+            }
+            path_tp.push_back(triple_parttern);
+            tp_id++;
+            continue;
+        }
+        for (const auto* term : {&s, &p, &o}) {
+            if (term->IsVariable())
+                required_variables.insert(term->value);
+        }
+
+        if (!p.IsVariable() && index_->Term2ID(p) == 0) {
+            zero_result_ = true;
+            return;
+        }
+
+        if (triple_parttern.variable_cnt == 1)
+            one_variable_tp.push_back({{s, p, o}, tp_id});
+        if (triple_parttern.variable_cnt == 2)
+            two_variable_tp.push_back({{s, p, o}, tp_id});
+        if (triple_parttern.variable_cnt == 3)
+            three_variable_tp.push_back({{s, p, o}, tp_id});
+        tp_id++;
+    }
+
+    for (const auto& variable : variable_order)
+        variable_order_.push_back(variable);
+    for (size_t i = 0; i < variable_order_.size(); ++i) {
+        variable_order_[i].priority = i;
+        value2variable_[variable_order_[i].value] = &variable_order_[i];
+    }
+
+    GenPlanTable(one_variable_tp, two_variable_tp, three_variable_tp);
+    GenPathTable(path_tp);
+    GenOptionalTable(optional_tp, required_variables);
+    GenFilters(sparql_parser);
+
+    // the checks of VariablePriority on the constants: a one variable pattern without candidates or
+    // a two variable pattern whose constant is not in the database has no result
+    for (const auto& results : pre_results_) {
+        for (const auto& result : results) {
+            if (result.empty())
+                zero_result_ = true;
+        }
+    }
+    for (const auto& items : query_plan_) {
+        for (const auto& item : items) {
+            if (item.prestore_type != PType::kEmpty && item.search_id == 0)
+                zero_result_ = true;
+        }
+    }
+}
+
 void PlanGenerator::DFS(const AdjacencyList& graph,
                         std::string vertex,
                         hash_map<std::string, bool>& visited,
@@ -276,7 +386,7 @@ phmap::flat_hash_map<std::string, uint> PlanGenerator::VariablePriority(
         if (!s.IsVariable() && p.IsVariable() && !o.IsVariable()) {
             v_value = p.value;
             if (max_frequency_variables.contains(v_value))
-                candidates = index_->GetBySO(index_->Term2ID(s), index_->Term2ID(o));
+                candidates = index_->GetBySO(index_->Term2ID(s), index_->Term2ID(o), merged_results_.emplace_back());
             else
                 size = index_->GetBySOSize(index_->Term2ID(s), index_->Term2ID(o));
         }
@@ -327,7 +437,7 @@ phmap::flat_hash_map<std::string, uint> PlanGenerator::VariablePriority(
             else
                 size1 = index_->GetSPreSet(edge).size();
             if (max_frequency_variables.contains(v_value_2))
-                candidates2 = index_->GetByS(edge);
+                candidates2 = index_->GetByS(edge, merged_results_.emplace_back());
             else
                 size2 = index_->GetBySSize(edge);
         }
@@ -336,7 +446,7 @@ phmap::flat_hash_map<std::string, uint> PlanGenerator::VariablePriority(
             v_value_2 = p.value;
             edge = index_->Term2ID(o);
             if (max_frequency_variables.contains(v_value_1))
-                candidates1 = index_->GetByO(edge);
+                candidates1 = index_->GetByO(edge, merged_results_.emplace_back());
             else
                 size1 = index_->GetByOSize(edge);
             if (max_frequency_variables.contains(v_value_2))
@@ -556,7 +666,7 @@ void PlanGenerator::GenPlanTable(TripplePattern& one_variable_tp,
             value2variable_[p.value]->position = Term::Positon::kPredicate;
             uint sid = index_->Term2ID(s);
             uint oid = index_->Term2ID(o);
-            std::span<uint> r = index_->GetBySO(sid, oid);
+            std::span<uint> r = index_->GetBySO(sid, oid, merged_results_.emplace_back());
             pre_results_[p_var_id].push_back(r);
         }
         if (!s.IsVariable() && !p.IsVariable() && o.IsVariable()) {
@@ -575,6 +685,14 @@ void PlanGenerator::GenPlanTable(TripplePattern& one_variable_tp,
         uint first_priority, second_priority;
         bool is_first_prior = false;
 
+        auto get_s_set = [&](uint id) { return index_->GetSSet(id); };
+        auto get_o_set = [&](uint id) { return index_->GetOSet(id); };
+        auto get_s_pre_set = [&](uint id) { return index_->GetSPreSet(id); };
+        auto get_o_pre_set = [&](uint id) { return index_->GetOPreSet(id); };
+        // the merged ids of the lookups of a subject or an object are held by the item
+        auto get_by_s = [&](uint id) { return index_->GetByS(id, filled_item.owned_result); };
+        auto get_by_o = [&](uint id) { return index_->GetByO(id, filled_item.owned_result); };
+
         auto process_filled_item = [&](const Term& fixed_term, const Term& var_term1, const Term& var_term2,
                                        Positon var1_position, Positon var2_position, PType prestore_type1,
                                        PType prestore_type2, RType retrieval_type1, RType retrieval_type2,
@@ -590,19 +708,19 @@ void PlanGenerator::GenPlanTable(TripplePattern& one_variable_tp,
             filled_item.search_id = index_->Term2ID(fixed_term);
             filled_item.prestore_type = is_first_prior ? prestore_type1 : prestore_type2;
             filled_item.retrieval_type = is_first_prior ? retrieval_type1 : retrieval_type2;
-            filled_item.index_result = is_first_prior ? ((*index_).*index_func1)(filled_item.search_id)
-                                                      : ((*index_).*index_func2)(filled_item.search_id);
+            filled_item.index_result = is_first_prior ? index_func1(filled_item.search_id)
+                                                      : index_func2(filled_item.search_id);
         };
 
         if (!s.IsVariable() && p.IsVariable() && o.IsVariable()) {
             process_filled_item(s, p, o, Positon::kPredicate, Positon::kObject, PType::kPredicate, PType::kObject,
-                                RType::kGetBySP, RType::kGetBySO, &IndexRetriever::GetSPreSet, &IndexRetriever::GetByS);
+                                RType::kGetBySP, RType::kGetBySO, get_s_pre_set, get_by_s);
         } else if (s.IsVariable() && !p.IsVariable() && o.IsVariable()) {
             process_filled_item(p, s, o, Positon::kSubject, Positon::kObject, PType::kPreSub, PType::kPreObj,
-                                RType::kGetBySP, RType::kGetByOP, &IndexRetriever::GetSSet, &IndexRetriever::GetOSet);
+                                RType::kGetBySP, RType::kGetByOP, get_s_set, get_o_set);
         } else if (s.IsVariable() && p.IsVariable() && !o.IsVariable()) {
             process_filled_item(o, s, p, Positon::kSubject, Positon::kPredicate, PType::kSubject, PType::kPredicate,
-                                RType::kGetBySO, RType::kGetByOP, &IndexRetriever::GetByO, &IndexRetriever::GetOPreSet);
+                                RType::kGetBySO, RType::kGetByOP, get_by_o, get_o_pre_set);
         }
 
         uint higher_priority = is_first_prior ? first_priority : second_priority;
@@ -680,6 +798,370 @@ void PlanGenerator::GenPlanTable(TripplePattern& one_variable_tp,
     }
 }
 
+void PlanGenerator::OrderPathVariables(const std::vector<SPARQLParser::TriplePattern>& path_tp) {
+    std::unordered_set<std::string> ordered;
+    for (const auto& variable : variable_order_)
+        ordered.insert(variable.value);
+
+    for (;;) {
+        // 0: a constant at the other end of a path, 1: a variable in the order, 2: a variable not in it yet
+        std::string next;
+        int next_rank = 3;
+        for (const auto& tp : path_tp) {
+            for (const auto& [term, other] : {std::pair{&tp.subject, &tp.object}, std::pair{&tp.object, &tp.subject}}) {
+                if (!term->IsVariable() || ordered.contains(term->value))
+                    continue;
+                int rank = !other->IsVariable() ? 0 : (ordered.contains(other->value) ? 1 : 2);
+                if (rank < next_rank) {
+                    next_rank = rank;
+                    next = term->value;
+                }
+            }
+        }
+        if (next.empty())
+            break;
+        variable_order_.push_back(next);
+        ordered.insert(next);
+    }
+}
+
+void PlanGenerator::GenPathTable(const std::vector<SPARQLParser::TriplePattern>& path_tp) {
+    size_t n = variable_order_.size();
+    path_items_.resize(n);
+    path_checks_.resize(n);
+    if (path_tp.empty())
+        return;
+
+    // the levels of the variables only bound by property paths, no other pattern gives them values
+    std::vector<bool> path_only(n);
+    for (size_t level = 0; level < n; level++)
+        path_only[level] = query_plan_[level].empty() && pre_results_[level].empty();
+
+    // an entity of a path may be a subject, an object or both, whichever the position of its term
+    auto entity_id = [&](Term term) {
+        uint id = index_->Term2ID(term);
+        if (id == 0) {
+            term.position = (term.position == Positon::kSubject) ? Positon::kObject : Positon::kSubject;
+            id = index_->Term2ID(term);
+        }
+        return id;
+    };
+
+    // the levels of the variables of paths from constants, their entities are searched by the executor
+    std::vector<bool> from_constant(n);
+    for (const auto& tp : path_tp) {
+        auto& s = tp.subject;
+        auto& o = tp.object;
+        uint pid = index_->Term2ID(tp.predicate);
+        bool zero_length = tp.path == SPARQLParser::TriplePattern::kZeroOrMore;
+        if (pid == 0 && !zero_length) {
+            zero_result_ = true;
+            return;
+        }
+
+        if (!s.IsVariable() && !o.IsVariable()) {
+            if (zero_length && s.value == o.value)
+                continue;
+            uint sid = entity_id(s);
+            uint oid = entity_id(o);
+            if (sid == 0 || oid == 0) {
+                zero_result_ = true;
+                return;
+            }
+            constant_paths_.push_back({-1, sid, oid, pid, true, zero_length});
+            continue;
+        }
+
+        if (!s.IsVariable() || !o.IsVariable()) {
+            const Term& constant = s.IsVariable() ? o : s;
+            const Term& variable = s.IsVariable() ? s : o;
+            Variable* v = value2variable_[variable.value];
+            uint id = entity_id(constant);
+            if (id == 0) {
+                zero_result_ = true;
+                return;
+            }
+            if (path_only[v->priority])
+                v->position = variable.position;
+            constant_paths_.push_back({int(v->priority), id, 0, pid, !s.IsVariable(), zero_length});
+            from_constant[v->priority] = true;
+            continue;
+        }
+
+        uint s_level = value2variable_[s.value]->priority;
+        uint o_level = value2variable_[o.value]->priority;
+        if (s_level == o_level) {
+            // ?x <p>* ?x holds for every value of ?x
+            if (!zero_length)
+                path_checks_[s_level].push_back({pid, s_level, true, false});
+            continue;
+        }
+        uint level = std::max(s_level, o_level);
+        PathItem item = {pid, std::min(s_level, o_level), s_level < o_level, zero_length};
+        if (path_only[level]) {
+            value2variable_[item.forward ? o.value : s.value]->position = item.forward ? Positon::kObject
+                                                                                       : Positon::kSubject;
+            path_items_[level].push_back(item);
+        } else {
+            path_checks_[level].push_back(item);
+        }
+    }
+
+    // the first variable of paths between variables only takes the subjects or the objects of the predicate
+    for (const auto& tp : path_tp) {
+        uint pid = index_->Term2ID(tp.predicate);
+        for (const auto* term : {&tp.subject, &tp.object}) {
+            if (!term->IsVariable())
+                continue;
+            Variable* v = value2variable_[term->value];
+            uint level = v->priority;
+            if (!path_only[level] || from_constant[level] || !pre_results_[level].empty() ||
+                !path_items_[level].empty())
+                continue;
+            if (pid == 0) {
+                zero_result_ = true;
+                return;
+            }
+            v->position = term->position;
+            std::span<uint> r = (term->position == Positon::kSubject) ? index_->GetSSet(pid) : index_->GetOSet(pid);
+            if (tp.path == SPARQLParser::TriplePattern::kZeroOrMore) {
+                // a path without edge starts and ends at any entity of the predicate
+                std::span<uint> subjects = index_->GetSSet(pid);
+                std::span<uint> objects = index_->GetOSet(pid);
+                std::vector<uint>& entities = path_results_.emplace_back();
+                std::set_union(subjects.begin(), subjects.end(), objects.begin(), objects.end(),
+                               std::back_inserter(entities));
+                r = std::span<uint>(entities);
+            }
+            pre_results_[level].push_back(r);
+        }
+    }
+}
+
+void PlanGenerator::OrderOptionalVariables(TripplePattern& optional_tp,
+                                           const std::unordered_set<std::string>& required_variables) {
+    std::unordered_set<std::string> bound_variables = required_variables;
+    for (const auto& tp : optional_tp) {
+        auto& [s, p, o] = tp.first;
+        // the predicate first, it narrows the lookups of the subject and the object
+        for (const auto* term : {&p, &s, &o}) {
+            if (term->IsVariable() && !bound_variables.contains(term->value)) {
+                variable_order_.push_back(term->value);
+                bound_variables.insert(term->value);
+            }
+        }
+    }
+}
+
+void PlanGenerator::GenOptionalTable(TripplePattern& optional_tp,
+                                     const std::unordered_set<std::string>& required_variables) {
+    optional_items_.resize(variable_order_.size());
+    std::unordered_set<std::string> bound_variables = required_variables;
+
+    for (const auto& tp : optional_tp) {
+        auto& terms = tp.first;
+        std::unordered_set<std::string> new_variables;
+        for (const auto& term : terms) {
+            if (term.IsVariable() && !bound_variables.contains(term.value))
+                new_variables.insert(term.value);
+        }
+
+        for (const auto& value : new_variables) {
+            Variable* variable = value2variable_[value];
+            uint level = variable->priority;
+
+            // the terms known when the level is reached, -1 for the unknown ones
+            uint ids[3] = {0, 0, 0};
+            int levels[3] = {-1, -1, -1};
+            bool known[3] = {false, false, false};
+            for (uint i = 0; i < 3; i++) {
+                if (!terms[i].IsVariable()) {
+                    ids[i] = index_->Term2ID(terms[i]);
+                    known[i] = true;
+                    continue;
+                }
+                auto it = value2variable_.find(terms[i].value);
+                if (terms[i].value != value && it != value2variable_.end() && it->second->priority < level) {
+                    levels[i] = it->second->priority;
+                    known[i] = true;
+                }
+            }
+
+            uint position = 0;
+            while (terms[position].value != value)
+                position++;
+            variable->position = Positon(position);
+
+            OptionalItem item = {RType::kNone, 0, -1, 0, -1, std::span<uint>()};
+            auto set_arguments = [&](RType retrieval_type, uint first, int second) {
+                item.retrieval_type = retrieval_type;
+                item.first_id = ids[first];
+                item.first_level = levels[first];
+                if (second != -1) {
+                    item.second_id = ids[second];
+                    item.second_level = levels[second];
+                }
+            };
+
+            if (position == 0) {
+                if (known[1] && known[2])
+                    set_arguments(RType::kGetByOP, 2, 1);
+                else if (known[1])
+                    set_arguments(RType::kGetSSet, 1, -1);
+            }
+            if (position == 1) {
+                if (known[0] && known[2])
+                    set_arguments(RType::kGetBySO, 0, 2);
+                else if (known[0])
+                    set_arguments(RType::kGetSPreSet, 0, -1);
+                else if (known[2])
+                    set_arguments(RType::kGetOPreSet, 2, -1);
+            }
+            if (position == 2) {
+                if (known[0] && known[1])
+                    set_arguments(RType::kGetBySP, 0, 1);
+                else if (known[1])
+                    set_arguments(RType::kGetOSet, 1, -1);
+            }
+
+            // a lookup on constants only is done once, a constant not in the database leaves it unbound
+            bool two_arguments = item.retrieval_type == RType::kGetBySP || item.retrieval_type == RType::kGetByOP ||
+                                 item.retrieval_type == RType::kGetBySO;
+            if (item.first_level == -1 && item.second_level == -1) {
+                if (item.retrieval_type == RType::kNone && position == 1) {
+                    if (all_predicates_.empty()) {
+                        all_predicates_.resize(index_->predicate_cnt());
+                        std::iota(all_predicates_.begin(), all_predicates_.end(), 1);
+                    }
+                    item.index_result = std::span<uint>(all_predicates_);
+                }
+                if (item.first_id != 0 && (!two_arguments || item.second_id != 0)) {
+                    if (item.retrieval_type == RType::kGetBySP)
+                        item.index_result = index_->GetBySP(item.first_id, item.second_id);
+                    if (item.retrieval_type == RType::kGetByOP)
+                        item.index_result = index_->GetByOP(item.first_id, item.second_id);
+                    if (item.retrieval_type == RType::kGetBySO)
+                        item.index_result = index_->GetBySO(item.first_id, item.second_id, merged_results_.emplace_back());
+                    if (item.retrieval_type == RType::kGetSPreSet)
+                        item.index_result = index_->GetSPreSet(item.first_id);
+                    if (item.retrieval_type == RType::kGetOPreSet)
+                        item.index_result = index_->GetOPreSet(item.first_id);
+                    if (item.retrieval_type == RType::kGetSSet)
+                        item.index_result = index_->GetSSet(item.first_id);
+                    if (item.retrieval_type == RType::kGetOSet)
+                        item.index_result = index_->GetOSet(item.first_id);
+                }
+                item.retrieval_type = RType::kNone;
+            }
+            optional_items_[level].push_back(item);
+        }
+
+        bound_variables.insert(new_variables.begin(), new_variables.end());
+    }
+}
+
+void PlanGenerator::GenFilters(std::shared_ptr<SPARQLParser>& sparql_parser) {
+    filter_ranges_.resize(variable_order_.size());
+    filter_items_.resize(variable_order_.size());
+
+    for (const auto& filter : sparql_parser->Filters()) {
+        if (filter.filter_type == SPARQLParser::Filter::Type::Function)
+            continue;
+        if (!GenFilterRange(filter))
+            GenFilterItem(filter);
+    }
+}
+
+bool PlanGenerator::GenFilterRange(const SPARQLParser::Filter& filter) {
+    if (!index_->ordered_literals() || filter.filter_type > SPARQLParser::Filter::Type::GreaterOrEq ||
+        filter.filter_type == SPARQLParser::Filter::Type::NotEqual || filter.filter_args.size() != 1 ||
+        filter.filter_args[0].IsVariable())
+        return false;
+    auto it = value2variable_.find(filter.variable_str);
+    if (it == value2variable_.end())
+        return false;
+
+    const Term& constant = filter.filter_args[0];
+    std::string_view lexical = constant.value;
+    Dictionary::LiteralType type = Dictionary::LiteralType::kNumeric;
+    if (constant.literal_type != Term::ValueType::kDouble)
+        type = Dictionary::TypeOf(constant.value, lexical);
+    if (type == Dictionary::LiteralType::kUnordered)
+        return false;
+
+    // a predicate is never a literal, the comparison fails for every value
+    if (it->second->position == Positon::kPredicate) {
+        zero_result_ = true;
+        return true;
+    }
+
+    FilterRange& range = filter_ranges_[it->second->priority];
+    auto [first, last] = index_->LiteralRange(type, filter.filter_type, lexical);
+    if (range.conditions.empty()) {
+        range.first = first;
+        range.last = last;
+    } else {
+        // the ranges of different datatypes do not overlap
+        range.first = std::max(range.first, first);
+        range.last = std::max(range.first, std::min(range.last, last));
+    }
+    range.conditions.push_back({type, filter.filter_type, std::string(lexical)});
+    return true;
+}
+
+void PlanGenerator::GenFilterItem(const SPARQLParser::Filter& filter) {
+    auto it = value2variable_.find(filter.variable_str);
+    if (it == value2variable_.end()) {
+        // a variable not in the patterns is never bound
+        if (filter.filter_type != SPARQLParser::Filter::Type::NotBound)
+            zero_result_ = true;
+        return;
+    }
+
+    FilterItem item;
+    item.type = filter.filter_type;
+    item.first_level = it->second->priority;
+    item.first_position = it->second->position;
+    item.second_level = -1;
+    item.second_position = Positon::kObject;
+    item.constant_id = 0;
+
+    if (!filter.filter_args.empty()) {
+        const Term& arg = filter.filter_args[0];
+        if (arg.IsVariable()) {
+            auto arg_it = value2variable_.find(arg.value);
+            // the comparison with an unbound variable is an error
+            if (arg_it == value2variable_.end()) {
+                zero_result_ = true;
+                return;
+            }
+            item.second_level = arg_it->second->priority;
+            item.second_position = arg_it->second->position;
+        } else {
+            item.constant = arg.value;
+            // a number of the query is compared as an xsd:decimal
+            if (arg.literal_type == Term::ValueType::kDouble)
+                item.constant = "\"" + arg.value + "\"^^<http://www.w3.org/2001/XMLSchema#decimal>";
+
+            Term term = arg;
+            term.value = item.constant;
+            if (item.first_position == Positon::kPredicate) {
+                term.position = Positon::kPredicate;
+                item.constant_id = index_->Term2ID(term);
+            } else {
+                term.position = Positon::kSubject;
+                item.constant_id = index_->Term2ID(term);
+                if (item.constant_id == 0) {
+                    term.position = Positon::kObject;
+                    item.constant_id = index_->Term2ID(term);
+                }
+            }
+        }
+    }
+
+    filter_items_[std::max(item.first_level, item.second_level)].push_back(item);
+}
+
 std::vector<PlanGenerator::Variable> PlanGenerator::MappingVariable(const std::vector<std::string>& variables) {
     std::vector<Variable> ret;
     ret.reserve(variables.size());
@@ -692,6 +1174,14 @@ std::vector<std::vector<PlanGenerator::Item>>& PlanGenerator::query_plan() {
     return query_plan_;
 }
 
+std::vector<std::string> PlanGenerator::variable_order() {
+    std::vector<std::string> variables;
+    variables.reserve(variable_order_.size());
+    for (const auto& variable : variable_order_)
+        variables.push_back(variable.value);
+    return variables;
+}
+
 hash_map<std::string, PlanGenerator::Variable*>& PlanGenerator::value2variable() {
     return value2variable_;
 }
@@ -708,10 +1198,68 @@ std::vector<std::vector<std::span<uint>>>& PlanGenerator::pre_results() {
     return pre_results_;
 }
 
+std::vector<std::vector<PlanGenerator::OptionalItem>>& PlanGenerator::optional_items() {
+    return optional_items_;
+}
+
+std::vector<std::vector<PlanGenerator::PathItem>>& PlanGenerator::path_items() {
+    return path_items_;
+}
+
+std::vector<std::vector<PlanGenerator::PathItem>>& PlanGenerator::path_checks() {
+    return path_checks_;
+}
+
+std::vector<PlanGenerator::ConstantPath>& PlanGenerator::constant_paths() {
+    return constant_paths_;
+}
+
+std::vector<PlanGenerator::FilterRange>& PlanGenerator::filter_ranges() {
+    return filter_ranges_;
+}
+
+std::vector<std::vector<PlanGenerator::FilterItem>>& PlanGenerator::filter_items() {
+    return filter_items_;
+}
+
 bool PlanGenerator::zero_result() {
     return zero_result_;
 }
 
 bool PlanGenerator::distinct_predicate() {
     return distinct_predicate_;
+}
+
+ulong PlanGenerator::estimated_cost() {
+    if (zero_result_ || query_plan_.empty())
+        return 0;
+    ulong cost = variable_order_.size();
+    for (ulong level = 0; level < query_plan_.size(); level++) {
+        // the values of a level looked up from an earlier one are not counted
+        if (!empty_item_indices_[level].empty())
+            continue;
+        ulong size = std::numeric_limits<ulong>::max();
+        for (const auto& result : pre_results_[level])
+            size = std::min(size, ulong(result.size()));
+        for (const auto& path : constant_paths_) {
+            if (path.level != int(level))
+                continue;
+            ulong reachable = path.forward ? index_->GetOSetSize(path.predicate_id)
+                                           : index_->GetSSetSize(path.predicate_id);
+            size = std::min(size, reachable + path.zero_length);
+        }
+        for (const auto& item : query_plan_[level]) {
+            if (item.index_result.size() != 0)
+                size = std::min(size, ulong(item.index_result.size()));
+        }
+        if (size == std::numeric_limits<ulong>::max()) {
+            if (level != 0)
+                continue;
+            size = index_->max_id();
+        }
+        if (size != 0 && cost > std::numeric_limits<ulong>::max() / size)
+            return std::numeric_limits<ulong>::max();
+        cost *= size;
+    }
+    return cost;
 }
\ No newline at end of file
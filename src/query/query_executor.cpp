@@ -1,11 +1,20 @@
 #include "rdf-tdaa/query/query_executor.hpp"
+#include <algorithm>
+#include <unistd.h>
+#include <climits>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <numeric>
+#include <string_view>
 
 QueryExecutor::Stat::Stat(const std::vector<std::vector<PlanGenerator::Item>>& p) : at_end(false), level(-1), plan(p) {
     size_t n = plan.size();
     candidate_indices.resize(n);
     candidate_value.resize(n);
+    owned_value.resize(n);
     current_tuple.resize(n);
-    result = std::make_shared<std::vector<std::vector<uint>>>();
+    result = std::make_shared<ResultTable>(n);
 
     for (long unsigned int i = 0; i < n; i++) {
         candidate_value[i] = std::span<uint>();
@@ -18,6 +27,7 @@ QueryExecutor::Stat::Stat(const QueryExecutor::Stat& other)
       current_tuple(other.current_tuple),
       candidate_value(other.candidate_value),
       candidate_indices(other.candidate_indices),
+      owned_value(other.owned_value),
       result(other.result),
       plan(other.plan) {}
 
@@ -28,6 +38,7 @@ QueryExecutor::Stat& QueryExecutor::Stat::operator=(const Stat& other) {
         candidate_indices = other.candidate_indices;
         current_tuple = other.current_tuple;
         candidate_value = other.candidate_value;
+        owned_value = other.owned_value;
         result = other.result;
         plan = other.plan;
     }
@@ -37,14 +48,43 @@ QueryExecutor::Stat& QueryExecutor::Stat::operator=(const Stat& other) {
 QueryExecutor::QueryExecutor(std::shared_ptr<IndexRetriever> index,
                              std::shared_ptr<PlanGenerator>& plan,
                              uint limit,
-                             uint shared_cnt)
+                             uint shared_cnt,
+                             uint thread_num)
     : stat_(plan->query_plan()),
       index_(index),
       filled_item_indices_(plan->filled_item_indices()),
       empty_item_indices_(plan->empty_item_indices()),
       pre_results_(plan->pre_results()),
+      constant_paths_(plan->constant_paths()),
+      constant_paths_searched_(false),
+      optional_items_(plan->optional_items()),
+      filter_ranges_(plan->filter_ranges()),
+      max_id_(index->max_id()),
+      filter_items_(plan->filter_items()),
+      filter_evaluator_(index),
+      path_items_(plan->path_items()),
+      path_checks_(plan->path_checks()),
+      // the workers of a parallel query already run at the same time, a search stays on the thread of its worker
+      path_search_(index, 1),
       limit_(limit),
-      shared_cnt_(shared_cnt) {}
+      shared_cnt_(shared_cnt),
+      thread_num_(std::max(thread_num, 1u)),
+      pending_cnt_(0),
+      queued_cnt_(0),
+      idle_cnt_(0),
+      result_cnt_(0),
+      stop_(false),
+      sink_(nullptr),
+      delivered_cnt_(0),
+      sink_closed_(false),
+      existential_level_(stat_.plan.size()),
+      distinct_hash_(false),
+      counting_(false),
+      count_level_(stat_.plan.size()),
+      suffix_cnt_(1),
+      count_(0),
+      sort_budget_(kSortBudget),
+      profiling_(false) {}
 
 std::span<uint> QueryExecutor::LeapfrogJoin(const std::vector<std::span<uint>>& lists) {
     JoinList join_list;
@@ -53,7 +93,7 @@ std::span<uint> QueryExecutor::LeapfrogJoin(const std::vector<std::span<uint>>&
     return LeapfrogJoin(join_list);
 }
 
-std::span<uint> QueryExecutor::LeapfrogJoin(JoinList& lists) {
+std::span<uint> QueryExecutor::LeapfrogJoin(JoinList& lists, CancellationToken* token) {
     std::vector<uint>* result_set = new std::vector<uint>();
 
     if (lists.Size() == 1) {
@@ -99,6 +139,8 @@ std::span<uint> QueryExecutor::LeapfrogJoin(JoinList& lists) {
         if (lists.AtEnd(idx)) {
             break;
         }
+        if (token != nullptr && token->Cancelled())
+            break;
 
         // Store the maximum
         max = lists.GetCurrentValOfList(idx);
@@ -109,10 +151,33 @@ std::span<uint> QueryExecutor::LeapfrogJoin(JoinList& lists) {
     return std::span<uint>(result_set->begin(), result_set->size());
 }
 
+std::span<uint> QueryExecutor::Join(int level, JoinList& lists) {
+    if (!profiling_)
+        return LeapfrogJoin(lists, token_.get());
+
+    auto& profile = profile_[level];
+    profile.joins++;
+    profile.join_lists += lists.Size();
+    for (int i = 0; i < lists.Size(); i++)
+        profile.join_input += lists.GetListByIndex(i).size();
+    std::span<uint> result = LeapfrogJoin(lists, token_.get());
+    profile.join_output += result.size();
+    return result;
+}
+
+void QueryExecutor::Spent(int level, std::chrono::steady_clock::time_point start) {
+    if (profiling_)
+        profile_[level].time += std::chrono::steady_clock::now() - start;
+}
+
 bool QueryExecutor::PreJoin() {
+    if (!SearchConstantPaths())
+        return false;
+
     JoinList join_list;
     std::stringstream key;
     pre_join_ = std::vector<std::span<uint>>(stat_.plan.size());
+    pre_join_owned_ = std::vector<std::shared_ptr<std::vector<uint>>>(stat_.plan.size());
     for (long unsigned int level = 0; level < stat_.plan.size(); level++) {
         if (!empty_item_indices_[level].empty())
             continue;
@@ -124,7 +189,7 @@ bool QueryExecutor::PreJoin() {
                 join_list.AddList(stat_.plan[level][i].index_result);
         }
         if (join_list.Size() > 1) {
-            pre_join_[level] = LeapfrogJoin(join_list);
+            pre_join_[level] = Restrict(level, Join(level, join_list), pre_join_owned_[level]);
             if (pre_join_[level].size() == 0) 
                 return false;
         }
@@ -135,11 +200,18 @@ bool QueryExecutor::PreJoin() {
 
 void QueryExecutor::Down(Stat& stat) {
     ++stat.level;
+    auto start = profiling_ ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
     // 如果当前层没有查询结果，就生成结果
     if (stat.candidate_value[stat.level].empty()) {
         GenCandidateValue(stat);
-        if (stat.at_end)
+        if (profiling_) {
+            profile_[stat.level].generations++;
+            profile_[stat.level].candidates += stat.candidate_value[stat.level].size();
+        }
+        if (stat.at_end) {
+            Spent(stat.level, start);
             return;
+        }
     }
 
     // 遍历当前 level_ 所有经过连接的得到的结果实体
@@ -147,12 +219,14 @@ void QueryExecutor::Down(Stat& stat) {
     bool success = UpdateCurrentTuple(stat);
     while (!success && !stat.at_end)
         success = UpdateCurrentTuple(stat);
+    Spent(stat.level, start);
 }
 
 void QueryExecutor::Up(Stat& stat) {
     // 清除较高 level_ 的查询结果
     stat.candidate_value[stat.level] = std::span<uint>();
     stat.candidate_indices[stat.level] = 0;
+    stat.owned_value[stat.level].reset();
 
     --stat.level;
 }
@@ -160,12 +234,23 @@ void QueryExecutor::Up(Stat& stat) {
 void QueryExecutor::Next(Stat& stat) {
     // 当前 level_ 的下一个 candidate_value_
     stat.at_end = false;
+    auto start = profiling_ ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
     bool success = UpdateCurrentTuple(stat);
     while (!success && !stat.at_end)
         success = UpdateCurrentTuple(stat);
+    Spent(stat.level, start);
 }
 
 void QueryExecutor::GenCandidateValue(Stat& stat) {
+    if (!optional_items_[stat.level].empty()) {
+        GenOptionalValue(stat);
+        return;
+    }
+    if (!path_items_[stat.level].empty()) {
+        GenPathValue(stat);
+        return;
+    }
+
     JoinList join_list;
 
     bool has_unariate_result = pre_results_[stat.level].size();
@@ -184,14 +269,14 @@ void QueryExecutor::GenCandidateValue(Stat& stat) {
 
     if ((!has_unariate_result && !has_empty_item_ && has_filled_item) ||
         (has_unariate_result && !has_empty_item_ && has_filled_item)) {
-        if (pre_join_[stat_.level].size()) {
-            stat.candidate_value[stat.level] = pre_join_[stat_.level];
+        if (pre_join_[stat.level].size()) {
+            stat.candidate_value[stat.level] = pre_join_[stat.level];
             return;
         } else {
             for (const auto& idx : filled_item_indices_[stat.level])
                 join_list.AddList(stat.plan[stat.level][idx].index_result);
         }
-        stat.candidate_value[stat.level] = LeapfrogJoin(join_list);
+        stat.candidate_value[stat.level] = Join(stat.level, join_list);
     }
 
     if ((!has_unariate_result && has_empty_item_ && has_filled_item) ||
@@ -204,8 +289,10 @@ void QueryExecutor::GenCandidateValue(Stat& stat) {
         (has_unariate_result && has_empty_item_ && has_filled_item) ||
         (has_unariate_result && !has_empty_item_ && !has_filled_item && join_list.Size() > 1) ||
         (!has_unariate_result && has_empty_item_ && !has_filled_item && join_list.Size() > 1)) {
-        stat.candidate_value[stat.level] = LeapfrogJoin(join_list);
+        stat.candidate_value[stat.level] = Join(stat.level, join_list);
     }
+    stat.candidate_value[stat.level] =
+        Restrict(stat.level, stat.candidate_value[stat.level], stat.owned_value[stat.level]);
     // 变量的交集为空
     if (stat.candidate_value[stat.level].empty()) {
         stat.at_end = true;
@@ -213,6 +300,195 @@ void QueryExecutor::GenCandidateValue(Stat& stat) {
     }
 }
 
+// the only value of a level without optional match, shared by all the stats
+static uint unbound_value[1] = {0};
+
+void QueryExecutor::GenOptionalValue(Stat& stat) {
+    JoinList join_list;
+    bool unbound = false;
+    // the merged ids of the lookups by subject and object, the values of the level may be a span of them
+    std::vector<std::shared_ptr<std::vector<uint>>> owners;
+    for (const auto& item : optional_items_[stat.level]) {
+        if (item.retrieval_type == RType::kNone) {
+            join_list.AddList(item.index_result);
+            continue;
+        }
+        uint first = (item.first_level == -1) ? item.first_id : stat.current_tuple[item.first_level];
+        uint second = (item.second_level == -1) ? item.second_id : stat.current_tuple[item.second_level];
+        bool two_arguments = item.retrieval_type == RType::kGetBySP || item.retrieval_type == RType::kGetByOP ||
+                             item.retrieval_type == RType::kGetBySO;
+        // a term of the pattern is unbound, the pattern has no match
+        if (first == 0 || (two_arguments && second == 0)) {
+            unbound = true;
+            break;
+        }
+
+        std::span<uint> r;
+        if (item.retrieval_type == RType::kGetBySP)
+            r = index_->GetBySP(first, second);
+        if (item.retrieval_type == RType::kGetByOP)
+            r = index_->GetByOP(first, second);
+        if (item.retrieval_type == RType::kGetBySO)
+            r = index_->GetBySO(first, second, owners.emplace_back());
+        if (item.retrieval_type == RType::kGetSPreSet)
+            r = index_->GetSPreSet(first);
+        if (item.retrieval_type == RType::kGetOPreSet)
+            r = index_->GetOPreSet(first);
+        if (item.retrieval_type == RType::kGetSSet)
+            r = index_->GetSSet(first);
+        if (item.retrieval_type == RType::kGetOSet)
+            r = index_->GetOSet(first);
+        if (profiling_)
+            profile_[stat.level].index_calls++;
+        join_list.AddList(r);
+    }
+
+    if (!unbound && !join_list.HasEmpty()) {
+        // a single list may be a span of them, a joined one is a copy
+        if (!owners.empty())
+            stat.owned_value[stat.level] = owners.back();
+        if (join_list.Size() == 1)
+            stat.candidate_value[stat.level] =
+                Restrict(stat.level, join_list.GetListByIndex(0), stat.owned_value[stat.level]);
+        else
+            stat.candidate_value[stat.level] =
+                Restrict(stat.level, Join(stat.level, join_list), stat.owned_value[stat.level]);
+    }
+    if (!stat.candidate_value[stat.level].empty())
+        return;
+    // a FILTER on an unbound variable fails
+    if ((!bound_levels_.empty() && bound_levels_[stat.level]) || !filter_ranges_[stat.level].conditions.empty()) {
+        stat.at_end = true;
+        return;
+    }
+    // the left outer join keeps the tuple with the variable unbound
+    stat.candidate_value[stat.level] = std::span<uint>(unbound_value);
+}
+
+void QueryExecutor::GenPathValue(Stat& stat) {
+    JoinList join_list;
+    join_list.AddLists(pre_results_[stat.level]);
+    // the entities reached are released when the level is left, or after they are intersected
+    std::vector<std::shared_ptr<std::vector<uint>>> reached;
+    for (const auto& item : path_items_[stat.level]) {
+        if (profiling_)
+            profile_[stat.level].index_calls++;
+        reached.push_back(std::make_shared<std::vector<uint>>(path_search_.Reach(
+            stat.current_tuple[item.other_level], item.predicate_id, item.forward, item.zero_length)));
+        join_list.AddList(std::span<uint>(*reached.back()));
+    }
+
+    // a single list is the entities of the only path
+    if (join_list.Size() == 1) {
+        stat.owned_value[stat.level] = reached[0];
+        stat.candidate_value[stat.level] =
+            Restrict(stat.level, join_list.GetListByIndex(0), stat.owned_value[stat.level]);
+    } else {
+        stat.candidate_value[stat.level] =
+            Restrict(stat.level, Join(stat.level, join_list), stat.owned_value[stat.level]);
+    }
+    if (stat.candidate_value[stat.level].empty())
+        stat.at_end = true;
+}
+
+bool QueryExecutor::CheckPaths(Stat& stat) {
+    uint value = stat.current_tuple[stat.level];
+    for (const auto& item : path_checks_[stat.level]) {
+        uint other = stat.current_tuple[item.other_level];
+        uint from = item.forward ? other : value;
+        uint to = item.forward ? value : other;
+        if (profiling_)
+            profile_[stat.level].index_calls++;
+        if (!path_search_.Reachable(from, to, item.predicate_id, item.zero_length))
+            return false;
+    }
+    return true;
+}
+
+bool QueryExecutor::SearchConstantPaths() {
+    if (constant_paths_searched_)
+        return true;
+    constant_paths_searched_ = true;
+
+    // the searches run before the levels are enumerated, all the threads of the query expand their frontiers
+    PathSearch search(index_, thread_num_);
+    search.CancelBy(token_);
+    for (const auto& path : constant_paths_) {
+        if (path.level == -1) {
+            if (!search.Reachable(path.start, path.end, path.predicate_id, path.zero_length))
+                return false;
+            continue;
+        }
+        if (profiling_)
+            profile_[path.level].index_calls++;
+        auto& reached = constant_path_results_.emplace_back(
+            search.Reach(path.start, path.predicate_id, path.forward, path.zero_length));
+        if (reached.empty())
+            return false;
+        pre_results_[path.level].push_back(std::span<uint>(reached));
+    }
+    return true;
+}
+
+std::span<uint> QueryExecutor::Restrict(uint level,
+                                        std::span<uint> values,
+                                        std::shared_ptr<std::vector<uint>>& owner) {
+    const auto& range = filter_ranges_[level];
+    if (range.conditions.empty())
+        return values;
+
+    auto begin = std::lower_bound(values.begin(), values.end(), range.first);
+    auto end = std::lower_bound(begin, values.end(), range.last);
+    auto inserted = std::upper_bound(end, values.end(), max_id_);
+    if (inserted == values.end())
+        return std::span<uint>(begin, end);
+
+    auto restricted = std::make_shared<std::vector<uint>>(begin, end);
+    for (; inserted != values.end(); inserted++) {
+        if (InFilterRange(range, *inserted))
+            restricted->push_back(*inserted);
+    }
+    // values may be held by owner, it is replaced once they are copied
+    owner = restricted;
+    return std::span<uint>(restricted->begin(), restricted->size());
+}
+
+bool QueryExecutor::InFilterRange(const PlanGenerator::FilterRange& range, uint value) {
+    const char* term = index_->ID2String(value, SPARQLParser::Term::Positon::kObject);
+    std::string_view lexical;
+    Dictionary::LiteralType type = Dictionary::TypeOf(term, lexical);
+
+    bool in_range = true;
+    for (const auto& condition : range.conditions) {
+        if (type != condition.type) {
+            in_range = false;
+            break;
+        }
+        int cmp = Dictionary::CompareLiterals(type, lexical, condition.lexical);
+        switch (condition.op) {
+            case SPARQLParser::Filter::Type::Equal:
+                in_range = in_range && cmp == 0;
+                break;
+            case SPARQLParser::Filter::Type::Less:
+                in_range = in_range && cmp < 0;
+                break;
+            case SPARQLParser::Filter::Type::LessOrEq:
+                in_range = in_range && cmp <= 0;
+                break;
+            case SPARQLParser::Filter::Type::Greater:
+                in_range = in_range && cmp > 0;
+                break;
+            case SPARQLParser::Filter::Type::GreaterOrEq:
+                in_range = in_range && cmp >= 0;
+                break;
+            default:
+                break;
+        }
+    }
+    delete[] term;
+    return in_range;
+}
+
 bool QueryExecutor::UpdateCurrentTuple(Stat& stat) {
     size_t idx = stat.candidate_indices[stat.level];
 
@@ -221,7 +497,12 @@ bool QueryExecutor::UpdateCurrentTuple(Stat& stat) {
         stat.candidate_indices[stat.level]++;
         if (FillEmptyItem(stat, value)) {
             stat.current_tuple[stat.level] = value;
-            return true;
+            bool match = (filter_items_[stat.level].empty() ||
+                          filter_evaluator_.Evaluate(filter_items_[stat.level], stat.current_tuple)) &&
+                         (path_checks_[stat.level].empty() || CheckPaths(stat));
+            if (match && profiling_)
+                profile_[stat.level].matches++;
+            return match;
         }
     } else {
         stat.at_end = true;
@@ -245,9 +526,9 @@ bool QueryExecutor::FillEmptyItem(Stat& stat, uint value) {
 
                 if (item.retrieval_type == RType::kGetBySO) {
                     if (item.prestore_type == PType::kObject)
-                        empty_item.index_result = index_->GetBySO(id, value);
+                        empty_item.index_result = index_->GetBySO(id, value, empty_item.owned_result);
                     if (item.prestore_type == PType::kSubject)
-                        empty_item.index_result = index_->GetBySO(value, id);
+                        empty_item.index_result = index_->GetBySO(value, id, empty_item.owned_result);
                 }
                 if (item.retrieval_type == RType::kGetBySP) {
                     if (item.prestore_type == PType::kPreSub)
@@ -284,6 +565,8 @@ bool QueryExecutor::FillEmptyItem(Stat& stat, uint value) {
                 if (item.retrieval_type == RType::kGetOSet)
                     empty_item.index_result = index_->GetOSet(value);
 
+                if (profiling_)
+                    profile_[stat.level].index_calls++;
                 if (empty_item.index_result.size() == 0)
                     match = false;
                 break;
@@ -293,7 +576,87 @@ bool QueryExecutor::FillEmptyItem(Stat& stat, uint value) {
     return match;
 }
 
+void QueryExecutor::Distinct(const std::vector<uint>& levels) {
+    distinct_levels_ = levels;
+
+    std::vector<bool> projected(stat_.plan.size(), false);
+    for (const auto& level : levels)
+        projected[level] = true;
+
+    existential_level_ = stat_.plan.size();
+    while (existential_level_ > 0 && !projected[existential_level_ - 1])
+        existential_level_--;
+    // the prefix of the plan before the existential levels is enumerated once per value
+    distinct_hash_ = std::find(projected.begin(), projected.begin() + existential_level_, false) !=
+                     projected.begin() + existential_level_;
+}
+
+void QueryExecutor::RequireBound(const std::vector<uint>& levels) {
+    bound_levels_.assign(stat_.plan.size(), false);
+    for (const auto& level : levels)
+        bound_levels_[level] = true;
+}
+
+void QueryExecutor::SkipExistential(Stat& stat) {
+    while (stat.level >= existential_level_)
+        Up(stat);
+}
+
+bool QueryExecutor::Seen(std::span<const uint> tuple) {
+    if (distinct_levels_.size() <= 2) {
+        ulong key = 0;
+        for (const auto& level : distinct_levels_)
+            key = (key << 32) | tuple[level];
+        return !seen_ids_.insert(key).second;
+    }
+    std::string key(distinct_levels_.size() * sizeof(uint), '\0');
+    for (uint i = 0; i < distinct_levels_.size(); i++)
+        std::memcpy(key.data() + i * sizeof(uint), &tuple[distinct_levels_[i]], sizeof(uint));
+    return !seen_rows_.insert(std::move(key)).second;
+}
+
+void QueryExecutor::CancelBy(std::shared_ptr<CancellationToken> token) {
+    token_ = token;
+    path_search_.CancelBy(token);
+}
+
+void QueryExecutor::Profile() {
+    profiling_ = true;
+    profile_.assign(stat_.plan.size(), LevelProfile());
+    thread_num_ = 1;
+}
+
+bool QueryExecutor::Cancelled() {
+    return token_ != nullptr && token_->Cancelled();
+}
+
 void QueryExecutor::Query() {
+    Query([&](std::span<const uint> tuple) {
+        stat_.result->Append(tuple);
+        return true;
+    });
+}
+
+void QueryExecutor::Query(const Sink& sink) {
+    if (order_keys_.empty()) {
+        Execute(sink);
+        return;
+    }
+
+    // the first results in the order are only known when every result is found
+    auto begin = std::chrono::high_resolution_clock::now();
+    ulong limit = limit_;
+    limit_ = UINT_MAX;
+    if (limit != UINT_MAX)
+        TopK(sink, limit);
+    else
+        Sort(sink);
+    auto end = std::chrono::high_resolution_clock::now();
+    query_duration_ = end - begin;
+}
+
+void QueryExecutor::Execute(const Sink& sink) {
+    sink_ = &sink;
     auto begin = std::chrono::high_resolution_clock::now();
 
     // uint cnt = 0;
@@ -318,7 +681,16 @@ void QueryExecutor::Query() {
     if (!PreJoin())
         return;
 
+    if (thread_num_ > 1 && stat_.plan.size() > 1) {
+        ParallelQuery();
+        auto end = std::chrono::high_resolution_clock::now();
+        query_duration_ = end - begin;
+        return;
+    }
+
     for (;;) {
+        if (Cancelled())
+            break;
         if (stat_.at_end) {
             if (stat_.level == 0)
                 break;
@@ -327,12 +699,14 @@ void QueryExecutor::Query() {
         } else {
             // 补完一个查询结果
             if (stat_.level == int(stat_.plan.size() - 1)) {
-                stat_.result->push_back(stat_.current_tuple);
-                // if (stat_.result->size() % 100000 == 0) {
-                //     std::cout << stat_.result->size() << std::endl;
-                // }
-                if (stat_.result->size() >= limit_)
-                    break;
+                if (!distinct_hash_ || !Seen(stat_.current_tuple)) {
+                    delivered_cnt_++;
+                    if (!sink(stat_.current_tuple))
+                        break;
+                    if (delivered_cnt_ >= limit_)
+                        break;
+                }
+                SkipExistential(stat_);
                 Next(stat_);
             } else {
                 Down(stat_);
@@ -372,10 +746,602 @@ void QueryExecutor::Query() {
     query_duration_ = end - begin;
 }
 
+ulong QueryExecutor::Count() {
+    // the count is a single row, the limit is not a limit on the matches
+    limit_ = UINT_MAX;
+    if (!distinct_levels_.empty()) {
+        Execute([](std::span<const uint>) { return true; });
+        return delivered_cnt_;
+    }
+
+    auto begin = std::chrono::high_resolution_clock::now();
+    counting_ = true;
+    skip_pre_result_ = false;
+
+    if (PreJoin()) {
+        count_level_ = IndependentLevel();
+        // the levels without empty items are bound by the constants only, they are counted once
+        for (int level = count_level_; level < int(stat_.plan.size()); level++) {
+            bool optional_depends =
+                std::any_of(optional_items_[level].begin(), optional_items_[level].end(),
+                            [](const auto& item) { return item.first_level != -1 || item.second_level != -1; });
+            if (!empty_item_indices_[level].empty() || optional_depends || !path_items_[level].empty()) {
+                count_levels_.push_back(level);
+                continue;
+            }
+            stat_.level = level;
+            GenCandidateValue(stat_);
+            suffix_cnt_ *= stat_.candidate_value[level].size();
+            stat_.candidate_value[level] = std::span<uint>();
+        }
+        stat_.level = -1;
+        stat_.at_end = false;
+
+        if (count_level_ == 0) {
+            count_ = suffix_cnt_;
+        } else if (thread_num_ > 1) {
+            ParallelQuery();
+        } else {
+            for (;;) {
+                if (Cancelled())
+                    break;
+                if (stat_.at_end) {
+                    if (stat_.level == 0)
+                        break;
+                    Up(stat_);
+                    Next(stat_);
+                } else if (stat_.level == count_level_ - 1) {
+                    count_ += CountSuffix(stat_);
+                    Next(stat_);
+                } else {
+                    Down(stat_);
+                }
+            }
+        }
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    query_duration_ = end - begin;
+    return count_;
+}
+
+int QueryExecutor::IndependentLevel() {
+    // the deepest level that fills an empty item of each level
+    std::vector<int> feeder(stat_.plan.size(), -1);
+    for (uint level = 0; level < stat_.plan.size(); level++) {
+        for (const auto& item : stat_.plan[level]) {
+            if (item.empty_item_level == 0)
+                continue;
+            int deepest = level;
+            if (item.prestore_type == PType::kEmpty)
+                deepest = std::max(deepest, int(item.father_item_id));
+            feeder[item.empty_item_level] = std::max(feeder[item.empty_item_level], deepest);
+        }
+        for (const auto& item : optional_items_[level])
+            feeder[level] = std::max({feeder[level], item.first_level, item.second_level});
+        for (const auto& item : path_items_[level])
+            feeder[level] = std::max(feeder[level], int(item.other_level));
+        // the values of a level with filters or checked paths are checked one by one
+        if (!filter_items_[level].empty() || !path_checks_[level].empty())
+            feeder[level] = level;
+    }
+
+    int level = stat_.plan.size();
+    int deepest = -1;
+    while (level > 0 && std::max(deepest, feeder[level - 1]) < level - 1) {
+        deepest = std::max(deepest, feeder[level - 1]);
+        level--;
+    }
+    return level;
+}
+
+ulong QueryExecutor::CountSuffix(Stat& stat) {
+    int level = stat.level;
+    ulong cnt = suffix_cnt_;
+    for (const auto& count_level : count_levels_) {
+        if (cnt == 0)
+            break;
+        stat.level = count_level;
+        GenCandidateValue(stat);
+        cnt *= stat.candidate_value[count_level].size();
+        stat.candidate_value[count_level] = std::span<uint>();
+    }
+    stat.level = level;
+    stat.at_end = false;
+    return cnt;
+}
+
+void QueryExecutor::OrderBy(const std::vector<OrderKey>& keys) {
+    order_keys_ = keys;
+}
+
+void QueryExecutor::SortBudget(ulong bytes) {
+    sort_budget_ = bytes;
+}
+
+int QueryExecutor::CompareTerms(const std::string& a, const std::string& b) {
+    auto kind = [](const std::string& term) {
+        if (term.empty())
+            return -1;
+        return term.starts_with("_:") ? 0 : (term.starts_with("<") ? 1 : 2);
+    };
+    int kind_a = kind(a);
+    int kind_b = kind(b);
+    if (kind_a != kind_b)
+        return kind_a < kind_b ? -1 : 1;
+
+    std::string_view lexical_a, lexical_b;
+    if (kind_a == 2) {
+        Dictionary::LiteralType type = Dictionary::TypeOf(a, lexical_a);
+        if (type != Dictionary::LiteralType::kUnordered && type == Dictionary::TypeOf(b, lexical_b)) {
+            int cmp = Dictionary::CompareLiterals(type, lexical_a, lexical_b);
+            if (cmp != 0)
+                return cmp;
+        }
+    }
+    int cmp = a.compare(b);
+    return (cmp > 0) - (cmp < 0);
+}
+
+QueryExecutor::KeyValue QueryExecutor::MakeKey(uint key, uint id) {
+    return KeyValue{id, index_->OrderedType(id, order_keys_[key].position), std::string(), false};
+}
+
+int QueryExecutor::CompareKey(uint key, KeyValue& a, KeyValue& b) {
+    if (a.id == b.id)
+        return 0;
+    // the ids of the literals of an ordered datatype follow their values
+    if (a.type != Dictionary::LiteralType::kUnordered && a.type == b.type)
+        return a.id < b.id ? -1 : 1;
+    for (KeyValue* value : {&a, &b}) {
+        if (!value->decoded) {
+            value->term = index_->Decode(value->id, order_keys_[key].position);
+            value->decoded = true;
+        }
+    }
+    return CompareTerms(a.term, b.term);
+}
+
+void QueryExecutor::TopK(const Sink& sink, ulong k) {
+    if (k == 0)
+        return;
+
+    struct Row {
+        std::vector<uint> tuple;
+        // decoded by the comparisons that need them
+        mutable std::vector<KeyValue> keys;
+        // rows with equal keys stay in the order they are found
+        ulong sequence;
+    };
+    auto before = [&](const Row& a, const Row& b) {
+        for (uint i = 0; i < order_keys_.size(); i++) {
+            int cmp = CompareKey(i, a.keys[i], b.keys[i]);
+            if (cmp != 0)
+                return order_keys_[i].descending ? cmp > 0 : cmp < 0;
+        }
+        return a.sequence < b.sequence;
+    };
+
+    // the row that comes last in the order is at the front of the heap
+    std::vector<Row> heap;
+    ulong sequence = 0;
+    Execute([&](std::span<const uint> tuple) {
+        std::vector<KeyValue> keys;
+        for (uint i = 0; i < order_keys_.size(); i++)
+            keys.push_back(MakeKey(i, tuple[order_keys_[i].level]));
+        if (heap.size() == k) {
+            // the keys are compared one by one until the tuple is known to come before or after the last row
+            const Row& last = heap.front();
+            int cmp = 0;
+            for (uint i = 0; i < order_keys_.size() && cmp == 0; i++) {
+                cmp = CompareKey(i, keys[i], last.keys[i]);
+                if (order_keys_[i].descending)
+                    cmp = -cmp;
+            }
+            // a tuple equal to the last row is found after it
+            if (cmp >= 0)
+                return true;
+            std::pop_heap(heap.begin(), heap.end(), before);
+            heap.pop_back();
+        }
+        heap.push_back(Row{std::vector<uint>(tuple.begin(), tuple.end()), std::move(keys), sequence++});
+        std::push_heap(heap.begin(), heap.end(), before);
+        return true;
+    });
+
+    // the rows found before the query was cancelled are not the first ones
+    if (Cancelled())
+        return;
+    std::sort_heap(heap.begin(), heap.end(), before);
+    for (const auto& row : heap) {
+        if (!sink(row.tuple))
+            break;
+    }
+}
+
+void QueryExecutor::Sort(const Sink& sink) {
+    ResultTable rows(stat_.plan.size());
+    // a row, the ranks of its keys and its place in the order
+    ulong row_bytes = (rows.width() + order_keys_.size()) * sizeof(uint) + sizeof(ulong);
+    std::vector<std::string> runs;
+    bool spilling = true;
+    Execute([&](std::span<const uint> tuple) {
+        rows.Append(tuple);
+        // a run that can not be written stays in memory
+        if (spilling && rows.size() * row_bytes >= sort_budget_) {
+            spilling = Spill(rows, runs);
+            if (spilling)
+                rows.Clear();
+        }
+        return true;
+    });
+
+    if (!Cancelled()) {
+        if (runs.empty()) {
+            std::vector<ulong> order;
+            SortRows(rows, order);
+            for (const auto& row : order) {
+                if (!sink(rows[row]))
+                    break;
+            }
+        } else if (rows.empty() || Spill(rows, runs)) {
+            rows.Clear();
+            MergeRuns(runs, sink);
+        }
+    }
+    for (const auto& run : runs)
+        std::filesystem::remove(run);
+}
+
+void QueryExecutor::SortRows(const ResultTable& rows, std::vector<ulong>& order) {
+    ulong n = rows.size();
+    ulong key_cnt = order_keys_.size();
+
+    // the ranks of the values of the keys, row by row, they compare like the terms
+    std::vector<uint> ranks(n * key_cnt);
+    for (uint i = 0; i < key_cnt; i++) {
+        const auto& key = order_keys_[i];
+        std::vector<uint> ids(n);
+        for (ulong row = 0; row < n; row++)
+            ids[row] = rows[row][key.level];
+        std::sort(ids.begin(), ids.end());
+        ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+        // the values are literals of one ordered datatype, their ids are in the order of the values
+        Dictionary::LiteralType type = index_->OrderedType(ids.front(), key.position);
+        bool ordered_ids = type != Dictionary::LiteralType::kUnordered &&
+                           index_->OrderedType(ids.back(), key.position) == type;
+        if (ordered_ids) {
+            for (ulong row = 0; row < n; row++) {
+                uint r = std::lower_bound(ids.begin(), ids.end(), rows[row][key.level]) - ids.begin();
+                ranks[row * key_cnt + i] = key.descending ? UINT_MAX - r : r;
+            }
+            continue;
+        }
+
+        std::vector<std::string> terms(ids.size());
+        ParallelFor(ids.size(), [&](ulong begin, ulong end) {
+            for (ulong j = begin; j < end; j++)
+                terms[j] = index_->Decode(ids[j], key.position);
+        });
+        std::vector<uint> order(ids.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(),
+                  [&](uint a, uint b) { return CompareTerms(terms[a], terms[b]) < 0; });
+
+        std::vector<uint> rank(ids.size());
+        for (ulong j = 1; j < order.size(); j++)
+            rank[order[j]] = rank[order[j - 1]] + (CompareTerms(terms[order[j - 1]], terms[order[j]]) != 0);
+        for (ulong row = 0; row < n; row++) {
+            uint r = rank[std::lower_bound(ids.begin(), ids.end(), rows[row][key.level]) - ids.begin()];
+            ranks[row * key_cnt + i] = key.descending ? UINT_MAX - r : r;
+        }
+    }
+
+    order.resize(n);
+    std::iota(order.begin(), order.end(), 0);
+    auto before = [&](ulong a, ulong b) {
+        for (ulong i = 0; i < key_cnt; i++) {
+            if (ranks[a * key_cnt + i] != ranks[b * key_cnt + i])
+                return ranks[a * key_cnt + i] < ranks[b * key_cnt + i];
+        }
+        return a < b;
+    };
+
+    // every thread sorts a run, then the runs are merged in pairs
+    ulong run = (n + thread_num_ - 1) / thread_num_;
+    ParallelFor(n, [&](ulong begin, ulong end) { std::sort(order.begin() + begin, order.begin() + end, before); });
+    for (ulong width = std::max(run, 1ul); width < n; width *= 2) {
+        std::vector<std::thread> mergers;
+        for (ulong begin = 0; begin + width < n; begin += 2 * width) {
+            mergers.emplace_back([&, begin, width]() {
+                std::inplace_merge(order.begin() + begin, order.begin() + begin + width,
+                                   order.begin() + std::min(begin + 2 * width, n), before);
+            });
+        }
+        for (auto& merger : mergers)
+            merger.join();
+    }
+}
+
+bool QueryExecutor::Spill(const ResultTable& rows, std::vector<std::string>& runs) {
+    static std::atomic<ulong> run_cnt = 0;
+    std::string path = (std::filesystem::temp_directory_path() /
+                        ("rdftdaa-sort-" + std::to_string(getpid()) + "-" + std::to_string(run_cnt++)))
+                           .string();
+    std::ofstream out(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) {
+        perror("Error opening sort run");
+        return false;
+    }
+
+    std::vector<ulong> order;
+    SortRows(rows, order);
+    for (const auto& row : order)
+        out.write(reinterpret_cast<const char*>(rows[row].data()), rows.width() * sizeof(uint));
+    out.close();
+    if (out.fail()) {
+        perror("Error writing sort run");
+        std::filesystem::remove(path);
+        return false;
+    }
+    runs.push_back(path);
+    return true;
+}
+
+void QueryExecutor::MergeRuns(const std::vector<std::string>& runs, const Sink& sink) {
+    struct Run {
+        std::ifstream in;
+        std::vector<uint> tuple;
+        std::vector<KeyValue> keys;
+    };
+    uint width = stat_.plan.size();
+    std::vector<Run> heads(runs.size());
+    auto read = [&](uint r) {
+        Run& run = heads[r];
+        if (!run.in.read(reinterpret_cast<char*>(run.tuple.data()), width * sizeof(uint)))
+            return false;
+        for (uint i = 0; i < order_keys_.size(); i++)
+            run.keys[i] = MakeKey(i, run.tuple[order_keys_[i].level]);
+        return true;
+    };
+    // the heap keeps the run whose tuple comes first at the front, the earlier run first among equal tuples
+    auto after = [&](uint a, uint b) {
+        for (uint i = 0; i < order_keys_.size(); i++) {
+            int cmp = CompareKey(i, heads[a].keys[i], heads[b].keys[i]);
+            if (cmp != 0)
+                return order_keys_[i].descending ? cmp < 0 : cmp > 0;
+        }
+        return a > b;
+    };
+
+    std::vector<uint> heap;
+    for (uint r = 0; r < runs.size(); r++) {
+        heads[r].in.open(runs[r], std::ios::in | std::ios::binary);
+        heads[r].tuple.resize(width);
+        heads[r].keys.resize(order_keys_.size());
+        if (read(r))
+            heap.push_back(r);
+    }
+    std::make_heap(heap.begin(), heap.end(), after);
+    while (!heap.empty() && !Cancelled()) {
+        std::pop_heap(heap.begin(), heap.end(), after);
+        uint r = heap.back();
+        if (!sink(heads[r].tuple))
+            break;
+        if (read(r))
+            std::push_heap(heap.begin(), heap.end(), after);
+        else
+            heap.pop_back();
+    }
+}
+
+void QueryExecutor::ParallelFor(ulong n, const std::function<void(ulong begin, ulong end)>& f) {
+    ulong range = (n + thread_num_ - 1) / thread_num_;
+    if (thread_num_ == 1 || n < 2) {
+        f(0, n);
+        return;
+    }
+    std::vector<std::thread> threads;
+    for (ulong begin = 0; begin < n; begin += range)
+        threads.emplace_back(f, begin, std::min(begin + range, n));
+    for (auto& thread : threads)
+        thread.join();
+}
+
+void QueryExecutor::ParallelQuery() {
+    Stat root = stat_;
+    root.level = 0;
+    GenCandidateValue(root);
+    if (root.at_end)
+        return;
+
+    morsels_ = std::vector<std::deque<std::unique_ptr<Morsel>>>(thread_num_);
+    morsel_mutexes_ = std::vector<std::mutex>(thread_num_);
+
+    // a few morsels per worker at the beginning, the rest of the balancing is done by stealing
+    std::span<uint> values = root.candidate_value[0];
+    ulong morsel_size = (values.size() + thread_num_ * 4 - 1) / (thread_num_ * 4);
+    uint worker_id = 0;
+    for (ulong offset = 0; offset < values.size(); offset += morsel_size) {
+        auto morsel = std::make_unique<Morsel>(Morsel{0, root});
+        morsel->stat.candidate_value[0] = values.subspan(offset, std::min(morsel_size, values.size() - offset));
+        PushMorsel(worker_id, std::move(morsel));
+        worker_id = (worker_id + 1) % thread_num_;
+    }
+
+    std::vector<std::thread> workers;
+    for (uint id = 0; id < thread_num_; id++)
+        workers.emplace_back(&QueryExecutor::Worker, this, id);
+    for (auto& worker : workers)
+        worker.join();
+}
+
+void QueryExecutor::Worker(uint worker_id) {
+    auto worker_result = std::make_shared<ResultTable>(stat_.plan.size());
+    std::unique_ptr<Morsel> morsel;
+    bool idle = false;
+    for (;;) {
+        if (PopMorsel(worker_id, morsel)) {
+            if (idle) {
+                idle_cnt_--;
+                idle = false;
+            }
+            if (!stop_) {
+                morsel->stat.result = worker_result;
+                Enumerate(worker_id, morsel->stat, morsel->base_level);
+                Flush(*worker_result);
+            }
+            if (--pending_cnt_ == 0) {
+                std::lock_guard<std::mutex> lock(idle_mutex_);
+                idle_cv_.notify_all();
+            }
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(idle_mutex_);
+        if (pending_cnt_ == 0)
+            break;
+        if (!idle) {
+            idle_cnt_++;
+            idle = true;
+        }
+        // the morsels pushed after the pop above are counted, so their notification is not missed
+        idle_cv_.wait(lock, [this]() { return pending_cnt_ == 0 || queued_cnt_ > 0; });
+    }
+    if (idle)
+        idle_cnt_--;
+}
+
+void QueryExecutor::Flush(ResultTable& tuples) {
+    std::lock_guard<std::mutex> lock(sink_mutex_);
+    for (ulong i = 0; i < tuples.size(); i++) {
+        if (sink_closed_ || delivered_cnt_ >= limit_)
+            break;
+        if (distinct_hash_ && Seen(tuples[i]))
+            continue;
+        delivered_cnt_++;
+        if (!(*sink_)(tuples[i])) {
+            sink_closed_ = true;
+            stop_ = true;
+        }
+    }
+    if (delivered_cnt_ >= limit_)
+        stop_ = true;
+    tuples.Clear();
+}
+
+bool QueryExecutor::PopMorsel(uint worker_id, std::unique_ptr<Morsel>& morsel) {
+    {
+        std::lock_guard<std::mutex> lock(morsel_mutexes_[worker_id]);
+        if (!morsels_[worker_id].empty()) {
+            morsel = std::move(morsels_[worker_id].back());
+            morsels_[worker_id].pop_back();
+            queued_cnt_--;
+            return true;
+        }
+    }
+    for (uint i = 1; i < thread_num_; i++) {
+        uint victim = (worker_id + i) % thread_num_;
+        std::lock_guard<std::mutex> lock(morsel_mutexes_[victim]);
+        if (!morsels_[victim].empty()) {
+            morsel = std::move(morsels_[victim].front());
+            morsels_[victim].pop_front();
+            queued_cnt_--;
+            return true;
+        }
+    }
+    return false;
+}
+
+void QueryExecutor::PushMorsel(uint worker_id, std::unique_ptr<Morsel> morsel) {
+    pending_cnt_++;
+    {
+        std::lock_guard<std::mutex> lock(morsel_mutexes_[worker_id]);
+        morsels_[worker_id].push_back(std::move(morsel));
+        queued_cnt_++;
+    }
+    std::lock_guard<std::mutex> lock(idle_mutex_);
+    idle_cv_.notify_one();
+}
+
+void QueryExecutor::Enumerate(uint worker_id, Stat& stat, int base_level) {
+    int last_level = int(stat.plan.size() - 1);
+    Next(stat);
+    while (!stop_) {
+        if (Cancelled()) {
+            stop_ = true;
+            break;
+        }
+        if (stat.at_end) {
+            if (stat.level == base_level)
+                break;
+            Up(stat);
+            Next(stat);
+        } else if (counting_ && stat.level == count_level_ - 1) {
+            count_ += CountSuffix(stat);
+            Next(stat);
+        } else {
+            if (stat.level == last_level) {
+                stat.result->Append(stat.current_tuple);
+                // duplicates are only known when they are flushed
+                if (!distinct_hash_ && limit_ != UINT_MAX && ++result_cnt_ >= limit_)
+                    stop_ = true;
+                // the first tuples reach the sink before the morsel is done
+                if (stat.result->size() >= kFlushSize)
+                    Flush(*stat.result);
+                SkipExistential(stat);
+                Next(stat);
+            } else {
+                if (idle_cnt_ > 0)
+                    Split(worker_id, stat, base_level);
+                Down(stat);
+            }
+        }
+    }
+}
+
+void QueryExecutor::Split(uint worker_id, Stat& stat, int base_level) {
+    {
+        // the morsels given away before have not been taken yet
+        std::lock_guard<std::mutex> lock(morsel_mutexes_[worker_id]);
+        if (!morsels_[worker_id].empty())
+            return;
+    }
+    // an existential level split in two would give a match for each half
+    for (int level = base_level; level <= std::min(stat.level, existential_level_ - 1); level++) {
+        ulong left = stat.candidate_value[level].size() - stat.candidate_indices[level];
+        if (left < 2)
+            continue;
+
+        ulong mid = stat.candidate_indices[level] + left / 2;
+        auto morsel = std::make_unique<Morsel>(Morsel{level, stat});
+        Stat& split = morsel->stat;
+        split.level = level;
+        split.at_end = false;
+        split.candidate_value[level] = stat.candidate_value[level].subspan(mid);
+        split.candidate_indices[level] = 0;
+        for (uint deeper = level + 1; deeper < split.plan.size(); deeper++) {
+            split.candidate_value[deeper] = std::span<uint>();
+            split.candidate_indices[deeper] = 0;
+            split.owned_value[deeper].reset();
+        }
+        stat.candidate_value[level] = stat.candidate_value[level].first(mid);
+        PushMorsel(worker_id, std::move(morsel));
+        return;
+    }
+}
+
 double QueryExecutor::query_duration() {
     return query_duration_.count();
 }
 
-std::vector<std::vector<uint>>& QueryExecutor::result() {
+ResultTable& QueryExecutor::result() {
     return *stat_.result;
-}
\ No newline at end of file
+}
+const std::vector<QueryExecutor::LevelProfile>& QueryExecutor::profile() const {
+    return profile_;
+}
+
+const std::vector<std::span<uint>>& QueryExecutor::pre_join() const {
+    return pre_join_;
+}
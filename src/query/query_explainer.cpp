@@ -0,0 +1,258 @@
+#include "rdf-tdaa/query/query_explainer.hpp"
+#include <algorithm>
+#include <cctype>
+#include <limits>
+#include "rapidjson/writer.h"
+
+using Writer = rapidjson::Writer<rapidjson::StringBuffer>;
+
+static const char* kRTypeNames[] = {"GetBySP",    "GetByOP",    "GetBySO", "OtherSet", "GetSPreSet",
+                                    "GetOPreSet", "GetSSet",    "GetOSet", "None"};
+static const char* kPTypeNames[] = {"PreSub", "PreObj", "Subject", "Predicate", "Object", "Empty"};
+static const char* kPositionNames[] = {"subject", "predicate", "object", "shared"};
+
+// whether the text continues with a keyword at pos, in any case and followed by white space or the end
+static bool Keyword(const std::string& text, size_t& pos, const std::string& keyword) {
+    if (text.size() - pos < keyword.size())
+        return false;
+    for (size_t i = 0; i < keyword.size(); i++) {
+        if (std::toupper(static_cast<unsigned char>(text[pos + i])) != keyword[i])
+            return false;
+    }
+    size_t end = pos + keyword.size();
+    if (end < text.size() && !std::isspace(static_cast<unsigned char>(text[end])))
+        return false;
+    pos = end;
+    while (pos < text.size() && std::isspace(static_cast<unsigned char>(text[pos])))
+        pos++;
+    return true;
+}
+
+static void Milliseconds(Writer& writer, const char* key, double milliseconds) {
+    writer.Key(key);
+    writer.Double(milliseconds);
+}
+
+bool QueryExplainer::Strip(std::string& query, bool& analyze) {
+    size_t pos = 0;
+    while (pos < query.size() && std::isspace(static_cast<unsigned char>(query[pos])))
+        pos++;
+    analyze = false;
+    if (!Keyword(query, pos, "EXPLAIN"))
+        return false;
+    analyze = Keyword(query, pos, "ANALYZE");
+    query.erase(0, pos);
+    return true;
+}
+
+QueryExplainer::QueryExplainer(std::shared_ptr<IndexRetriever> index,
+                               std::shared_ptr<SPARQLParser> parser,
+                               const Planner& planner)
+    : index_(index), parser_(parser) {
+    auto start = std::chrono::steady_clock::now();
+    if (parser_->HasUnion()) {
+        for (auto& branch : parser_->Branches())
+            branches_.push_back({branch, planner(branch)});
+    } else {
+        branches_.push_back({parser_, planner(parser_)});
+    }
+    plan_time_ = std::chrono::steady_clock::now() - start;
+}
+
+void QueryExplainer::CancelBy(std::shared_ptr<CancellationToken> token) {
+    token_ = token;
+}
+
+ulong QueryExplainer::estimated_cost() {
+    ulong cost = 0;
+    for (auto& branch : branches_) {
+        ulong branch_cost = branch.plan->estimated_cost();
+        cost = std::min(cost, std::numeric_limits<ulong>::max() - branch_cost) + branch_cost;
+    }
+    return cost;
+}
+
+std::shared_ptr<QueryExecutor> QueryExplainer::Analyze(Branch& branch, ulong& rows, double& execute_time) {
+    rows = 0;
+    execute_time = 0;
+    if (branch.plan->zero_result())
+        return nullptr;
+
+    auto executor = std::make_shared<QueryExecutor>(index_, branch.plan, parser_->Limit(), index_->shared_cnt());
+    executor->CancelBy(token_);
+    executor->Profile();
+
+    auto start = std::chrono::steady_clock::now();
+    // the modifiers of a query with UNION apply to the rows of all alternatives, not to one of them
+    const auto& modifier = parser_->project_modifier().modifier_type;
+    if (!parser_->HasUnion() && modifier == SPARQLParser::ProjectModifier::Count) {
+        std::vector<uint> levels;
+        for (const auto& idx : branch.plan->MappingVariable(parser_->ProjectVariables()))
+            levels.push_back(idx.priority);
+        if (!parser_->CountAll())
+            executor->RequireBound(levels);
+        if (parser_->CountDistinct())
+            executor->Distinct(levels);
+        rows = executor->Count();
+    } else {
+        if (!parser_->HasUnion() && modifier == SPARQLParser::ProjectModifier::Distinct) {
+            std::vector<uint> levels;
+            for (const auto& idx : branch.plan->MappingVariable(parser_->ProjectVariables()))
+                levels.push_back(idx.priority);
+            executor->Distinct(levels);
+        }
+        executor->Query([&](std::span<const uint>) {
+            rows++;
+            return true;
+        });
+    }
+    execute_time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return executor;
+}
+
+std::string QueryExplainer::Explain(bool analyze) {
+    rapidjson::StringBuffer result;
+    Writer writer(result);
+
+    writer.StartObject();
+    writer.Key("analyze");
+    writer.Bool(analyze);
+    Milliseconds(writer, "plan_time_ms", plan_time_.count());
+    writer.Key("estimated_cost");
+    writer.Uint64(estimated_cost());
+    writer.Key("branches");
+    writer.StartArray();
+    for (auto& branch : branches_) {
+        auto& plan = branch.plan;
+        ulong rows = 0;
+        double execute_time = 0;
+        std::shared_ptr<QueryExecutor> executor;
+        if (analyze)
+            executor = Analyze(branch, rows, execute_time);
+
+        writer.StartObject();
+        writer.Key("estimated_cost");
+        writer.Uint64(plan->estimated_cost());
+        writer.Key("zero_result");
+        writer.Bool(plan->zero_result());
+        if (analyze) {
+            writer.Key("rows");
+            writer.Uint64(rows);
+            Milliseconds(writer, "execute_time_ms", execute_time);
+            writer.Key("cancelled");
+            writer.Bool(token_ != nullptr && token_->reason() != CancellationToken::kNone);
+        }
+
+        // the levels of the plan, in the order their variables are bound
+        auto variables = plan->variable_order();
+        auto& query_plan = plan->query_plan();
+        writer.Key("levels");
+        writer.StartArray();
+        for (uint level = 0; level < query_plan.size(); level++) {
+            writer.StartObject();
+            writer.Key("level");
+            writer.Uint(level);
+            if (level < variables.size()) {
+                writer.Key("variable");
+                writer.String(variables[level].c_str());
+                writer.Key("position");
+                writer.String(kPositionNames[plan->value2variable()[variables[level]]->position]);
+            }
+
+            // the values of a level with an empty item are looked up from a level before, they are not estimated
+            bool looked_up = !plan->empty_item_indices()[level].empty();
+            ulong estimated = std::numeric_limits<ulong>::max();
+            writer.Key("pre_results");
+            writer.StartArray();
+            for (const auto& pre_result : plan->pre_results()[level]) {
+                writer.Uint64(pre_result.size());
+                estimated = std::min(estimated, ulong(pre_result.size()));
+            }
+            writer.EndArray();
+
+            writer.Key("items");
+            writer.StartArray();
+            const auto& empty_items = plan->empty_item_indices()[level];
+            for (uint i = 0; i < query_plan[level].size(); i++) {
+                const auto& item = query_plan[level][i];
+                writer.StartObject();
+                writer.Key("triple_pattern");
+                writer.Uint(item.triple_pattern_id);
+                writer.Key("retrieval_type");
+                writer.String(kRTypeNames[item.retrieval_type]);
+                writer.Key("prestore_type");
+                writer.String(kPTypeNames[item.prestore_type]);
+                writer.Key("search_id");
+                writer.Uint(item.search_id);
+                if (item.empty_item_level != 0) {
+                    writer.Key("fills_level");
+                    writer.Uint(item.empty_item_level);
+                }
+                bool empty = std::find(empty_items.begin(), empty_items.end(), i) != empty_items.end();
+                writer.Key("empty");
+                writer.Bool(empty);
+                if (!empty) {
+                    writer.Key("index_result");
+                    writer.Uint64(item.index_result.size());
+                    if (item.index_result.size() != 0)
+                        estimated = std::min(estimated, ulong(item.index_result.size()));
+                }
+                writer.EndObject();
+            }
+            writer.EndArray();
+
+            writer.Key("estimated_candidates");
+            if (looked_up || estimated == std::numeric_limits<ulong>::max())
+                writer.Null();
+            else
+                writer.Uint64(estimated);
+            writer.Key("optional_items");
+            writer.Uint(plan->optional_items()[level].size());
+            writer.Key("path_items");
+            writer.Uint(plan->path_items()[level].size());
+            writer.Key("path_checks");
+            writer.Uint(plan->path_checks()[level].size());
+            writer.Key("constant_paths");
+            writer.Uint(std::count_if(plan->constant_paths().begin(), plan->constant_paths().end(),
+                                      [&](const auto& path) { return path.level == int(level); }));
+            writer.Key("filter_range");
+            writer.Bool(!plan->filter_ranges()[level].conditions.empty());
+            writer.Key("filter_items");
+            writer.Uint(plan->filter_items()[level].size());
+
+            if (executor != nullptr && level < executor->profile().size()) {
+                const auto& profile = executor->profile()[level];
+                writer.Key("actual");
+                writer.StartObject();
+                if (level < executor->pre_join().size() && executor->pre_join()[level].size()) {
+                    writer.Key("pre_join");
+                    writer.Uint64(executor->pre_join()[level].size());
+                }
+                writer.Key("generations");
+                writer.Uint64(profile.generations);
+                writer.Key("candidates");
+                writer.Uint64(profile.candidates);
+                writer.Key("matches");
+                writer.Uint64(profile.matches);
+                writer.Key("joins");
+                writer.Uint64(profile.joins);
+                writer.Key("join_lists");
+                writer.Uint64(profile.join_lists);
+                writer.Key("join_input");
+                writer.Uint64(profile.join_input);
+                writer.Key("join_output");
+                writer.Uint64(profile.join_output);
+                writer.Key("index_calls");
+                writer.Uint64(profile.index_calls);
+                Milliseconds(writer, "time_ms", std::chrono::duration<double, std::milli>(profile.time).count());
+                writer.EndObject();
+            }
+            writer.EndObject();
+        }
+        writer.EndArray();
+        writer.EndObject();
+    }
+    writer.EndArray();
+    writer.EndObject();
+    return result.GetString();
+}
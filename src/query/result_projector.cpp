@@ -0,0 +1,133 @@
+#include "rdf-tdaa/query/result_projector.hpp"
+#include <algorithm>
+#include <thread>
+
+std::atomic<ulong> ResultProjector::all_bytes_(0);
+
+ResultProjector::ResultProjector(std::shared_ptr<IndexRetriever> index, uint columns, uint thread_num, Sink sink)
+    : index_(index),
+      thread_num_(std::max(thread_num, 1u)),
+      sink_(sink),
+      rows_(columns),
+      bytes_(0),
+      decode_time_(0),
+      emit_time_(0) {
+    rows_.Reserve(kBatchRows);
+}
+
+ResultProjector::~ResultProjector() {
+    DropTerms();
+}
+
+void ResultProjector::DropTerms() {
+    entities_.clear();
+    predicates_.clear();
+    all_bytes_ -= bytes_;
+    bytes_ = 0;
+}
+
+void ResultProjector::Decode(std::vector<uint>& ids, bool predicate, hash_map<uint, std::string>& terms) {
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+    auto position = predicate ? SPARQLParser::Term::Positon::kPredicate : SPARQLParser::Term::Positon::kSubject;
+    std::vector<std::string> decoded(ids.size());
+    auto decode = [&](ulong begin, ulong end) {
+        for (ulong i = begin; i < end; i++)
+            decoded[i] = index_->Decode(ids[i], position);
+    };
+
+    if (thread_num_ == 1 || ids.size() < kParallelTerms) {
+        decode(0, ids.size());
+    } else {
+        // every thread reads a contiguous range of the dictionary
+        std::vector<std::thread> threads;
+        ulong chunk = (ids.size() + thread_num_ - 1) / thread_num_;
+        for (uint t = 0; t < thread_num_; t++) {
+            ulong begin = std::min(t * chunk, ids.size());
+            ulong end = std::min(begin + chunk, ids.size());
+            threads.emplace_back(decode, begin, end);
+        }
+        for (auto& thread : threads)
+            thread.join();
+    }
+
+    ulong bytes = 0;
+    for (ulong i = 0; i < ids.size(); i++) {
+        bytes += decoded[i].size();
+        terms.emplace(ids[i], std::move(decoded[i]));
+    }
+    bytes_ += bytes;
+    all_bytes_ += bytes;
+}
+
+bool ResultProjector::Add(std::span<const uint> row, std::span<const SPARQLParser::Term::Positon> positions) {
+    rows_.Append(row);
+    positions_.insert(positions_.end(), positions.begin(), positions.begin() + rows_.width());
+    if (rows_.size() < kBatchRows)
+        return true;
+    return Flush();
+}
+
+bool ResultProjector::Flush() {
+    if (rows_.empty())
+        return true;
+
+    if (entities_.size() + predicates_.size() > kMaxTerms)
+        DropTerms();
+
+    std::vector<uint> new_entities;
+    std::vector<uint> new_predicates;
+    uint width = rows_.width();
+    for (ulong r = 0; r < rows_.size(); r++) {
+        auto row = rows_[r];
+        for (uint i = 0; i < width; i++) {
+            if (row[i] == 0)
+                continue;
+            if (positions_[r * width + i] == SPARQLParser::Term::Positon::kPredicate) {
+                if (!predicates_.contains(row[i]))
+                    new_predicates.push_back(row[i]);
+            } else if (!entities_.contains(row[i])) {
+                new_entities.push_back(row[i]);
+            }
+        }
+    }
+    auto decode_start = std::chrono::steady_clock::now();
+    Decode(new_entities, false, entities_);
+    Decode(new_predicates, true, predicates_);
+    auto emit_start = std::chrono::steady_clock::now();
+    decode_time_ += emit_start - decode_start;
+
+    // the terms are not moved while the batch is emitted, nothing is added to the maps
+    bool go_on = true;
+    std::vector<const std::string*> terms(width);
+    for (ulong r = 0; r < rows_.size() && go_on; r++) {
+        auto row = rows_[r];
+        for (uint i = 0; i < width; i++) {
+            if (row[i] == 0)
+                terms[i] = nullptr;
+            else if (positions_[r * width + i] == SPARQLParser::Term::Positon::kPredicate)
+                terms[i] = &predicates_.find(row[i])->second;
+            else
+                terms[i] = &entities_.find(row[i])->second;
+        }
+        go_on = sink_(row, std::span(positions_).subspan(r * width, width), terms);
+    }
+    emit_time_ += std::chrono::steady_clock::now() - emit_start;
+
+    rows_.Clear();
+    positions_.clear();
+    return go_on;
+}
+
+std::chrono::nanoseconds ResultProjector::decode_time() const {
+    return decode_time_;
+}
+
+std::chrono::nanoseconds ResultProjector::emit_time() const {
+    return emit_time_;
+}
+
+ulong ResultProjector::decoded_bytes() {
+    return all_bytes_;
+}
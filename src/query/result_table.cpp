@@ -0,0 +1,40 @@
+#include "rdf-tdaa/query/result_table.hpp"
+
+ResultTable::ResultTable(uint width) : width_(width) {}
+
+uint ResultTable::width() const {
+    return width_;
+}
+
+ulong ResultTable::size() const {
+    return width_ ? values_.size() / width_ : 0;
+}
+
+bool ResultTable::empty() const {
+    return values_.empty();
+}
+
+void ResultTable::Reserve(ulong rows) {
+    values_.reserve(rows * width_);
+}
+
+void ResultTable::Append(std::span<const uint> row) {
+    values_.insert(values_.end(), row.begin(), row.begin() + width_);
+}
+
+std::span<uint> ResultTable::operator[](ulong row) {
+    return std::span<uint>(values_.data() + row * width_, width_);
+}
+
+std::span<const uint> ResultTable::operator[](ulong row) const {
+    return std::span<const uint>(values_.data() + row * width_, width_);
+}
+
+void ResultTable::Clear() {
+    values_.clear();
+}
+
+void ResultTable::Truncate(ulong rows) {
+    if (rows < size())
+        values_.resize(rows * width_);
+}
@@ -0,0 +1,226 @@
+#include "rdf-tdaa/query/union_executor.hpp"
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <thread>
+
+UnionExecutor::UnionExecutor(std::shared_ptr<IndexRetriever> index,
+                             std::shared_ptr<SPARQLParser> parser,
+                             const std::vector<std::shared_ptr<PlanGenerator>>& plans,
+                             uint thread_num)
+    : index_(index),
+      parser_(parser),
+      limit_(parser->Limit()),
+      distinct_(parser->project_modifier().modifier_type == SPARQLParser::ProjectModifier::Distinct),
+      delivered_cnt_(0),
+      sink_closed_(false),
+      query_duration_(0) {
+    uint branch_cnt = std::count_if(plans.begin(), plans.end(), [](const auto& plan) { return !plan->zero_result(); });
+    // a branch can not stop at the limit when some of its rows may be dropped as found by another branch
+    bool shared_rows = distinct_ || parser->project_modifier().modifier_type == SPARQLParser::ProjectModifier::Count;
+    uint branch_limit = (shared_rows && branch_cnt > 1) ? UINT_MAX : limit_;
+    uint branch_threads = std::max(thread_num / std::max(branch_cnt, 1u), 1u);
+
+    for (auto plan : plans) {
+        if (plan->zero_result())
+            continue;
+        Branch branch;
+        branch.plan = plan;
+        branch.executor =
+            std::make_shared<QueryExecutor>(index, branch.plan, branch_limit, index->shared_cnt(), branch_threads);
+
+        auto& variables = plan->value2variable();
+        for (const auto& variable : parser->ProjectVariables()) {
+            auto it = variables.find(variable);
+            branch.levels.push_back(it == variables.end() ? -1 : int(it->second->priority));
+            branch.positions.push_back(it == variables.end() ? Positon::kSubject : it->second->position);
+        }
+        for (const auto& condition : parser->OrderConditions()) {
+            auto it = variables.find(condition.variable);
+            branch.key_levels.push_back(it == variables.end() ? -1 : int(it->second->priority));
+            branch.key_positions.push_back(it == variables.end() ? Positon::kSubject : it->second->position);
+        }
+        branches_.push_back(std::move(branch));
+    }
+}
+
+void UnionExecutor::CancelBy(std::shared_ptr<CancellationToken> token) {
+    token_ = token;
+    for (auto& branch : branches_)
+        branch.executor->CancelBy(token);
+}
+
+void UnionExecutor::ForEachBranch(const std::function<void(Branch& branch)>& f) {
+    if (branches_.size() == 1) {
+        f(branches_[0]);
+        return;
+    }
+    std::vector<std::thread> threads;
+    for (auto& branch : branches_)
+        threads.emplace_back(f, std::ref(branch));
+    for (auto& thread : threads)
+        thread.join();
+}
+
+std::vector<uint> UnionExecutor::BoundLevels(const Branch& branch) {
+    std::vector<uint> levels;
+    for (const auto& level : branch.levels) {
+        if (level != -1)
+            levels.push_back(level);
+    }
+    return levels;
+}
+
+void UnionExecutor::Project(const Branch& branch, std::span<const uint> tuple, std::vector<uint>& row) {
+    for (uint i = 0; i < branch.levels.size(); i++)
+        row[i] = branch.levels[i] == -1 ? 0 : tuple[branch.levels[i]];
+}
+
+bool UnionExecutor::Deliver(const Sink& sink, std::span<const uint> row, std::span<const Positon> positions) {
+    if (sink_closed_ || delivered_cnt_ >= limit_)
+        return false;
+    if (distinct_ && branches_.size() > 1) {
+        std::string key;
+        key.reserve(row.size() * (sizeof(uint) + 1));
+        for (uint i = 0; i < row.size(); i++) {
+            key.append(reinterpret_cast<const char*>(&row[i]), sizeof(uint));
+            // the ids of the predicates and of the other terms overlap
+            key.push_back(row[i] != 0 && positions[i] == Positon::kPredicate);
+        }
+        if (!seen_rows_.insert(std::move(key)).second)
+            return true;
+    }
+    delivered_cnt_++;
+    if (!sink(row, positions)) {
+        sink_closed_ = true;
+        return false;
+    }
+    return delivered_cnt_ < limit_;
+}
+
+void UnionExecutor::Sort(const Sink& sink) {
+    struct Row {
+        std::vector<uint> values;
+        const Branch* branch;
+        std::vector<std::string> keys;
+    };
+
+    // every branch delivers its rows sorted, at most limit_ of them, they are merged by their keys
+    std::vector<std::vector<Row>> branch_rows(branches_.size());
+    ForEachBranch([&](Branch& branch) {
+        auto& rows = branch_rows[&branch - branches_.data()];
+        branch.executor->Query([&](std::span<const uint> tuple) {
+            Row row{std::vector<uint>(branch.levels.size()), &branch, {}};
+            Project(branch, tuple, row.values);
+            for (uint i = 0; i < branch.key_levels.size(); i++) {
+                int level = branch.key_levels[i];
+                row.keys.push_back(level == -1 ? "" : index_->Decode(tuple[level], branch.key_positions[i]));
+            }
+            rows.push_back(std::move(row));
+            return true;
+        });
+    });
+
+    // the rows found before the query was cancelled are not the first ones
+    if (token_ != nullptr && token_->Cancelled())
+        return;
+    std::vector<Row> rows;
+    for (auto& branch_row : branch_rows)
+        std::move(branch_row.begin(), branch_row.end(), std::back_inserter(rows));
+    const auto& conditions = parser_->OrderConditions();
+    std::stable_sort(rows.begin(), rows.end(), [&](const Row& a, const Row& b) {
+        for (uint i = 0; i < conditions.size(); i++) {
+            int cmp = QueryExecutor::CompareTerms(a.keys[i], b.keys[i]);
+            if (cmp != 0)
+                return conditions[i].descending ? cmp > 0 : cmp < 0;
+        }
+        return false;
+    });
+
+    for (const auto& row : rows) {
+        if (!Deliver(sink, row.values, row.branch->positions))
+            break;
+    }
+}
+
+void UnionExecutor::Query(const Sink& sink) {
+    auto begin = std::chrono::high_resolution_clock::now();
+
+    for (auto& branch : branches_) {
+        if (distinct_)
+            branch.executor->Distinct(BoundLevels(branch));
+        std::vector<QueryExecutor::OrderKey> keys;
+        for (uint i = 0; i < branch.key_levels.size(); i++) {
+            // a variable the branch does not bind is unbound in all of its rows
+            if (branch.key_levels[i] != -1)
+                keys.push_back({uint(branch.key_levels[i]), branch.key_positions[i],
+                                parser_->OrderConditions()[i].descending});
+        }
+        if (!keys.empty())
+            branch.executor->OrderBy(keys);
+    }
+
+    if (!parser_->OrderConditions().empty()) {
+        Sort(sink);
+    } else {
+        ForEachBranch([&](Branch& branch) {
+            std::vector<uint> row(branch.levels.size());
+            branch.executor->Query([&](std::span<const uint> tuple) {
+                Project(branch, tuple, row);
+                std::lock_guard<std::mutex> lock(sink_mutex_);
+                return Deliver(sink, row, branch.positions);
+            });
+        });
+    }
+
+    query_duration_ = std::chrono::high_resolution_clock::now() - begin;
+}
+
+ulong UnionExecutor::Count() {
+    auto begin = std::chrono::high_resolution_clock::now();
+
+    // COUNT(?x) only counts the matches binding ?x, a branch without ?x has none
+    std::vector<Branch*> counted;
+    for (auto& branch : branches_) {
+        auto levels = BoundLevels(branch);
+        if (!parser_->CountAll()) {
+            if (levels.size() < branch.levels.size())
+                continue;
+            branch.executor->RequireBound(levels);
+        }
+        if (parser_->CountDistinct())
+            branch.executor->Distinct(levels);
+        counted.push_back(&branch);
+    }
+
+    std::atomic<ulong> count = 0;
+    if (parser_->CountDistinct() && counted.size() > 1) {
+        // the rows found by several branches are counted once
+        distinct_ = true;
+        limit_ = UINT_MAX;
+        Sink skip = [](std::span<const uint>, std::span<const Positon>) { return true; };
+        ForEachBranch([&](Branch& branch) {
+            if (std::find(counted.begin(), counted.end(), &branch) == counted.end())
+                return;
+            std::vector<uint> row(branch.levels.size());
+            branch.executor->Query([&](std::span<const uint> tuple) {
+                Project(branch, tuple, row);
+                std::lock_guard<std::mutex> lock(sink_mutex_);
+                return Deliver(skip, row, branch.positions);
+            });
+        });
+        count = delivered_cnt_;
+    } else {
+        ForEachBranch([&](Branch& branch) {
+            if (std::find(counted.begin(), counted.end(), &branch) != counted.end())
+                count += branch.executor->Count();
+        });
+    }
+
+    query_duration_ = std::chrono::high_resolution_clock::now() - begin;
+    return count;
+}
+
+double UnionExecutor::query_duration() {
+    return query_duration_.count();
+}
@@ -1,87 +1,233 @@
 #include <rdf-tdaa/rdf-tdaa.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <numeric>
+#include <thread>
 #include "rdf-tdaa/index/index_builder.hpp"
 #include "rdf-tdaa/index/index_retriever.hpp"
 #include "rdf-tdaa/parser/sparql_parser.hpp"
 #include "rdf-tdaa/query/plan_generator.hpp"
 #include "rdf-tdaa/query/query_executor.hpp"
+#include "rdf-tdaa/query/query_explainer.hpp"
+#include "rdf-tdaa/query/result_projector.hpp"
+#include "rdf-tdaa/query/union_executor.hpp"
 #include "rdf-tdaa/server/server.hpp"
+#include "rdf-tdaa/utils/packed_image.hpp"
+#include "rapidjson/writer.h"
+
+// prints the results to out while the executor finds them, in batches whose distinct ids are decoded once, the
+// time spent decoding and printing is added to projection_time
+uint StreamResult(QueryExecutor& executor,
+                  const std::shared_ptr<IndexRetriever> index,
+                  const std::shared_ptr<PlanGenerator> query_plan,
+                  const std::shared_ptr<SPARQLParser> parser,
+                  uint thread_num,
+                  std::chrono::duration<double, std::milli>& projection_time,
+                  std::ostream& out) {
+    // a COUNT query has a single row, the matches are counted without being enumerated
+    if (parser->project_modifier().modifier_type == SPARQLParser::ProjectModifier::Count) {
+        out << parser->CountVariable() << " " << std::endl;
+        ulong count = 0;
+        if (!query_plan->zero_result()) {
+            std::vector<uint> levels;
+            for (const auto& idx : query_plan->MappingVariable(parser->ProjectVariables()))
+                levels.push_back(idx.priority);
+            if (!parser->CountAll())
+                executor.RequireBound(levels);
+            if (parser->CountDistinct())
+                executor.Distinct(levels);
+            count = executor.Count();
+        }
+        out << count << " " << std::endl;
+        return 1;
+    }
 
-uint QueryResult(std::vector<std::vector<uint>>& result,
-                 const std::shared_ptr<IndexRetriever> index,
-                 const std::shared_ptr<PlanGenerator> query_plan,
-                 const std::shared_ptr<SPARQLParser> parser) {
-    const auto& modifier = parser->project_modifier();
-    // project_variables 是要输出的变量顺序
-    // 而 result 的变量顺序是计划生成中的变量排序
-    // 所以要获取每一个要输出的变量在 result 中的位置
     for (uint i = 0; i < parser->ProjectVariables().size(); i++)
-        std::cout << parser->ProjectVariables()[i] << " ";
-    std::cout << std::endl;
+        out << parser->ProjectVariables()[i] << " ";
+    out << std::endl;
 
     if (query_plan->zero_result())
         return 0;
 
     const auto variable_indexes = query_plan->MappingVariable(parser->ProjectVariables());
-
-    if (query_plan->distinct_predicate()) {
-        phmap::flat_hash_set<uint> distinct_predicate;
-        for (auto it = result.begin(); it != result.end(); ++it) {
-            const auto& item = *it;
-            for (const auto& idx : variable_indexes)
-                distinct_predicate.insert(item[idx.priority]);
+    if (parser->project_modifier().modifier_type == SPARQLParser::ProjectModifier::Distinct) {
+        std::vector<uint> levels;
+        for (const auto& idx : variable_indexes)
+            levels.push_back(idx.priority);
+        executor.Distinct(levels);
+    }
+    if (!parser->OrderConditions().empty()) {
+        std::vector<QueryExecutor::OrderKey> keys;
+        for (const auto& condition : parser->OrderConditions()) {
+            const auto variable = query_plan->MappingVariable({condition.variable})[0];
+            keys.push_back({uint(variable.priority), variable.position, condition.descending});
         }
-        for (auto it = distinct_predicate.begin(); it != distinct_predicate.end(); ++it)
-            std::cout << index->ID2String(*it, SPARQLParser::Term::Positon::kPredicate) << std::endl;
-        return distinct_predicate.size();
+        executor.OrderBy(keys);
+    }
+
+    std::vector<SPARQLParser::Term::Positon> positions;
+    for (const auto& idx : variable_indexes)
+        positions.push_back(idx.position);
+    uint cnt = 0;
+    ResultProjector projector(index, positions.size(), thread_num,
+                              [&](std::span<const uint>, std::span<const SPARQLParser::Term::Positon>,
+                                  std::span<const std::string* const> terms) {
+                                  for (const std::string* term : terms) {
+                                      // an unbound variable of an OPTIONAL pattern
+                                      if (term == nullptr)
+                                          out << "UNDEF ";
+                                      else
+                                          out << *term << " ";
+                                  }
+                                  out << "\n";
+                                  cnt++;
+                                  return true;
+                              });
+    std::vector<uint> row(variable_indexes.size());
+    executor.Query([&](std::span<const uint> tuple) {
+        auto projection_start = std::chrono::high_resolution_clock::now();
+        for (uint i = 0; i < variable_indexes.size(); i++)
+            row[i] = tuple[variable_indexes[i].priority];
+        projector.Add(row, positions);
+        projection_time += std::chrono::high_resolution_clock::now() - projection_start;
+        return true;
+    });
+    auto projection_start = std::chrono::high_resolution_clock::now();
+    projector.Flush();
+    projection_time += std::chrono::high_resolution_clock::now() - projection_start;
+    out << std::flush;
+    return cnt;
+}
+
+// prints the rows of the branches of a query with UNION, like StreamResult
+uint StreamUnionResult(UnionExecutor& executor,
+                       const std::shared_ptr<IndexRetriever> index,
+                       const std::shared_ptr<SPARQLParser> parser,
+                       uint thread_num,
+                       std::chrono::duration<double, std::milli>& projection_time,
+                       std::ostream& out) {
+    if (parser->project_modifier().modifier_type == SPARQLParser::ProjectModifier::Count) {
+        out << parser->CountVariable() << " " << std::endl;
+        out << executor.Count() << " " << std::endl;
+        return 1;
+    }
+
+    for (uint i = 0; i < parser->ProjectVariables().size(); i++)
+        out << parser->ProjectVariables()[i] << " ";
+    out << std::endl;
+
+    uint cnt = 0;
+    ResultProjector projector(index, parser->ProjectVariables().size(), thread_num,
+                              [&](std::span<const uint>, std::span<const SPARQLParser::Term::Positon>,
+                                  std::span<const std::string* const> terms) {
+                                  for (const std::string* term : terms) {
+                                      // a variable unbound by an OPTIONAL pattern or not in the branch
+                                      if (term == nullptr)
+                                          out << "UNDEF ";
+                                      else
+                                          out << *term << " ";
+                                  }
+                                  out << "\n";
+                                  cnt++;
+                                  return true;
+                              });
+    executor.Query([&](std::span<const uint> row, std::span<const SPARQLParser::Term::Positon> positions) {
+        auto projection_start = std::chrono::high_resolution_clock::now();
+        projector.Add(row, positions);
+        projection_time += std::chrono::high_resolution_clock::now() - projection_start;
+        return true;
+    });
+    auto projection_start = std::chrono::high_resolution_clock::now();
+    projector.Flush();
+    projection_time += std::chrono::high_resolution_clock::now() - projection_start;
+    out << std::flush;
+    return cnt;
+}
+
+// the milliseconds spent on the phases of a query run by RunQuery
+struct QueryTimes {
+    double plan;
+    double execute;
+    double projection;
+    double total;
+};
+
+// parses, plans and executes a query and prints its results to out, returns the number of results
+uint RunQuery(std::shared_ptr<IndexRetriever> index,
+              const std::string& sparql,
+              uint thread_num,
+              QueryTimes& times,
+              std::ostream& out) {
+    auto start = std::chrono::high_resolution_clock::now();
+    auto parser = std::make_shared<SPARQLParser>(sparql);
+
+    std::chrono::duration<double, std::milli> mapping_diff(0);
+    std::chrono::time_point<std::chrono::high_resolution_clock> plan_end;
+    uint cnt;
+    double execute_time;
+    if (parser->HasUnion()) {
+        // every alternative of the UNIONs is planned and executed as a query of its own
+        std::vector<std::shared_ptr<PlanGenerator>> plans;
+        for (auto& branch : parser->Branches())
+            plans.push_back(std::make_shared<PlanGenerator>(index, branch));
+        plan_end = std::chrono::high_resolution_clock::now();
+
+        UnionExecutor executor(index, parser, plans, thread_num);
+        cnt = StreamUnionResult(executor, index, parser, thread_num, mapping_diff, out);
+        execute_time = executor.query_duration();
     } else {
-        auto last = result.end();
+        auto query_plan = std::make_shared<PlanGenerator>(index, parser);
+        plan_end = std::chrono::high_resolution_clock::now();
 
-        uint cnt = 0;
-        if (modifier.modifier_type == SPARQLParser::ProjectModifier::Distinct) {
-            uint variable_cnt = query_plan->value2variable().size();
+        auto executor = std::make_shared<QueryExecutor>(index, query_plan, parser->Limit(), index->shared_cnt(),
+                                                        thread_num);
+        cnt = StreamResult(*executor, index, query_plan, parser, thread_num, mapping_diff, out);
+        execute_time = executor->query_duration();
+    }
 
-            if (variable_cnt != variable_indexes.size()) {
-                std::vector<uint> not_projection_variable_index;
-                for (uint i = 0; i < variable_cnt; i++)
-                    not_projection_variable_index.push_back(i);
+    auto finish = std::chrono::high_resolution_clock::now();
+    times.plan = std::chrono::duration<double, std::milli>(plan_end - start).count();
+    times.execute = execute_time;
+    times.projection = mapping_diff.count();
+    times.total = std::chrono::duration<double, std::milli>(finish - start).count();
+    return cnt;
+}
 
-                std::set<uint> indexes_to_remove;
-                for (const auto& idx : variable_indexes)
-                    indexes_to_remove.insert(idx.priority);
+// a stream buffer that drops what is written to it, the rows of a replayed query are projected but not printed
+class NullBuffer : public std::streambuf {
+   protected:
+    int overflow(int c) override {
+        return c;
+    }
 
-                not_projection_variable_index.erase(
-                    std::remove_if(not_projection_variable_index.begin(), not_projection_variable_index.end(),
-                                   [&indexes_to_remove](uint value) { return indexes_to_remove.count(value) > 0; }),
-                    not_projection_variable_index.end());
+    std::streamsize xsputn(const char*, std::streamsize n) override {
+        return n;
+    }
+};
 
-                for (uint result_id = 0; result_id < result.size(); result_id++) {
-                    for (const auto& idx : not_projection_variable_index)
-                        result[result_id][idx] = 0;
-                }
-                std::sort(result.begin(), result.end());
-            }
+// the latency of the p-th percentile of sorted latencies, by the nearest rank
+double Percentile(const std::vector<double>& sorted, double p) {
+    ulong rank = std::max(ulong(std::ceil(p / 100 * sorted.size())), 1ul);
+    return sorted[rank - 1];
+}
 
-            last = std::unique(result.begin(), result.end(),
-                               // 判断两个列表 a 和 b 是否相同，
-                               [&](const std::vector<uint>& a, const std::vector<uint>& b) {
-                                   // std::all_of 可以用来判断数组中的值是否都满足一个条件
-                                   return std::all_of(
-                                       variable_indexes.begin(), variable_indexes.end(),
-                                       // 判断依据是，列表中的每一个元素都相同
-                                       [&](PlanGenerator::Variable v) { return a[v.priority] == b[v.priority]; });
-                               });
-        }
-        for (auto it = result.begin(); it != last; ++it) {
-            const auto& item = *it;
-            for (const auto& idx : variable_indexes) {
-                std::cout << index->ID2String(item[idx.priority], idx.position) << " ";
-            }
-            std::cout << std::endl;
-            cnt++;
-        }
-        return cnt;
+void WriteLatencies(rapidjson::Writer<rapidjson::StringBuffer>& writer, std::vector<double> latencies) {
+    std::sort(latencies.begin(), latencies.end());
+    writer.StartObject();
+    if (!latencies.empty()) {
+        writer.Key("mean");
+        writer.Double(std::accumulate(latencies.begin(), latencies.end(), 0.0) / latencies.size());
+        writer.Key("p50");
+        writer.Double(Percentile(latencies, 50));
+        writer.Key("p95");
+        writer.Double(Percentile(latencies, 95));
+        writer.Key("p99");
+        writer.Double(Percentile(latencies, 99));
+        writer.Key("max");
+        writer.Double(latencies.back());
     }
-    return 0;
+    writer.EndObject();
 }
 
 namespace rdftdaa {
@@ -100,7 +246,58 @@ void RDFTDAA::Create(const std::string& db_name, const std::string& data_file) {
     std::cout << "create " << db_name << " takes " << diff.count() << " ms." << std::endl;
 }
 
-void RDFTDAA::Query(const std::string& db_path, const std::string& data_file) {
+void RDFTDAA::Merge(const std::string& db_name, const std::vector<std::string>& source_paths) {
+    auto beg = std::chrono::high_resolution_clock::now();
+
+    std::vector<std::shared_ptr<IndexRetriever>> sources;
+    for (const auto& source_path : source_paths) {
+        if (!std::filesystem::exists(source_path)) {
+            std::cerr << source_path << " does not exist, terminal the process." << std::endl;
+            exit(1);
+        }
+        sources.push_back(std::make_shared<IndexRetriever>(source_path));
+    }
+
+    IndexBuilder builder(db_name, sources);
+    if (!builder.Build()) {
+        std::cerr << "Merging index data failed, terminal the process." << std::endl;
+        exit(1);
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::milli> diff = end - beg;
+    std::cout << "merge " << source_paths.size() << " databases into " << db_name << " takes " << diff.count()
+              << " ms." << std::endl;
+}
+
+void RDFTDAA::Pack(const std::string& db_path, const std::string& image_path) {
+    auto beg = std::chrono::high_resolution_clock::now();
+
+    if (!PackedImage::Pack(db_path, image_path)) {
+        std::cerr << "Packing " << db_path << " failed, terminal the process." << std::endl;
+        exit(1);
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::milli> diff = end - beg;
+    std::cout << "pack " << db_path << " into " << image_path << " takes " << diff.count() << " ms."
+              << std::endl;
+}
+
+void RDFTDAA::Verify(const std::string& image_path) {
+    auto beg = std::chrono::high_resolution_clock::now();
+
+    if (!PackedImage::Verify(image_path)) {
+        std::cerr << image_path << " is corrupted." << std::endl;
+        exit(1);
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::milli> diff = end - beg;
+    std::cout << "verify " << image_path << " takes " << diff.count() << " ms." << std::endl;
+}
+
+void RDFTDAA::Query(const std::string& db_path, const std::string& data_file, uint thread_num) {
     if (db_path != "" and data_file != "") {
         std::shared_ptr<IndexRetriever> index = std::make_shared<IndexRetriever>(db_path);
         std::ifstream in(data_file, std::ifstream::in);
@@ -125,40 +322,184 @@ void RDFTDAA::Query(const std::string& db_path, const std::string& data_file) {
                 std::cout << sparql << std::endl;
             }
 
-            auto start = std::chrono::high_resolution_clock::now();
-            auto parser = std::make_shared<SPARQLParser>(sparql);
+            // EXPLAIN [ANALYZE] before a query prints its plan as JSON instead of its results
+            bool analyze = false;
+            if (QueryExplainer::Strip(sparql, analyze)) {
+                auto parser = std::make_shared<SPARQLParser>(sparql);
+                QueryExplainer explainer(index, parser, [&](std::shared_ptr<SPARQLParser>& branch) {
+                    return std::make_shared<PlanGenerator>(index, branch);
+                });
+                std::cout << explainer.Explain(analyze) << std::endl;
+                continue;
+            }
 
-            auto query_plan = std::make_shared<PlanGenerator>(index, parser);
-            auto plan_end = std::chrono::high_resolution_clock::now();
+            QueryTimes times;
+            uint cnt = RunQuery(index, sparql, thread_num, times, std::cout);
 
-            auto executor = std::make_shared<QueryExecutor>(index, query_plan, parser->Limit(), index->shared_cnt());
-            if (!query_plan->zero_result())
-                executor->Query();
+            std::cout << cnt << " result(s).\n";
+            std::cout << "generate plan takes " << times.plan << " ms.\n";
+            std::cout << "execute takes " << times.execute << " ms.\n";
+            std::cout << "projection takes " << times.projection << " ms.\n";
+            std::cout << "query cost " << times.total << " ms." << std::endl;
+            all_time += times.total;
+        }
+        // std::cout << "avg query time: " << all_time / sparqls.size() << std::endl;
+        exit(0);
+    }
+}
 
-            auto projection_start = std::chrono::high_resolution_clock::now();
-            uint cnt = QueryResult(executor->result(), index, query_plan, parser);
-            auto projection_finish = std::chrono::high_resolution_clock::now();
-            std::chrono::duration<double, std::milli> mapping_diff = projection_finish - projection_start;
+void RDFTDAA::Bench(const std::string& db_path,
+                    const std::string& data_file,
+                    uint thread_num,
+                    uint worker_num,
+                    uint warmup,
+                    uint repetitions,
+                    const std::string& output) {
+    std::vector<std::string> sparqls;
+    std::ifstream in(data_file, std::ifstream::in);
+    if (!in.is_open()) {
+        std::cerr << data_file << " does not exist, terminal the process." << std::endl;
+        exit(1);
+    }
+    std::string sparql;
+    while (std::getline(in, sparql)) {
+        if (!sparql.empty())
+            sparqls.push_back(sparql);
+    }
+    in.close();
 
-            auto finish = std::chrono::high_resolution_clock::now();
-            std::chrono::duration<double, std::milli> diff = finish - start;
+    // the progress of the index is dropped before the workers start, the report alone is printed
+    NullBuffer null_buffer;
+    std::streambuf* stdout_buffer = std::cout.rdbuf(&null_buffer);
+    std::shared_ptr<IndexRetriever> index = std::make_shared<IndexRetriever>(db_path);
+    std::cout.rdbuf(stdout_buffer);
 
-            std::chrono::duration<double, std::milli> plan_time = plan_end - start;
+    // the queries that do not parse are reported and not replayed
+    std::vector<std::string> errors(sparqls.size());
+    std::vector<uint> replayed;
+    for (uint i = 0; i < sparqls.size(); i++) {
+        try {
+            SPARQLParser parser(sparqls[i]);
+            replayed.push_back(i);
+        } catch (const SPARQLParser::ParserException& e) {
+            errors[i] = e.what();
+        }
+    }
 
-            std::cout << cnt << " result(s).\n";
-            std::cout << "generate plan takes " << plan_time.count() << " ms.\n";
-            std::cout << "execute takes " << executor->query_duration() << " ms.\n";
-            std::cout << "projection takes " << mapping_diff.count() << " ms.\n";
-            std::cout << "query cost " << diff.count() << " ms." << std::endl;
-            all_time += diff.count();
+    // the workers take the runs of the queries in turn, round after round
+    std::vector<std::vector<double>> latencies(sparqls.size(), std::vector<double>(repetitions));
+    std::vector<uint> result_cnts(sparqls.size());
+    auto replay = [&](uint rounds, bool measured) {
+        std::atomic<ulong> next(0);
+        ulong runs = ulong(rounds) * replayed.size();
+        std::vector<std::thread> workers;
+        for (uint w = 0; w < std::max(worker_num, 1u); w++) {
+            workers.emplace_back([&]() {
+                // the rows of the queries are dropped, each worker writes to a stream of its own
+                NullBuffer buffer;
+                std::ostream null_out(&buffer);
+                for (ulong run = next++; run < runs; run = next++) {
+                    uint query = replayed[run % replayed.size()];
+                    QueryTimes times;
+                    uint cnt = RunQuery(index, sparqls[query], thread_num, times, null_out);
+                    if (measured) {
+                        latencies[query][run / replayed.size()] = times.total;
+                        result_cnts[query] = cnt;
+                    }
+                }
+            });
         }
-        // std::cout << "avg query time: " << all_time / sparqls.size() << std::endl;
-        exit(0);
+        for (auto& worker : workers)
+            worker.join();
+    };
+
+    replay(warmup, false);
+    auto start = std::chrono::steady_clock::now();
+    replay(repetitions, true);
+    std::chrono::duration<double, std::milli> wall_time = std::chrono::steady_clock::now() - start;
+
+    rapidjson::StringBuffer result;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(result);
+    writer.StartObject();
+    writer.Key("database");
+    writer.String(db_path.c_str());
+    writer.Key("file");
+    writer.String(data_file.c_str());
+    writer.Key("workers");
+    writer.Uint(worker_num);
+    writer.Key("threads");
+    writer.Uint(thread_num);
+    writer.Key("warmup");
+    writer.Uint(warmup);
+    writer.Key("repetitions");
+    writer.Uint(repetitions);
+    ulong runs = ulong(repetitions) * replayed.size();
+    writer.Key("runs");
+    writer.Uint64(runs);
+    writer.Key("errors");
+    writer.Uint64(sparqls.size() - replayed.size());
+    writer.Key("wall_time_ms");
+    writer.Double(wall_time.count());
+    writer.Key("qps");
+    writer.Double(wall_time.count() > 0 ? runs / (wall_time.count() / 1000) : 0);
+
+    std::vector<double> all_latencies;
+    for (uint query : replayed)
+        all_latencies.insert(all_latencies.end(), latencies[query].begin(), latencies[query].end());
+    writer.Key("latency_ms");
+    WriteLatencies(writer, all_latencies);
+
+    writer.Key("queries");
+    writer.StartArray();
+    for (uint i = 0; i < sparqls.size(); i++) {
+        writer.StartObject();
+        writer.Key("query");
+        writer.Uint(i + 1);
+        writer.Key("sparql");
+        writer.String(sparqls[i].c_str());
+        if (!errors[i].empty()) {
+            writer.Key("error");
+            writer.String(errors[i].c_str());
+        } else {
+            writer.Key("results");
+            writer.Uint(result_cnts[i]);
+            writer.Key("latency_ms");
+            WriteLatencies(writer, latencies[i]);
+        }
+        writer.EndObject();
+    }
+    writer.EndArray();
+    writer.EndObject();
+
+    if (output.empty()) {
+        std::cout << result.GetString() << std::endl;
+    } else {
+        std::ofstream out(output, std::ofstream::out);
+        out << result.GetString() << std::endl;
     }
+    exit(0);
 }
 
-void RDFTDAA::Server(const std::string& ip, const std::string& port, const std::string& db) {
+void RDFTDAA::Server(const std::string& ip,
+                     const std::string& port,
+                     const std::string& db,
+                     uint thread_num,
+                     uint timeout,
+                     bool partial,
+                     AdmissionController::Limits light_lane,
+                     AdmissionController::Limits heavy_lane,
+                     ulong heavy_cost,
+                     ulong result_cache_bytes,
+                     uint result_cache_ttl) {
     Endpoint e;
+    e.thread_num = thread_num;
+    e.timeout = timeout;
+    e.partial_results = partial;
+    e.light_lane = light_lane;
+    e.heavy_lane = heavy_lane;
+    e.heavy_cost = heavy_cost;
+    e.result_cache_bytes = result_cache_bytes;
+    e.result_cache_ttl = result_cache_ttl;
 
     e.start_server(ip, port, db);
 }
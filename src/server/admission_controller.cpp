@@ -0,0 +1,61 @@
+#include "rdf-tdaa/server/admission_controller.hpp"
+#include <algorithm>
+
+AdmissionController::Slot::Slot(AdmissionController* controller, Lane lane) : controller_(controller), lane_(lane) {}
+
+AdmissionController::Slot::~Slot() {
+    controller_->Release(lane_);
+}
+
+AdmissionController::Lane AdmissionController::Slot::lane() const {
+    return lane_;
+}
+
+AdmissionController::AdmissionController(Limits light, Limits heavy, ulong heavy_cost) : heavy_cost_(heavy_cost) {
+    lanes_[kLight].limits = light;
+    lanes_[kHeavy].limits = heavy;
+    // a lane runs at least one query
+    for (auto& lane : lanes_)
+        lane.limits.queries = std::max(lane.limits.queries, 1u);
+}
+
+AdmissionController::Lane AdmissionController::Route(ulong cost) const {
+    return cost >= heavy_cost_ ? kHeavy : kLight;
+}
+
+std::shared_ptr<AdmissionController::Slot> AdmissionController::Admit(Lane lane, CancellationToken& token) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto& state = lanes_[lane];
+    if (state.running >= state.limits.queries) {
+        if (state.waiting >= state.limits.queue)
+            return nullptr;
+        state.waiting++;
+        // the deadline of the query runs while it waits
+        bool cancelled = false;
+        while (state.running >= state.limits.queries && !cancelled) {
+            state.released.wait_for(lock, kWaitInterval);
+            cancelled = token.Check();
+        }
+        state.waiting--;
+        if (cancelled) {
+            // a release this query was woken by goes to the next one
+            state.released.notify_one();
+            return nullptr;
+        }
+    }
+    state.running++;
+    return std::shared_ptr<Slot>(new Slot(this, lane));
+}
+
+void AdmissionController::Release(Lane lane) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    lanes_[lane].running--;
+    lanes_[lane].released.notify_one();
+}
+
+uint AdmissionController::threads() const {
+    uint threads = 0;
+    for (const auto& lane : lanes_)
+        threads += lane.limits.queries + lane.limits.queue;
+    return threads;
+}
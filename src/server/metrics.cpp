@@ -0,0 +1,93 @@
+#include "rdf-tdaa/server/metrics.hpp"
+#include <algorithm>
+#include <sstream>
+
+// a number as Prometheus reads it, a count without an exponent
+static std::string Number(double value) {
+    if (value == double(ulong(value)))
+        return std::to_string(ulong(value));
+    std::ostringstream out;
+    out.precision(9);
+    out << value;
+    return out.str();
+}
+
+Metrics::Histogram::Histogram() : sum_(0) {
+    for (auto& count : counts_)
+        count.store(0, std::memory_order_relaxed);
+}
+
+void Metrics::Histogram::Observe(std::chrono::nanoseconds duration) {
+    double seconds = std::chrono::duration<double>(duration).count();
+    uint bucket = std::lower_bound(std::begin(kBounds), std::end(kBounds), seconds) - std::begin(kBounds);
+    counts_[bucket].fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(duration.count(), std::memory_order_relaxed);
+}
+
+void Metrics::Histogram::Write(std::string& out, const std::string& name, const std::string& labels) const {
+    // the buckets of Prometheus are cumulative
+    ulong count = 0;
+    for (uint i = 0; i < kBuckets; i++) {
+        count += counts_[i].load(std::memory_order_relaxed);
+        std::string bound = i + 1 < kBuckets ? Number(kBounds[i]) : "+Inf";
+        out += name + "_bucket{" + labels + ",le=\"" + bound + "\"} " + std::to_string(count) + "\n";
+    }
+    double sum = sum_.load(std::memory_order_relaxed) / 1e9;
+    out += name + "_sum{" + labels + "} " + Number(sum) + "\n";
+    out += name + "_count{" + labels + "} " + std::to_string(count) + "\n";
+}
+
+Metrics::InFlight::InFlight(Metrics& metrics) : metrics_(metrics) {
+    metrics_.in_flight_.fetch_add(1, std::memory_order_relaxed);
+}
+
+Metrics::InFlight::~InFlight() {
+    metrics_.in_flight_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+Metrics::Metrics() : queries_(0), results_(0), errors_(0), timeouts_(0), in_flight_(0) {}
+
+void Metrics::Observe(Phase phase, std::chrono::nanoseconds duration) {
+    phases_[phase].Observe(duration);
+}
+
+void Metrics::AddQuery() {
+    queries_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Metrics::AddResults(ulong results) {
+    results_.fetch_add(results, std::memory_order_relaxed);
+}
+
+void Metrics::AddError() {
+    errors_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Metrics::AddTimeout() {
+    timeouts_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Metrics::WriteValue(std::string& out,
+                         const std::string& name,
+                         const std::string& type,
+                         const std::string& help,
+                         double value) {
+    out += "# HELP " + name + " " + help + "\n";
+    out += "# TYPE " + name + " " + type + "\n";
+    out += name + " " + Number(value) + "\n";
+}
+
+void Metrics::Write(std::string& out) const {
+    out += "# HELP rdftdaa_query_phase_seconds The time of the phases of the queries.\n";
+    out += "# TYPE rdftdaa_query_phase_seconds histogram\n";
+    for (uint phase = 0; phase < kPhases; phase++)
+        phases_[phase].Write(out, "rdftdaa_query_phase_seconds", "phase=\"" + std::string(kPhaseNames[phase]) + "\"");
+
+    WriteValue(out, "rdftdaa_queries_total", "counter", "The queries received.", queries_.load());
+    WriteValue(out, "rdftdaa_results_total", "counter", "The rows returned by the queries.", results_.load());
+    WriteValue(out, "rdftdaa_errors_total", "counter", "The queries answered with an error status.",
+               errors_.load());
+    WriteValue(out, "rdftdaa_timeouts_total", "counter", "The queries stopped at their deadline.",
+               timeouts_.load());
+    WriteValue(out, "rdftdaa_queries_in_flight", "gauge", "The queries being answered.", in_flight_.load());
+}
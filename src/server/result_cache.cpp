@@ -0,0 +1,136 @@
+#include "rdf-tdaa/server/result_cache.hpp"
+#include <cctype>
+
+ResultCache::ResultCache(ulong capacity, std::chrono::seconds ttl)
+    : capacity_(capacity), ttl_(ttl), bytes_(0), version_(0), hits_(0), misses_(0), evictions_(0), invalidations_(0) {}
+
+std::string ResultCache::Normalize(const std::string& query) {
+    std::string normalized;
+    normalized.reserve(query.size());
+    char quote = 0;
+    bool space = false;
+    for (size_t i = 0; i < query.size(); i++) {
+        char c = query[i];
+        if (quote) {
+            normalized += c;
+            if (c == '\\' && quote != '>' && i + 1 < query.size())
+                normalized += query[++i];
+            else if (c == quote)
+                quote = 0;
+            continue;
+        }
+        if (std::isspace(static_cast<unsigned char>(c))) {
+            space = true;
+            continue;
+        }
+        if (space && !normalized.empty())
+            normalized += ' ';
+        space = false;
+        normalized += c;
+        if (c == '"' || c == '\'')
+            quote = c;
+        else if (c == '<')
+            quote = '>';
+    }
+    return normalized;
+}
+
+bool ResultCache::enabled() const {
+    return capacity_ != 0;
+}
+
+ulong ResultCache::max_response() const {
+    // one response does not take the whole cache
+    return capacity_ / 4;
+}
+
+void ResultCache::Erase(hash_map<std::string, Entry>::iterator it) {
+    bytes_ -= it->first.size() + it->second.response->content_type.size() + it->second.response->body.size();
+    recency_.erase(it->second.recency);
+    entries_.erase(it);
+}
+
+void ResultCache::Update(ulong version) {
+    if (version <= version_)
+        return;
+    if (!entries_.empty())
+        invalidations_++;
+    entries_.clear();
+    recency_.clear();
+    bytes_ = 0;
+    version_ = version;
+}
+
+std::shared_ptr<const ResultCache::Response> ResultCache::Lookup(const std::string& key, ulong version) {
+    if (!enabled())
+        return nullptr;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    Update(version);
+    auto it = entries_.find(key);
+    if (it == entries_.end() || version != version_) {
+        misses_++;
+        return nullptr;
+    }
+    if (ttl_.count() && std::chrono::steady_clock::now() >= it->second.expiry) {
+        Erase(it);
+        misses_++;
+        return nullptr;
+    }
+    recency_.splice(recency_.begin(), recency_, it->second.recency);
+    hits_++;
+    return it->second.response;
+}
+
+void ResultCache::Insert(const std::string& key, ulong version, std::string content_type, std::string body) {
+    ulong size = key.size() + content_type.size() + body.size();
+    if (!enabled() || size > max_response())
+        return;
+
+    auto response = std::make_shared<Response>();
+    response->content_type = std::move(content_type);
+    response->body = std::move(body);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    Update(version);
+    // the database has changed since the query started
+    if (version != version_)
+        return;
+    auto it = entries_.find(key);
+    if (it != entries_.end())
+        Erase(it);
+    while (bytes_ + size > capacity_ && !recency_.empty()) {
+        Erase(entries_.find(recency_.back()));
+        evictions_++;
+    }
+
+    recency_.push_front(key);
+    entries_[key] = {response, std::chrono::steady_clock::now() + ttl_, recency_.begin()};
+    bytes_ += size;
+}
+
+ulong ResultCache::hits() const {
+    return hits_;
+}
+
+ulong ResultCache::misses() const {
+    return misses_;
+}
+
+ulong ResultCache::evictions() const {
+    return evictions_;
+}
+
+ulong ResultCache::invalidations() const {
+    return invalidations_;
+}
+
+ulong ResultCache::bytes() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return bytes_;
+}
+
+ulong ResultCache::size() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+}
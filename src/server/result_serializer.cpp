@@ -0,0 +1,331 @@
+#include "rdf-tdaa/server/result_serializer.hpp"
+#include <cstdlib>
+#include <cstring>
+
+// the value of a literal, with the escapes of N-Triples replaced by the characters
+static std::string Unescape(std::string_view lexical) {
+    std::string value;
+    value.reserve(lexical.size());
+    for (size_t i = 0; i < lexical.size(); i++) {
+        if (lexical[i] != '\\' || i + 1 == lexical.size()) {
+            value += lexical[i];
+            continue;
+        }
+        char c = lexical[++i];
+        switch (c) {
+            case 't':
+                value += '\t';
+                break;
+            case 'b':
+                value += '\b';
+                break;
+            case 'n':
+                value += '\n';
+                break;
+            case 'r':
+                value += '\r';
+                break;
+            case 'f':
+                value += '\f';
+                break;
+            case 'u':
+            case 'U': {
+                size_t digits = c == 'u' ? 4 : 8;
+                if (i + digits >= lexical.size()) {
+                    value += '\\';
+                    value += c;
+                    break;
+                }
+                uint code = std::strtoul(std::string(lexical.substr(i + 1, digits)).c_str(), nullptr, 16);
+                i += digits;
+                // UTF-8
+                if (code < 0x80) {
+                    value += char(code);
+                } else if (code < 0x800) {
+                    value += char(0xC0 | (code >> 6));
+                    value += char(0x80 | (code & 0x3F));
+                } else if (code < 0x10000) {
+                    value += char(0xE0 | (code >> 12));
+                    value += char(0x80 | ((code >> 6) & 0x3F));
+                    value += char(0x80 | (code & 0x3F));
+                } else {
+                    value += char(0xF0 | (code >> 18));
+                    value += char(0x80 | ((code >> 12) & 0x3F));
+                    value += char(0x80 | ((code >> 6) & 0x3F));
+                    value += char(0x80 | (code & 0x3F));
+                }
+                break;
+            }
+            default:
+                // \", \' and \\ are the character itself
+                value += c;
+                break;
+        }
+    }
+    return value;
+}
+
+// the lexical form of a literal "lexical"@lang or "lexical"^^<datatype> and the part after it
+static void SplitLiteral(std::string_view term, std::string_view& lexical, std::string_view& suffix) {
+    size_t end = term.rfind('"');
+    if (end == 0 || end == std::string_view::npos) {
+        lexical = term.substr(1);
+        suffix = "";
+        return;
+    }
+    lexical = term.substr(1, end - 1);
+    suffix = term.substr(end + 1);
+}
+
+ResultSerializer::Format ResultSerializer::Negotiate(const std::string& accept) {
+    static const std::pair<std::string_view, Format> media_types[] = {
+        {"application/sparql-results+json", kJSON},
+        {"application/json", kJSON},
+        {"text/tab-separated-values", kTSV},
+        {"text/csv", kCSV},
+        {"application/x-rdftdaa-binary", kBinary},
+    };
+
+    Format format = kJSON;
+    double best = 0;
+    size_t begin = 0;
+    while (begin < accept.size()) {
+        size_t end = accept.find(',', begin);
+        if (end == std::string::npos)
+            end = accept.size();
+        std::string_view range(accept.data() + begin, end - begin);
+        begin = end + 1;
+
+        double quality = 1;
+        size_t parameters = range.find(';');
+        if (parameters != std::string_view::npos) {
+            size_t q = range.find("q=", parameters);
+            if (q != std::string_view::npos)
+                quality = std::atof(std::string(range.substr(q + 2)).c_str());
+            range = range.substr(0, parameters);
+        }
+        while (!range.empty() && range.front() == ' ')
+            range.remove_prefix(1);
+        while (!range.empty() && range.back() == ' ')
+            range.remove_suffix(1);
+
+        for (const auto& [media_type, media_format] : media_types) {
+            if (range == media_type && quality > best) {
+                format = media_format;
+                best = quality;
+            }
+        }
+    }
+    return format;
+}
+
+const char* ResultSerializer::ContentType(Format format) {
+    switch (format) {
+        case kTSV:
+            return "text/tab-separated-values;charset=utf-8";
+        case kCSV:
+            return "text/csv;charset=utf-8";
+        case kBinary:
+            return "application/x-rdftdaa-binary";
+        default:
+            return "application/sparql-results+json;charset=utf-8";
+    }
+}
+
+ResultSerializer::ResultSerializer(Format format, const std::vector<std::string>& variables, Write write)
+    : format_(format), write_(write), writer_(buffer_) {
+    for (const auto& variable : variables)
+        variables_.push_back(variable[0] == '?' ? variable.substr(1) : variable);
+
+    switch (format_) {
+        case kJSON:
+            writer_.StartObject();
+            writer_.Key("head");
+            writer_.StartObject();
+            writer_.Key("vars");
+            writer_.StartArray();
+            for (const auto& variable : variables_)
+                writer_.String(variable.c_str(), variable.size());
+            writer_.EndArray();
+            writer_.EndObject();
+            writer_.Key("results");
+            writer_.StartObject();
+            writer_.Key("bindings");
+            writer_.StartArray();
+            break;
+        case kTSV:
+            for (uint i = 0; i < variables_.size(); i++) {
+                Append(i ? "\t?" : "?");
+                Append(variables_[i]);
+            }
+            Append("\n");
+            break;
+        case kCSV:
+            for (uint i = 0; i < variables_.size(); i++) {
+                if (i)
+                    Append(",");
+                Append(variables_[i]);
+            }
+            Append("\r\n");
+            break;
+        case kBinary:
+            Append("RTB1");
+            Varint(variables_.size());
+            for (const auto& variable : variables_)
+                BinaryTerm(variable);
+            break;
+    }
+}
+
+void ResultSerializer::Append(std::string_view data) {
+    memcpy(buffer_.Push(data.size()), data.data(), data.size());
+}
+
+void ResultSerializer::Varint(ulong value) {
+    while (value >= 0x80) {
+        buffer_.Put(char(value | 0x80));
+        value >>= 7;
+    }
+    buffer_.Put(char(value));
+}
+
+void ResultSerializer::BinaryTerm(std::string_view term) {
+    Varint(term.size());
+    Append(term);
+}
+
+void ResultSerializer::JSONTerm(std::string_view term) {
+    writer_.StartObject();
+    writer_.Key("type");
+    if (term.size() > 1 && term.front() == '<' && term.back() == '>') {
+        writer_.String("uri");
+        writer_.Key("value");
+        writer_.String(term.data() + 1, term.size() - 2);
+    } else if (term.starts_with("_:")) {
+        writer_.String("bnode");
+        writer_.Key("value");
+        writer_.String(term.data() + 2, term.size() - 2);
+    } else if (term.starts_with("\"")) {
+        std::string_view lexical, suffix;
+        SplitLiteral(term, lexical, suffix);
+        writer_.String("literal");
+        writer_.Key("value");
+        std::string value = Unescape(lexical);
+        writer_.String(value.c_str(), value.size());
+        if (suffix.starts_with("@")) {
+            writer_.Key("xml:lang");
+            writer_.String(suffix.data() + 1, suffix.size() - 1);
+        } else if (suffix.starts_with("^^<") && suffix.back() == '>') {
+            writer_.Key("datatype");
+            writer_.String(suffix.data() + 3, suffix.size() - 4);
+        }
+    } else {
+        writer_.String("literal");
+        writer_.Key("value");
+        writer_.String(term.data(), term.size());
+    }
+    writer_.EndObject();
+}
+
+void ResultSerializer::CSVTerm(std::string_view term) {
+    std::string value;
+    if (term.size() > 1 && term.front() == '<' && term.back() == '>') {
+        value = term.substr(1, term.size() - 2);
+    } else if (term.starts_with("\"")) {
+        std::string_view lexical, suffix;
+        SplitLiteral(term, lexical, suffix);
+        value = Unescape(lexical);
+    } else {
+        value = term;
+    }
+
+    if (value.find_first_of(",\"\r\n") == std::string::npos) {
+        Append(value);
+        return;
+    }
+    Append("\"");
+    for (char c : value) {
+        if (c == '"')
+            Append("\"");
+        buffer_.Put(c);
+    }
+    Append("\"");
+}
+
+bool ResultSerializer::Send() {
+    if (buffer_.GetSize() < kChunkSize)
+        return true;
+    bool written = write_(buffer_.GetString(), buffer_.GetSize());
+    buffer_.Clear();
+    return written;
+}
+
+bool ResultSerializer::Row(std::span<const uint> ids,
+                           std::span<const SPARQLParser::Term::Positon> positions,
+                           std::span<const std::string* const> terms) {
+    switch (format_) {
+        case kJSON:
+            writer_.StartObject();
+            for (uint i = 0; i < terms.size(); i++) {
+                // an unbound variable has no binding
+                if (terms[i] == nullptr)
+                    continue;
+                writer_.Key(variables_[i].c_str(), variables_[i].size());
+                JSONTerm(*terms[i]);
+            }
+            writer_.EndObject();
+            break;
+        case kTSV:
+            for (uint i = 0; i < terms.size(); i++) {
+                if (i)
+                    Append("\t");
+                // the terms are kept in their N-Triples form, which is the form of TSV
+                if (terms[i] != nullptr)
+                    Append(*terms[i]);
+            }
+            Append("\n");
+            break;
+        case kCSV:
+            for (uint i = 0; i < terms.size(); i++) {
+                if (i)
+                    Append(",");
+                if (terms[i] != nullptr)
+                    CSVTerm(*terms[i]);
+            }
+            Append("\r\n");
+            break;
+        case kBinary:
+            for (uint i = 0; i < terms.size(); i++) {
+                if (terms[i] == nullptr) {
+                    Varint(0);
+                } else if (ids.empty()) {
+                    Varint(1);
+                    BinaryTerm(*terms[i]);
+                } else {
+                    ulong key = ulong(ids[i]) << 1 | (positions[i] == SPARQLParser::Term::Positon::kPredicate);
+                    Varint(key + 2);
+                    if (sent_.insert(key).second)
+                        BinaryTerm(*terms[i]);
+                }
+            }
+            break;
+    }
+    return Send();
+}
+
+bool ResultSerializer::Count(ulong count) {
+    std::string term = "\"" + std::to_string(count) + "\"^^<http://www.w3.org/2001/XMLSchema#integer>";
+    const std::string* terms[] = {&term};
+    return Row({}, {}, terms);
+}
+
+bool ResultSerializer::Finish() {
+    if (format_ == kJSON) {
+        writer_.EndArray();
+        writer_.EndObject();
+        writer_.EndObject();
+    }
+    bool written = write_(buffer_.GetString(), buffer_.GetSize());
+    buffer_.Clear();
+    return written;
+}
@@ -1,174 +1,750 @@
 #include "rdf-tdaa/server/server.hpp"
+#include <limits>
+#include <sstream>
 #include "rapidjson/writer.h"
+#include "rdf-tdaa/index/index_builder.hpp"
 #include "rdf-tdaa/parser/sparql_parser.hpp"
 #include "rdf-tdaa/query/plan_generator.hpp"
 #include "rdf-tdaa/query/query_executor.hpp"
+#include "rdf-tdaa/query/query_explainer.hpp"
+#include "rdf-tdaa/query/result_projector.hpp"
+#include "rdf-tdaa/query/union_executor.hpp"
+#include "rdf-tdaa/server/result_serializer.hpp"
+
+Endpoint::~Endpoint() {
+    if (compaction_.joinable())
+        compaction_.join();
+}
+
+std::shared_ptr<IndexRetriever> Endpoint::index() {
+    std::lock_guard<std::mutex> lock(db_index_mutex_);
+    return db_index_;
+}
 
 void Endpoint::query(const httplib::Request& req, httplib::Response& res) {
     std::string sparql = req.get_param_value("query");
+    // a compaction may replace the index, the query keeps using the one it started with
+    std::shared_ptr<IndexRetriever> db_index = index();
 
     if (db_name != "" && db_index != 0) {
-        auto exec_start = std::chrono::high_resolution_clock::now();
+        auto options = query_options(req);
+        // EXPLAIN [ANALYZE] before a query asks for its plan instead of its results
+        bool analyze = false;
+        bool explain = QueryExplainer::Strip(sparql, analyze);
+        if (result_cache_->enabled() && !explain)
+            options.cache_key = std::to_string(options.format) + " " + ResultCache::Normalize(sparql);
+        if (!cached(res, options)) {
+            std::shared_ptr<SPARQLParser> parser;
+            auto parse_start = std::chrono::steady_clock::now();
+            try {
+                parser = std::make_shared<SPARQLParser>(sparql);
+            } catch (const SPARQLParser::ParserException& e) {
+                metrics_.AddError();
+                rapidjson::StringBuffer result;
+                rapidjson::Writer<rapidjson::StringBuffer> writer(result);
+                writer.StartObject();
+                writer.Key("code");
+                writer.Uint(0);
+                writer.Key("message");
+                writer.String(e.what());
+                writer.EndObject();
+                res.status = 400;
+                res.set_content(result.GetString(), "application/json;charset=utf-8");
+                return;
+            }
+            metrics_.Observe(Metrics::kParse, std::chrono::steady_clock::now() - parse_start);
+            if (explain)
+                explain_query(res, db_index, parser, analyze, options);
+            else
+                execute_query(res, db_index, parser, options);
+        }
+    }
+}
 
-        auto parser = std::make_shared<SPARQLParser>(sparql);
+Endpoint::QueryOptions Endpoint::query_options(const httplib::Request& req) {
+    metrics_.AddQuery();
+    QueryOptions options;
+    options.in_flight = std::make_shared<Metrics::InFlight>(metrics_);
+    options.format = ResultSerializer::Negotiate(req.get_header_value("Accept"));
+    // a response cached under the version read before the query runs is not older than the data
+    options.version = db_version;
+
+    ulong query_timeout = timeout;
+    if (req.has_param("timeout")) {
+        ulong asked = std::strtoul(req.get_param_value("timeout").c_str(), nullptr, 10);
+        if (asked != 0 && (timeout == 0 || asked < timeout))
+            query_timeout = asked;
+    }
+    options.token = std::make_shared<CancellationToken>();
+    options.token->SetTimeout(std::chrono::milliseconds(query_timeout));
+    // a query is also stopped while it has no result to send when its client goes away
+    if (req.is_connection_closed)
+        options.token->SetProbe(req.is_connection_closed);
+
+    options.partial = partial_results;
+    if (req.has_param("on_timeout"))
+        options.partial = req.get_param_value("on_timeout") == "partial";
+    return options;
+}
 
-        auto query_plan = std::make_shared<PlanGenerator>(db_index, parser);
-        auto executor =
-            std::make_shared<QueryExecutor>(db_index, query_plan, parser->Limit(), db_index->shared_cnt());
-        if (!query_plan->zero_result())
-            executor->Query();
+bool Endpoint::cached(httplib::Response& res, const QueryOptions& options) {
+    if (options.cache_key.empty())
+        return false;
+    auto response = result_cache_->Lookup(options.cache_key, options.version);
+    if (response == nullptr)
+        return false;
+    res.set_content(response->body, response->content_type);
+    return true;
+}
 
-        std::vector<std::vector<uint>>& results_id = executor->result();
+// a writer of the chunks of a response that also keeps them for the result cache, the copy is dropped when
+// the client has gone away or the response is too large to be cached
+static ResultSerializer::Write Keep(ResultSerializer::Write write, std::string& body, bool& kept, ulong limit) {
+    return [write, &body, &kept, limit](const char* data, size_t size) {
+        bool written = write(data, size);
+        if (kept && (!written || body.size() + size > limit)) {
+            kept = false;
+            std::string().swap(body);
+        }
+        if (kept)
+            body.append(data, size);
+        return written;
+    };
+}
 
-        std::cout << results_id.size() << " ";
+// records the phases of a streamed query: its rows are decoded and serialized while the executor finds them,
+// the executor has the rest of the time
+static void ObserveStream(Metrics& metrics,
+                          std::chrono::steady_clock::time_point start,
+                          std::chrono::nanoseconds decode_time,
+                          std::chrono::nanoseconds serialize_time) {
+    std::chrono::nanoseconds total = std::chrono::steady_clock::now() - start;
+    metrics.Observe(Metrics::kExecute, total - decode_time - serialize_time);
+    metrics.Observe(Metrics::kProjection, decode_time);
+    metrics.Observe(Metrics::kSerialize, serialize_time);
+}
 
-        rapidjson::StringBuffer result;
-        rapidjson::Writer<rapidjson::StringBuffer> writer(result);
+// whether the results of a cancelled query are sent, only those of a query that timed out with partial results
+static bool Complete(const std::shared_ptr<CancellationToken>& token, bool partial) {
+    auto reason = token->reason();
+    return reason == CancellationToken::kNone || (reason == CancellationToken::kTimeout && partial);
+}
 
-        std::vector<std::string> variables = parser->ProjectVariables();
+// the response of a query that did not complete and has not sent anything yet
+static void Cancelled(httplib::Response& res, const std::shared_ptr<CancellationToken>& token, Metrics& metrics) {
+    metrics.AddError();
+    rapidjson::StringBuffer result;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(result);
+    writer.StartObject();
+    writer.Key("code");
+    writer.Uint(0);
+    writer.Key("message");
+    writer.String(token->reason() == CancellationToken::kTimeout ? "Query timed out" : "Query cancelled");
+    writer.EndObject();
+    res.status = 503;
+    res.set_content(result.GetString(), "application/json;charset=utf-8");
+}
 
-        writer.StartObject();
+std::shared_ptr<AdmissionController::Slot> Endpoint::admit(httplib::Response& res,
+                                                           ulong cost,
+                                                           const std::shared_ptr<CancellationToken>& token) {
+    auto slot = admission_->Admit(admission_->Route(cost), *token);
+    if (slot != nullptr)
+        return slot;
+    if (token->reason() != CancellationToken::kNone) {
+        if (token->reason() == CancellationToken::kTimeout)
+            metrics_.AddTimeout();
+        Cancelled(res, token, metrics_);
+        return nullptr;
+    }
 
-        writer.Key("head");
-        writer.StartObject();
-        writer.Key("vars");
-        writer.StartArray();
-        for (uint i = 0; i < variables.size(); i++)
-            writer.String(variables[i].c_str());
-        writer.EndArray();
-        writer.EndObject();
+    metrics_.AddError();
+
+    rapidjson::StringBuffer result;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(result);
+    writer.StartObject();
+    writer.Key("code");
+    writer.Uint(0);
+    writer.Key("message");
+    writer.String("Server is busy");
+    writer.EndObject();
+    res.status = 503;
+    res.set_header("Retry-After", "1");
+    res.set_content(result.GetString(), "application/json;charset=utf-8");
+    return nullptr;
+}
 
-        writer.Key("results");
-        writer.StartObject();
-        writer.Key("bindings");
-        writer.StartArray();
+void Endpoint::execute_query(httplib::Response& res,
+                             std::shared_ptr<IndexRetriever>& db_index,
+                             std::shared_ptr<SPARQLParser>& parser,
+                             const QueryOptions& options) {
+    if (parser->HasUnion()) {
+        execute_union_query(res, db_index, parser, options);
+        return;
+    }
 
-        if (results_id.size()) {
-            const auto variable_indexes = query_plan->MappingVariable(variables);
-            auto last = results_id.end();
+    auto format = options.format;
+    auto token = options.token;
+    bool partial = options.partial;
+    auto plan_start = std::chrono::steady_clock::now();
+    auto query_plan = plan_cache_.Generate(db_index, parser);
+    metrics_.Observe(Metrics::kPlan, std::chrono::steady_clock::now() - plan_start);
+    auto slot = admit(res, query_plan->estimated_cost(), token);
+    if (slot == nullptr)
+        return;
+    // a light query is a short lookup, the threads of a query are left to the heavy ones
+    uint threads = slot->lane() == AdmissionController::kLight ? 1 : thread_num;
+    auto executor = std::make_shared<QueryExecutor>(db_index, query_plan, parser->Limit(),
+                                                    db_index->shared_cnt(), threads);
+    executor->CancelBy(token);
+
+    std::vector<std::string> variables = parser->ProjectVariables();
+
+    if (parser->project_modifier().modifier_type == SPARQLParser::ProjectModifier::Count) {
+        auto execute_start = std::chrono::steady_clock::now();
+        ulong count = 0;
+        if (!query_plan->zero_result()) {
+            std::vector<uint> levels;
+            for (const auto& idx : query_plan->MappingVariable(variables))
+                levels.push_back(idx.priority);
+            if (!parser->CountAll())
+                executor->RequireBound(levels);
+            if (parser->CountDistinct())
+                executor->Distinct(levels);
+            count = executor->Count();
+        }
+        metrics_.Observe(Metrics::kExecute, std::chrono::steady_clock::now() - execute_start);
+        if (token->reason() == CancellationToken::kTimeout)
+            metrics_.AddTimeout();
+        if (!Complete(token, partial)) {
+            Cancelled(res, token, metrics_);
+            return;
+        }
 
-            if (query_plan->distinct_predicate()) {
-                phmap::flat_hash_set<uint> distinct_predicate;
-                for (auto it = results_id.begin(); it != last; ++it) {
-                    const auto& item = *it;
+        auto serialize_start = std::chrono::steady_clock::now();
+        std::string result;
+        ResultSerializer serializer(format, {parser->CountVariable()}, [&](const char* data, size_t size) {
+            result.append(data, size);
+            return true;
+        });
+        serializer.Count(count);
+        serializer.Finish();
+        metrics_.Observe(Metrics::kSerialize, std::chrono::steady_clock::now() - serialize_start);
+        metrics_.AddResults(1);
+        if (!options.cache_key.empty() && token->reason() == CancellationToken::kNone)
+            result_cache_->Insert(options.cache_key, options.version, ResultSerializer::ContentType(format), result);
+        res.set_content(result, ResultSerializer::ContentType(format));
+        return;
+    }
+
+    // the results are sent while the executor finds them, the query keeps its slot until they are sent
+    res.set_chunked_content_provider(
+        ResultSerializer::ContentType(format),
+        [db_index, parser, query_plan, executor, variables, format, token, partial, threads, slot,
+         cache = result_cache_.get(), cache_key = options.cache_key, version = options.version,
+         metrics = &metrics_, in_flight = options.in_flight](size_t offset, httplib::DataSink& sink) {
+            auto start = std::chrono::steady_clock::now();
+            std::chrono::nanoseconds decode_time(0), serialize_time(0);
+            std::string body;
+            bool kept = !cache_key.empty();
+            ResultSerializer serializer(format, variables, Keep(sink.write, body, kept, cache->max_response()));
+
+            ulong cnt = 0;
+            if (!query_plan->zero_result()) {
+                const auto variable_indexes = query_plan->MappingVariable(variables);
+                if (parser->project_modifier().modifier_type == SPARQLParser::ProjectModifier::Distinct) {
+                    std::vector<uint> levels;
                     for (const auto& idx : variable_indexes)
-                        distinct_predicate.insert(item[idx.priority]);
+                        levels.push_back(idx.priority);
+                    executor->Distinct(levels);
                 }
-                for (auto it = distinct_predicate.begin(); it != distinct_predicate.end(); ++it) {
-                    writer.StartArray();
-                    writer.String(db_index->ID2String(*it, SPARQLParser::Term::Positon::kPredicate));
-                    writer.EndArray();
-                }
-            } else {
-                const auto& modifier = parser->project_modifier();
-                if (modifier.modifier_type == SPARQLParser::ProjectModifier::Distinct) {
-                    uint variable_cnt = query_plan->value2variable().size();
-
-                    if (variable_cnt != variable_indexes.size()) {
-                        std::vector<uint> not_projection_variable_index;
-                        for (uint i = 0; i < variable_cnt; i++)
-                            not_projection_variable_index.push_back(i);
-
-                        std::set<uint> indexes_to_remove;
-                        for (const auto& idx : variable_indexes)
-                            indexes_to_remove.insert(idx.priority);
-
-                        not_projection_variable_index.erase(
-                            std::remove_if(not_projection_variable_index.begin(),
-                                           not_projection_variable_index.end(),
-                                           [&indexes_to_remove](uint value) {
-                                               return indexes_to_remove.count(value) > 0;
-                                           }),
-                            not_projection_variable_index.end());
-
-                        for (uint result_id = 0; result_id < results_id.size(); result_id++) {
-                            for (const auto& idx : not_projection_variable_index)
-                                results_id[result_id][idx] = 0;
-                        }
-                        std::sort(results_id.begin(), results_id.end());
+                if (!parser->OrderConditions().empty()) {
+                    std::vector<QueryExecutor::OrderKey> keys;
+                    for (const auto& condition : parser->OrderConditions()) {
+                        const auto variable = query_plan->MappingVariable({condition.variable})[0];
+                        keys.push_back({uint(variable.priority), variable.position, condition.descending});
                     }
-
-                    last = std::unique(
-                        results_id.begin(), results_id.end(),
-                        [&](const std::vector<uint>& a, const std::vector<uint>& b) {
-                            return std::all_of(
-                                variable_indexes.begin(), variable_indexes.end(),
-                                [&](PlanGenerator::Variable v) { return a[v.priority] == b[v.priority]; });
-                        });
+                    executor->OrderBy(keys);
                 }
-                uint size = last - results_id.begin();
-
-                for (uint rid = 0; rid < size; ++rid) {
-                    const auto& item = results_id[rid];
-                    writer.StartArray();
-                    for (uint i = 0; i < variable_indexes.size(); i++) {
-                        auto& idx = variable_indexes[i];
-                        writer.String(db_index->ID2String(item[idx.priority], idx.position));
-                    }
-                    writer.EndArray();
+
+                std::vector<SPARQLParser::Term::Positon> positions;
+                for (const auto& idx : variable_indexes)
+                    positions.push_back(idx.position);
+                // a client that has gone away stops the query
+                ResultProjector projector(db_index, positions.size(), threads,
+                                          [&](std::span<const uint> ids,
+                                              std::span<const SPARQLParser::Term::Positon> positions,
+                                              std::span<const std::string* const> terms) {
+                                              cnt++;
+                                              return serializer.Row(ids, positions, terms);
+                                          });
+                std::vector<uint> row(variable_indexes.size());
+                executor->Query([&](std::span<const uint> tuple) {
+                    for (uint i = 0; i < variable_indexes.size(); i++)
+                        row[i] = tuple[variable_indexes[i].priority];
+                    return projector.Add(row, positions);
+                });
+                projector.Flush();
+                decode_time = projector.decode_time();
+                serialize_time = projector.emit_time();
+            }
+            metrics->AddResults(cnt);
+            if (token->reason() == CancellationToken::kTimeout)
+                metrics->AddTimeout();
+
+            // the response of a query that did not complete is cut off, the client sees it is not whole
+            if (!Complete(token, partial)) {
+                metrics->AddError();
+                ObserveStream(*metrics, start, decode_time, serialize_time);
+                return false;
+            }
+            auto finish_start = std::chrono::steady_clock::now();
+            serializer.Finish();
+            ObserveStream(*metrics, start, decode_time,
+                          serialize_time + (std::chrono::steady_clock::now() - finish_start));
+            // the results of a query that timed out are not kept
+            if (kept && token->reason() == CancellationToken::kNone)
+                cache->Insert(cache_key, version, ResultSerializer::ContentType(format), std::move(body));
+            sink.done();
+            return true;
+        });
+}
+
+void Endpoint::execute_union_query(httplib::Response& res,
+                                   std::shared_ptr<IndexRetriever>& db_index,
+                                   std::shared_ptr<SPARQLParser>& parser,
+                                   const QueryOptions& options) {
+    auto format = options.format;
+    auto token = options.token;
+    bool partial = options.partial;
+    std::vector<std::shared_ptr<PlanGenerator>> plans;
+    ulong cost = 0;
+    auto plan_start = std::chrono::steady_clock::now();
+    for (auto& branch : parser->Branches()) {
+        plans.push_back(plan_cache_.Generate(db_index, branch));
+        ulong branch_cost = plans.back()->estimated_cost();
+        cost = std::min(cost, std::numeric_limits<ulong>::max() - branch_cost) + branch_cost;
+    }
+    metrics_.Observe(Metrics::kPlan, std::chrono::steady_clock::now() - plan_start);
+    auto slot = admit(res, cost, token);
+    if (slot == nullptr)
+        return;
+    uint threads = slot->lane() == AdmissionController::kLight ? 1 : thread_num;
+    auto executor = std::make_shared<UnionExecutor>(db_index, parser, plans, threads);
+    executor->CancelBy(token);
+
+    std::vector<std::string> variables = parser->ProjectVariables();
+
+    if (parser->project_modifier().modifier_type == SPARQLParser::ProjectModifier::Count) {
+        auto execute_start = std::chrono::steady_clock::now();
+        ulong count = executor->Count();
+        metrics_.Observe(Metrics::kExecute, std::chrono::steady_clock::now() - execute_start);
+        if (token->reason() == CancellationToken::kTimeout)
+            metrics_.AddTimeout();
+        if (!Complete(token, partial)) {
+            Cancelled(res, token, metrics_);
+            return;
+        }
+
+        auto serialize_start = std::chrono::steady_clock::now();
+        std::string result;
+        ResultSerializer serializer(format, {parser->CountVariable()}, [&](const char* data, size_t size) {
+            result.append(data, size);
+            return true;
+        });
+        serializer.Count(count);
+        serializer.Finish();
+        metrics_.Observe(Metrics::kSerialize, std::chrono::steady_clock::now() - serialize_start);
+        metrics_.AddResults(1);
+        if (!options.cache_key.empty() && token->reason() == CancellationToken::kNone)
+            result_cache_->Insert(options.cache_key, options.version, ResultSerializer::ContentType(format), result);
+        res.set_content(result, ResultSerializer::ContentType(format));
+        return;
+    }
+
+    res.set_chunked_content_provider(
+        ResultSerializer::ContentType(format),
+        [db_index, executor, variables, format, token, partial, threads, slot, cache = result_cache_.get(),
+         cache_key = options.cache_key, version = options.version, metrics = &metrics_,
+         in_flight = options.in_flight](size_t offset, httplib::DataSink& sink) {
+            auto start = std::chrono::steady_clock::now();
+            std::string body;
+            bool kept = !cache_key.empty();
+            ResultSerializer serializer(format, variables, Keep(sink.write, body, kept, cache->max_response()));
+
+            ulong cnt = 0;
+            ResultProjector projector(db_index, variables.size(), threads,
+                                      [&](std::span<const uint> ids,
+                                          std::span<const SPARQLParser::Term::Positon> positions,
+                                          std::span<const std::string* const> terms) {
+                                          cnt++;
+                                          return serializer.Row(ids, positions, terms);
+                                      });
+            executor->Query([&](std::span<const uint> row, std::span<const SPARQLParser::Term::Positon> positions) {
+                return projector.Add(row, positions);
+            });
+            projector.Flush();
+            metrics->AddResults(cnt);
+            if (token->reason() == CancellationToken::kTimeout)
+                metrics->AddTimeout();
+
+            if (!Complete(token, partial)) {
+                metrics->AddError();
+                ObserveStream(*metrics, start, projector.decode_time(), projector.emit_time());
+                return false;
+            }
+            auto finish_start = std::chrono::steady_clock::now();
+            serializer.Finish();
+            ObserveStream(*metrics, start, projector.decode_time(),
+                          projector.emit_time() + (std::chrono::steady_clock::now() - finish_start));
+            // the results of a query that timed out are not kept
+            if (kept && token->reason() == CancellationToken::kNone)
+                cache->Insert(cache_key, version, ResultSerializer::ContentType(format), std::move(body));
+            sink.done();
+            return true;
+        });
+}
+
+void Endpoint::explain_query(httplib::Response& res,
+                             std::shared_ptr<IndexRetriever>& db_index,
+                             std::shared_ptr<SPARQLParser>& parser,
+                             bool analyze,
+                             const QueryOptions& options) {
+    auto plan_start = std::chrono::steady_clock::now();
+    QueryExplainer explainer(db_index, parser, [&](std::shared_ptr<SPARQLParser>& branch) {
+        return plan_cache_.Generate(db_index, branch);
+    });
+    metrics_.Observe(Metrics::kPlan, std::chrono::steady_clock::now() - plan_start);
+
+    // an analyzed query runs like any other, in the lane of its cost
+    std::shared_ptr<AdmissionController::Slot> slot;
+    if (analyze) {
+        slot = admit(res, explainer.estimated_cost(), options.token);
+        if (slot == nullptr)
+            return;
+        explainer.CancelBy(options.token);
+    }
+    auto execute_start = std::chrono::steady_clock::now();
+    std::string result = explainer.Explain(analyze);
+    if (analyze) {
+        metrics_.Observe(Metrics::kExecute, std::chrono::steady_clock::now() - execute_start);
+        if (options.token->reason() == CancellationToken::kTimeout)
+            metrics_.AddTimeout();
+    }
+    res.set_content(result, "application/json;charset=utf-8");
+}
+
+void Endpoint::prepare(const httplib::Request& req, httplib::Response& res) {
+    std::string sparql = req.has_param("query") ? req.get_param_value("query") : req.body;
+
+    rapidjson::StringBuffer result;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(result);
+    writer.StartObject();
+    writer.Key("code");
+    try {
+        auto parser = std::make_shared<SPARQLParser>(sparql);
+
+        std::string handle;
+        {
+            std::lock_guard<std::mutex> lock(statements_mutex_);
+            auto it = statement_handles_.find(sparql);
+            if (it != statement_handles_.end()) {
+                handle = it->second;
+                auto& statement = statements_[handle];
+                statement_recency_.splice(statement_recency_.begin(), statement_recency_, statement.recency);
+            } else {
+                // a client executing a closed statement gets a 404 and prepares it again
+                if (statements_.size() >= kStatementCapacity) {
+                    auto oldest = statements_.find(statement_recency_.back());
+                    statement_handles_.erase(oldest->second.query);
+                    statements_.erase(oldest);
+                    statement_recency_.pop_back();
                 }
+                handle = std::to_string(next_statement_++);
+                statement_recency_.push_front(handle);
+                statements_[handle] = {sparql, parser, statement_recency_.begin()};
+                statement_handles_[sparql] = handle;
             }
         }
 
+        writer.Uint(1);
+        writer.Key("statement");
+        writer.String(handle.c_str());
+        writer.Key("parameters");
+        writer.StartArray();
+        for (const auto& parameter : parser->Parameters())
+            writer.String(parameter.c_str());
         writer.EndArray();
+    } catch (const SPARQLParser::ParserException& e) {
+        writer.Uint(0);
+        writer.Key("message");
+        writer.String(e.what());
+        res.status = 400;
+    }
+    writer.EndObject();
+    res.set_content(result.GetString(), "application/json;charset=utf-8");
+}
+
+void Endpoint::execute(const httplib::Request& req, httplib::Response& res) {
+    std::shared_ptr<IndexRetriever> db_index = index();
+    if (db_name == "" || db_index == 0)
+        return;
+
+    std::shared_ptr<SPARQLParser> statement;
+    {
+        std::lock_guard<std::mutex> lock(statements_mutex_);
+        auto it = statements_.find(req.get_param_value("statement"));
+        if (it != statements_.end()) {
+            statement = it->second.parser;
+            statement_recency_.splice(statement_recency_.begin(), statement_recency_, it->second.recency);
+        }
+    }
+
+    QueryOptions options = query_options(req);
+    std::string message;
+    std::shared_ptr<SPARQLParser> parser;
+    if (statement == nullptr) {
+        message = "Unknown statement";
+        res.status = 404;
+    } else {
+        std::unordered_map<std::string, std::string> bindings;
+        for (const auto& [name, value] : req.params) {
+            if (!name.empty() && name[0] == '$')
+                bindings[name] = value;
+        }
+        // the values of the parameters of the statement in their order, prefixed by their lengths so that no
+        // value can pass for several; the parameters the statement does not use are left out
+        std::string binding_key;
+        for (const auto& parameter : statement->Parameters()) {
+            auto it = bindings.find(parameter);
+            binding_key += (it == bindings.end()) ? " -" : " " + std::to_string(it->second.size()) + ":" + it->second;
+        }
+        if (result_cache_->enabled())
+            options.cache_key = std::to_string(options.format) + " statement " + req.get_param_value("statement") +
+                                binding_key;
+        if (cached(res, options))
+            return;
+        auto parse_start = std::chrono::steady_clock::now();
+        try {
+            parser = statement->Bind(bindings);
+            metrics_.Observe(Metrics::kParse, std::chrono::steady_clock::now() - parse_start);
+        } catch (const SPARQLParser::ParserException& e) {
+            message = e.what();
+            res.status = 400;
+        }
+    }
+
+    if (parser == nullptr) {
+        metrics_.AddError();
+        rapidjson::StringBuffer result;
+        rapidjson::Writer<rapidjson::StringBuffer> writer(result);
+        writer.StartObject();
+        writer.Key("code");
+        writer.Uint(0);
+        writer.Key("message");
+        writer.String(message.c_str());
         writer.EndObject();
-        writer.EndObject();
+        res.set_content(result.GetString(), "application/json;charset=utf-8");
+        return;
+    }
+
+    execute_query(res, db_index, parser, options);
+}
+
+void Endpoint::plan_cache(const httplib::Request& req, httplib::Response& res) {
+    ulong hits = plan_cache_.hits();
+    ulong misses = plan_cache_.misses();
+
+    rapidjson::StringBuffer result;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(result);
+    writer.StartObject();
+    writer.Key("code");
+    writer.Uint(1);
+    writer.Key("hits");
+    writer.Uint64(hits);
+    writer.Key("misses");
+    writer.Uint64(misses);
+    writer.Key("hit_rate");
+    writer.Double(hits + misses ? double(hits) / (hits + misses) : 0);
+    writer.Key("plans");
+    writer.Uint64(plan_cache_.size());
+    writer.Key("invalidations");
+    writer.Uint64(plan_cache_.invalidations());
+    writer.EndObject();
+    res.set_content(result.GetString(), "application/json;charset=utf-8");
+}
+
+void Endpoint::result_cache(const httplib::Request& req, httplib::Response& res) {
+    ulong hits = result_cache_->hits();
+    ulong misses = result_cache_->misses();
+
+    rapidjson::StringBuffer result;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(result);
+    writer.StartObject();
+    writer.Key("code");
+    writer.Uint(1);
+    writer.Key("enabled");
+    writer.Bool(result_cache_->enabled());
+    writer.Key("hits");
+    writer.Uint64(hits);
+    writer.Key("misses");
+    writer.Uint64(misses);
+    writer.Key("hit_rate");
+    writer.Double(hits + misses ? double(hits) / (hits + misses) : 0);
+    writer.Key("responses");
+    writer.Uint64(result_cache_->size());
+    writer.Key("bytes");
+    writer.Uint64(result_cache_->bytes());
+    writer.Key("evictions");
+    writer.Uint64(result_cache_->evictions());
+    writer.Key("invalidations");
+    writer.Uint64(result_cache_->invalidations());
+    writer.EndObject();
+    res.set_content(result.GetString(), "application/json;charset=utf-8");
+}
+
+void Endpoint::metrics(const httplib::Request& req, httplib::Response& res) {
+    std::string result;
+    metrics_.Write(result);
+    Metrics::WriteValue(result, "rdftdaa_decoded_terms_bytes", "gauge",
+                        "The bytes of the terms decoded by the running queries.", ResultProjector::decoded_bytes());
+    Metrics::WriteValue(result, "rdftdaa_result_cache_bytes", "gauge", "The bytes of the cached responses.",
+                        result_cache_->bytes());
+    Metrics::WriteValue(result, "rdftdaa_result_cache_hits_total", "counter",
+                        "The queries answered by the result cache.", result_cache_->hits());
+    Metrics::WriteValue(result, "rdftdaa_plan_cache_hits_total", "counter", "The plans found in the plan cache.",
+                        plan_cache_.hits());
+    Metrics::WriteValue(result, "rdftdaa_plan_cache_misses_total", "counter",
+                        "The plans not found in the plan cache.", plan_cache_.misses());
+    Metrics::WriteValue(result, "rdftdaa_database_version", "gauge", "The changes of the data.", db_version);
+    res.set_content(result, "text/plain; version=0.0.4; charset=utf-8");
+}
+
+void Endpoint::update(const httplib::Request& req, httplib::Response& res, char op) {
+    std::string data = req.body.empty() ? req.get_param_value("data") : req.body;
+
+    uint changed_cnt = 0;
+    uint invalid_cnt = 0;
+    {
+        std::lock_guard<std::mutex> lock(update_mutex_);
+        std::shared_ptr<IndexRetriever> db_index = index();
+        std::istringstream in(data);
+        std::string line, s, p, o;
+        while (std::getline(in, line)) {
+            if (line.empty() || line[0] == '#')
+                continue;
+            if (!DeltaStore::ParseTriple(line, s, p, o)) {
+                invalid_cnt++;
+                continue;
+            }
+            if (op == '+' ? db_index->Insert(s, p, o) : db_index->Delete(s, p, o))
+                changed_cnt++;
+        }
+        if (changed_cnt)
+            db_version++;
+    }
+
+    rapidjson::StringBuffer result;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(result);
+    writer.StartObject();
+    writer.Key("code");
+    writer.Uint(invalid_cnt ? 0 : 1);
+    writer.Key("message");
+    writer.String(invalid_cnt ? "Some lines are not N-Triples" : "Success");
+    writer.Key(op == '+' ? "inserted" : "deleted");
+    writer.Uint(changed_cnt);
+    writer.Key("invalid");
+    writer.Uint(invalid_cnt);
+    writer.Key("version");
+    writer.Uint64(db_version);
+    writer.EndObject();
+
+    res.status = invalid_cnt ? 400 : 200;
+    res.set_content(result.GetString(), "application/json;charset=utf-8");
+}
+
+void Endpoint::compact(const httplib::Request& req, httplib::Response& res) {
+    rapidjson::StringBuffer result;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(result);
+    writer.StartObject();
+    writer.Key("code");
 
-        // std::string result;
-        // result += "{\"head\": {\"vars\": [";
-        // for (uint i = 0; i < variables.size(); i++) {
-        //     result += '\"' + variables[i];
-        //     if (i != variables.size() - 1)
-        //         result += "\",";
-        //     else
-        //         result += '\"';
-        // }
-        // result += "]}, \"results\": {\"bindings\": [";
-
-        // if (results_id.size()) {
-        //     auto last = results_id.end();
-        //     const auto& modifier = parser->project_modifier();
-        //     if (modifier.modifier_type_ == SPARQLParser::ProjectModifier::Distinct) {
-        //         last = std::unique(results_id.begin(), results_id.end(),
-        //                            [&](const std::vector<uint>& a, const std::vector<uint>& b) {
-        //                                return std::all_of(
-        //                                    variable_indexes.begin(), variable_indexes.end(),
-        //                                    [&](std::pair<uint, Pos> i) { return a[i.first] ==
-        //                                    b[i.first];
-        //                                    });
-        //                            });
-        //     }
-        //     uint size = last - results_id.begin();
-
-        //     auto& idx = variable_indexes[0];
-        //     uint est_size =
-        //         results_id.size() * db_index->ID2String(results_id[0][idx.first], idx.second).size();
-
-        //     result.reserve(est_size);
-        //     for (uint rid = 0; rid < size; ++rid) {
-        //         const auto& item = results_id[rid];
-        //         result += '[';
-        //         for (uint i = 0; i < variable_indexes.size(); i++) {
-        //             auto& idx = variable_indexes[i];
-        //             result += db_index->ID2String(item[idx.first], idx.second);
-        //             if (i != variable_indexes.size() - 1)
-        //                 result += ',';
-        //         }
-        //         if (rid != size - 1)
-        //             result += "],";
-        //         else
-        //             result += ']';
-        //     }
-        // }
-        // result += "]}}";
-        // res.set_content(result, "application/sparql-results+json;charset=utf-8");
-
-        res.set_content(result.GetString(), "application/sparql-results+json;charset=utf-8");
-
-        auto exec_finish = std::chrono::high_resolution_clock::now();
-        std::chrono::duration<double, std::milli> diff = exec_finish - exec_start;
-        std::cout << diff.count() << std::endl;
+    bool expected = false;
+    if (std::filesystem::is_regular_file(db_name)) {
+        writer.Uint(0);
+        writer.Key("message");
+        writer.String("A packed database image can not be compacted");
+        res.status = 400;
+    } else if (!compacting_.compare_exchange_strong(expected, true)) {
+        writer.Uint(0);
+        writer.Key("message");
+        writer.String("Compaction is running");
+        res.status = 409;
+    } else {
+        if (compaction_.joinable())
+            compaction_.join();
+        compaction_ = std::thread([this]() {
+            compact_database();
+            compacting_ = false;
+        });
+        writer.Uint(1);
+        writer.Key("message");
+        writer.String("Compaction started");
     }
+    writer.EndObject();
+    res.set_content(result.GetString(), "application/json;charset=utf-8");
+}
+
+bool Endpoint::compact_database() {
+    auto beg = std::chrono::high_resolution_clock::now();
+
+    std::string db_path = db_name;
+    while (db_path.size() > 1 && db_path.back() == '/')
+        db_path.pop_back();
+    std::string compact_path = db_path + ".compact";
+
+    // the index is rebuilt from the old index merged with its delta; the updates arriving during
+    // the rebuild are appended to the delta log of the old index, they are read back from the offset
+    // the rebuild scanned at and replayed on the new index before it replaces the old one
+    std::shared_ptr<IndexRetriever> old_index = index();
+
+    std::filesystem::remove_all(compact_path);
+    std::filesystem::remove(compact_path + ".delta");
+    IndexBuilder builder(compact_path, std::vector<std::shared_ptr<IndexRetriever>>{old_index});
+    if (!builder.Build()) {
+        std::cerr << "compaction of " << db_path << " failed." << std::endl;
+        std::filesystem::remove_all(compact_path);
+        return false;
+    }
+
+    std::shared_ptr<IndexRetriever> new_index = std::make_shared<IndexRetriever>(compact_path);
+    {
+        std::lock_guard<std::mutex> lock(update_mutex_);
+        for (const auto& update : old_index->DeltaUpdatesSince(builder.delta_offsets()[0]))
+            new_index->Apply(update);
+
+        // files mapped by the old index stay valid after they are removed
+        std::filesystem::rename(db_path, db_path + ".old");
+        std::filesystem::rename(compact_path, db_path);
+        if (std::filesystem::exists(compact_path + ".delta"))
+            std::filesystem::rename(compact_path + ".delta", db_path + ".delta");
+        else
+            std::filesystem::remove(db_path + ".delta");
+        // the next updates go to the log that is replayed when the database is opened again
+        new_index->Relocate(db_path);
+
+        std::lock_guard<std::mutex> index_lock(db_index_mutex_);
+        // the variable orders were ranked with the cardinalities of the old index
+        plan_cache_.Clear();
+        db_index_ = new_index;
+        db_version++;
+    }
+    std::filesystem::remove_all(db_path + ".old");
+
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::milli> diff = end - beg;
+    std::cout << "compact " << db_path << " takes " << diff.count() << " ms." << std::endl;
+    return true;
 }
 
 bool Endpoint::start_server(const std::string& ip, const std::string& port, const std::string& db) {
@@ -176,6 +752,12 @@ bool Endpoint::start_server(const std::string& ip, const std::string& port, cons
 
     httplib::Server svr;
 
+    // a request of each query a lane admits has a thread, a few more serve the other requests
+    admission_ = std::make_unique<AdmissionController>(light_lane, heavy_lane, heavy_cost);
+    uint server_threads = admission_->threads() + kServiceThreads;
+    svr.new_task_queue = [server_threads] { return new httplib::ThreadPool(server_threads); };
+    result_cache_ = std::make_unique<ResultCache>(result_cache_bytes, std::chrono::seconds(result_cache_ttl));
+
     svr.set_default_headers({{"Access-Control-Allow-Origin", "*"},
                              {"Access-Control-Allow-Methods", "POST, GET, PUT, OPTIONS, DELETE"},
                              {"Access-Control-Max-Age", "3600"},
@@ -186,7 +768,7 @@ bool Endpoint::start_server(const std::string& ip, const std::string& port, cons
 
     std::string base_url = "/rdftdaa";
 
-    db_index = std::make_shared<IndexRetriever>(db);
+    db_index_ = std::make_shared<IndexRetriever>(db);
     db_name = db;
 
     svr.Get(base_url + "/sparql", [this](const httplib::Request& req, httplib::Response& res) {
@@ -198,6 +780,38 @@ bool Endpoint::start_server(const std::string& ip, const std::string& port, cons
     svr.Options(base_url + "/sparql",
                 [](const httplib::Request& req, httplib::Response& res) { res.status = 200; });
 
+    // prepared statements
+    svr.Post(base_url + "/prepare", [this](const httplib::Request& req, httplib::Response& res) {
+        this->prepare(req, res);
+    });
+    svr.Get(base_url + "/execute", [this](const httplib::Request& req, httplib::Response& res) {
+        this->execute(req, res);
+    });
+    svr.Post(base_url + "/execute", [this](const httplib::Request& req, httplib::Response& res) {
+        this->execute(req, res);
+    });
+
+    svr.Get(base_url + "/plan_cache", [this](const httplib::Request& req, httplib::Response& res) {
+        this->plan_cache(req, res);
+    });
+    svr.Get(base_url + "/result_cache", [this](const httplib::Request& req, httplib::Response& res) {
+        this->result_cache(req, res);
+    });
+    svr.Get(base_url + "/metrics", [this](const httplib::Request& req, httplib::Response& res) {
+        this->metrics(req, res);
+    });
+
+    // updates, the body holds N-Triples
+    svr.Post(base_url + "/insert", [this](const httplib::Request& req, httplib::Response& res) {
+        this->update(req, res, '+');
+    });
+    svr.Post(base_url + "/delete", [this](const httplib::Request& req, httplib::Response& res) {
+        this->update(req, res, '-');
+    });
+    svr.Post(base_url + "/compact", [this](const httplib::Request& req, httplib::Response& res) {
+        this->compact(req, res);
+    });
+
     // disconnect
     svr.Get(base_url + "/disconnect", [&](const httplib::Request& req, httplib::Response& res) {
         std::cout << "disconnection from http://" << req.remote_addr << ":" << req.remote_port << std::endl;
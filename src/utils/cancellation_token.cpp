@@ -0,0 +1,48 @@
+#include "rdf-tdaa/utils/cancellation_token.hpp"
+
+CancellationToken::CancellationToken()
+    : cancelled_(false), reason_(kNone), deadline_(std::chrono::steady_clock::time_point::max()) {}
+
+void CancellationToken::SetTimeout(std::chrono::milliseconds timeout) {
+    if (timeout.count() > 0)
+        deadline_ = std::chrono::steady_clock::now() + timeout;
+    else
+        deadline_ = std::chrono::steady_clock::time_point::max();
+}
+
+void CancellationToken::SetProbe(std::function<bool()> probe) {
+    probe_ = probe;
+    last_probe_ = std::chrono::steady_clock::now();
+}
+
+void CancellationToken::Stop(Reason reason) {
+    Reason none = kNone;
+    // the first reason is kept
+    reason_.compare_exchange_strong(none, reason);
+    cancelled_ = true;
+}
+
+void CancellationToken::Cancel() {
+    Stop(kCancelled);
+}
+
+bool CancellationToken::Check() {
+    auto now = std::chrono::steady_clock::now();
+    if (now >= deadline_) {
+        Stop(kTimeout);
+        return true;
+    }
+    if (probe_) {
+        std::unique_lock<std::mutex> lock(probe_mutex_, std::try_to_lock);
+        if (lock.owns_lock() && now - last_probe_ >= kProbeInterval) {
+            last_probe_ = now;
+            if (probe_())
+                Stop(kDisconnected);
+        }
+    }
+    return cancelled_;
+}
+
+CancellationToken::Reason CancellationToken::reason() const {
+    return reason_;
+}
@@ -0,0 +1,245 @@
+#include "rdf-tdaa/utils/packed_image.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace fs = std::filesystem;
+
+std::mutex PackedImage::mounted_mutex_;
+std::vector<std::shared_ptr<PackedImage>> PackedImage::mounted_;
+
+namespace {
+
+std::string NormalizePath(const std::string& path) {
+    std::string normalized = fs::path(path).lexically_normal().generic_string();
+    while (normalized.size() > 1 && normalized.back() == '/')
+        normalized.pop_back();
+    return normalized;
+}
+
+ulong AlignUp(ulong offset, ulong alignment) {
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+}  // namespace
+
+PackedImage::PackedImage(std::string root, char* map, ulong size)
+    : root_(root),
+      map_(map),
+      size_(size),
+      header_(reinterpret_cast<Header*>(map)),
+      sections_(reinterpret_cast<Section*>(map + sizeof(Header))) {}
+
+PackedImage::~PackedImage() {
+    if (munmap(map_, size_) == -1)
+        perror("Error unmapping image");
+}
+
+ulong PackedImage::Checksum(const char* data, ulong size, ulong seed) {
+    // FNV-1a
+    ulong hash = seed;
+    for (ulong i = 0; i < size; i++) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 1099511628211ul;
+    }
+    return hash;
+}
+
+bool PackedImage::Pack(const std::string& db_path, const std::string& image_path) {
+    if (!fs::is_directory(db_path)) {
+        std::cerr << db_path << " is not a database directory." << std::endl;
+        return false;
+    }
+
+    std::vector<std::string> names;
+    for (const auto& entry : fs::recursive_directory_iterator(db_path)) {
+        if (!entry.is_regular_file())
+            continue;
+        std::string name = fs::relative(entry.path(), db_path).generic_string();
+        if (name.size() >= sizeof(Section::name)) {
+            std::cerr << "file name too long for image: " << name << std::endl;
+            return false;
+        }
+        names.push_back(name);
+    }
+    std::sort(names.begin(), names.end());
+
+    Header header;
+    memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.section_cnt = names.size();
+    header.alignment = kAlignment;
+
+    std::vector<Section> sections(names.size());
+    ulong offset = AlignUp(sizeof(Header) + sizeof(Section) * names.size(), kAlignment);
+    for (uint i = 0; i < names.size(); i++) {
+        memset(sections[i].name, 0, sizeof(Section::name));
+        memcpy(sections[i].name, names[i].c_str(), names[i].size());
+        sections[i].offset = offset;
+        sections[i].size = fs::file_size(fs::path(db_path) / names[i]);
+        sections[i].checksum = 0;
+        offset = AlignUp(offset + sections[i].size, kAlignment);
+    }
+    header.file_size = offset;
+
+    std::ofstream out(image_path, std::ios::binary | std::ios::trunc);
+    if (out.fail()) {
+        perror("Error opening image");
+        return false;
+    }
+
+    // the checksums are computed while copying, the table is rewritten once all files are in place
+    std::vector<char> buffer(1 << 20);
+    for (uint i = 0; i < names.size(); i++) {
+        std::ifstream in(fs::path(db_path) / names[i], std::ios::binary);
+        out.seekp(sections[i].offset);
+        ulong checksum = 14695981039346656037ul;
+        ulong remaining = sections[i].size;
+        while (remaining > 0 && in.read(buffer.data(), std::min(remaining, buffer.size()))) {
+            checksum = Checksum(buffer.data(), in.gcount(), checksum);
+            out.write(buffer.data(), in.gcount());
+            remaining -= in.gcount();
+        }
+        if (remaining != 0) {
+            std::cerr << "failed to read " << names[i] << std::endl;
+            return false;
+        }
+        sections[i].checksum = checksum;
+    }
+
+    header.table_checksum =
+        Checksum(reinterpret_cast<const char*>(sections.data()), sizeof(Section) * sections.size());
+    out.seekp(0);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+    out.write(reinterpret_cast<const char*>(sections.data()), sizeof(Section) * sections.size());
+    out.close();
+    if (out.fail()) {
+        perror("Error writing image");
+        return false;
+    }
+    // make the padding after the last section part of the file
+    fs::resize_file(image_path, header.file_size);
+
+    return Verify(image_path);
+}
+
+bool PackedImage::Verify(const std::string& image_path) {
+    if (!Mount(image_path))
+        return false;
+    std::lock_guard<std::mutex> lock(mounted_mutex_);
+    std::string root = NormalizePath(image_path);
+    for (auto& mounted : mounted_) {
+        if (mounted->root_ == root)
+            return mounted->Verify();
+    }
+    return false;
+}
+
+bool PackedImage::Mount(const std::string& image_path) {
+    std::string root = NormalizePath(image_path);
+
+    std::lock_guard<std::mutex> lock(mounted_mutex_);
+    for (auto& mounted : mounted_) {
+        if (mounted->root_ == root)
+            return true;
+    }
+
+    int fd = open(image_path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        perror("Error opening image");
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1 || static_cast<ulong>(st.st_size) < sizeof(Header)) {
+        std::cerr << image_path << " is not a database image." << std::endl;
+        close(fd);
+        return false;
+    }
+    ulong size = st.st_size;
+    char* map = static_cast<char*>(mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0));
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("Error mapping image");
+        return false;
+    }
+
+    // the image owns the mapping from here on
+    std::shared_ptr<PackedImage> image(new PackedImage(root, map, size));
+    Header* header = image->header_;
+    if (memcmp(header->magic, kMagic, sizeof(kMagic)) != 0) {
+        std::cerr << image_path << " is not a database image." << std::endl;
+        return false;
+    }
+    if (header->version != kVersion) {
+        std::cerr << image_path << " has unsupported image version " << header->version << "."
+                  << std::endl;
+        return false;
+    }
+    ulong table_size = sizeof(Section) * header->section_cnt;
+    if (header->file_size != size || sizeof(Header) + table_size > size ||
+        header->table_checksum != Checksum(reinterpret_cast<const char*>(image->sections_), table_size)) {
+        std::cerr << image_path << " is truncated or corrupted." << std::endl;
+        return false;
+    }
+    for (uint i = 0; i < header->section_cnt; i++) {
+        Section& section = image->sections_[i];
+        if (section.offset % header->alignment != 0 || section.offset + section.size > size) {
+            std::cerr << image_path << " has an invalid section " << section.name << "." << std::endl;
+            return false;
+        }
+    }
+
+    mounted_.push_back(image);
+    return true;
+}
+
+PackedImage::Section* PackedImage::FindSection(const std::string& name) const {
+    // sections are sorted by name when packing
+    Section* begin = sections_;
+    Section* end = sections_ + header_->section_cnt;
+    Section* it = std::lower_bound(begin, end, name,
+                                   [](const Section& s, const std::string& n) { return s.name < n; });
+    if (it != end && name == it->name)
+        return it;
+    return nullptr;
+}
+
+bool PackedImage::Resolve(const std::string& path, char*& data, ulong& size) {
+    std::lock_guard<std::mutex> lock(mounted_mutex_);
+    if (mounted_.empty())
+        return false;
+
+    std::string normalized = NormalizePath(path);
+    for (auto& mounted : mounted_) {
+        const std::string& root = mounted->root_;
+        if (normalized.size() <= root.size() + 1 || normalized.compare(0, root.size(), root) != 0 ||
+            normalized[root.size()] != '/')
+            continue;
+
+        Section* section = mounted->FindSection(normalized.substr(root.size() + 1));
+        if (section == nullptr)
+            return false;
+        data = mounted->map_ + section->offset;
+        size = section->size;
+        return true;
+    }
+    return false;
+}
+
+bool PackedImage::Verify() const {
+    bool intact = true;
+    for (uint i = 0; i < header_->section_cnt; i++) {
+        const Section& section = sections_[i];
+        if (Checksum(map_ + section.offset, section.size) != section.checksum) {
+            std::cerr << "checksum mismatch in section " << section.name << std::endl;
+            intact = false;
+        }
+    }
+    return intact;
+}
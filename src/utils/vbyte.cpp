@@ -1,7 +1,9 @@
 #include "rdf-tdaa/utils/vbyte.hpp"
 #include <climits>
+#include <cstring>
 #include <fstream>
 #include <iostream>
+#include "rdf-tdaa/utils/mmap.hpp"
 #include "streamvbyte.h"
 
 std::pair<uint8_t*, uint> Compress(uint* data, uint size) {
@@ -41,12 +43,14 @@ std::pair<uint*, uint> LoadAndDecompress(std::string filename) {
     uint compressed_length;
     uint8_t* compressed_buffer;
 
-    std::ifstream infile(filename, std::ios::binary);
-    infile.read(reinterpret_cast<char*>(&total_length), sizeof(total_length));
-    infile.read(reinterpret_cast<char*>(&compressed_length), sizeof(compressed_length));
+    // read through MMap so that files inside a mounted PackedImage are resolved as well
+    MMap<char> infile = MMap<char>(filename);
+    memcpy(&total_length, infile.map_, sizeof(total_length));
+    memcpy(&compressed_length, infile.map_ + sizeof(total_length), sizeof(compressed_length));
     compressed_buffer = new uint8_t[compressed_length];
-    infile.read(reinterpret_cast<char*>(compressed_buffer), compressed_length);
-    infile.close();
+    memcpy(compressed_buffer, infile.map_ + sizeof(total_length) + sizeof(compressed_length),
+           compressed_length);
+    infile.CloseMap();
 
     return {Decompress(compressed_buffer, total_length), total_length};
 }
\ No newline at end of file